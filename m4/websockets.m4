@@ -109,6 +109,14 @@ if test "$enable_websockets" != "no"; then
         AC_MSG_RESULT([$old_websockets])
     fi
 
+    # Check for zlib, needed for tuning the deflate extensions.
+    if test "$have_websockets" = "yes"; then
+        AC_CHECK_HEADER([zlib.h],
+            [AC_CHECK_LIB([z], [deflateParams],
+                          [websockets_deflate=yes], [websockets_deflate=no])],
+            [websockets_deflate=no])
+    fi
+
     WEBSOCKETS_LIBS="-lwebsockets"
     if test "$old_websockets" = "yes"; then
         WEBSOCKETS_CFLAGS="$WEBSOCKETS_CFLAGS -DWEBSOCKETS_OLD"
@@ -122,6 +130,10 @@ if test "$enable_websockets" != "no"; then
     if test "$websockets_log_with_level" = "yes"; then
         WEBSOCKETS_CFLAGS="$WEBSOCKETS_CFLAGS -DWEBSOCKETS_LOG_WITH_LEVEL"
     fi
+    if test "$websockets_deflate" = "yes"; then
+        WEBSOCKETS_CFLAGS="$WEBSOCKETS_CFLAGS -DWEBSOCKETS_DEFLATE"
+        WEBSOCKETS_LIBS="$WEBSOCKETS_LIBS -lz"
+    fi
     LDFLAGS="$saved_LDFLAGS"
 else
     AC_MSG_NOTICE([libwebsockets support is disabled.])
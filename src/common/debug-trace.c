@@ -0,0 +1,769 @@
+/*
+ * Copyright (c) 2012, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include <murphy/common/macros.h>
+#include <murphy/common/mm.h>
+#include <murphy/common/log.h>
+#include <murphy/common/debug.h>
+
+#define SITE_CACHE 1024                  /* site lookup cache size */
+#define SITE_NONE  0xffffffffU           /* no site index */
+#define STR_SLOTS  3                     /* max. slots for a string arg */
+
+/*
+ * an active trace buffer
+ *
+ * Writers on other threads may still be running when tracing is stopped
+ * or restarted, so a trace buffer is never unmapped or freed once it has
+ * been activated. A replacement buffer is allocated instead.
+ */
+
+typedef struct {
+    char                *path;           /* trace file path */
+    void                *map;            /* mapped trace file */
+    size_t               size;           /* size of mapping */
+    mrp_debug_theader_t *hdr;            /* trace header */
+    mrp_debug_tsite_t   *sites;          /* site table */
+    mrp_debug_record_t  *recs;           /* record ring */
+    uint64_t             mask;           /* ring index mask */
+    const char         **site_ptrs;      /* site index -> debug site */
+    uint32_t             cache[SITE_CACHE]; /* site hash -> index + 1 */
+} trace_t;
+
+static trace_t         *active;          /* active trace buffer, if any */
+static pthread_mutex_t  lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread pid_t   thread_id;       /* cached thread id */
+
+/* length modifiers */
+enum {
+    MOD_NONE = 0,
+    MOD_HH,
+    MOD_H,
+    MOD_L,
+    MOD_LL,
+    MOD_J,
+    MOD_Z,
+    MOD_T,
+    MOD_LDBL,
+};
+
+/* a single parsed format conversion */
+typedef struct {
+    const char *start;                   /* start of conversion ('%') */
+    const char *spec;                    /* end of flags, width, precision */
+    const char *end;                     /* end of conversion */
+    int         nstar;                   /* number of '*' arguments */
+    int         mod;                     /* length modifier */
+    char        conv;                    /* conversion character */
+} conv_t;
+
+
+static uint64_t mono_usecs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+
+static uint64_t real_usecs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+
+static const char *next_conv(const char *p, conv_t *c)
+{
+    if ((p = strchr(p, '%')) == NULL)
+        return NULL;
+
+    c->start = p++;
+    c->nstar = 0;
+    c->mod   = MOD_NONE;
+
+    p += strspn(p, "#0- +'");
+
+    while (*p == '*' || *p == '.' || isdigit(*p)) {
+        if (*p == '*')
+            c->nstar++;
+        p++;
+    }
+
+    c->spec = p;
+
+    switch (*p) {
+    case 'h':
+        if (*++p == 'h') { c->mod = MOD_HH; p++; }
+        else               c->mod = MOD_H;
+        break;
+    case 'l':
+        if (*++p == 'l') { c->mod = MOD_LL; p++; }
+        else               c->mod = MOD_L;
+        break;
+    case 'q': c->mod = MOD_LL;   p++; break;
+    case 'j': c->mod = MOD_J;    p++; break;
+    case 'z': c->mod = MOD_Z;    p++; break;
+    case 't': c->mod = MOD_T;    p++; break;
+    case 'L': c->mod = MOD_LDBL; p++; break;
+    }
+
+    c->conv = *p;
+
+    if (*p)
+        p++;
+
+    c->end = p;
+
+    return p;
+}
+
+
+static int capture_args(uint64_t *slots, int *flags, const char *format,
+                        va_list ap, int saved_errno)
+{
+    const char *p, *s;
+    conv_t      c;
+    double      d;
+    size_t      len;
+    int         n, i, cnt;
+
+    n = 0;
+    p = format;
+
+    while ((p = next_conv(p, &c)) != NULL) {
+        if (c.conv == '%')
+            continue;
+
+        if (n + c.nstar > MRP_DEBUG_TRACE_NSLOT)
+            goto truncated;
+
+        for (i = 0; i < c.nstar; i++)
+            slots[n++] = (uint64_t)(int64_t)va_arg(ap, int);
+
+        if (c.conv == 'n') {
+            (void)va_arg(ap, void *);
+            continue;
+        }
+
+        if (n >= MRP_DEBUG_TRACE_NSLOT || !c.conv ||
+            strchr("diouxXcpmseEfFgGaA", c.conv) == NULL)
+            goto truncated;
+
+        switch (c.conv) {
+        case 'd':
+        case 'i':
+            switch (c.mod) {
+            case MOD_HH:  slots[n] = (int64_t)(signed char)va_arg(ap, int); break;
+            case MOD_H:   slots[n] = (int64_t)(short)va_arg(ap, int);       break;
+            case MOD_L:   slots[n] = (int64_t)va_arg(ap, long);             break;
+            case MOD_LL:  slots[n] = (int64_t)va_arg(ap, long long);        break;
+            case MOD_J:   slots[n] = (int64_t)va_arg(ap, intmax_t);         break;
+            case MOD_Z:   slots[n] = (int64_t)va_arg(ap, ssize_t);          break;
+            case MOD_T:   slots[n] = (int64_t)va_arg(ap, ptrdiff_t);        break;
+            default:      slots[n] = (int64_t)va_arg(ap, int);              break;
+            }
+            n++;
+            break;
+
+        case 'o':
+        case 'u':
+        case 'x':
+        case 'X':
+            switch (c.mod) {
+            case MOD_HH:  slots[n] = (unsigned char)va_arg(ap, unsigned int);  break;
+            case MOD_H:   slots[n] = (unsigned short)va_arg(ap, unsigned int); break;
+            case MOD_L:   slots[n] = va_arg(ap, unsigned long);                break;
+            case MOD_LL:  slots[n] = va_arg(ap, unsigned long long);           break;
+            case MOD_J:   slots[n] = va_arg(ap, uintmax_t);                    break;
+            case MOD_Z:   slots[n] = va_arg(ap, size_t);                       break;
+            case MOD_T:   slots[n] = (uint64_t)va_arg(ap, ptrdiff_t);          break;
+            default:      slots[n] = va_arg(ap, unsigned int);                 break;
+            }
+            n++;
+            break;
+
+        case 'c':
+            slots[n++] = (uint64_t)va_arg(ap, int);
+            break;
+
+        case 'p':
+            slots[n++] = (uint64_t)(uintptr_t)va_arg(ap, void *);
+            break;
+
+        case 'm':
+            slots[n++] = (uint64_t)saved_errno;
+            break;
+
+        case 's':
+            s   = va_arg(ap, const char *);
+            cnt = MRP_DEBUG_TRACE_NSLOT - n;
+
+            if (cnt > STR_SLOTS)
+                cnt = STR_SLOTS;
+
+            if (s == NULL)
+                s = "(null)";
+
+            len = strnlen(s, cnt * sizeof(slots[0]) - 1);
+            memcpy(slots + n, s, len);
+            ((char *)(slots + n))[len] = '\0';
+
+            n += (len + 1 + sizeof(slots[0]) - 1) / sizeof(slots[0]);
+            break;
+
+        default:
+            if (c.mod == MOD_LDBL)
+                d = (double)va_arg(ap, long double);
+            else
+                d = va_arg(ap, double);
+            memcpy(slots + n, &d, sizeof(d));
+            n++;
+        }
+    }
+
+    return n;
+
+ truncated:
+    *flags |= MRP_DEBUG_TRACE_TRUNCATED;
+    return n;
+}
+
+
+static uint32_t add_site(trace_t *t, uint32_t h, const char *site,
+                         const char *file, int line, const char *func,
+                         const char *format)
+{
+    mrp_debug_tsite_t *ts;
+    const char        *fn;
+    uint32_t           idx, nsite;
+
+    pthread_mutex_lock(&lock);
+
+    nsite = t->hdr->nsite;
+
+    for (idx = 0; idx < nsite; idx++)
+        if (t->site_ptrs[idx] == site)
+            goto out;
+
+    if (nsite >= t->hdr->nsite_max) {
+        idx = SITE_NONE;
+        goto unlock;
+    }
+
+    idx = nsite;
+    ts  = t->sites + idx;
+
+    if ((fn = mrp_debug_site_function(file, line)) == NULL)
+        fn = func;
+
+    strncpy(ts->file, file ? file : "", sizeof(ts->file) - 1);
+    strncpy(ts->func, fn ? fn : "", sizeof(ts->func) - 1);
+    strncpy(ts->format, format, sizeof(ts->format) - 1);
+    ts->line = line;
+
+    t->site_ptrs[idx] = site;
+    __atomic_store_n(&t->hdr->nsite, nsite + 1, __ATOMIC_RELEASE);
+
+ out:
+    __atomic_store_n(t->cache + h, idx + 1, __ATOMIC_RELEASE);
+ unlock:
+    pthread_mutex_unlock(&lock);
+
+    return idx;
+}
+
+
+static inline uint32_t lookup_site(trace_t *t, const char *site,
+                                   const char *file, int line,
+                                   const char *func, const char *format)
+{
+    uint32_t h, idx;
+
+    h   = (((uintptr_t)site >> 3) ^ ((uintptr_t)site >> 13)) & (SITE_CACHE-1);
+    idx = __atomic_load_n(t->cache + h, __ATOMIC_ACQUIRE);
+
+    if (MRP_LIKELY(idx != 0 && t->site_ptrs[idx - 1] == site))
+        return idx - 1;
+    else
+        return add_site(t, h, site, file, line, func, format);
+}
+
+
+void mrp_debug_trace(const char *site, const char *file, int line,
+                     const char *func, const char *format, va_list ap)
+{
+    trace_t            *t;
+    mrp_debug_record_t *r;
+    uint64_t            seq;
+    uint32_t            idx;
+    int                 saved_errno, flags, nslot;
+    va_list             aq;
+
+    t = __atomic_load_n(&active, __ATOMIC_ACQUIRE);
+
+    if (t == NULL)
+        return;
+
+    saved_errno = errno;
+    idx = lookup_site(t, site, file, line, func, format);
+
+    if (idx == SITE_NONE) {
+        __atomic_fetch_add(&t->hdr->lost, 1, __ATOMIC_RELAXED);
+        errno = saved_errno;
+        return;
+    }
+
+    if (MRP_UNLIKELY(thread_id == 0))
+        thread_id = (pid_t)syscall(SYS_gettid);
+
+    seq = __atomic_fetch_add(&t->hdr->head, 1, __ATOMIC_RELAXED);
+    r   = t->recs + (seq & t->mask);
+
+    __atomic_store_n(&r->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    flags = 0;
+    va_copy(aq, ap);
+    nslot = capture_args(r->slots, &flags, format, aq, saved_errno);
+    va_end(aq);
+
+    r->stamp = mono_usecs();
+    r->tid   = (uint32_t)thread_id;
+    r->site  = (uint16_t)idx;
+    r->nslot = (uint8_t)nslot;
+    r->flags = (uint8_t)flags;
+
+    __atomic_store_n(&r->seq, seq + 1, __ATOMIC_RELEASE);
+
+    errno = saved_errno;
+}
+
+
+static size_t trace_size(uint32_t nrecord, uint32_t nsite)
+{
+    return sizeof(mrp_debug_theader_t) +
+        nsite   * sizeof(mrp_debug_tsite_t) +
+        nrecord * sizeof(mrp_debug_record_t);
+}
+
+
+int mrp_debug_trace_start(const char *path, size_t nrecord)
+{
+    char         buf[PATH_MAX];
+    trace_t     *t;
+    struct stat  st;
+    size_t       n;
+    int          fd;
+
+    if (nrecord == 0)
+        nrecord = MRP_DEBUG_TRACE_RECORDS;
+
+    for (n = 1; n < nrecord; n <<= 1)
+        ;
+
+    if (n > (1U << 24)) {
+        errno = EOVERFLOW;
+        return -1;
+    }
+
+    nrecord = n;
+
+    if (path == NULL) {
+        snprintf(buf, sizeof(buf), MRP_DEBUG_TRACE_PATH, (unsigned)getpid());
+        path = buf;
+    }
+
+    if ((t = mrp_allocz(sizeof(*t))) == NULL)
+        return -1;
+
+    t->path      = mrp_strdup(path);
+    t->site_ptrs = mrp_allocz_array(const char *, MRP_DEBUG_TRACE_SITES);
+
+    if (t->path == NULL || t->site_ptrs == NULL)
+        goto fail;
+
+    t->size = trace_size(nrecord, MRP_DEBUG_TRACE_SITES);
+
+    /*
+     * The default path is in a world-writable directory. Only replace a
+     * stale trace file of our own, and never follow or reuse anything else
+     * found there. Buffers mapped from a replaced file stay valid.
+     */
+    if (lstat(path, &st) == 0 && S_ISREG(st.st_mode) && st.st_uid == geteuid())
+        unlink(path);
+
+    fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+
+    if (fd < 0)
+        goto fail;
+
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        goto fail;
+    }
+
+    if (!S_ISREG(st.st_mode) || st.st_uid != geteuid()) {
+        close(fd);
+        errno = EPERM;
+        goto fail;
+    }
+
+    if (ftruncate(fd, t->size) < 0) {
+        close(fd);
+        goto fail;
+    }
+
+    t->map = mmap(NULL, t->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (t->map == MAP_FAILED)
+        goto fail;
+
+    t->hdr   = t->map;
+    t->sites = (mrp_debug_tsite_t *)(t->hdr + 1);
+    t->recs  = (mrp_debug_record_t *)(t->sites + MRP_DEBUG_TRACE_SITES);
+    t->mask  = nrecord - 1;
+
+    memcpy(t->hdr->magic, MRP_DEBUG_TRACE_MAGIC, sizeof(t->hdr->magic));
+    t->hdr->version     = MRP_DEBUG_TRACE_VERSION;
+    t->hdr->pid         = (uint32_t)getpid();
+    t->hdr->record_size = sizeof(mrp_debug_record_t);
+    t->hdr->nrecord     = nrecord;
+    t->hdr->site_size   = sizeof(mrp_debug_tsite_t);
+    t->hdr->nsite_max   = MRP_DEBUG_TRACE_SITES;
+    t->hdr->mono_base   = mono_usecs();
+    t->hdr->real_base   = real_usecs();
+
+    pthread_mutex_lock(&lock);
+    __atomic_store_n(&active, t, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&lock);
+
+    mrp_log_info("Tracing debug messages to %s (%zu records).", path, nrecord);
+
+    return 0;
+
+ fail:
+    mrp_log_error("Failed to set up debug trace buffer %s (%d: %s).", path,
+                  errno, strerror(errno));
+    mrp_free(t->path);
+    mrp_free(t->site_ptrs);
+    mrp_free(t);
+
+    return -1;
+}
+
+
+void mrp_debug_trace_stop(void)
+{
+    pthread_mutex_lock(&lock);
+    __atomic_store_n(&active, NULL, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&lock);
+}
+
+
+int mrp_debug_tracing(void)
+{
+    return __atomic_load_n(&active, __ATOMIC_RELAXED) != NULL;
+}
+
+
+const char *mrp_debug_trace_path(void)
+{
+    trace_t *t = __atomic_load_n(&active, __ATOMIC_ACQUIRE);
+
+    return t ? t->path : NULL;
+}
+
+
+/*
+ * decoding
+ */
+
+#define EMIT(fmt, args...) do {                                         \
+        int __n = snprintf(p, l, fmt, ## args);                         \
+                                                                        \
+        if (__n < 0)                                                    \
+            __n = 0;                                                    \
+        if ((size_t)__n >= l)                                           \
+            __n = l ? l - 1 : 0;                                        \
+        p += __n;                                                       \
+        l -= __n;                                                       \
+    } while (0)
+
+static void decode_record(char *buf, size_t size, const mrp_debug_tsite_t *ts,
+                          const mrp_debug_record_t *r)
+{
+    const uint64_t *slot;
+    const char     *f, *s, *str;
+    char            spec[64], *sp, *p;
+    conv_t          c;
+    size_t          l, len;
+    double          d;
+    int             n, nslot;
+
+    p     = buf;
+    l     = size;
+    f     = ts->format;
+    slot  = r->slots;
+    nslot = r->nslot < MRP_DEBUG_TRACE_NSLOT ? r->nslot : MRP_DEBUG_TRACE_NSLOT;
+    n     = 0;
+
+    *p = '\0';
+
+    while ((s = next_conv(f, &c)) != NULL) {
+        EMIT("%.*s", (int)(c.start - f), f);
+
+        if (c.conv == '%') {
+            EMIT("%%");
+            f = s;
+            continue;
+        }
+
+        if (c.conv == 'n') {
+            f = s;
+            continue;
+        }
+
+        if (n + c.nstar >= nslot)
+            break;
+
+        /* rebuild the conversion with '*' replaced and a 64-bit modifier */
+        sp = spec;
+        for (f = c.start; f < c.spec && sp < spec + sizeof(spec) - 24; f++) {
+            if (*f == '*')
+                sp += sprintf(sp, "%d", (int)(int64_t)slot[n++]);
+            else
+                *sp++ = *f;
+        }
+        *sp = '\0';
+
+        switch (c.conv) {
+        case 'd':
+        case 'i':
+            strcat(spec, "ll");
+            strncat(spec, &c.conv, 1);
+            EMIT(spec, (long long)slot[n++]);
+            break;
+
+        case 'o':
+        case 'u':
+        case 'x':
+        case 'X':
+            strcat(spec, "ll");
+            strncat(spec, &c.conv, 1);
+            EMIT(spec, (unsigned long long)slot[n++]);
+            break;
+
+        case 'c':
+            strncat(spec, &c.conv, 1);
+            EMIT(spec, (int)slot[n++]);
+            break;
+
+        case 'p':
+            strncat(spec, &c.conv, 1);
+            EMIT(spec, (void *)(uintptr_t)slot[n++]);
+            break;
+
+        case 'm':
+            EMIT("%s", strerror((int)slot[n++]));
+            break;
+
+        case 's':
+            str = (const char *)(slot + n);
+            len = strnlen(str, (nslot - n) * sizeof(slot[0]));
+            strncat(spec, &c.conv, 1);
+            EMIT(spec, str);
+            n  += (len + 1 + sizeof(slot[0]) - 1) / sizeof(slot[0]);
+            break;
+
+        case 'e': case 'E':
+        case 'f': case 'F':
+        case 'g': case 'G':
+        case 'a': case 'A':
+            memcpy(&d, slot + n++, sizeof(d));
+            strncat(spec, &c.conv, 1);
+            EMIT(spec, d);
+            break;
+
+        default:
+            goto out;
+        }
+
+        f = s;
+    }
+
+ out:
+    if (s == NULL)
+        EMIT("%s", f);
+    else
+        EMIT("...");
+}
+
+
+static int dump_trace(FILE *fp, const mrp_debug_theader_t *hdr, int cnt)
+{
+    const mrp_debug_tsite_t  *sites, *ts;
+    const mrp_debug_record_t *recs, *rp;
+    mrp_debug_record_t        r;
+    uint64_t                  head, seq, first, real, mask;
+    uint32_t                  nsite;
+    char                      msg[1024], tbuf[32];
+    struct tm                 tm;
+    time_t                    sec;
+    int                       n, skipped;
+
+    sites = (const mrp_debug_tsite_t *)(hdr + 1);
+    recs  = (const mrp_debug_record_t *)(sites + hdr->nsite_max);
+    mask  = hdr->nrecord - 1;
+    head  = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+    nsite = __atomic_load_n(&hdr->nsite, __ATOMIC_ACQUIRE);
+
+    first = head > hdr->nrecord ? head - hdr->nrecord : 0;
+
+    if (cnt > 0 && head - first > (uint64_t)cnt)
+        first = head - cnt;
+
+    fprintf(fp, "trace of process %u: %llu records, %llu overwritten, "
+            "%llu lost, %u sites\n", hdr->pid, (unsigned long long)head,
+            (unsigned long long)(head > hdr->nrecord ? head - hdr->nrecord : 0),
+            (unsigned long long)hdr->lost, nsite);
+
+    n       = 0;
+    skipped = 0;
+
+    for (seq = first; seq < head; seq++) {
+        rp = recs + (seq & mask);
+
+        if (__atomic_load_n(&rp->seq, __ATOMIC_ACQUIRE) != seq + 1) {
+            skipped++;
+            continue;
+        }
+
+        memcpy(&r, rp, sizeof(r));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        if (__atomic_load_n(&rp->seq, __ATOMIC_RELAXED) != seq + 1 ||
+            r.site >= nsite) {
+            skipped++;
+            continue;
+        }
+
+        ts   = sites + r.site;
+        real = hdr->real_base + (r.stamp - hdr->mono_base);
+        sec  = (time_t)(real / 1000000);
+
+        localtime_r(&sec, &tm);
+        strftime(tbuf, sizeof(tbuf), "%H:%M:%S", &tm);
+        decode_record(msg, sizeof(msg), ts, &r);
+
+        fprintf(fp, "%s.%06u [%u] %s@%s:%d: %s\n", tbuf,
+                (unsigned int)(real % 1000000), r.tid,
+                *ts->func ? ts->func : "?", ts->file, ts->line, msg);
+        n++;
+    }
+
+    if (skipped)
+        fprintf(fp, "(%d records skipped, being overwritten)\n", skipped);
+
+    return n;
+}
+
+
+int mrp_debug_trace_dump(FILE *fp, const char *path, int cnt)
+{
+    const mrp_debug_theader_t *hdr;
+    struct stat                st;
+    trace_t                   *t;
+    void                      *map;
+    int                        fd, n;
+
+    if (path == NULL) {
+        if ((t = __atomic_load_n(&active, __ATOMIC_ACQUIRE)) == NULL) {
+            errno = ENOENT;
+            return -1;
+        }
+
+        return dump_trace(fp, t->hdr, cnt);
+    }
+
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+        return -1;
+
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(*hdr)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED)
+        return -1;
+
+    hdr = map;
+
+    if (memcmp(hdr->magic, MRP_DEBUG_TRACE_MAGIC, sizeof(hdr->magic)) ||
+        hdr->version != MRP_DEBUG_TRACE_VERSION ||
+        hdr->record_size != sizeof(mrp_debug_record_t) ||
+        hdr->site_size != sizeof(mrp_debug_tsite_t) ||
+        hdr->nrecord == 0 || (hdr->nrecord & (hdr->nrecord - 1)) ||
+        (size_t)st.st_size < trace_size(hdr->nrecord, hdr->nsite_max)) {
+        munmap(map, st.st_size);
+        errno = EINVAL;
+        return -1;
+    }
+
+    n = dump_trace(fp, hdr, cnt);
+    munmap(map, st.st_size);
+
+    return n;
+}
@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2012, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __MURPHY_DEBUG_TRACE_H__
+#define __MURPHY_DEBUG_TRACE_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdarg.h>
+
+#include <murphy/common/macros.h>
+
+MRP_CDECL_BEGIN
+
+/*
+ * binary debug trace buffer
+ *
+ * When tracing is active, every enabled debug site records its message
+ * into an mmap'd ring of fixed-size binary records instead of (or in
+ * addition to) formatting it for the log. Records carry a timestamp,
+ * the writing thread, an index into the site table and the raw message
+ * arguments. The site table, with the file, line, function and format
+ * string of every site seen so far, lives in the same file, so the ring
+ * can be decoded both by the live process and offline, for instance
+ * from the file left behind by a crashed daemon.
+ */
+
+#define MRP_DEBUG_TRACE_MAGIC    "MRPTRACE"  /* trace file magic */
+#define MRP_DEBUG_TRACE_VERSION  1           /* trace file format version */
+#define MRP_DEBUG_TRACE_PATH     "/dev/shm/murphy-trace.%u" /* default path */
+#define MRP_DEBUG_TRACE_RECORDS  16384       /* default number of records */
+#define MRP_DEBUG_TRACE_SITES    2048        /* max. number of sites */
+#define MRP_DEBUG_TRACE_NSLOT    13          /* argument slots per record */
+
+/** Trace file header. */
+typedef struct {
+    char     magic[8];                   /* MRP_DEBUG_TRACE_MAGIC */
+    uint32_t version;                    /* MRP_DEBUG_TRACE_VERSION */
+    uint32_t pid;                        /* traced process */
+    uint32_t record_size;                /* sizeof(mrp_debug_record_t) */
+    uint32_t nrecord;                    /* number of records, power of 2 */
+    uint32_t site_size;                  /* sizeof(mrp_debug_tsite_t) */
+    uint32_t nsite_max;                  /* size of the site table */
+    uint32_t nsite;                      /* sites in use */
+    uint32_t unused;
+    uint64_t head;                       /* next record sequence number */
+    uint64_t lost;                       /* records lost, site table full */
+    uint64_t mono_base;                  /* monotonic time at start (usecs) */
+    uint64_t real_base;                  /* wallclock time at start (usecs) */
+    uint8_t  pad[56];                    /* pad to 128 bytes */
+} mrp_debug_theader_t;
+
+/** Trace site table entry. */
+typedef struct {
+    char    file[128];                   /* source file */
+    char    func[124];                   /* function */
+    int32_t line;                        /* line number */
+    char    format[256];                 /* message format string */
+} mrp_debug_tsite_t;
+
+/** Trace record flags. */
+#define MRP_DEBUG_TRACE_TRUNCATED 0x1    /* ran out of argument slots */
+
+/** Trace record. */
+typedef struct {
+    uint64_t seq;                        /* sequence number + 1, 0 if busy */
+    uint64_t stamp;                      /* monotonic timestamp (usecs) */
+    uint32_t tid;                        /* writing thread */
+    uint16_t site;                       /* index to the site table */
+    uint8_t  nslot;                      /* argument slots in use */
+    uint8_t  flags;                      /* MRP_DEBUG_TRACE_* flags */
+    uint64_t slots[MRP_DEBUG_TRACE_NSLOT]; /* raw message arguments */
+} mrp_debug_record_t;
+
+/**
+ * Start tracing to path (NULL for default) using nrecord records. A stale
+ * regular file of ours at path is replaced, anything else found there
+ * (another user's file, a symlink) makes this fail.
+ */
+int mrp_debug_trace_start(const char *path, size_t nrecord);
+
+/** Stop tracing. The trace file is left behind for inspection. */
+void mrp_debug_trace_stop(void);
+
+/** Check whether tracing is active. */
+int mrp_debug_tracing(void);
+
+/** Get the path of the active trace file. */
+const char *mrp_debug_trace_path(void);
+
+/** Record a debug message into the active trace buffer. */
+void mrp_debug_trace(const char *site, const char *file, int line,
+                     const char *func, const char *format, va_list ap);
+
+/** Decode the last n (all if 0) records of the active trace or a file. */
+int mrp_debug_trace_dump(FILE *fp, const char *path, int n);
+
+MRP_CDECL_END
+
+#endif /* __MURPHY_DEBUG_TRACE_H__ */
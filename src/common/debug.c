@@ -30,6 +30,7 @@
 #define _GNU_SOURCE
 #include <link.h>
 #include <elf.h>
+#include <dlfcn.h>
 
 #include <stdarg.h>
 #include <limits.h>
@@ -109,7 +110,10 @@ int mrp_debug_enable(int enabled)
     int prev = debug_enabled;
 
     debug_enabled = !!enabled;
-    mrp_log_enable(MRP_LOG_MASK_DEBUG);
+
+    /* when tracing, log debug messages as text only if explicitly asked */
+    if (!mrp_debug_tracing())
+        mrp_log_enable(MRP_LOG_MASK_DEBUG);
     mrp_debug_stamp++;
 
     return prev;
@@ -471,7 +475,14 @@ void mrp_debug_msg(const char *site, const char *file, int line,
 {
     va_list ap;
 
-    MRP_UNUSED(site);
+    if (mrp_debug_tracing()) {
+        va_start(ap, format);
+        mrp_debug_trace(site, file, line, func, format, ap);
+        va_end(ap);
+
+        if (!(mrp_log_get_mask() & MRP_LOG_MASK_DEBUG))
+            return;
+    }
 
     va_start(ap, format);
     mrp_log_msgv(MRP_LOG_DEBUG, file, line, func, format, ap);
@@ -600,6 +611,45 @@ const char *mrp_debug_site_function(const char *file, int line)
 }
 
 
+const char *mrp_debug_address_function(void *addr, const char **filep)
+{
+    mrp_list_hook_t  *p, *n;
+    mrp_debug_file_t *df;
+    mrp_debug_info_t *info;
+    void             *h;
+
+    /*
+     * Notes:
+     *     The function tables only have names and line numbers, so we
+     *     can only map addresses of functions the dynamic linker knows
+     *     about back to a table entry. This is mostly useful for getting
+     *     at the source file of a function.
+     */
+
+    if (addr == NULL || (h = dlopen(NULL, RTLD_LAZY)) == NULL)
+        return NULL;
+
+    mrp_list_foreach(&debug_files, p, n) {
+        df = mrp_list_entry(p, typeof(*df), hook);
+
+        for (info = df->info; info->func != NULL; info++) {
+            if (dlsym(h, info->func) == addr) {
+                dlclose(h);
+
+                if (filep != NULL)
+                    *filep = df->file;
+
+                return info->func;
+            }
+        }
+    }
+
+    dlclose(h);
+
+    return NULL;
+}
+
+
 static void populate_file_table(void)
 {
     mrp_htbl_config_t  hcfg;
@@ -34,6 +34,7 @@
 
 #include <murphy/common/macros.h>
 #include <murphy/common/debug-info.h>
+#include <murphy/common/debug-trace.h>
 
 MRP_CDECL_BEGIN
 
@@ -94,6 +95,9 @@ int mrp_debug_unregister_file(mrp_debug_file_t *df);
 /** Return the name of the function that corresponds to file:line. */
 const char *mrp_debug_site_function(const char *file, int line);
 
+/** Return the name (and file) of the function at the given address. */
+const char *mrp_debug_address_function(void *addr, const char **filep);
+
 MRP_CDECL_END
 
 #endif /* __MURPHY_DEBUG_H__ */
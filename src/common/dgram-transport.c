@@ -27,6 +27,7 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#define _GNU_SOURCE
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
@@ -51,6 +52,8 @@
 
 
 #define DEFAULT_SIZE 1024                /* default input buffer size */
+#define MAX_BATCH     64                 /* max. datagrams per wakeup */
+#define BATCH_SLOT    (64 * 1024)        /* batched receive buffer size */
 
 typedef struct {
     MRP_TRANSPORT_PUBLIC_FIELDS;         /* common transport fields */
@@ -60,6 +63,12 @@ typedef struct {
     void           *ibuf;                /* input buffer */
     size_t          isize;               /* input buffer size */
     size_t          idata;               /* amount of input data */
+    int             nbatch;              /* datagrams per wakeup, 0=off */
+    int             nslot;               /* allocated batch slots */
+    struct mmsghdr *mmsg;                /* batched receive headers */
+    struct iovec   *miov;                /* batched receive buffers */
+    mrp_sockaddr_t *maddr;               /* batched receive addresses */
+    void           *mbuf;                /* batched receive data */
 } dgrm_t;
 
 
@@ -67,6 +76,7 @@ static void dgrm_recv_cb(mrp_io_watch_t *w, int fd, mrp_io_event_t events,
                          void *user_data);
 static int dgrm_disconnect(mrp_transport_t *mu);
 static int open_socket(dgrm_t *u, int family);
+static void free_batch(dgrm_t *u);
 
 
 /*
@@ -286,6 +296,29 @@ static int dgrm_createfrom(mrp_transport_t *mu, void *conn)
 }
 
 
+static int dgrm_setopt(mrp_transport_t *mu, const char *opt, const void *val)
+{
+    dgrm_t *u = (dgrm_t *)mu;
+    int     n;
+
+    if (!strcmp(opt, MRP_TRANSPORT_OPT_RECVBATCH) && val != NULL) {
+        n = *(const int *)val;
+
+        if (n < 1 || n > MAX_BATCH) {
+            errno = EINVAL;
+            return FALSE;
+        }
+
+        /* slots are resized on the next wakeup, not under a callback */
+        u->nbatch = n;
+
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+
 static int dgrm_bind(mrp_transport_t *mu, mrp_sockaddr_t *addr,
                      socklen_t addrlen)
 {
@@ -322,6 +355,8 @@ static void dgrm_close(mrp_transport_t *mu)
     u->isize = 0;
     u->idata = 0;
 
+    free_batch(u);
+
     if (u->sock >= 0){
         close(u->sock);
         u->sock = -1;
@@ -329,10 +364,54 @@ static void dgrm_close(mrp_transport_t *mu)
 }
 
 
-static void dgrm_recv_cb(mrp_io_watch_t *w, int fd, mrp_io_event_t events,
-                         void *user_data)
+static int alloc_batch(dgrm_t *u, int n)
+{
+    /*
+     * Notes:
+     *     The receive buffers are allocated but never cleared, so only
+     *     the pages actually used for incoming datagrams get touched.
+     */
+
+    free_batch(u);
+
+    u->mmsg  = mrp_allocz_array(struct mmsghdr, n);
+    u->miov  = mrp_allocz_array(struct iovec, n);
+    u->maddr = mrp_allocz_array(mrp_sockaddr_t, n);
+    u->mbuf  = mrp_alloc(n * BATCH_SLOT);
+
+    if (u->mmsg && u->miov && u->maddr && u->mbuf) {
+        u->nslot = n;
+        return TRUE;
+    }
+
+    free_batch(u);
+
+    return FALSE;
+}
+
+
+static void free_batch(dgrm_t *u)
+{
+    mrp_free(u->mmsg);
+    mrp_free(u->miov);
+    mrp_free(u->maddr);
+    mrp_free(u->mbuf);
+
+    u->mmsg  = NULL;
+    u->miov  = NULL;
+    u->maddr = NULL;
+    u->mbuf  = NULL;
+    u->nslot = 0;
+}
+
+
+/*
+ * Receive a single datagram. Returns 0 on success, -1 if the transport
+ * got destroyed, or an errno if the transport should be closed.
+ */
+
+static int recv_single(dgrm_t *u, int fd)
 {
-    dgrm_t          *u  = (dgrm_t *)user_data;
     mrp_transport_t *mu = (mrp_transport_t *)u;
     mrp_sockaddr_t   addr;
     socklen_t        addrlen;
@@ -341,72 +420,177 @@ static void dgrm_recv_cb(mrp_io_watch_t *w, int fd, mrp_io_event_t events,
     void            *data;
     int              old, error;
 
-    MRP_UNUSED(w);
-
-    if (events & MRP_IO_EVENT_IN) {
-        if (u->idata == u->isize) {
-            if (u->isize != 0) {
-                old      = u->isize;
-                u->isize *= 2;
-            }
-            else {
-                old      = 0;
-                u->isize = DEFAULT_SIZE;
-            }
-            if (!mrp_reallocz(u->ibuf, old, u->isize)) {
-                error = ENOMEM;
-            fatal_error:
-            closed:
-                dgrm_disconnect(mu);
-
-                if (u->evt.closed != NULL)
-                    MRP_TRANSPORT_BUSY(mu, {
-                            mu->evt.closed(mu, error, mu->user_data);
-                        });
-
-                u->check_destroy(mu);
-                return;
-            }
+    if (u->idata == u->isize) {
+        if (u->isize != 0) {
+            old      = u->isize;
+            u->isize *= 2;
         }
-
-        if (recv(fd, &size, sizeof(size), MSG_PEEK) != sizeof(size)) {
-            error = EIO;
-            goto fatal_error;
+        else {
+            old      = 0;
+            u->isize = DEFAULT_SIZE;
         }
+        if (!mrp_reallocz(u->ibuf, old, u->isize))
+            return ENOMEM;
+    }
 
-        size = ntohl(size);
+    if (recv(fd, &size, sizeof(size), MSG_PEEK) != sizeof(size))
+        return EIO;
 
-        if (u->isize < size + sizeof(size)) {
-            old      = u->isize;
-            u->isize = size + sizeof(size);
+    size = ntohl(size);
 
-            if (!mrp_reallocz(u->ibuf, old, u->isize)) {
-                error = ENOMEM;
-                goto fatal_error;
-            }
-        }
+    if (u->isize < size + sizeof(size)) {
+        old      = u->isize;
+        u->isize = size + sizeof(size);
 
-        addrlen = sizeof(addr);
-        n = recvfrom(fd, u->ibuf, size + sizeof(size), 0, &addr.any, &addrlen);
+        if (!mrp_reallocz(u->ibuf, old, u->isize))
+            return ENOMEM;
+    }
+
+    addrlen = sizeof(addr);
+    n = recvfrom(fd, u->ibuf, size + sizeof(size), 0, &addr.any, &addrlen);
+
+    if (n != (ssize_t)(size + sizeof(size)))
+        return n < 0 ? EIO : EPROTO;
+
+    data  = u->ibuf + sizeof(size);
+    error = mu->recv_data(mu, data, size, &addr, addrlen);
+
+    if (error)
+        return error;
+
+    return u->check_destroy(mu) ? -1 : 0;
+}
 
-        if (n != (ssize_t)(size + sizeof(size))) {
-            error = n < 0 ? EIO : EPROTO;
-            goto fatal_error;
+
+/*
+ * Receive and dispatch up to nbatch pending datagrams with a single
+ * recvmmsg. Returns like recv_single. Datagrams larger than a slot
+ * (BATCH_SLOT bytes) get truncated by the kernel and are dropped.
+ *
+ * Slots are allocated lazily: we start with a single one and double
+ * the number of slots, up to nbatch, only when a wakeup fills all of
+ * them, so a transport with sporadic traffic keeps a single slot.
+ */
+
+static int recv_batch(dgrm_t *u, int fd)
+{
+    mrp_transport_t *mu = (mrp_transport_t *)u;
+    struct msghdr   *hdr;
+    uint32_t         size;
+    void            *data;
+    int              n, i, error;
+
+    if (u->mmsg == NULL || u->nslot > u->nbatch) {
+        if (!alloc_batch(u, 1))
+            return ENOMEM;
+    }
+
+    for (i = 0; i < u->nslot; i++) {
+        u->miov[i].iov_base = u->mbuf + i * BATCH_SLOT;
+        u->miov[i].iov_len  = BATCH_SLOT;
+
+        hdr = &u->mmsg[i].msg_hdr;
+        hdr->msg_name       = &u->maddr[i];
+        hdr->msg_namelen    = sizeof(u->maddr[i]);
+        hdr->msg_iov        = &u->miov[i];
+        hdr->msg_iovlen     = 1;
+        hdr->msg_control    = NULL;
+        hdr->msg_controllen = 0;
+        hdr->msg_flags      = 0;
+    }
+
+    n = recvmmsg(fd, u->mmsg, u->nslot, MSG_DONTWAIT, NULL);
+
+    if (n < 0)
+        return (errno == EAGAIN || errno == EINTR) ? 0 : EIO;
+
+    /*
+     * Notes:
+     *     A callback may change the batch size, so we always deliver
+     *     the full batch we already have and only resize the slots on
+     *     the next wakeup. If the batch was full, more is likely to be
+     *     pending, so grow it (if this fails we start over with a
+     *     single slot on the next wakeup).
+     */
+
+    for (i = 0; i < n; i++) {
+        hdr  = &u->mmsg[i].msg_hdr;
+        data = u->miov[i].iov_base;
+
+        if (hdr->msg_flags & MSG_TRUNC) {
+            mrp_log_error("%s(): dropped datagram larger than %d bytes.",
+                          __FUNCTION__, BATCH_SLOT);
+            continue;
         }
 
-        data  = u->ibuf + sizeof(size);
-        error = mu->recv_data(mu, data, size, &addr, addrlen);
+        if (u->mmsg[i].msg_len < sizeof(size))
+            return EPROTO;
+
+        size = ntohl(*(uint32_t *)data);
+
+        if (size != u->mmsg[i].msg_len - sizeof(size))
+            return EPROTO;
+
+        error = mu->recv_data(mu, data + sizeof(size), size,
+                              &u->maddr[i], hdr->msg_namelen);
 
         if (error)
-            goto fatal_error;
+            return error;
 
         if (u->check_destroy(mu))
+            return -1;
+
+        if (u->mmsg == NULL)             /* transport closed by callback */
+            return 0;
+    }
+
+    if (n == u->nslot && n < u->nbatch)
+        alloc_batch(u, MRP_MIN(2 * n, u->nbatch));
+
+    return 0;
+}
+
+
+static void dgrm_recv_cb(mrp_io_watch_t *w, int fd, mrp_io_event_t events,
+                         void *user_data)
+{
+    dgrm_t          *u  = (dgrm_t *)user_data;
+    mrp_transport_t *mu = (mrp_transport_t *)u;
+    int              error;
+
+    MRP_UNUSED(w);
+
+    if (events & MRP_IO_EVENT_IN) {
+        /*
+         * Batching is opt-in: batch slots have a fixed size, so a larger
+         * datagram is lost, while recv_single grows its buffer to fit.
+         */
+        if (u->nbatch > 1)
+            error = recv_batch(u, fd);
+        else {
+            if (u->mmsg != NULL)
+                free_batch(u);
+            error = recv_single(u, fd);
+        }
+
+        if (error < 0)
             return;
+
+        if (error)
+            goto closed;
     }
 
     if (events & MRP_IO_EVENT_HUP) {
         error = 0;
-        goto closed;
+    closed:
+        dgrm_disconnect(mu);
+
+        if (u->evt.closed != NULL)
+            MRP_TRANSPORT_BUSY(mu, {
+                    mu->evt.closed(mu, error, mu->user_data);
+                });
+
+        u->check_destroy(mu);
     }
 }
 
@@ -696,7 +880,7 @@ static int dgrm_senddatato(mrp_transport_t *mu, void *data, uint16_t tag,
 
 
 MRP_REGISTER_TRANSPORT(udp4, UDP4, dgrm_t, dgrm_resolve,
-                       dgrm_open, dgrm_createfrom, dgrm_close, NULL,
+                       dgrm_open, dgrm_createfrom, dgrm_close, dgrm_setopt,
                        dgrm_bind, dgrm_listen, NULL,
                        dgrm_connect, dgrm_disconnect,
                        dgrm_send, dgrm_sendto,
@@ -705,7 +889,7 @@ MRP_REGISTER_TRANSPORT(udp4, UDP4, dgrm_t, dgrm_resolve,
                        NULL, NULL);
 
 MRP_REGISTER_TRANSPORT(udp6, UDP6, dgrm_t, dgrm_resolve,
-                       dgrm_open, dgrm_createfrom, dgrm_close, NULL,
+                       dgrm_open, dgrm_createfrom, dgrm_close, dgrm_setopt,
                        dgrm_bind, dgrm_listen, NULL,
                        dgrm_connect, dgrm_disconnect,
                        dgrm_send, dgrm_sendto,
@@ -714,7 +898,7 @@ MRP_REGISTER_TRANSPORT(udp6, UDP6, dgrm_t, dgrm_resolve,
                        NULL, NULL);
 
 MRP_REGISTER_TRANSPORT(unxdgrm, UNXD, dgrm_t, dgrm_resolve,
-                       dgrm_open, dgrm_createfrom, dgrm_close, NULL,
+                       dgrm_open, dgrm_createfrom, dgrm_close, dgrm_setopt,
                        dgrm_bind, dgrm_listen, NULL,
                        dgrm_connect, dgrm_disconnect,
                        dgrm_send, dgrm_sendto,
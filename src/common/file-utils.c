@@ -30,12 +30,15 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <dirent.h>
 #include <regex.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
 #include <murphy/common/macros.h>
+#include <murphy/common/mm.h>
 #include <murphy/common/file-utils.h>
 
 
@@ -134,3 +137,163 @@ int mrp_scan_dir(const char *path, const char *pattern, mrp_dirent_type_t mask,
 
     return TRUE;
 }
+
+
+static void *read_file(const char *path, int trusted, size_t *sizep)
+{
+    struct stat  st;
+    char        *buf;
+    ssize_t      n;
+    size_t       size;
+    int          fd;
+
+    if ((fd = open(path, O_RDONLY | (trusted ? O_NOFOLLOW : 0))) < 0)
+        return NULL;
+
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    /* check what we actually opened, not what the path pointed to before */
+    if (trusted) {
+        if ((st.st_uid != geteuid() && st.st_uid != 0) ||
+            (st.st_mode & (S_IWGRP | S_IWOTH))) {
+            close(fd);
+            errno = EPERM;
+            return NULL;
+        }
+    }
+
+    if ((buf = mrp_alloc(st.st_size + 1)) == NULL) {
+        close(fd);
+        return NULL;
+    }
+
+    size = 0;
+    while (size < (size_t)st.st_size) {
+        n = read(fd, buf + size, st.st_size - size);
+
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            goto fail;
+        }
+
+        if (n == 0)
+            break;
+
+        size += n;
+    }
+
+    close(fd);
+
+    buf[size] = '\0';
+
+    if (sizep != NULL)
+        *sizep = size;
+
+    return buf;
+
+ fail:
+    close(fd);
+    mrp_free(buf);
+    return NULL;
+}
+
+
+void *mrp_read_file(const char *path, size_t *sizep)
+{
+    return read_file(path, FALSE, sizep);
+}
+
+
+void *mrp_read_trusted_file(const char *path, size_t *sizep)
+{
+    return read_file(path, TRUE, sizep);
+}
+
+
+int mrp_write_file(const char *path, const void *data, size_t size)
+{
+    char        tmp[PATH_MAX];
+    const char *p;
+    ssize_t     n;
+    int         fd;
+
+    n = snprintf(tmp, sizeof(tmp), "%s.%u", path, (unsigned int)getpid());
+
+    if (n < 0 || n >= (ssize_t)sizeof(tmp)) {
+        errno = ENAMETOOLONG;
+        return FALSE;
+    }
+
+    if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+        return FALSE;
+
+    p = data;
+    while (size > 0) {
+        n = write(fd, p, size);
+
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            goto fail;
+        }
+
+        p    += n;
+        size -= n;
+    }
+
+    if (close(fd) < 0) {
+        fd = -1;
+        goto fail;
+    }
+
+    if (rename(tmp, path) < 0) {
+        fd = -1;
+        goto fail;
+    }
+
+    return TRUE;
+
+ fail:
+    if (fd >= 0)
+        close(fd);
+    unlink(tmp);
+    return FALSE;
+}
+
+
+uint64_t mrp_hash_data(const void *data, size_t size)
+{
+    const uint8_t *p = data;
+    uint64_t       h = 0xcbf29ce484222325ULL;
+
+    while (size-- > 0) {
+        h ^= *p++;
+        h *= 0x100000001b3ULL;
+    }
+
+    return h;
+}
+
+
+int mrp_hash_file(const char *path, uint64_t *hashp, size_t *sizep)
+{
+    void   *buf;
+    size_t  size;
+
+    if ((buf = mrp_read_file(path, &size)) == NULL)
+        return FALSE;
+
+    *hashp = mrp_hash_data(buf, size);
+
+    if (sizep != NULL)
+        *sizep = size;
+
+    mrp_free(buf);
+
+    return TRUE;
+}
@@ -30,6 +30,7 @@
 #ifndef __MURPHY_FILEUTILS_H__
 #define __MURPHY_FILEUTILS_H__
 
+#include <stdint.h>
 #include <dirent.h>
 #include <sys/types.h>
 
@@ -66,4 +67,28 @@ int mrp_scan_dir(const char *path, const char *pattern, mrp_dirent_type_t mask,
                  mrp_scan_dir_cb_t cb, void *user_data);
 
 
+/*
+ * Routines for caching data derived from (configuration) files.
+ */
+
+/** Read the full content of a file, NUL-terminated, into a new buffer. */
+void *mrp_read_file(const char *path, size_t *sizep);
+
+/**
+ * Like mrp_read_file, but fail with EPERM unless the file is owned by
+ * us or root and is not writable by group or others. Use this for any
+ * data that ends up being executed or otherwise trusted.
+ */
+void *mrp_read_trusted_file(const char *path, size_t *sizep);
+
+/** Atomically replace the content of a file with the given data. */
+int mrp_write_file(const char *path, const void *data, size_t size);
+
+/** Calculate a (non-cryptographic, 64-bit FNV-1a) hash of the given data. */
+uint64_t mrp_hash_data(const void *data, size_t size);
+
+/** Calculate the hash and size of the content of a file. */
+int mrp_hash_file(const char *path, uint64_t *hashp, size_t *sizep);
+
+
 #endif /* __MURPHY_FILEUTILS_H__ */
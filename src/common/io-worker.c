@@ -0,0 +1,945 @@
+/*
+ * Copyright (c) 2012, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <endian.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+#include <murphy/common/macros.h>
+#include <murphy/common/mm.h>
+#include <murphy/common/log.h>
+#include <murphy/common/mainloop.h>
+#include <murphy/common/msg.h>
+#include <murphy/common/metrics.h>
+#include <murphy/common/io-worker.h>
+
+#define MAX_WORKERS 64                   /* max. number of worker threads */
+#define MAX_EVENTS  64                   /* max. epoll events per round */
+#define MAX_IOV     32                   /* max. output items per write */
+#define MAX_READS   16                   /* max. reads per input event */
+#define READ_CHUNK  4096                 /* min. free space for reading */
+#define MAX_FRAME   (16 * 1024 * 1024)   /* max. incoming frame size */
+#define MAX_OUTPUT  (2 * MAX_FRAME)      /* max. queued output per channel */
+
+/*
+ * Everything passed between the threads (items, channels) is allocated
+ * with malloc(3) and freed with free(3) directly, as the debugging mode
+ * of our own allocator is not thread-safe. For the same reason workers
+ * only decode messages when the passthru allocator is in use.
+ */
+
+typedef enum {
+    ITEM_FRAME = 0,                      /* received frame, to mainloop */
+    ITEM_MSG,                            /* decoded message, to mainloop */
+    ITEM_CLOSED,                         /* connection closed, to mainloop */
+    ITEM_ATTACH,                         /* new channel, to worker */
+    ITEM_WRITE,                          /* data to send, to worker */
+    ITEM_DETACH,                         /* channel detached, to worker */
+} item_type_t;
+
+typedef struct item_s item_t;
+
+struct item_s {
+    item_t           *next;              /* next item in queue */
+    item_type_t       type;              /* item type */
+    mrp_io_channel_t *ch;                /* channel of this item */
+    mrp_msg_t        *msg;               /* decoded message */
+    int               error;             /* error for ITEM_CLOSED */
+    size_t            size;              /* amount of data */
+    size_t            offs;              /* amount of data already sent */
+    char              data[0];           /* frame or output data */
+};
+
+/*
+ * lock-free multiple-producer, single-consumer queue
+ */
+
+typedef struct {
+    item_t *head;                        /* last pushed item */
+} queue_t;
+
+typedef struct {
+    pthread_t         tid;               /* worker thread */
+    int               epfd;              /* epoll fd */
+    int               evfd;              /* eventfd for cmdq */
+    queue_t           cmdq;              /* items from the mainloop */
+    int               stop;              /* whether asked to stop */
+    mrp_io_channel_t *linger;            /* detached, flushing channels */
+} io_worker_t;
+
+struct mrp_io_channel_s {
+    int                  refcnt;         /* reference count */
+    int                  fd;             /* connected socket */
+    io_worker_t         *w;              /* worker we're assigned to */
+    int                  decode;         /* decode messages in worker */
+    mrp_io_channel_cb_t  cb;             /* input callback */
+    void                *user_data;      /* opaque callback data */
+    int                  detached;       /* detached (mainloop only) */
+    size_t               oqueued;        /* queued output (atomic) */
+    item_t              *bye;            /* preallocated detach item */
+    char                *ibuf;           /* input buffer (worker only) */
+    size_t               isize;          /* input buffer size */
+    size_t               ilen;           /* amount of buffered input */
+    item_t              *ohead;          /* pending output (worker only) */
+    item_t              *otail;          /* last pending output */
+    uint32_t             events;         /* epoll events watched */
+    int                  eof;            /* input closed */
+    int                  closing;        /* detached, flushing output */
+    mrp_io_channel_t    *lnext;          /* next lingering channel */
+};
+
+static struct {
+    mrp_mainloop_t *ml;                  /* mainloop we feed */
+    mrp_io_watch_t *iow;                 /* I/O watch for evfd */
+    int             evfd;                /* eventfd for doneq */
+    queue_t         doneq;               /* items to the mainloop */
+    io_worker_t    *workers;             /* worker threads */
+    int             nworker;             /* number of workers */
+    int             nchannel;            /* number of attached channels */
+    int             next;                /* next worker to assign to */
+    int             decode;              /* whether workers may decode */
+    mrp_metric_t   *outq;                /* queued output bytes */
+} pool = { .evfd = -1 };
+
+
+static int queue_push(queue_t *q, item_t *item)
+{
+    item_t *head = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+
+    do {
+        item->next = head;
+    } while (!__atomic_compare_exchange_n(&q->head, &head, item, TRUE,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    return head == NULL;
+}
+
+
+static item_t *queue_take(queue_t *q)
+{
+    item_t *item, *next, *prev;
+
+    item = __atomic_exchange_n(&q->head, NULL, __ATOMIC_ACQUIRE);
+    prev = NULL;
+
+    while (item != NULL) {               /* reverse into FIFO order */
+        next       = item->next;
+        item->next = prev;
+        prev       = item;
+        item       = next;
+    }
+
+    return prev;
+}
+
+
+static void wakeup(int fd)
+{
+    uint64_t one = 1;
+
+    while (write(fd, &one, sizeof(one)) < 0 && errno == EINTR)
+        ;
+}
+
+
+static void clear_wakeup(int fd)
+{
+    uint64_t cnt;
+
+    while (read(fd, &cnt, sizeof(cnt)) < 0 && errno == EINTR)
+        ;
+}
+
+
+static mrp_io_channel_t *channel_ref(mrp_io_channel_t *ch)
+{
+    __atomic_add_fetch(&ch->refcnt, 1, __ATOMIC_RELAXED);
+
+    return ch;
+}
+
+
+static void channel_unref(mrp_io_channel_t *ch)
+{
+    if (__atomic_sub_fetch(&ch->refcnt, 1, __ATOMIC_ACQ_REL) == 0)
+        free(ch);
+}
+
+
+static item_t *item_create(mrp_io_channel_t *ch, item_type_t type,
+                           size_t size)
+{
+    item_t *item;
+
+    item = malloc(sizeof(*item) + size);
+
+    if (item != NULL) {
+        item->next  = NULL;
+        item->type  = type;
+        item->ch    = channel_ref(ch);
+        item->msg   = NULL;
+        item->error = 0;
+        item->size  = size;
+        item->offs  = 0;
+    }
+
+    return item;
+}
+
+
+static void item_free(item_t *item)
+{
+    if (item->type == ITEM_WRITE) {
+        __atomic_sub_fetch(&item->ch->oqueued, item->size, __ATOMIC_RELAXED);
+        mrp_metric_adjust(pool.outq, -(int64_t)item->size);
+    }
+
+    if (item->msg != NULL)
+        mrp_msg_unref(item->msg);
+
+    channel_unref(item->ch);
+    free(item);
+}
+
+
+static void push_done(item_t *item)
+{
+    if (queue_push(&pool.doneq, item))
+        wakeup(pool.evfd);
+}
+
+
+static void push_cmd(io_worker_t *w, item_t *item)
+{
+    if (queue_push(&w->cmdq, item))
+        wakeup(w->evfd);
+}
+
+
+/*
+ * worker side
+ */
+
+static void drop_output(mrp_io_channel_t *ch)
+{
+    item_t *item, *next;
+
+    for (item = ch->ohead; item != NULL; item = next) {
+        next = item->next;
+        item_free(item);
+    }
+
+    ch->ohead = ch->otail = NULL;
+}
+
+
+static void update_events(io_worker_t *w, mrp_io_channel_t *ch)
+{
+    struct epoll_event e;
+    uint32_t           events;
+
+    if (ch->eof)
+        return;
+
+    events = ch->closing ? 0 : EPOLLIN | EPOLLRDHUP;
+
+    if (ch->ohead != NULL)
+        events |= EPOLLOUT;
+
+    if (events != ch->events) {
+        e.events   = events;
+        e.data.ptr = ch;
+
+        if (epoll_ctl(w->epfd, EPOLL_CTL_MOD, ch->fd, &e) == 0)
+            ch->events = events;
+    }
+}
+
+
+static void channel_closed(io_worker_t *w, mrp_io_channel_t *ch, int error)
+{
+    item_t *item;
+
+    epoll_ctl(w->epfd, EPOLL_CTL_DEL, ch->fd, NULL);
+    ch->eof    = TRUE;
+    ch->events = 0;
+    drop_output(ch);
+
+    if ((item = item_create(ch, ITEM_CLOSED, 0)) != NULL) {
+        item->error = error;
+        push_done(item);
+    }
+}
+
+
+static int deliver_frame(mrp_io_channel_t *ch, void *data, size_t size)
+{
+    item_t    *item;
+    mrp_msg_t *msg;
+    uint16_t   tag;
+
+    if (ch->decode && size >= sizeof(tag)) {
+        memcpy(&tag, data, sizeof(tag));
+
+        if (be16toh(tag) == MRP_MSG_TAG_DEFAULT) {
+            msg = mrp_msg_default_decode(data + sizeof(tag),
+                                         size - sizeof(tag));
+
+            if (msg != NULL) {
+                if ((item = item_create(ch, ITEM_MSG, 0)) == NULL) {
+                    mrp_msg_unref(msg);
+                    return FALSE;
+                }
+
+                item->msg = msg;
+                push_done(item);
+
+                return TRUE;
+            }
+        }
+
+        /* let the mainloop deal with undecodable frames */
+    }
+
+    if ((item = item_create(ch, ITEM_FRAME, size)) == NULL)
+        return FALSE;
+
+    memcpy(item->data, data, size);
+    push_done(item);
+
+    return TRUE;
+}
+
+
+static int parse_input(mrp_io_channel_t *ch)
+{
+    uint32_t len;
+    size_t   offs;
+    int      error;
+
+    offs  = 0;
+    error = 0;
+
+    while (ch->ilen - offs >= sizeof(len)) {
+        memcpy(&len, ch->ibuf + offs, sizeof(len));
+        len = be32toh(len);
+
+        /* don't let the peer make us buffer arbitrary amounts of input */
+        if (len > MAX_FRAME) {
+            mrp_log_error("I/O worker: %u byte frame exceeds %d byte limit.",
+                          len, MAX_FRAME);
+            return EMSGSIZE;
+        }
+
+        if (ch->ilen - offs - sizeof(len) < len)
+            break;
+
+        if (!deliver_frame(ch, ch->ibuf + offs + sizeof(len), len)) {
+            error = ENOMEM;
+            break;
+        }
+
+        offs += sizeof(len) + len;
+    }
+
+    if (offs > 0) {
+        ch->ilen -= offs;
+        memmove(ch->ibuf, ch->ibuf + offs, ch->ilen);
+    }
+
+    return error;
+}
+
+
+static void channel_read(io_worker_t *w, mrp_io_channel_t *ch)
+{
+    ssize_t  n;
+    size_t   size;
+    char    *buf;
+    int      i, error;
+
+    for (i = 0; i < MAX_READS; i++) {
+        if (ch->isize - ch->ilen < READ_CHUNK) {
+            size = ch->isize ? 2 * ch->isize : 2 * READ_CHUNK;
+            buf  = realloc(ch->ibuf, size);
+
+            if (buf == NULL) {
+                channel_closed(w, ch, ENOMEM);
+                return;
+            }
+
+            ch->ibuf  = buf;
+            ch->isize = size;
+        }
+
+        n = read(ch->fd, ch->ibuf + ch->ilen, ch->isize - ch->ilen);
+
+        if (n > 0) {
+            ch->ilen += n;
+
+            if ((error = parse_input(ch)) != 0) {
+                channel_closed(w, ch, error);
+                return;
+            }
+        }
+        else if (n == 0) {
+            channel_closed(w, ch, 0);
+            return;
+        }
+        else {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                channel_closed(w, ch, EIO);
+            return;
+        }
+    }
+}
+
+
+static void channel_finish(io_worker_t *w, mrp_io_channel_t *ch)
+{
+    mrp_io_channel_t **prev;
+
+    for (prev = &w->linger; *prev != NULL; prev = &(*prev)->lnext) {
+        if (*prev == ch) {
+            *prev = ch->lnext;
+            break;
+        }
+    }
+
+    if (!ch->eof)
+        epoll_ctl(w->epfd, EPOLL_CTL_DEL, ch->fd, NULL);
+
+    drop_output(ch);
+    close(ch->fd);
+    ch->fd = -1;
+
+    free(ch->ibuf);
+    ch->ibuf  = NULL;
+    ch->isize = ch->ilen = 0;
+
+    channel_unref(ch);                   /* drop worker reference */
+}
+
+
+static void channel_flush(io_worker_t *w, mrp_io_channel_t *ch)
+{
+    struct iovec   iov[MAX_IOV];
+    struct msghdr  mh;
+    item_t        *item;
+    ssize_t        n;
+    size_t         left;
+    int            cnt;
+
+    while (ch->ohead != NULL) {
+        for (item = ch->ohead, cnt = 0;
+             item != NULL && cnt < MAX_IOV;
+             item = item->next, cnt++) {
+            iov[cnt].iov_base = item->data + item->offs;
+            iov[cnt].iov_len  = item->size - item->offs;
+        }
+
+        mrp_clear(&mh);
+        mh.msg_iov    = iov;
+        mh.msg_iovlen = cnt;
+
+        n = sendmsg(ch->fd, &mh, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                drop_output(ch);         /* reading will notice the error */
+            break;
+        }
+
+        while (n > 0) {
+            item = ch->ohead;
+            left = item->size - item->offs;
+
+            if ((size_t)n < left) {
+                item->offs += n;
+                break;
+            }
+
+            n -= left;
+            ch->ohead = item->next;
+            if (ch->ohead == NULL)
+                ch->otail = NULL;
+            item_free(item);
+        }
+    }
+
+    if (ch->closing && ch->ohead == NULL)
+        channel_finish(w, ch);
+    else
+        update_events(w, ch);
+}
+
+
+static void worker_attach(io_worker_t *w, mrp_io_channel_t *ch)
+{
+    struct epoll_event e;
+
+    e.events   = EPOLLIN | EPOLLRDHUP;
+    e.data.ptr = ch;
+
+    if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, ch->fd, &e) == 0)
+        ch->events = e.events;
+    else
+        channel_closed(w, ch, errno);
+}
+
+
+static void worker_detach(io_worker_t *w, mrp_io_channel_t *ch)
+{
+    if (ch->eof || ch->ohead == NULL) {
+        channel_finish(w, ch);
+        return;
+    }
+
+    /* keep the socket open until pending output is written out */
+    ch->closing = TRUE;
+    ch->lnext   = w->linger;
+    w->linger   = ch;
+
+    channel_flush(w, ch);
+}
+
+
+static void worker_commands(io_worker_t *w)
+{
+    item_t           *item, *next;
+    mrp_io_channel_t *ch;
+
+    clear_wakeup(w->evfd);
+
+    for (item = queue_take(&w->cmdq); item != NULL; item = next) {
+        next = item->next;
+        ch   = item->ch;
+
+        switch (item->type) {
+        case ITEM_ATTACH:
+            worker_attach(w, ch);
+            item_free(item);
+            break;
+
+        case ITEM_WRITE:
+            if (ch->eof || ch->fd < 0) {
+                item_free(item);
+                break;
+            }
+
+            item->next = NULL;
+            if (ch->otail != NULL)
+                ch->otail->next = item;
+            else
+                ch->ohead = item;
+            ch->otail = item;
+
+            if (ch->ohead == item)
+                channel_flush(w, ch);
+            break;
+
+        case ITEM_DETACH:
+            worker_detach(w, ch);
+            item_free(item);
+            break;
+
+        default:
+            item_free(item);
+        }
+    }
+}
+
+
+static void *worker_thread(void *ptr)
+{
+    io_worker_t        *w = ptr;
+    struct epoll_event  events[MAX_EVENTS];
+    mrp_io_channel_t   *ch;
+    int                 n, i, cmds, stop;
+
+    for (;;) {
+        stop = __atomic_load_n(&w->stop, __ATOMIC_ACQUIRE);
+
+        if (stop) {
+            worker_commands(w);          /* pick up any final detaches */
+
+            if (w->linger == NULL)
+                break;
+        }
+
+        n = epoll_wait(w->epfd, events, MAX_EVENTS, stop ? 1000 : -1);
+
+        if (n == 0)                      /* lingering output got stuck */
+            break;
+
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+
+            mrp_log_error("I/O worker: epoll_wait failed (%d: %s).",
+                          errno, strerror(errno));
+            break;
+        }
+
+        cmds = FALSE;
+
+        for (i = 0; i < n; i++) {
+            ch = events[i].data.ptr;
+
+            if (ch == NULL) {
+                cmds = TRUE;
+                continue;
+            }
+
+            if (ch->eof)
+                continue;
+
+            if (ch->closing) {
+                channel_flush(w, ch);
+                continue;
+            }
+
+            if (events[i].events & EPOLLOUT)
+                channel_flush(w, ch);
+
+            if (events[i].events & (EPOLLIN|EPOLLRDHUP|EPOLLHUP|EPOLLERR))
+                channel_read(w, ch);
+        }
+
+        /* only now, so no stale events refer to a detached channel */
+        if (cmds)
+            worker_commands(w);
+    }
+
+    while (w->linger != NULL)
+        channel_finish(w, w->linger);
+
+    return NULL;
+}
+
+
+/*
+ * mainloop side
+ */
+
+static void done_cb(mrp_io_watch_t *wd, int fd, mrp_io_event_t events,
+                    void *user_data)
+{
+    item_t           *item, *next;
+    mrp_io_channel_t *ch;
+
+    MRP_UNUSED(wd);
+    MRP_UNUSED(events);
+    MRP_UNUSED(user_data);
+
+    clear_wakeup(fd);
+
+    for (item = queue_take(&pool.doneq); item != NULL; item = next) {
+        next = item->next;
+        ch   = item->ch;
+
+        if (!ch->detached) {
+            switch (item->type) {
+            case ITEM_FRAME:
+                ch->cb(ch, item->data, item->size, NULL, 0, ch->user_data);
+                break;
+            case ITEM_MSG:
+                ch->cb(ch, NULL, 0, item->msg, 0, ch->user_data);
+                break;
+            case ITEM_CLOSED:
+                ch->cb(ch, NULL, 0, NULL, item->error, ch->user_data);
+                break;
+            default:
+                break;
+            }
+        }
+
+        item_free(item);
+    }
+}
+
+
+static int start_worker(io_worker_t *w)
+{
+    struct epoll_event e;
+    sigset_t           all, old;
+    int                status;
+
+    w->epfd = epoll_create1(EPOLL_CLOEXEC);
+    w->evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (w->epfd < 0 || w->evfd < 0)
+        return FALSE;
+
+    e.events   = EPOLLIN;
+    e.data.ptr = NULL;
+
+    if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->evfd, &e) < 0)
+        return FALSE;
+
+    /* leave all signal handling to the mainloop thread */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    status = pthread_create(&w->tid, NULL, worker_thread, w);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if (status != 0) {
+        errno = status;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+static void stop_worker(io_worker_t *w)
+{
+    if (w->tid != 0) {
+        __atomic_store_n(&w->stop, TRUE, __ATOMIC_RELEASE);
+        wakeup(w->evfd);
+        pthread_join(w->tid, NULL);
+        w->tid = 0;
+    }
+
+    if (w->epfd >= 0)
+        close(w->epfd);
+    if (w->evfd >= 0)
+        close(w->evfd);
+
+    w->epfd = w->evfd = -1;
+}
+
+
+int mrp_io_workers_start(mrp_mainloop_t *ml, int nworker)
+{
+    int i;
+
+    if (pool.ml != NULL) {
+        errno = EBUSY;
+        return FALSE;
+    }
+
+    if (nworker <= 0 || nworker > MAX_WORKERS) {
+        errno = EINVAL;
+        return FALSE;
+    }
+
+    pool.outq = mrp_metric_gauge("io_worker_output_bytes", NULL,
+                                 "output queued for I/O workers in bytes");
+    pool.evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (pool.evfd < 0)
+        return FALSE;
+
+    pool.iow = mrp_add_io_watch(ml, pool.evfd, MRP_IO_EVENT_IN, done_cb, NULL);
+    pool.workers = mrp_allocz_array(io_worker_t, nworker);
+
+    if (pool.iow == NULL || pool.workers == NULL)
+        goto fail;
+
+    for (i = 0; i < nworker; i++)
+        pool.workers[i].epfd = pool.workers[i].evfd = -1;
+
+    pool.ml      = ml;
+    pool.nworker = nworker;
+    pool.next    = 0;
+    pool.decode  = (mrp_mm_type() == MRP_MM_PASSTHRU);
+
+    for (i = 0; i < nworker; i++) {
+        if (!start_worker(pool.workers + i)) {
+            mrp_log_error("Failed to start I/O worker #%d (%d: %s).", i,
+                          errno, strerror(errno));
+            goto fail;
+        }
+    }
+
+    return TRUE;
+
+ fail:
+    mrp_io_workers_stop();
+    return FALSE;
+}
+
+
+int mrp_io_workers_stop(void)
+{
+    int i;
+
+    /*
+     * Attached channels point to their worker, and the transports they
+     * belong to may still detach or write to them, so we refuse to stop
+     * until all of them are detached.
+     */
+    if (pool.nchannel > 0) {
+        mrp_log_error("Can't stop I/O workers, %d channels still attached.",
+                      pool.nchannel);
+        errno = EBUSY;
+        return FALSE;
+    }
+
+    for (i = 0; i < pool.nworker; i++)
+        stop_worker(pool.workers + i);
+
+    mrp_free(pool.workers);
+    pool.workers = NULL;
+    pool.nworker = 0;
+
+    mrp_del_io_watch(pool.iow);
+    pool.iow = NULL;
+
+    if (pool.evfd >= 0) {
+        done_cb(NULL, pool.evfd, MRP_IO_EVENT_IN, NULL);
+        close(pool.evfd);
+        pool.evfd = -1;
+    }
+
+    pool.ml = NULL;
+
+    return TRUE;
+}
+
+
+int mrp_io_workers_running(mrp_mainloop_t *ml)
+{
+    return pool.ml != NULL && pool.ml == ml;
+}
+
+
+mrp_io_channel_t *mrp_io_channel_attach(int fd, int decode,
+                                        mrp_io_channel_cb_t cb,
+                                        void *user_data)
+{
+    mrp_io_channel_t *ch;
+    item_t           *item;
+    long              nb;
+
+    if (pool.ml == NULL || cb == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if ((ch = calloc(1, sizeof(*ch))) == NULL)
+        return NULL;
+
+    nb = 1;
+    fcntl(fd, F_SETFL, O_NONBLOCK, nb);
+
+    ch->refcnt    = 1;                   /* mainloop reference */
+    ch->fd        = fd;
+    ch->w         = pool.workers + pool.next;
+    ch->decode    = decode && pool.decode;
+    ch->cb        = cb;
+    ch->user_data = user_data;
+
+    item    = item_create(ch, ITEM_ATTACH, 0);
+    ch->bye = item_create(ch, ITEM_DETACH, 0);
+
+    if (item == NULL || ch->bye == NULL) {
+        free(item);
+        free(ch->bye);
+        free(ch);
+        return NULL;
+    }
+
+    channel_ref(ch);                     /* worker reference */
+    pool.next = (pool.next + 1) % pool.nworker;
+    pool.nchannel++;
+    push_cmd(ch->w, item);
+
+    return ch;
+}
+
+
+void mrp_io_channel_detach(mrp_io_channel_t *ch)
+{
+    item_t *item;
+
+    if (ch == NULL || ch->detached)
+        return;
+
+    ch->detached = TRUE;
+    item         = ch->bye;
+    ch->bye      = NULL;
+    pool.nchannel--;
+
+    push_cmd(ch->w, item);
+    channel_unref(ch);                   /* drop mainloop reference */
+}
+
+
+int mrp_io_channel_write(mrp_io_channel_t *ch, struct iovec *iov, int iovcnt)
+{
+    item_t *item;
+    size_t  size, offs;
+    int     i;
+
+    if (ch == NULL || ch->detached) {
+        errno = EBADF;
+        return -1;
+    }
+
+    for (i = 0, size = 0; i < iovcnt; i++)
+        size += iov[i].iov_len;
+
+    /*
+     * Don't queue without bounds for a peer that is not reading. Like
+     * a full socket buffer, this fails the send.
+     */
+    if (__atomic_load_n(&ch->oqueued, __ATOMIC_RELAXED) + size > MAX_OUTPUT) {
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    if ((item = item_create(ch, ITEM_WRITE, size)) == NULL)
+        return -1;
+
+    __atomic_add_fetch(&ch->oqueued, size, __ATOMIC_RELAXED);
+
+    for (i = 0, offs = 0; i < iovcnt; i++) {
+        memcpy(item->data + offs, iov[i].iov_base, iov[i].iov_len);
+        offs += iov[i].iov_len;
+    }
+
+    mrp_metric_adjust(pool.outq, size);
+    push_cmd(ch->w, item);
+
+    return 0;
+}
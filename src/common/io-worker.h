@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2012, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __MURPHY_IO_WORKER_H__
+#define __MURPHY_IO_WORKER_H__
+
+#include <sys/uio.h>
+
+#include <murphy/common/macros.h>
+#include <murphy/common/mainloop.h>
+#include <murphy/common/msg.h>
+
+MRP_CDECL_BEGIN
+
+/*
+ * I/O worker threads
+ *
+ * An optional pool of threads that take over socket I/O for connected
+ * stream transports. A worker reads from its sockets, splits the input
+ * into frames and, if asked to and the allocator permits it, decodes
+ * messages. It also writes out frames queued by the mainloop thread,
+ * buffering them while the socket is not writable. Received frames and
+ * messages are passed to the mainloop thread through a lock-free queue
+ * and an eventfd, so all transport callbacks are still invoked from the
+ * mainloop in the usual single-threaded manner.
+ */
+
+typedef struct mrp_io_channel_s mrp_io_channel_t;
+
+/**
+ * Type of a channel input callback, invoked in the mainloop thread. It
+ * gets either a received frame (data and size), a message decoded by the
+ * worker (msg, unreferenced once the callback returns), or, with both
+ * data and msg NULL, a notification about the peer closing the connection
+ * (error is 0 for an orderly close).
+ */
+typedef void (*mrp_io_channel_cb_t)(mrp_io_channel_t *ch, void *data,
+                                    size_t size, mrp_msg_t *msg, int error,
+                                    void *user_data);
+
+/** Start a pool of nworker I/O worker threads for the given mainloop. */
+int mrp_io_workers_start(mrp_mainloop_t *ml, int nworker);
+
+/**
+ * Stop the I/O worker threads. Fails with EBUSY while any channel is
+ * still attached.
+ */
+int mrp_io_workers_stop(void);
+
+/** Check if I/O workers are running for the given mainloop. */
+int mrp_io_workers_running(mrp_mainloop_t *ml);
+
+/** Hand the I/O of the given connected socket over to an I/O worker. */
+mrp_io_channel_t *mrp_io_channel_attach(int fd, int decode,
+                                        mrp_io_channel_cb_t cb,
+                                        void *user_data);
+
+/** Detach a channel, closing its socket once pending output is flushed. */
+void mrp_io_channel_detach(mrp_io_channel_t *ch);
+
+/**
+ * Queue a copy of the given data for output. Fails with ENOBUFS if too
+ * much output is already queued for the channel.
+ */
+int mrp_io_channel_write(mrp_io_channel_t *ch, struct iovec *iov, int iovcnt);
+
+MRP_CDECL_END
+
+#endif /* __MURPHY_IO_WORKER_H__ */
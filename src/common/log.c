@@ -32,6 +32,10 @@
 #include <stddef.h>
 #include <string.h>
 #include <stdarg.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
 
 #include <murphy/common/mm.h>
 #include <murphy/common/list.h>
@@ -49,6 +53,7 @@ static log_target_t stderr_target;
 static log_target_t stdout_target;
 static log_target_t syslog_target;
 static log_target_t file_target;
+static log_target_t async_target;
 
 static MRP_LIST_HOOK(log_targets);
 static int           log_mask   = MRP_LOG_MASK_ERROR;
@@ -169,6 +174,347 @@ mrp_log_mask_t mrp_log_set_mask(mrp_log_mask_t enabled)
 }
 
 
+/*
+ * asynchronous logging
+ *
+ * The async target decouples the producers of log messages from the
+ * (potentially blocking) final log sink. Producers format messages into
+ * preallocated records in a bounded lock-free ring, and a dedicated
+ * writer thread drains the ring in batches to the sink. If the ring is
+ * full, the message is dropped and accounted for; producers never block.
+ *
+ * Notes:
+ *     Messages are formatted by the producer. Deferring the formatting
+ *     to the writer would need copies of all arguments, since %s ones
+ *     typically point to transient buffers.
+ */
+
+#define ASYNC_RECORDS  1024              /* number of records, power of 2 */
+#define ASYNC_TEXTLEN   480              /* max. length of a message */
+#define ASYNC_WAIT_MS    20              /* max. writer idle wait */
+#define ASYNC_WAKEUP    (ASYNC_RECORDS / 4) /* fill level to kick writer at */
+
+typedef struct {
+    uint32_t seq;                        /* ring sequence number */
+    uint16_t level;                      /* message log level */
+    uint16_t len;                        /* message length */
+    char     text[ASYNC_TEXTLEN];        /* formatted message */
+} async_record_t;
+
+static struct {
+    async_record_t *ring;                /* record ring */
+    uint32_t        head;                /* next record to fill */
+    uint32_t        tail;                /* next record to drain */
+    FILE           *fp;                  /* sink, or NULL for syslog */
+    int             owned;               /* whether to close fp */
+    pthread_t       thread;              /* writer thread */
+    sem_t           sem;                 /* writer wakeup semaphore */
+    int             running;             /* writer thread running */
+    int             sleeping;            /* writer waiting for records */
+    int             stop;                /* writer asked to stop */
+    uint64_t        dropped;             /* records dropped */
+    uint64_t        reported;            /* dropped records reported */
+} async;
+
+
+static const char *level_prefix(mrp_log_level_t level, int *lvl)
+{
+    switch (level) {
+    case MRP_LOG_ERROR:   *lvl = LOG_ERR;     return "E: ";
+    case MRP_LOG_WARNING: *lvl = LOG_WARNING; return "W: ";
+    case MRP_LOG_INFO:    *lvl = LOG_INFO;    return "I: ";
+    case MRP_LOG_DEBUG:   *lvl = LOG_INFO;    return "D: ";
+    default:              *lvl = LOG_INFO;    return "";
+    }
+}
+
+
+static void log_async(void *data, mrp_log_level_t level, const char *file,
+                      int line, const char *func, const char *format,
+                      va_list ap)
+{
+    async_record_t *r;
+    uint32_t        pos, seq;
+    int             n, l;
+
+    MRP_UNUSED(data);
+    MRP_UNUSED(file);
+    MRP_UNUSED(line);
+
+    if (!(log_mask & (1 << level)))
+        return;
+
+    /* claim a free record, or drop the message if there is none */
+    pos = __atomic_load_n(&async.head, __ATOMIC_RELAXED);
+
+    for (;;) {
+        r   = async.ring + (pos & (ASYNC_RECORDS - 1));
+        seq = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+
+        if (seq == pos) {
+            if (__atomic_compare_exchange_n(&async.head, &pos, pos + 1, TRUE,
+                                            __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED))
+                break;
+        }
+        else if ((int32_t)(seq - pos) < 0) {
+            __sync_fetch_and_add(&async.dropped, 1);
+            return;
+        }
+        else
+            pos = __atomic_load_n(&async.head, __ATOMIC_RELAXED);
+    }
+
+    if (level == MRP_LOG_DEBUG)
+        n = snprintf(r->text, sizeof(r->text), "[%s] ", func);
+    else
+        n = 0;
+
+    if (n < 0 || n >= (int)sizeof(r->text))
+        n = 0;
+
+    l = vsnprintf(r->text + n, sizeof(r->text) - n, format, ap);
+
+    if (l < 0)
+        l = 0;
+    else if (n + l >= (int)sizeof(r->text)) {
+        l = sizeof(r->text) - 1 - n;
+        memcpy(r->text + sizeof(r->text) - 4, "...", 3);
+    }
+
+    r->level = level;
+    r->len   = n + l;
+
+    __atomic_store_n(&r->seq, pos + 1, __ATOMIC_RELEASE);
+
+    /*
+     * Let the writer batch up messages. Only kick it for errors and
+     * warnings or if the ring is filling up, otherwise it picks up the
+     * messages after its idle wait.
+     */
+
+    if (level > MRP_LOG_WARNING &&
+        pos - __atomic_load_n(&async.tail, __ATOMIC_RELAXED) < ASYNC_WAKEUP)
+        return;
+
+    __sync_synchronize();
+
+    if (async.sleeping && __sync_bool_compare_and_swap(&async.sleeping, 1, 0))
+        sem_post(&async.sem);
+}
+
+
+static int async_drain(void)
+{
+    async_record_t *r;
+    uint64_t        dropped;
+    const char     *prefix;
+    int             lvl, cnt;
+
+    cnt = 0;
+
+    for (;;) {
+        r = async.ring + (async.tail & (ASYNC_RECORDS - 1));
+
+        if (__atomic_load_n(&r->seq, __ATOMIC_ACQUIRE) != async.tail + 1)
+            break;
+
+        prefix = level_prefix(r->level, &lvl);
+
+        if (async.fp != NULL) {
+            fputs(prefix, async.fp);
+            fwrite(r->text, 1, r->len, async.fp);
+            fputc('\n', async.fp);
+        }
+        else
+            syslog(lvl, "%.*s", (int)r->len, r->text);
+
+        __atomic_store_n(&r->seq, async.tail + ASYNC_RECORDS,
+                         __ATOMIC_RELEASE);
+        __atomic_store_n(&async.tail, async.tail + 1, __ATOMIC_RELAXED);
+        cnt++;
+    }
+
+    dropped = __atomic_load_n(&async.dropped, __ATOMIC_RELAXED);
+
+    if (dropped != async.reported) {
+        if (async.fp != NULL)
+            fprintf(async.fp, "W: %llu log messages dropped\n",
+                    (unsigned long long)(dropped - async.reported));
+        else
+            syslog(LOG_WARNING, "%llu log messages dropped",
+                   (unsigned long long)(dropped - async.reported));
+
+        async.reported = dropped;
+        cnt++;
+    }
+
+    if (cnt > 0 && async.fp != NULL)
+        fflush(async.fp);
+
+    return cnt;
+}
+
+
+static void *async_writer(void *data)
+{
+    struct timespec ts;
+
+    MRP_UNUSED(data);
+
+    for (;;) {
+        if (async_drain() > 0)
+            continue;
+
+        if (async.stop)
+            break;
+
+        /* announce that we're going to sleep, then recheck for records */
+        __sync_bool_compare_and_swap(&async.sleeping, 0, 1);
+
+        if (__atomic_load_n(&async.ring[async.tail & (ASYNC_RECORDS - 1)].seq,
+                            __ATOMIC_ACQUIRE) == async.tail + 1) {
+            async.sleeping = 0;
+            continue;
+        }
+
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += ASYNC_WAIT_MS * 1000 * 1000;
+
+        if (ts.tv_nsec >= 1000 * 1000 * 1000) {
+            ts.tv_sec  += 1;
+            ts.tv_nsec -= 1000 * 1000 * 1000;
+        }
+
+        sem_timedwait(&async.sem, &ts);
+        async.sleeping = 0;
+    }
+
+    return NULL;
+}
+
+
+static int async_start_thread(void)
+{
+    if (sem_init(&async.sem, 0, 0) < 0)
+        return FALSE;
+
+    async.stop     = FALSE;
+    async.sleeping = FALSE;
+
+    if (pthread_create(&async.thread, NULL, async_writer, NULL) != 0) {
+        sem_destroy(&async.sem);
+        return FALSE;
+    }
+
+    async.running = TRUE;
+
+    return TRUE;
+}
+
+
+static void async_stop(void)
+{
+    if (!async.running)
+        return;
+
+    async.stop = TRUE;
+    sem_post(&async.sem);
+    pthread_join(async.thread, NULL);
+    sem_destroy(&async.sem);
+
+    async.running = FALSE;
+
+    if (async.owned && async.fp != NULL)
+        fclose(async.fp);
+
+    async.fp    = NULL;
+    async.owned = FALSE;
+}
+
+
+static void async_atfork_child(void)
+{
+    /* the writer thread does not survive a fork, recreate it */
+    if (async.running) {
+        async.running = FALSE;
+        async_start_thread();
+    }
+}
+
+
+static void async_init(void)
+{
+    static int initialized = FALSE;
+    uint32_t   i;
+
+    if (initialized)
+        return;
+
+    for (i = 0; i < ASYNC_RECORDS; i++)
+        async.ring[i].seq = i;
+
+    pthread_atfork(NULL, NULL, async_atfork_child);
+    atexit(async_stop);
+
+    initialized = TRUE;
+}
+
+
+static int async_start(const char *sink)
+{
+    FILE *fp;
+    int   owned;
+
+    if (async.ring == NULL) {
+        async.ring = mrp_allocz(sizeof(*async.ring) * ASYNC_RECORDS);
+
+        if (async.ring == NULL)
+            return FALSE;
+    }
+
+    async_init();
+
+    owned = FALSE;
+
+    if (sink == NULL || !*sink || !strcmp(sink, MRP_LOG_TO_STDERR))
+        fp = stderr;
+    else if (!strcmp(sink, MRP_LOG_TO_STDOUT))
+        fp = stdout;
+    else if (!strcmp(sink, MRP_LOG_TO_SYSLOG))
+        fp = NULL;
+    else if (!strncmp(sink, "file:", 5)) {
+        if ((fp = fopen(sink + 5, "a")) == NULL)
+            return FALSE;
+        owned = TRUE;
+    }
+    else
+        return FALSE;
+
+    async_stop();
+
+    async.fp    = fp;
+    async.owned = owned;
+
+    if (!async_start_thread()) {
+        if (owned)
+            fclose(fp);
+        async.fp    = NULL;
+        async.owned = FALSE;
+
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+uint64_t mrp_log_dropped(void)
+{
+    return __atomic_load_n(&async.dropped, __ATOMIC_RELAXED);
+}
+
+
 static log_target_t *find_target(const char *name)
 {
     log_target_t    *t;
@@ -194,6 +540,10 @@ int mrp_log_set_target(const char *name)
         path = name + 5;
         name = "file";
     }
+    else if (!strncmp(name, "async:", 6) || !strcmp(name, "async")) {
+        path = name[5] ? name + 6 : NULL;
+        name = "async";
+    }
     else
         path = NULL;
 
@@ -202,6 +552,27 @@ int mrp_log_set_target(const char *name)
     if (target == NULL)
         return FALSE;
 
+    /* start (or restart) the writer before switching to it */
+    if (target == &async_target) {
+        if (!async_start(path))
+            return FALSE;
+
+        if (log_target == &file_target && file_target.data != NULL) {
+            fclose(file_target.data);
+            file_target.data = NULL;
+        }
+
+        log_target = target;
+
+        return TRUE;
+    }
+
+    /* stop the writer, flushing any pending messages */
+    if (log_target == &async_target) {
+        log_target = target;
+        async_stop();
+    }
+
     /* close files opened by us, if any */
     if (log_target == &file_target) {
         if (file_target.data != NULL) {
@@ -395,6 +766,13 @@ static __attribute__((constructor)) void set_default_logging(void)
     file_target.data    = NULL;
     file_target.builtin = TRUE;
 
+    mrp_list_init(&async_target.hook);
+    async_target.name    = "async";
+    async_target.logger  = log_async;
+    async_target.data    = NULL;
+    async_target.builtin = TRUE;
+
+    mrp_list_prepend(&log_targets, &async_target.hook);
     mrp_list_prepend(&log_targets, &file_target.hook);
     mrp_list_prepend(&log_targets, &syslog_target.hook);
     mrp_list_prepend(&log_targets, &stderr_target.hook);
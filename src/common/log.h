@@ -36,6 +36,7 @@
 
 #include <syslog.h>
 #include <stdarg.h>
+#include <stdint.h>
 
 #include <murphy/common/macros.h>
 #include <murphy/common/debug.h>
@@ -106,6 +107,14 @@ mrp_log_mask_t mrp_log_disable(mrp_log_mask_t mask);
 #define MRP_LOG_TO_SYSLOG     "syslog"
 #define MRP_LOG_TO_FILE(path) ((const char *)(path))
 
+/**
+ * Asynchronous logging target. Messages are queued to a bounded ring and
+ * written out to the sink by a dedicated thread. The sink is given after
+ * the prefix, as stdout, stderr (default), syslog or file:<path>, for
+ * instance async:syslog. Messages are dropped if the ring is full.
+ */
+#define MRP_LOG_TO_ASYNC(sink) "async:"sink
+
 
 /** Parse a log target name to MRP_LOG_TO_*. */
 const char *mrp_log_parse_target(const char *target);
@@ -119,6 +128,9 @@ const char *mrp_log_get_target(void);
 /** Get all available logging targets. */
 int mrp_log_get_targets(const char **targets, size_t size);
 
+/** Get the number of messages dropped by the asynchronous target. */
+uint64_t mrp_log_dropped(void);
+
 /** Log an error. */
 #define mrp_log_error(fmt, args...) \
     mrp_log_msg(MRP_LOG_ERROR, __LOC__, fmt , ## args)
@@ -27,14 +27,29 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#define _GNU_SOURCE
 #include <unistd.h>
 #include <errno.h>
 #include <time.h>
 #include <signal.h>
 #include <limits.h>
+#include <pthread.h>
 #include <sys/epoll.h>
 #include <sys/signalfd.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <dlfcn.h>
+
+#include "murphy/config.h"
+
+#ifdef HAVE_LINUX_IO_URING_H
+#    include <linux/io_uring.h>
+#    if defined(__NR_io_uring_setup) && defined(IORING_FEAT_EXT_ARG)
+#        define IO_URING_ENABLED 1
+#    endif
+#endif
 
 #include <murphy/common/macros.h>
 #include <murphy/common/mm.h>
@@ -42,6 +57,7 @@
 #include <murphy/common/list.h>
 #include <murphy/common/hashtbl.h>
 #include <murphy/common/mainloop.h>
+#include <murphy/common/metrics.h>
 
 #define USECS_PER_SEC  (1000 * 1000)
 #define USECS_PER_MSEC (1000)
@@ -51,6 +67,9 @@
  * I/O watches
  */
 
+typedef struct uring_poll_s uring_poll_t;
+typedef struct cbprof_s     cbprof_t;
+
 struct mrp_io_watch_s {
     mrp_list_hook_t    hook;                     /* to list of watches */
     mrp_list_hook_t    deleted;                  /* to list of pending delete */
@@ -63,6 +82,9 @@ struct mrp_io_watch_s {
     struct pollfd     *pollfd;                   /* associated pollfd */
     mrp_list_hook_t    slave;                    /* watches with the same fd */
     int                wrhup;                    /* EPOLLHUPs delivered */
+    uring_poll_t      *poll;                     /* io_uring poll request */
+    mrp_metric_t      *metric;                   /* callback time metric */
+    cbprof_t          *prof;                     /* callback profile */
 };
 
 #define is_master(w) !mrp_list_empty(&(w)->hook)
@@ -82,6 +104,7 @@ struct mrp_timer_s {
     uint64_t         expire;                     /* next expiration time */
     mrp_timer_cb_t   cb;                         /* user callback */
     void            *user_data;                  /* opaque user data */
+    cbprof_t        *prof;                       /* callback profile */
 };
 
 
@@ -96,6 +119,7 @@ struct mrp_deferred_s {
     mrp_mainloop_t    *ml;                       /* mainloop */
     mrp_deferred_cb_t  cb;                       /* user callback */
     void              *user_data;                /* opaque user data */
+    cbprof_t          *prof;                     /* callback profile */
     int                inactive : 1;
 };
 
@@ -129,6 +153,56 @@ struct mrp_wakeup_s {
     void                *user_data;              /* opaque user data */
 };
 
+/*
+ * work offloaded to worker threads
+ */
+
+#define WORK_MAX_THREADS 64                      /* upper limit for threads */
+#define WORK_DEF_THREADS 4                       /* default max. threads */
+#define WORK_DEF_QUEUED  1024                    /* default max. queued */
+
+typedef enum {
+    WORK_QUEUED = 0,                             /* waiting for a thread */
+    WORK_RUNNING,                                /* being run by a thread */
+    WORK_DONE,                                   /* finished running */
+    WORK_CANCELLED,                              /* cancelled before run */
+} work_state_t;
+
+struct mrp_work_s {
+    mrp_list_hook_t     hook;                    /* to queue or done list */
+    mrp_mainloop_t     *ml;                      /* mainloop */
+    mrp_work_cb_t       work;                    /* work callback */
+    mrp_work_done_cb_t  done;                    /* completion callback */
+    void               *user_data;               /* opaque user data */
+    uint64_t            seqno;                   /* submission order */
+    work_state_t        state;                   /* current state */
+    uint64_t            queued;                  /* time queued */
+    uint64_t            started;                 /* time started */
+    uint64_t            finished;                /* time finished */
+};
+
+typedef struct {
+    pthread_mutex_t     lock;                    /* protects all below */
+    pthread_cond_t      cond;                    /* signalled for new work */
+    mrp_list_hook_t     queue;                   /* queued work */
+    mrp_list_hook_t     done;                    /* finished work */
+    pthread_t           threads[WORK_MAX_THREADS]; /* worker threads */
+    int                 nthread;                 /* number of threads */
+    int                 nidle;                   /* idle threads */
+    int                 nqueued;                 /* queued work */
+    int                 nrunning;                /* running work */
+    int                 stop;                    /* TRUE if stopping */
+    int                 evfd;                    /* completion eventfd */
+    mrp_io_watch_t     *iow;                     /* eventfd I/O watch */
+    mrp_list_hook_t     ready;                   /* completions (mainloop) */
+    uint64_t            next_seqno;              /* next seqno to assign */
+    uint64_t            next_done;               /* next seqno to complete */
+    mrp_work_stats_t    stats;                   /* queue statistics */
+    uint64_t            wait_sum;                /* total time queued */
+    uint64_t            run_sum;                 /* total time running */
+    int                 pending;                 /* completions to check */
+} work_pool_t;
+
 #define mark_deleted(o) do {                                    \
         (o)->cb = NULL;                                         \
         mrp_list_append(&(o)->ml->deleted, &(o)->deleted);      \
@@ -178,6 +252,59 @@ typedef struct {
 } fdtbl_t;
 
 
+/*
+ * io_uring polling backend
+ *
+ * With io_uring we use one-shot poll requests which we rearm once the
+ * completion has been dispatched. This keeps the level-triggered semantics
+ * of our epoll backend. Instead of the fd, completions carry a pointer to
+ * a per-fd poll request. The request is detached from its watch when the
+ * fd is no longer polled and only freed once the kernel has completed all
+ * its outstanding submissions, so stale completions can never carry a
+ * dangling pointer. Requests are queued and submitted in batches, together
+ * with waiting for completions, using a single system call.
+ */
+
+typedef struct uring_s uring_t;
+
+#ifdef IO_URING_ENABLED
+
+#define URING_SQ_ENTRIES  256                    /* submission queue size */
+#define URING_CQ_ENTRIES 4096                    /* completion queue size */
+
+struct uring_poll_s {
+    mrp_list_hook_t      hook;                   /* to list of requests */
+    mrp_io_watch_t      *master;                 /* master watch, if any */
+    int                  fd;                     /* fd being polled */
+    uint32_t             mask;                   /* events polled for */
+    int                  pending;                /* requests in flight */
+    int                  busy;                   /* being dispatched */
+};
+
+struct uring_s {
+    int                  fd;                     /* io_uring fd */
+    void                *sq_ring;                /* mapped SQ ring */
+    size_t               sq_size;                /* SQ ring mapping size */
+    void                *cq_ring;                /* mapped CQ ring */
+    size_t               cq_size;                /* CQ ring mapping size */
+    struct io_uring_sqe *sqes;                   /* mapped SQ entries */
+    size_t               sqes_size;              /* SQ entries mapping size */
+    unsigned            *sq_head;                /* SQ head (kernel) */
+    unsigned            *sq_tail;                /* SQ tail (us) */
+    unsigned             sq_mask;                /* SQ index mask */
+    unsigned             sq_entries;             /* SQ size */
+    unsigned            *sq_array;               /* SQ index array */
+    unsigned            *cq_head;                /* CQ head (us) */
+    unsigned            *cq_tail;                /* CQ tail (kernel) */
+    unsigned             cq_mask;                /* CQ index mask */
+    struct io_uring_cqe *cqes;                   /* CQ entries */
+    unsigned             tail;                   /* local SQ tail */
+    mrp_list_hook_t      polls;                  /* poll requests */
+};
+
+#endif /* IO_URING_ENABLED */
+
+
 /*
  * external mainloops
  */
@@ -198,6 +325,7 @@ struct mrp_subloop_s {
     int                  npollfd;                /* number of pollfds */
     int                  pending;                /* pending events */
     int                  poll;                   /* need to poll for events */
+    cbprof_t            *prof;                   /* callback profile */
 };
 
 
@@ -206,6 +334,8 @@ struct mrp_subloop_s {
  */
 
 struct mrp_mainloop_s {
+    mrp_mainloop_backend_t backend;              /* polling backend */
+    uring_t             *uring;                  /* io_uring, if used */
     int                  epollfd;                /* our epoll descriptor */
     struct epoll_event  *events;                 /* epoll event buffer */
     int                  nevent;                 /* epoll event buffer size */
@@ -232,6 +362,10 @@ struct mrp_mainloop_s {
 
     mrp_list_hook_t      subloops;               /* external main loops */
 
+    work_pool_t         *work_pool;              /* worker threads */
+    int                  work_threads;           /* max. worker threads */
+    int                  work_queued;            /* max. queued work */
+
     mrp_list_hook_t      deleted;                /* unfreed deleted items */
     int                  quit;                   /* TRUE if _quit called */
     int                  exit_code;              /* returned from _run */
@@ -241,6 +375,58 @@ struct mrp_mainloop_s {
     void                *iow;                    /* superloop epollfd watch */
     void                *timer;                  /* superloop timer */
     void                *work;                   /* superloop deferred work */
+
+    int                  profile;                /* profile callbacks */
+    unsigned int         slow_usecs;             /* slow callback threshold */
+    mrp_list_hook_t      profiles;               /* callback profiles */
+
+    mrp_deferred_t      *trim;                   /* object pool trimming */
+};
+
+
+/*
+ * object pools for watches, timers and deferred callbacks
+ */
+
+static mrp_objpool_t *io_watch_pool;
+static mrp_objpool_t *timer_pool;
+static mrp_objpool_t *deferred_pool;
+static pthread_once_t pools_once = PTHREAD_ONCE_INIT;
+
+static void create_pools(void)
+{
+    mrp_objpool_config_t cfg;
+
+    mrp_clear(&cfg);
+    cfg.flags    = MRP_OBJPOOL_FLAG_ZERO;
+    cfg.prealloc = 64;
+
+    cfg.name    = "mainloop-io-watch";
+    cfg.objsize = sizeof(mrp_io_watch_t);
+    io_watch_pool = mrp_objpool_create(&cfg);
+
+    cfg.name    = "mainloop-timer";
+    cfg.objsize = sizeof(mrp_timer_t);
+    timer_pool = mrp_objpool_create(&cfg);
+
+    cfg.name    = "mainloop-deferred";
+    cfg.objsize = sizeof(mrp_deferred_t);
+    deferred_pool = mrp_objpool_create(&cfg);
+}
+
+
+/*
+ * callback profiles
+ */
+
+struct cbprof_s {
+    mrp_list_hook_t      hook;                   /* to list of profiles */
+    mrp_callback_type_t  type;                   /* callback type */
+    void                *cb;                     /* callback function */
+    char                *name;                   /* resolved name, if any */
+    uint64_t             count;                  /* number of invocations */
+    uint64_t             total;                  /* total time (usecs) */
+    uint64_t             max;                    /* maximum time (usecs) */
 };
 
 
@@ -351,11 +537,446 @@ static void fdtbl_remove(fdtbl_t *ft, int fd)
 }
 
 
+/*
+ * polling backends
+ *
+ * These start, update, and stop polling the fd of a master I/O watch for
+ * the combined events of the master and all its slaves.
+ */
+
+static int epoll_fd_ctl(mrp_mainloop_t *ml, int op, int fd, uint32_t mask)
+{
+    struct epoll_event evt;
+
+    evt.events   = mask;
+    evt.data.u64 = 0;                    /* init full union for valgrind... */
+    evt.data.fd  = fd;
+
+    return epoll_ctl(ml->epollfd, op, fd, &evt);
+}
+
+
+#ifdef IO_URING_ENABLED
+
+static int uring_enter(uring_t *u, unsigned nsubmit, unsigned nwait,
+                       unsigned flags, struct io_uring_getevents_arg *arg)
+{
+    return syscall(__NR_io_uring_enter, u->fd, nsubmit, nwait, flags,
+                   arg, arg ? sizeof(*arg) : 0);
+}
+
+
+static int uring_submit(uring_t *u)
+{
+    unsigned n;
+
+    n = u->tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+
+    if (n == 0)
+        return 0;
+
+    return uring_enter(u, n, 0, 0, NULL);
+}
+
+
+static struct io_uring_sqe *uring_get_sqe(uring_t *u)
+{
+    struct io_uring_sqe *sqe;
+    unsigned             idx;
+
+    if (u->tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) >=
+        u->sq_entries) {
+        if (uring_submit(u) < 0) {
+            mrp_log_error("Failed to submit io_uring requests (%d: %s).",
+                          errno, strerror(errno));
+            return NULL;
+        }
+    }
+
+    idx = u->tail & u->sq_mask;
+    sqe = u->sqes + idx;
+    memset(sqe, 0, sizeof(*sqe));
+
+    u->sq_array[idx] = idx;
+    u->tail++;
+    __atomic_store_n(u->sq_tail, u->tail, __ATOMIC_RELEASE);
+
+    return sqe;
+}
+
+
+static int uring_poll_arm(mrp_mainloop_t *ml, uring_poll_t *p, int relink)
+{
+    struct io_uring_sqe *sqe;
+
+    if (relink) {
+        /* cancel the old request before (re)arming the new one */
+        if ((sqe = uring_get_sqe(ml->uring)) == NULL)
+            return -1;
+
+        sqe->opcode    = IORING_OP_POLL_REMOVE;
+        sqe->fd        = -1;
+        sqe->addr      = (uint64_t)(ptrdiff_t)p;
+        sqe->flags     = IOSQE_IO_HARDLINK;
+        sqe->user_data = 0;
+    }
+
+    if ((sqe = uring_get_sqe(ml->uring)) == NULL)
+        return -1;
+
+    sqe->opcode        = IORING_OP_POLL_ADD;
+    sqe->fd            = p->fd;
+    sqe->poll32_events = p->mask;
+    sqe->user_data     = (uint64_t)(ptrdiff_t)p;
+
+    p->pending++;
+
+    if (ml->super_ops != NULL)
+        ml->super_ops->mod_defer(ml->super_data, ml->work, TRUE);
+
+    return 0;
+}
+
+
+static void uring_poll_cancel(mrp_mainloop_t *ml, uring_poll_t *p)
+{
+    struct io_uring_sqe *sqe;
+
+    if ((sqe = uring_get_sqe(ml->uring)) != NULL) {
+        sqe->opcode    = IORING_OP_POLL_REMOVE;
+        sqe->fd        = -1;
+        sqe->addr      = (uint64_t)(ptrdiff_t)p;
+        sqe->user_data = 0;
+    }
+
+    /*
+     * Notes: If we fail to cancel, the request will eventually complete
+     *        and since it has no master by then, it just gets freed.
+     */
+}
+
+
+static void uring_poll_free(uring_poll_t *p)
+{
+    mrp_list_delete(&p->hook);
+    mrp_free(p);
+}
+
+
+static int uring_fd_add(mrp_mainloop_t *ml, mrp_io_watch_t *master,
+                        uint32_t mask)
+{
+    uring_poll_t *p;
+
+    if ((p = mrp_allocz(sizeof(*p))) == NULL)
+        return -1;
+
+    mrp_list_init(&p->hook);
+    p->master = master;
+    p->fd     = master->fd;
+    p->mask   = mask;
+
+    if (uring_poll_arm(ml, p, FALSE) < 0) {
+        mrp_free(p);
+        return -1;
+    }
+
+    mrp_list_append(&ml->uring->polls, &p->hook);
+
+    master->poll = p;
+
+    return 0;
+}
+
+
+static int uring_fd_mod(mrp_mainloop_t *ml, mrp_io_watch_t *master,
+                        uint32_t mask)
+{
+    uring_poll_t *p = master->poll;
+
+    if (p == NULL) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    if (p->mask == mask)
+        return 0;
+
+    p->mask = mask;
+
+    /*
+     * Notes: If the request is being dispatched, it gets rearmed with
+     *        the updated mask once dispatching is done.
+     */
+
+    if (p->pending > 0)
+        return uring_poll_arm(ml, p, TRUE);
+
+    if (!p->busy)
+        return uring_poll_arm(ml, p, FALSE);
+
+    return 0;
+}
+
+
+static int uring_fd_del(mrp_mainloop_t *ml, mrp_io_watch_t *master)
+{
+    uring_poll_t *p = master->poll;
+
+    if (p == NULL) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    master->poll = NULL;
+    p->master    = NULL;
+
+    if (p->pending > 0)
+        uring_poll_cancel(ml, p);
+    else if (!p->busy)
+        uring_poll_free(p);
+
+    return 0;
+}
+
+
+static int uring_wait(uring_t *u, int timeout)
+{
+    struct io_uring_getevents_arg  arg, *argp;
+    struct __kernel_timespec       ts;
+    unsigned                       nsubmit, nready, nwait, flags;
+
+    nsubmit = u->tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+    nready  = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE) - *u->cq_head;
+    nwait   = (nready == 0 && timeout != 0) ? 1 : 0;
+
+    if (nsubmit == 0 && nwait == 0)
+        return nready;
+
+    flags = 0;
+    argp  = NULL;
+
+    if (nwait > 0) {
+        flags = IORING_ENTER_GETEVENTS;
+
+        if (timeout > 0) {
+            ts.tv_sec  = timeout / 1000;
+            ts.tv_nsec = (timeout % 1000) * USECS_PER_MSEC * NSECS_PER_USEC;
+
+            memset(&arg, 0, sizeof(arg));
+            arg.ts = (uint64_t)(ptrdiff_t)&ts;
+
+            flags |= IORING_ENTER_EXT_ARG;
+            argp   = &arg;
+        }
+    }
+
+    if (uring_enter(u, nsubmit, nwait, flags, argp) < 0) {
+        if (errno != EINTR && errno != ETIME &&
+            errno != EAGAIN && errno != EBUSY)
+            mrp_log_error("Failed to poll io_uring (%d: %s).", errno,
+                          strerror(errno));
+    }
+
+    return __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE) - *u->cq_head;
+}
+
+
+static void uring_destroy(uring_t *u)
+{
+    mrp_list_hook_t *p, *n;
+
+    if (u == NULL)
+        return;
+
+    /* free requests we never got the final completion for */
+    mrp_list_foreach(&u->polls, p, n) {
+        uring_poll_free(mrp_list_entry(p, uring_poll_t, hook));
+    }
+
+    if (u->sqes != NULL)
+        munmap(u->sqes, u->sqes_size);
+    if (u->cq_ring != NULL && u->cq_ring != u->sq_ring)
+        munmap(u->cq_ring, u->cq_size);
+    if (u->sq_ring != NULL)
+        munmap(u->sq_ring, u->sq_size);
+
+    close(u->fd);
+    mrp_free(u);
+}
+
+
+static uring_t *uring_create(void)
+{
+    struct io_uring_params  params;
+    uring_t                *u;
+    uint32_t                features;
+    char                   *ring;
+
+    if ((u = mrp_allocz(sizeof(*u))) == NULL)
+        return NULL;
+
+    mrp_list_init(&u->polls);
+
+    memset(&params, 0, sizeof(params));
+    params.flags      = IORING_SETUP_CQSIZE;
+    params.cq_entries = URING_CQ_ENTRIES;
+
+    u->fd = syscall(__NR_io_uring_setup, URING_SQ_ENTRIES, &params);
+
+    if (u->fd < 0) {
+        mrp_debug("io_uring not available (%d: %s)", errno, strerror(errno));
+        goto fail;
+    }
+
+    features = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP |
+        IORING_FEAT_EXT_ARG;
+
+    if ((params.features & features) != features) {
+        mrp_debug("io_uring lacks required features (0x%x)", params.features);
+        errno = EOPNOTSUPP;
+        goto fail;
+    }
+
+    u->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    u->cq_size = params.cq_off.cqes +
+        params.cq_entries * sizeof(struct io_uring_cqe);
+
+    if (u->cq_size > u->sq_size)
+        u->sq_size = u->cq_size;
+    u->cq_size = u->sq_size;
+
+    u->sq_ring = mmap(NULL, u->sq_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+
+    if (u->sq_ring == MAP_FAILED) {
+        u->sq_ring = NULL;
+        goto fail;
+    }
+
+    u->cq_ring   = u->sq_ring;
+    u->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes      = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+
+    if (u->sqes == MAP_FAILED) {
+        u->sqes = NULL;
+        goto fail;
+    }
+
+    ring = u->sq_ring;
+
+    u->sq_head    = (unsigned *)(ring + params.sq_off.head);
+    u->sq_tail    = (unsigned *)(ring + params.sq_off.tail);
+    u->sq_mask    = *(unsigned *)(ring + params.sq_off.ring_mask);
+    u->sq_entries = *(unsigned *)(ring + params.sq_off.ring_entries);
+    u->sq_array   = (unsigned *)(ring + params.sq_off.array);
+    u->tail       = *u->sq_tail;
+
+    u->cq_head    = (unsigned *)(ring + params.cq_off.head);
+    u->cq_tail    = (unsigned *)(ring + params.cq_off.tail);
+    u->cq_mask    = *(unsigned *)(ring + params.cq_off.ring_mask);
+    u->cqes       = (struct io_uring_cqe *)(ring + params.cq_off.cqes);
+
+    return u;
+
+ fail:
+    if (u->fd >= 0)
+        close(u->fd);
+    u->fd = -1;
+    uring_destroy(u);
+
+    return NULL;
+}
+
+#else /* !IO_URING_ENABLED */
+
+static int uring_fd_add(mrp_mainloop_t *ml, mrp_io_watch_t *master,
+                        uint32_t mask)
+{
+    MRP_UNUSED(ml);
+    MRP_UNUSED(master);
+    MRP_UNUSED(mask);
+
+    errno = EOPNOTSUPP;
+    return -1;
+}
+
+
+static int uring_fd_mod(mrp_mainloop_t *ml, mrp_io_watch_t *master,
+                        uint32_t mask)
+{
+    return uring_fd_add(ml, master, mask);
+}
+
+
+static int uring_fd_del(mrp_mainloop_t *ml, mrp_io_watch_t *master)
+{
+    return uring_fd_add(ml, master, 0);
+}
+
+#endif /* !IO_URING_ENABLED */
+
+
+static int poll_fd_add(mrp_mainloop_t *ml, mrp_io_watch_t *master,
+                       uint32_t mask)
+{
+    if (ml->uring != NULL)
+        return uring_fd_add(ml, master, mask);
+    else
+        return epoll_fd_ctl(ml, EPOLL_CTL_ADD, master->fd, mask);
+}
+
+
+static int poll_fd_mod(mrp_mainloop_t *ml, mrp_io_watch_t *master,
+                       uint32_t mask)
+{
+    if (ml->uring != NULL)
+        return uring_fd_mod(ml, master, mask);
+    else
+        return epoll_fd_ctl(ml, EPOLL_CTL_MOD, master->fd, mask);
+}
+
+
+static int poll_fd_del(mrp_mainloop_t *ml, mrp_io_watch_t *master)
+{
+    if (ml->uring != NULL)
+        return uring_fd_del(ml, master);
+    else
+        return epoll_fd_ctl(ml, EPOLL_CTL_DEL, master->fd, 0);
+}
+
+
+static int poll_fd(mrp_mainloop_t *ml)
+{
+#ifdef IO_URING_ENABLED
+    if (ml->uring != NULL)
+        return ml->uring->fd;
+#endif
+    return ml->epollfd;
+}
+
+
+static void poll_fd_move(mrp_io_watch_t *from, mrp_io_watch_t *to)
+{
+#ifdef IO_URING_ENABLED
+    if (from->poll != NULL) {
+        to->poll         = from->poll;
+        to->poll->master = to;
+        from->poll       = NULL;
+    }
+#else
+    MRP_UNUSED(from);
+    MRP_UNUSED(to);
+#endif
+}
+
+
 /*
  * I/O watches
  */
 
-static uint32_t epoll_event_mask(mrp_io_watch_t *master, mrp_io_watch_t *ignore)
+static uint32_t io_event_mask(mrp_io_watch_t *master, mrp_io_watch_t *ignore)
 {
     mrp_io_watch_t  *w;
     mrp_list_hook_t *p, *n;
@@ -374,16 +995,14 @@ static uint32_t epoll_event_mask(mrp_io_watch_t *master, mrp_io_watch_t *ignore)
 }
 
 
-static int epoll_add_slave(mrp_io_watch_t *master, mrp_io_watch_t *slave)
+static int io_watch_add_slave(mrp_io_watch_t *master, mrp_io_watch_t *slave)
 {
-    mrp_mainloop_t     *ml = master->ml;
-    struct epoll_event  evt;
+    mrp_mainloop_t *ml = master->ml;
+    uint32_t        mask;
 
-    evt.events   = epoll_event_mask(master, NULL) | slave->events;
-    evt.data.u64 = 0;
-    evt.data.fd  = master->fd;
+    mask = io_event_mask(master, NULL) | slave->events;
 
-    if (epoll_ctl(ml->epollfd, EPOLL_CTL_MOD, master->fd, &evt) == 0) {
+    if (poll_fd_mod(ml, master, mask) == 0) {
         mrp_list_append(&master->slave, &slave->slave);
 
         return 0;
@@ -393,18 +1012,13 @@ static int epoll_add_slave(mrp_io_watch_t *master, mrp_io_watch_t *slave)
 }
 
 
-static int epoll_add(mrp_io_watch_t *w)
+static int io_watch_add(mrp_io_watch_t *w)
 {
-    mrp_mainloop_t     *ml = w->ml;
-    mrp_io_watch_t     *master;
-    struct epoll_event  evt;
+    mrp_mainloop_t *ml = w->ml;
+    mrp_io_watch_t *master;
 
     if (fdtbl_insert(ml->fdtbl, w->fd, w) == 0) {
-        evt.events   = w->events;
-        evt.data.u64 = 0;                /* init full union for valgrind... */
-        evt.data.fd  = w->fd;
-
-        if (epoll_ctl(ml->epollfd, EPOLL_CTL_ADD, w->fd, &evt) == 0) {
+        if (poll_fd_add(ml, w, w->events) == 0) {
             mrp_list_append(&ml->iowatches, &w->hook);
             ml->niowatch++;
 
@@ -418,7 +1032,7 @@ static int epoll_add(mrp_io_watch_t *w)
             master = fdtbl_lookup(ml->fdtbl, w->fd);
 
             if (master != NULL)
-                return epoll_add_slave(master, w);
+                return io_watch_add_slave(master, w);
         }
     }
 
@@ -426,12 +1040,12 @@ static int epoll_add(mrp_io_watch_t *w)
 }
 
 
-static int epoll_del(mrp_io_watch_t *w)
+static int io_watch_del(mrp_io_watch_t *w)
 {
-    mrp_mainloop_t     *ml = w->ml;
-    mrp_io_watch_t     *master;
-    struct epoll_event  evt;
-    int                 status;
+    mrp_mainloop_t *ml = w->ml;
+    mrp_io_watch_t *master;
+    uint32_t        mask;
+    int             status;
 
     if (is_master(w))
         master = w;
@@ -439,24 +1053,22 @@ static int epoll_del(mrp_io_watch_t *w)
         master = fdtbl_lookup(ml->fdtbl, w->fd);
 
     if (master != NULL) {
-        evt.events   = epoll_event_mask(master, w);
-        evt.data.u64 = 0;                /* init full union for valgrind... */
-        evt.data.fd  = w->fd;
+        mask = io_event_mask(master, w);
 
-        if (evt.events == 0) {
+        if (mask == 0) {
             fdtbl_remove(ml->fdtbl, w->fd);
-            status = epoll_ctl(ml->epollfd, EPOLL_CTL_DEL, w->fd, &evt);
+            status = poll_fd_del(ml, master);
 
             if (status == 0 || (errno == EBADF || errno == ENOENT))
                 ml->niowatch--;
         }
         else
-            status = epoll_ctl(ml->epollfd, EPOLL_CTL_MOD, w->fd, &evt);
+            status = poll_fd_mod(ml, master, mask);
 
         if (status == 0 || (errno == EBADF || errno == ENOENT))
             return 0;
         else
-            mrp_log_error("Failed to update epoll for deleted I/O watch %p "
+            mrp_log_error("Failed to update polling for deleted I/O watch %p "
                           "(fd %d, %d: %s).", w, w->fd, errno, strerror(errno));
     }
     else {
@@ -484,13 +1096,14 @@ static int free_io_watch(void *ptr)
             /* relink first slave as new master to mainloop */
             master = mrp_list_entry(w->slave.next, typeof(*master), slave);
             mrp_list_append(&ml->iowatches, &master->hook);
+            poll_fd_move(w, master);
 
             fdtbl_insert(ml->fdtbl, master->fd, master);
         }
     }
 
     mrp_list_delete(&w->slave);
-    mrp_free(w);
+    mrp_objpool_free(w);
 
     return TRUE;
 }
@@ -505,7 +1118,7 @@ mrp_io_watch_t *mrp_add_io_watch(mrp_mainloop_t *ml, int fd,
     if (fd < 0 || cb == NULL)
         return NULL;
 
-    if ((w = mrp_allocz(sizeof(*w))) != NULL) {
+    if ((w = mrp_objpool_alloc(io_watch_pool)) != NULL) {
         mrp_list_init(&w->hook);
         mrp_list_init(&w->deleted);
         mrp_list_init(&w->slave);
@@ -516,8 +1129,8 @@ mrp_io_watch_t *mrp_add_io_watch(mrp_mainloop_t *ml, int fd,
         w->user_data = user_data;
         w->free      = free_io_watch;
 
-        if (epoll_add(w) != 0) {
-            mrp_free(w);
+        if (io_watch_add(w) != 0) {
+            mrp_objpool_free(w);
             w = NULL;
         }
     }
@@ -541,7 +1154,7 @@ void mrp_del_io_watch(mrp_io_watch_t *w)
         mark_deleted(w);
         w->events = 0;
 
-        epoll_del(w);
+        io_watch_del(w);
     }
 }
 
@@ -643,7 +1256,7 @@ static int free_timer(void *ptr)
 {
     mrp_timer_t *t = (mrp_timer_t *)ptr;
 
-    mrp_free(t);
+    mrp_objpool_free(t);
 
     return TRUE;
 }
@@ -658,7 +1271,7 @@ mrp_timer_t *mrp_add_timer(mrp_mainloop_t *ml, unsigned int msecs,
     if (cb == NULL)
         return NULL;
 
-    if ((t = mrp_allocz(sizeof(*t))) != NULL) {
+    if ((t = mrp_objpool_alloc(timer_pool)) != NULL) {
         mrp_list_init(&t->hook);
         mrp_list_init(&t->deleted);
         t->ml        = ml;
@@ -708,6 +1321,14 @@ mrp_mainloop_t *mrp_get_timer_mainloop(mrp_timer_t *t)
  * deferred/idle callbacks
  */
 
+static int free_deferred(void *ptr)
+{
+    mrp_objpool_free(ptr);
+
+    return TRUE;
+}
+
+
 mrp_deferred_t *mrp_add_deferred(mrp_mainloop_t *ml, mrp_deferred_cb_t cb,
                                  void *user_data)
 {
@@ -716,12 +1337,13 @@ mrp_deferred_t *mrp_add_deferred(mrp_mainloop_t *ml, mrp_deferred_cb_t cb,
     if (cb == NULL)
         return NULL;
 
-    if ((d = mrp_allocz(sizeof(*d))) != NULL) {
+    if ((d = mrp_objpool_alloc(deferred_pool)) != NULL) {
         mrp_list_init(&d->hook);
         mrp_list_init(&d->deleted);
         d->ml        = ml;
         d->cb        = cb;
         d->user_data = user_data;
+        d->free      = free_deferred;
 
         mrp_list_append(&ml->deferred, &d->hook);
     }
@@ -947,6 +1569,417 @@ mrp_mainloop_t *mrp_get_wakeup_mainloop(mrp_wakeup_t *w)
 }
 
 
+/*
+ * work offloaded to worker threads
+ */
+
+static void *work_thread(void *ptr)
+{
+    work_pool_t *wp  = (work_pool_t *)ptr;
+    uint64_t     one = 1;
+    mrp_work_t  *w;
+    int          notify;
+
+    pthread_mutex_lock(&wp->lock);
+
+    for (;;) {
+        while (!wp->stop && mrp_list_empty(&wp->queue)) {
+            wp->nidle++;
+            pthread_cond_wait(&wp->cond, &wp->lock);
+            wp->nidle--;
+        }
+
+        if (wp->stop)
+            break;
+
+        w = mrp_list_entry(wp->queue.next, typeof(*w), hook);
+        mrp_list_delete(&w->hook);
+
+        w->state   = WORK_RUNNING;
+        w->started = time_now();
+        wp->nqueued--;
+        wp->nrunning++;
+
+        pthread_mutex_unlock(&wp->lock);
+
+        w->work(w, w->user_data);
+
+        pthread_mutex_lock(&wp->lock);
+
+        w->finished = time_now();
+        w->state    = WORK_DONE;
+        wp->nrunning--;
+
+        notify = mrp_list_empty(&wp->done);
+        mrp_list_append(&wp->done, &w->hook);
+
+        if (notify)
+            while (write(wp->evfd, &one, sizeof(one)) < 0 && errno == EINTR)
+                ;
+    }
+
+    pthread_mutex_unlock(&wp->lock);
+
+    return NULL;
+}
+
+
+static void work_event_cb(mrp_io_watch_t *w, int fd, mrp_io_event_t events,
+                          void *user_data)
+{
+    work_pool_t *wp = (work_pool_t *)user_data;
+    uint64_t     cnt;
+
+    MRP_UNUSED(w);
+    MRP_UNUSED(events);
+
+    /*
+     * Notes: We only note here that we have completions to dispatch.
+     *        They get dispatched along with deferred callbacks during
+     *        the next iteration. Since the eventfd is cleared before the
+     *        completion list is checked, no wakeups can get lost.
+     */
+
+    while (read(fd, &cnt, sizeof(cnt)) < 0 && errno == EINTR)
+        ;
+
+    wp->pending = TRUE;
+}
+
+
+static int start_work_thread(work_pool_t *wp)
+{
+    sigset_t all, old;
+    int      status;
+
+    /* leave all signal handling to the mainloop thread */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    status = pthread_create(wp->threads + wp->nthread, NULL, work_thread, wp);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if (status != 0) {
+        mrp_log_error("Failed to create worker thread (%d: %s).",
+                      status, strerror(status));
+        return FALSE;
+    }
+
+    wp->nthread++;
+
+    return TRUE;
+}
+
+
+static work_pool_t *create_work_pool(mrp_mainloop_t *ml)
+{
+    work_pool_t *wp;
+
+    if ((wp = mrp_allocz(sizeof(*wp))) == NULL)
+        return NULL;
+
+    pthread_mutex_init(&wp->lock, NULL);
+    pthread_cond_init(&wp->cond, NULL);
+    mrp_list_init(&wp->queue);
+    mrp_list_init(&wp->done);
+    mrp_list_init(&wp->ready);
+
+    wp->evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (wp->evfd < 0)
+        goto fail;
+
+    wp->iow = mrp_add_io_watch(ml, wp->evfd, MRP_IO_EVENT_IN,
+                               work_event_cb, wp);
+
+    if (wp->iow == NULL)
+        goto fail;
+
+    ml->work_pool = wp;
+
+    return wp;
+
+ fail:
+    if (wp->evfd >= 0)
+        close(wp->evfd);
+    pthread_cond_destroy(&wp->cond);
+    pthread_mutex_destroy(&wp->lock);
+    mrp_free(wp);
+
+    return NULL;
+}
+
+
+static void free_work_list(mrp_list_hook_t *list)
+{
+    mrp_list_hook_t *p, *n;
+    mrp_work_t      *w;
+
+    mrp_list_foreach(list, p, n) {
+        w = mrp_list_entry(p, typeof(*w), hook);
+        mrp_list_delete(&w->hook);
+        mrp_free(w);
+    }
+}
+
+
+static void destroy_work_pool(mrp_mainloop_t *ml)
+{
+    work_pool_t *wp = ml->work_pool;
+    int          i;
+
+    if (wp == NULL)
+        return;
+
+    pthread_mutex_lock(&wp->lock);
+    wp->stop = TRUE;
+    pthread_cond_broadcast(&wp->cond);
+    pthread_mutex_unlock(&wp->lock);
+
+    for (i = 0; i < wp->nthread; i++)
+        pthread_join(wp->threads[i], NULL);
+
+    free_work_list(&wp->queue);
+    free_work_list(&wp->done);
+    free_work_list(&wp->ready);
+
+    mrp_del_io_watch(wp->iow);
+    close(wp->evfd);
+    pthread_cond_destroy(&wp->cond);
+    pthread_mutex_destroy(&wp->lock);
+
+    mrp_free(wp);
+    ml->work_pool = NULL;
+}
+
+
+static void ready_work(work_pool_t *wp, mrp_work_t *w)
+{
+    mrp_list_hook_t *p, *n;
+    mrp_work_t      *prev;
+
+    /* keep the ready list sorted, work mostly completes in order */
+    mrp_list_foreach_back(&wp->ready, p, n) {
+        prev = mrp_list_entry(p, typeof(*prev), hook);
+
+        if (prev->seqno < w->seqno) {
+            mrp_list_insert_after(p, &w->hook);
+            return;
+        }
+    }
+
+    mrp_list_prepend(&wp->ready, &w->hook);
+}
+
+
+static void dispatch_work(mrp_mainloop_t *ml)
+{
+    work_pool_t      *wp = ml->work_pool;
+    mrp_list_hook_t   done, *p, *n;
+    mrp_work_t       *w;
+    mrp_work_stats_t *st;
+    uint64_t          wait, run;
+    int               status;
+
+    if (wp == NULL || !wp->pending)
+        return;
+
+    wp->pending = FALSE;
+    st          = &wp->stats;
+
+    pthread_mutex_lock(&wp->lock);
+    if (!mrp_list_empty(&wp->done))
+        mrp_list_move(&done, &wp->done);
+    else
+        mrp_list_init(&done);
+    pthread_mutex_unlock(&wp->lock);
+
+    mrp_list_foreach(&done, p, n) {
+        w = mrp_list_entry(p, typeof(*w), hook);
+        mrp_list_delete(&w->hook);
+        ready_work(wp, w);
+    }
+
+    while (!mrp_list_empty(&wp->ready)) {
+        w = mrp_list_entry(wp->ready.next, typeof(*w), hook);
+
+        if (w->seqno != wp->next_done)
+            break;
+
+        mrp_list_delete(&w->hook);
+        wp->next_done++;
+
+        if (w->state == WORK_CANCELLED) {
+            status = ECANCELED;
+            st->ncancelled++;
+        }
+        else {
+            status = 0;
+            wait   = w->started  - w->queued;
+            run    = w->finished - w->started;
+
+            st->ndone++;
+            wp->wait_sum += wait;
+            wp->run_sum  += run;
+            st->wait_max  = MRP_MAX(st->wait_max, wait);
+            st->run_max   = MRP_MAX(st->run_max, run);
+        }
+
+        mrp_debug("dispatching work completion %p", w);
+        w->done(w, status, w->user_data);
+
+        /* the handle dies here, callers clear theirs in the callback */
+        mrp_free(w);
+
+        if (ml->quit) {
+            wp->pending = TRUE;
+            break;
+        }
+    }
+}
+
+
+static inline int pending_work(mrp_mainloop_t *ml)
+{
+    return ml->work_pool != NULL && ml->work_pool->pending;
+}
+
+
+int mrp_set_work_limits(mrp_mainloop_t *ml, int max_threads, int max_queued)
+{
+    if (max_threads <= 0 || max_threads > WORK_MAX_THREADS || max_queued <= 0) {
+        errno = EINVAL;
+        return FALSE;
+    }
+
+    ml->work_threads = max_threads;
+    ml->work_queued  = max_queued;
+
+    return TRUE;
+}
+
+
+mrp_work_t *mrp_add_work(mrp_mainloop_t *ml, mrp_work_cb_t work,
+                         mrp_work_done_cb_t done, void *user_data)
+{
+    work_pool_t *wp;
+    mrp_work_t  *w;
+
+    /* the completion callback is the only way to learn the handle died */
+    if (work == NULL || done == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if ((wp = ml->work_pool) == NULL && (wp = create_work_pool(ml)) == NULL)
+        return NULL;
+
+    if ((w = mrp_allocz(sizeof(*w))) == NULL)
+        return NULL;
+
+    mrp_list_init(&w->hook);
+    w->ml        = ml;
+    w->work      = work;
+    w->done      = done;
+    w->user_data = user_data;
+    w->state     = WORK_QUEUED;
+    w->queued    = time_now();
+
+    pthread_mutex_lock(&wp->lock);
+
+    if (wp->nqueued >= ml->work_queued) {
+        pthread_mutex_unlock(&wp->lock);
+        mrp_free(w);
+        errno = EAGAIN;
+        return NULL;
+    }
+
+    if (wp->nidle < wp->nqueued + 1 && wp->nthread < ml->work_threads)
+        start_work_thread(wp);
+
+    if (wp->nthread == 0) {
+        pthread_mutex_unlock(&wp->lock);
+        mrp_free(w);
+        errno = EAGAIN;
+        return NULL;
+    }
+
+    w->seqno = wp->next_seqno++;
+    mrp_list_append(&wp->queue, &w->hook);
+    wp->nqueued++;
+    pthread_cond_signal(&wp->cond);
+
+    wp->stats.nadded++;
+    wp->stats.max_queued = MRP_MAX(wp->stats.max_queued, wp->nqueued);
+
+    pthread_mutex_unlock(&wp->lock);
+
+    mrp_debug("added work %p (#%llu)", w, (unsigned long long)w->seqno);
+
+    return w;
+}
+
+
+int mrp_cancel_work(mrp_work_t *w)
+{
+    work_pool_t *wp;
+    int          cancelled;
+
+    if (w == NULL || (wp = w->ml->work_pool) == NULL)
+        return FALSE;
+
+    pthread_mutex_lock(&wp->lock);
+
+    if (w->state == WORK_QUEUED) {
+        mrp_list_delete(&w->hook);
+        w->state  = WORK_CANCELLED;
+        wp->nqueued--;
+        cancelled = TRUE;
+    }
+    else
+        cancelled = FALSE;
+
+    pthread_mutex_unlock(&wp->lock);
+
+    if (cancelled) {
+        mrp_debug("cancelled work %p", w);
+        ready_work(wp, w);
+        wp->pending = TRUE;
+    }
+
+    return cancelled;
+}
+
+
+mrp_mainloop_t *mrp_get_work_mainloop(mrp_work_t *w)
+{
+    return w ? w->ml : NULL;
+}
+
+
+void mrp_get_work_stats(mrp_mainloop_t *ml, mrp_work_stats_t *stats)
+{
+    work_pool_t *wp = ml->work_pool;
+
+    if (wp == NULL) {
+        mrp_clear(stats);
+        return;
+    }
+
+    pthread_mutex_lock(&wp->lock);
+    *stats          = wp->stats;
+    stats->nthread  = wp->nthread;
+    stats->nidle    = wp->nidle;
+    stats->nqueued  = wp->nqueued;
+    stats->nrunning = wp->nrunning;
+    pthread_mutex_unlock(&wp->lock);
+
+    if (stats->ndone > 0) {
+        stats->wait_avg = wp->wait_sum / stats->ndone;
+        stats->run_avg  = wp->run_sum  / stats->ndone;
+    }
+}
+
+
 /*
  * external mainloops we pump
  */
@@ -1144,7 +2177,7 @@ int mrp_set_superloop(mrp_mainloop_t *ml, mrp_superloop_ops_t *ops,
         mrp_mainloop_prepare(ml);
 
         events    = MRP_IO_EVENT_IN | MRP_IO_EVENT_OUT | MRP_IO_EVENT_HUP;
-        ml->iow   = ops->add_io(ml->super_data, ml->epollfd, events,
+        ml->iow   = ops->add_io(ml->super_data, poll_fd(ml), events,
                                 super_io_cb, ml);
         ml->work  = ops->add_defer(ml->super_data, super_work_cb, ml);
 
@@ -1231,10 +2264,10 @@ static void purge_io_watches(mrp_mainloop_t *ml)
         mrp_list_foreach(&w->slave, sp, sn) {
             s = mrp_list_entry(sp, typeof(*s), slave);
             mrp_list_delete(&s->slave);
-            mrp_free(s);
+            mrp_objpool_free(s);
         }
 
-        mrp_free(w);
+        mrp_objpool_free(w);
     }
 }
 
@@ -1248,7 +2281,7 @@ static void purge_timers(mrp_mainloop_t *ml)
         t = mrp_list_entry(p, typeof(*t), hook);
         mrp_list_delete(&t->hook);
         mrp_list_delete(&t->deleted);
-        mrp_free(t);
+        mrp_objpool_free(t);
     }
 }
 
@@ -1262,14 +2295,14 @@ static void purge_deferred(mrp_mainloop_t *ml)
         d = mrp_list_entry(p, typeof(*d), hook);
         mrp_list_delete(&d->hook);
         mrp_list_delete(&d->deleted);
-        mrp_free(d);
+        mrp_objpool_free(d);
     }
 
     mrp_list_foreach(&ml->inactive_deferred, p, n) {
         d = mrp_list_entry(p, typeof(*d), hook);
         mrp_list_delete(&d->hook);
         mrp_list_delete(&d->deleted);
-        mrp_free(d);
+        mrp_objpool_free(d);
     }
 }
 
@@ -1340,16 +2373,316 @@ static void purge_subloops(mrp_mainloop_t *ml)
 }
 
 
+/*
+ * callback profiling
+ */
+
+static void purge_profiles(mrp_mainloop_t *ml)
+{
+    mrp_list_hook_t *p, *n;
+    cbprof_t        *prof;
+
+    mrp_list_foreach(&ml->profiles, p, n) {
+        prof = mrp_list_entry(p, typeof(*prof), hook);
+        mrp_list_delete(&prof->hook);
+        mrp_free(prof->name);
+        mrp_free(prof);
+    }
+}
+
+
+static cbprof_t *lookup_profile(mrp_mainloop_t *ml, mrp_callback_type_t type,
+                                void *cb)
+{
+    mrp_list_hook_t *p, *n;
+    cbprof_t        *prof;
+
+    mrp_list_foreach(&ml->profiles, p, n) {
+        prof = mrp_list_entry(p, typeof(*prof), hook);
+
+        if (prof->cb == cb && prof->type == type)
+            return prof;
+    }
+
+    if ((prof = mrp_allocz(sizeof(*prof))) != NULL) {
+        mrp_list_init(&prof->hook);
+        prof->type = type;
+        prof->cb   = cb;
+
+        mrp_list_append(&ml->profiles, &prof->hook);
+    }
+
+    return prof;
+}
+
+
+static const char *callback_name(void *cb, char *buf, size_t size)
+{
+    Dl_info     info;
+    const char *module, *func, *file;
+
+    /*
+     * Notes:
+     *     We first try the function tables of the debug infra, which
+     *     also give us the source file. These only resolve functions
+     *     visible to the dynamic linker, so for anything else we fall
+     *     back to dladdr and eventually to module+offset which can be
+     *     fed to addr2line.
+     */
+
+    if ((func = mrp_debug_address_function(cb, &file)) != NULL)
+        snprintf(buf, size, "%s (%s)", func, file);
+    else if (dladdr(cb, &info) != 0) {
+        module = info.dli_fname ? strrchr(info.dli_fname, '/') : NULL;
+        module = module ? module + 1 : info.dli_fname;
+
+        if (info.dli_sname != NULL && info.dli_saddr == cb)
+            snprintf(buf, size, "%s (%s)", info.dli_sname,
+                     module ? module : "?");
+        else
+            snprintf(buf, size, "%s+%#lx", module ? module : "?",
+                     (unsigned long)(cb - info.dli_fbase));
+    }
+    else
+        snprintf(buf, size, "%p", cb);
+
+    return buf;
+}
+
+
+static const char *profile_name(cbprof_t *prof)
+{
+    char buf[256];
+
+    if (prof->name != NULL)
+        return prof->name;
+
+    prof->name = mrp_strdup(callback_name(prof->cb, buf, sizeof(buf)));
+
+    return prof->name ? prof->name : "<unknown>";
+}
+
+
+static void profile_done(mrp_mainloop_t *ml, cbprof_t **profp,
+                         mrp_callback_type_t type, void *cb, uint64_t start)
+{
+    static const char *types[] = {
+        [MRP_CALLBACK_IO]       = "I/O",
+        [MRP_CALLBACK_TIMER]    = "timer",
+        [MRP_CALLBACK_DEFERRED] = "deferred",
+        [MRP_CALLBACK_SUBLOOP]  = "subloop",
+    };
+
+    cbprof_t *prof;
+    uint64_t  diff;
+
+    diff = time_now() - start;
+
+    if ((prof = *profp) == NULL || prof->cb != cb) {
+        if ((prof = *profp = lookup_profile(ml, type, cb)) == NULL)
+            return;
+    }
+
+    prof->count++;
+    prof->total += diff;
+
+    if (diff > prof->max)
+        prof->max = diff;
+
+    if (ml->slow_usecs && diff >= ml->slow_usecs)
+        mrp_log_warning("Slow %s callback %s blocked mainloop for %llu usecs.",
+                        types[type], profile_name(prof),
+                        (unsigned long long)diff);
+}
+
+
+/*
+ * Run a callback of the given object, profiling it if enabled. The
+ * callback pointer is saved upfront as the callback might delete its
+ * own object.
+ */
+
+#define PROFILED_CALL(ml, o, type, cb, ...) do {                        \
+        if (MRP_UNLIKELY((ml)->profile)) {                              \
+            void     *_cb    = (void *)(cb);                            \
+            uint64_t  _start = time_now();                              \
+                                                                        \
+            __VA_ARGS__;                                                \
+            profile_done((ml), &(o)->prof, (type), _cb, _start);        \
+        }                                                               \
+        else {                                                          \
+            __VA_ARGS__;                                                \
+        }                                                               \
+    } while (0)
+
+
+void mrp_mainloop_profile(mrp_mainloop_t *ml, int enable)
+{
+    ml->profile = !!enable;
+}
+
+
+int mrp_mainloop_profiling(mrp_mainloop_t *ml)
+{
+    return ml->profile;
+}
+
+
+void mrp_mainloop_set_slow_threshold(mrp_mainloop_t *ml, unsigned int usecs)
+{
+    ml->slow_usecs = usecs;
+}
+
+
+unsigned int mrp_mainloop_get_slow_threshold(mrp_mainloop_t *ml)
+{
+    return ml->slow_usecs;
+}
+
+
+void mrp_mainloop_reset_profile(mrp_mainloop_t *ml)
+{
+    mrp_list_hook_t *p, *n;
+    cbprof_t        *prof;
+
+    /* profiles are cached by watches, so zero them instead of freeing */
+    mrp_list_foreach(&ml->profiles, p, n) {
+        prof = mrp_list_entry(p, typeof(*prof), hook);
+        prof->count = 0;
+        prof->total = 0;
+        prof->max   = 0;
+    }
+}
+
+
+int mrp_mainloop_top_callbacks(mrp_mainloop_t *ml, int by_max,
+                               mrp_callback_stat_t *stats, int nstat)
+{
+    mrp_list_hook_t *p, *n;
+    cbprof_t        *prof;
+    uint64_t         key;
+    int              cnt, i;
+
+    cnt = 0;
+
+    mrp_list_foreach(&ml->profiles, p, n) {
+        prof = mrp_list_entry(p, typeof(*prof), hook);
+
+        if (!prof->count)
+            continue;
+
+        key = by_max ? prof->max : prof->total;
+
+        /* insertion sort into the (short) result array */
+        for (i = cnt; i > 0; i--) {
+            if ((by_max ? stats[i-1].max : stats[i-1].total) >= key)
+                break;
+            if (i < nstat)
+                stats[i] = stats[i-1];
+        }
+
+        if (i >= nstat)
+            continue;
+
+        stats[i].type  = prof->type;
+        stats[i].name  = profile_name(prof);
+        stats[i].count = prof->count;
+        stats[i].total = prof->total;
+        stats[i].max   = prof->max;
+
+        if (cnt < nstat)
+            cnt++;
+    }
+
+    return cnt;
+}
+
+
+static mrp_mainloop_backend_t default_backend(void)
+{
+    const char *backend = getenv(MRP_MAINLOOP_BACKEND_ENVVAR);
+
+    if (backend != NULL) {
+        if (!strcmp(backend, "io_uring") || !strcmp(backend, "io-uring"))
+            return MRP_MAINLOOP_BACKEND_IO_URING;
+        if (strcmp(backend, "epoll"))
+            mrp_log_warning("Unknown mainloop backend '%s', using epoll.",
+                            backend);
+    }
+
+    return MRP_MAINLOOP_BACKEND_EPOLL;
+}
+
+
+static int create_poller(mrp_mainloop_t *ml, mrp_mainloop_backend_t backend)
+{
+    if (backend == MRP_MAINLOOP_BACKEND_DEFAULT)
+        backend = default_backend();
+
+    if (backend == MRP_MAINLOOP_BACKEND_IO_URING) {
+#ifdef IO_URING_ENABLED
+        if ((ml->uring = uring_create()) != NULL) {
+            ml->backend = MRP_MAINLOOP_BACKEND_IO_URING;
+            ml->epollfd = -1;
+
+            return TRUE;
+        }
+#endif
+        mrp_log_info("io_uring is not available, falling back to epoll.");
+    }
+
+    ml->backend = MRP_MAINLOOP_BACKEND_EPOLL;
+    ml->epollfd = epoll_create1(EPOLL_CLOEXEC);
+
+    return ml->epollfd >= 0;
+}
+
+
+static void destroy_poller(mrp_mainloop_t *ml)
+{
+#ifdef IO_URING_ENABLED
+    uring_destroy(ml->uring);
+    ml->uring = NULL;
+#endif
+    close(ml->epollfd);
+    ml->epollfd = -1;
+}
+
+
 mrp_mainloop_t *mrp_mainloop_create(void)
+{
+    return mrp_mainloop_create_backend(MRP_MAINLOOP_BACKEND_DEFAULT);
+}
+
+
+static void trim_pools_cb(mrp_deferred_t *d, void *user_data)
+{
+    int n;
+
+    MRP_UNUSED(user_data);
+
+    mrp_disable_deferred(d);
+
+    if ((n = mrp_objpool_trim_all()) > 0)
+        mrp_debug("released %d idle object pool chunks", n);
+}
+
+
+mrp_mainloop_t *mrp_mainloop_create_backend(mrp_mainloop_backend_t backend)
 {
     mrp_mainloop_t *ml;
 
+    pthread_once(&pools_once, create_pools);
+
+    if (io_watch_pool == NULL || timer_pool == NULL || deferred_pool == NULL)
+        return NULL;
+
     if ((ml = mrp_allocz(sizeof(*ml))) != NULL) {
-        ml->epollfd = epoll_create1(EPOLL_CLOEXEC);
+        ml->epollfd = -1;
         ml->sigfd   = -1;
         ml->fdtbl   = fdtbl_create();
 
-        if (ml->epollfd >= 0 && ml->fdtbl != NULL) {
+        if (create_poller(ml, backend) && ml->fdtbl != NULL) {
             mrp_list_init(&ml->iowatches);
             mrp_list_init(&ml->timers);
             mrp_list_init(&ml->deferred);
@@ -1358,15 +2691,22 @@ mrp_mainloop_t *mrp_mainloop_create(void)
             mrp_list_init(&ml->wakeups);
             mrp_list_init(&ml->deleted);
             mrp_list_init(&ml->subloops);
+            mrp_list_init(&ml->profiles);
+
+            ml->work_threads = WORK_DEF_THREADS;
+            ml->work_queued  = WORK_DEF_QUEUED;
 
-            if (!setup_sighandlers(ml)) {
-                close(ml->epollfd);
+            if (!setup_sighandlers(ml))
                 goto fail;
-            }
+
+            if ((ml->trim = mrp_add_deferred(ml, trim_pools_cb, NULL)) == NULL)
+                goto fail;
+
+            mrp_disable_deferred(ml->trim);
         }
         else {
         fail:
-            close(ml->epollfd);
+            destroy_poller(ml);
             fdtbl_destroy(ml->fdtbl);
             mrp_free(ml);
             ml = NULL;
@@ -1377,10 +2717,17 @@ mrp_mainloop_t *mrp_mainloop_create(void)
 }
 
 
+mrp_mainloop_backend_t mrp_mainloop_get_backend(mrp_mainloop_t *ml)
+{
+    return ml->backend;
+}
+
+
 void mrp_mainloop_destroy(mrp_mainloop_t *ml)
 {
     if (ml != NULL) {
         mrp_clear_superloop(ml);
+        destroy_work_pool(ml);
         purge_io_watches(ml);
         purge_timers(ml);
         purge_deferred(ml);
@@ -1388,9 +2735,10 @@ void mrp_mainloop_destroy(mrp_mainloop_t *ml)
         purge_wakeups(ml);
         purge_subloops(ml);
         purge_deleted(ml);
+        purge_profiles(ml);
 
         close(ml->sigfd);
-        close(ml->epollfd);
+        destroy_poller(ml);
         fdtbl_destroy(ml->fdtbl);
 
         mrp_free(ml->events);
@@ -1571,7 +2919,7 @@ int mrp_mainloop_prepare(mrp_mainloop_t *ml)
     int          timeout, ext_timeout;
     uint64_t     now;
 
-    if (!mrp_list_empty(&ml->deferred)) {
+    if (!mrp_list_empty(&ml->deferred) || pending_work(ml)) {
         timeout = 0;
     }
     else {
@@ -1595,13 +2943,19 @@ int mrp_mainloop_prepare(mrp_mainloop_t *ml)
     else
         ml->poll_timeout = timeout;
 
-    if (ml->nevent < ml->niowatch) {
+    if (ml->uring == NULL && ml->nevent < ml->niowatch) {
         ml->nevent = ml->niowatch;
         ml->events = mrp_realloc(ml->events, ml->nevent * sizeof(*ml->events));
 
         MRP_ASSERT(ml->events != NULL, "can't allocate epoll event buffer");
     }
 
+#ifdef IO_URING_ENABLED
+    /* under a superloop nobody else submits our queued requests */
+    if (ml->uring != NULL && ml->super_ops != NULL)
+        uring_submit(ml->uring);
+#endif
+
     mrp_debug("mainloop %p prepared: %d I/O watches, timeout %d", ml,
               ml->niowatch, ml->poll_timeout);
 
@@ -1615,6 +2969,16 @@ int mrp_mainloop_prepare(mrp_mainloop_t *ml)
 
     timeout = may_block ? ml->poll_timeout : 0;
 
+#ifdef IO_URING_ENABLED
+    if (ml->uring != NULL) {
+        n = uring_wait(ml->uring, timeout);
+
+        mrp_debug("mainloop %p has %d I/O events waiting", ml, n);
+
+        ml->poll_result = n;
+    }
+    else
+#endif
     if (ml->nevent > 0) {
         n = epoll_wait(ml->epollfd, ml->events, ml->nevent, timeout);
 
@@ -1724,7 +3088,8 @@ static void dispatch_deferred(mrp_mainloop_t *ml)
 
         if (!is_deleted(d) && !d->inactive) {
             mrp_debug("dispatching active deferred cb %p", d);
-            d->cb(d, d->user_data);
+            PROFILED_CALL(ml, d, MRP_CALLBACK_DEFERRED, d->cb,
+                          d->cb(d, d->user_data));
         }
         else
             mrp_debug("skipping %s deferred cb %p",
@@ -1754,7 +3119,8 @@ static void dispatch_timers(mrp_mainloop_t *ml)
             if (t->expire <= now) {
                 mrp_debug("dispatching expired timer %p", t);
 
-                t->cb(t, t->user_data);
+                PROFILED_CALL(ml, t, MRP_CALLBACK_TIMER, t->cb,
+                              t->cb(t, t->user_data));
 
                 if (!is_deleted(t))
                     rearm_timer(t);
@@ -1785,7 +3151,8 @@ static void dispatch_subloops(mrp_mainloop_t *ml)
             if (sl->cb->check(sl->user_data, sl->pollfds,
                               sl->npollfd)) {
                 mrp_debug("dispatching subloop %p", sl);
-                sl->cb->dispatch(sl->user_data);
+                PROFILED_CALL(ml, sl, MRP_CALLBACK_SUBLOOP, sl->cb->dispatch,
+                              sl->cb->dispatch(sl->user_data));
             }
             else
                 mrp_debug("skipping subloop %p, check said no", sl);
@@ -1794,13 +3161,13 @@ static void dispatch_subloops(mrp_mainloop_t *ml)
 }
 
 
-static void dispatch_slaves(mrp_io_watch_t *w, struct epoll_event *e)
+static void dispatch_slaves(mrp_io_watch_t *w, uint32_t mask)
 {
     mrp_io_watch_t  *s;
     mrp_list_hook_t *p, *n;
     mrp_io_event_t   events;
 
-    events = e->events & ~(MRP_IO_EVENT_INOUT & w->events);
+    events = mask & ~(MRP_IO_EVENT_INOUT & w->events);
 
     mrp_list_foreach(&w->slave, p, n) {
         if (events == MRP_IO_EVENT_NONE)
@@ -1810,7 +3177,8 @@ static void dispatch_slaves(mrp_io_watch_t *w, struct epoll_event *e)
 
         if (!is_deleted(s)) {
             mrp_debug("dispatching slave I/O watch %p (fd %d)", s, s->fd);
-            s->cb(s, s->fd, events, s->user_data);
+            PROFILED_CALL(s->ml, s, MRP_CALLBACK_IO, s->cb,
+                          s->cb(s, s->fd, events, s->user_data));
         }
         else
             mrp_debug("skipping slave I/O watch %p (fd %d)", s, s->fd);
@@ -1820,7 +3188,138 @@ static void dispatch_slaves(mrp_io_watch_t *w, struct epoll_event *e)
 }
 
 
-static void dispatch_poll_events(mrp_mainloop_t *ml)
+static void io_callback_timed(mrp_io_watch_t *w, uint32_t mask)
+{
+    char     name[256], label[300];
+    uint64_t start;
+
+    /*
+     * Notes:
+     *     Watches are keyed by their callback, not by their fd. Metrics
+     *     are never released, so per-fd series would pile up with every
+     *     new connection, and reused fds would mix unrelated watches.
+     *     The set of I/O callbacks is fixed and so is this set of series.
+     */
+
+    if (MRP_UNLIKELY(w->metric == NULL)) {
+        snprintf(label, sizeof(label), "callback=%s",
+                 callback_name((void *)w->cb, name, sizeof(name)));
+        w->metric = mrp_metric_histogram("mainloop_io_callback_usecs", label,
+                                         "I/O watch callback time by "
+                                         "callback in microseconds");
+    }
+
+    start = mrp_metric_now();
+    PROFILED_CALL(w->ml, w, MRP_CALLBACK_IO, w->cb,
+                  w->cb(w, w->fd, mask, w->user_data));
+    mrp_metric_since(w->metric, start);
+}
+
+
+static void dispatch_io_event(mrp_mainloop_t *ml, mrp_io_watch_t *w,
+                              uint32_t mask)
+{
+    if (!is_deleted(w)) {
+        mrp_debug("dispatching I/O watch %p (fd %d)", w, w->fd);
+
+        if (mrp_metrics_on)
+            io_callback_timed(w, mask);
+        else
+            PROFILED_CALL(ml, w, MRP_CALLBACK_IO, w->cb,
+                          w->cb(w, w->fd, mask, w->user_data));
+    }
+    else
+        mrp_debug("skipping delete I/O watch %p (fd %d)", w, w->fd);
+
+    if (!mrp_list_empty(&w->slave))
+        dispatch_slaves(w, mask);
+
+    if (mask & EPOLLRDHUP) {
+        if (poll_fd_del(ml, w) < 0 && (errno != EBADF && errno != ENOENT))
+            mrp_log_error("Failed to stop polling fd %d (%d: %s).",
+                          w->fd, errno, strerror(errno));
+        fdtbl_remove(ml->fdtbl, w->fd);
+    }
+    else {
+        if ((mask & EPOLLHUP) && !is_deleted(w)) {
+            /*
+             * Notes:
+             *
+             *    If the user does not react to EPOLLHUPs delivered
+             *    we stop monitoring the fd to avoid sitting in an
+             *    infinite busy loop just delivering more EPOLLHUP
+             *    notifications...
+             */
+
+            if (w->wrhup++ > 5) {
+                if (poll_fd_del(ml, w) < 0 &&
+                    (errno != EBADF && errno != ENOENT))
+                    mrp_log_error("Failed to stop polling fd %d (%d: %s).",
+                                  w->fd, errno,strerror(errno));
+                fdtbl_remove(ml->fdtbl, w->fd);
+            }
+        }
+    }
+}
+
+
+#ifdef IO_URING_ENABLED
+
+static void dispatch_uring_events(mrp_mainloop_t *ml)
+{
+    uring_t             *u = ml->uring;
+    struct io_uring_cqe *cqe;
+    uring_poll_t        *p;
+    unsigned             head, tail;
+    int                  res;
+
+    head = *u->cq_head;
+    tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+
+    while (head != tail && !ml->quit) {
+        cqe  = u->cqes + (head & u->cq_mask);
+        p    = (uring_poll_t *)(ptrdiff_t)cqe->user_data;
+        res  = cqe->res;
+
+        __atomic_store_n(u->cq_head, ++head, __ATOMIC_RELEASE);
+
+        if (p == NULL)                   /* completion of a cancellation */
+            continue;
+
+        p->pending--;
+        p->busy = TRUE;
+
+        if (p->master == NULL)
+            mrp_debug("ignoring event for deleted fd %d", p->fd);
+        else {
+            if (res > 0)
+                dispatch_io_event(ml, p->master, (uint32_t)res);
+            else if (res < 0 && res != -ECANCELED) {
+                mrp_log_error("Failed to poll fd %d (%d: %s).", p->fd,
+                              -res, strerror(-res));
+                fdtbl_remove(ml->fdtbl, p->fd);
+                uring_fd_del(ml, p->master);
+            }
+        }
+
+        p->busy = FALSE;
+
+        if (p->pending == 0) {
+            if (p->master == NULL)
+                uring_poll_free(p);
+            else {
+                if (uring_poll_arm(ml, p, FALSE) < 0)
+                    mrp_log_error("Failed to rearm polling for fd %d.",
+                                  p->fd);
+            }
+        }
+    }
+}
+
+#endif /* IO_URING_ENABLED */
+
+
+static void dispatch_epoll_events(mrp_mainloop_t *ml)
 {
     struct epoll_event *e;
     mrp_io_watch_t     *w;
@@ -1835,47 +3334,22 @@ static void dispatch_poll_events(mrp_mainloop_t *ml)
             continue;
         }
 
-        if (!is_deleted(w)) {
-            mrp_debug("dispatching I/O watch %p (fd %d)", w, fd);
-            w->cb(w, w->fd, e->events, w->user_data);
-        }
-        else
-            mrp_debug("skipping delete I/O watch %p (fd %d)", w, fd);
-
-        if (!mrp_list_empty(&w->slave))
-            dispatch_slaves(w, e);
-
-        if (e->events & EPOLLRDHUP) {
-            if (epoll_ctl(ml->epollfd, EPOLL_CTL_DEL, w->fd, e) < 0 &&
-                (errno != EBADF && errno != ENOENT))
-                mrp_log_error("Failed to delete fd %d from epoll "
-                              "(%d: %s).", w->fd, errno, strerror(errno));
-            fdtbl_remove(ml->fdtbl, w->fd);
-        }
-        else {
-            if ((e->events & EPOLLHUP) && !is_deleted(w)) {
-                /*
-                 * Notes:
-                 *
-                 *    If the user does not react to EPOLLHUPs delivered
-                 *    we stop monitoring the fd to avoid sitting in an
-                 *    infinite busy loop just delivering more EPOLLHUP
-                 *    notifications...
-                 */
-
-                if (w->wrhup++ > 5) {
-                    if (epoll_ctl(ml->epollfd, EPOLL_CTL_DEL, w->fd, e) < 0 &&
-                        (errno != EBADF && errno != ENOENT))
-                        mrp_log_error("Failed to EPOLL_CTL_DEL fd %d (%d: %s).",
-                                      w->fd, errno,strerror(errno));
-                    fdtbl_remove(ml->fdtbl, w->fd);
-                }
-            }
-        }
+        dispatch_io_event(ml, w, e->events);
 
         if (ml->quit)
             break;
     }
+}
+
+
+static void dispatch_poll_events(mrp_mainloop_t *ml)
+{
+#ifdef IO_URING_ENABLED
+    if (ml->uring != NULL)
+        dispatch_uring_events(ml);
+    else
+#endif
+        dispatch_epoll_events(ml);
 
     if (ml->quit)
         return;
@@ -1884,28 +3358,111 @@ static void dispatch_poll_events(mrp_mainloop_t *ml)
 }
 
 
+/*
+ * dispatch phase metrics
+ */
+
+typedef enum {
+    PHASE_WAKEUP = 0,
+    PHASE_DEFERRED,
+    PHASE_WORK,
+    PHASE_TIMERS,
+    PHASE_IO,
+    PHASE_MAX
+} dispatch_phase_t;
+
+
+static uint64_t phase_done(dispatch_phase_t phase, uint64_t start)
+{
+    static const char *labels[] = {
+        [PHASE_WAKEUP]   = "phase=wakeup",
+        [PHASE_DEFERRED] = "phase=deferred",
+        [PHASE_WORK]     = "phase=work",
+        [PHASE_TIMERS]   = "phase=timers",
+        [PHASE_IO]       = "phase=io",
+    };
+    static mrp_metric_t *metrics[PHASE_MAX];
+
+    uint64_t now;
+
+    if (MRP_UNLIKELY(metrics[phase] == NULL))
+        metrics[phase] = mrp_metric_histogram("mainloop_dispatch_usecs",
+                                              labels[phase],
+                                              "mainloop dispatch time by "
+                                              "phase in microseconds");
+
+    now = mrp_metric_now();
+    mrp_metric_observe(metrics[phase], now - start);
+
+    return now;
+}
+
+
 int mrp_mainloop_dispatch(mrp_mainloop_t *ml)
 {
+    static mrp_metric_t *iteration;
+
+    uint64_t begin, start;
+    int      timed;
+
+    if ((timed = mrp_metrics_on)) {
+        if (MRP_UNLIKELY(iteration == NULL))
+            iteration = mrp_metric_histogram("mainloop_iteration_usecs", NULL,
+                                             "mainloop dispatch time per "
+                                             "iteration in microseconds");
+        begin = start = mrp_metric_now();
+    }
+    else
+        begin = start = 0;
+
     dispatch_wakeup(ml);
 
+    if (timed)
+        start = phase_done(PHASE_WAKEUP, start);
+
     if (ml->quit)
         goto quit;
 
     dispatch_deferred(ml);
 
+    if (timed)
+        start = phase_done(PHASE_DEFERRED, start);
+
+    if (ml->quit)
+        goto quit;
+
+    dispatch_work(ml);
+
+    if (timed)
+        start = phase_done(PHASE_WORK, start);
+
     if (ml->quit)
         goto quit;
 
     dispatch_timers(ml);
 
+    if (timed)
+        start = phase_done(PHASE_TIMERS, start);
+
     if (ml->quit)
         goto quit;
 
     dispatch_poll_events(ml);
 
+    if (timed)
+        phase_done(PHASE_IO, start);
+
  quit:
     purge_deleted(ml);
 
+    /* release surplus object pool memory once we've been idle */
+    if (ml->poll_timeout != 0 && ml->poll_result == 0 &&
+        mrp_objpool_trim_pending())
+        mrp_enable_deferred(ml->trim);
+
+    if (timed)
+        mrp_metric_since(iteration, begin);
+
     return !ml->quit;
 }
 
@@ -30,6 +30,7 @@
 #ifndef __MURPHY_MAINLOOP_H__
 #define __MURPHY_MAINLOOP_H__
 
+#include <stdint.h>
 #include <signal.h>
 #include <sys/poll.h>
 #include <sys/epoll.h>
@@ -118,6 +119,67 @@ void mrp_enable_deferred(mrp_deferred_t *d);
 mrp_mainloop_t *mrp_get_deferred_mainloop(mrp_deferred_t *d);
 
 
+/*
+ * work offloaded to worker threads
+ *
+ * Work callbacks are run in one of a bounded number of worker threads.
+ * They must not touch the mainloop or any other non-thread-safe state,
+ * including memory allocation by mrp_alloc when the debugging allocator
+ * is active. Completion callbacks are invoked from the mainloop, next to
+ * deferred callbacks, in the order the work was added. Work that gets
+ * cancelled before it is started completes with status ECANCELED.
+ *
+ * A completion callback is mandatory. The work handle is freed as soon
+ * as it returns, so callers that keep the handle around must clear their
+ * reference in the completion callback and must not use it afterwards.
+ */
+
+typedef struct mrp_work_s mrp_work_t;
+
+/** Work callback type, invoked in a worker thread. */
+typedef void (*mrp_work_cb_t)(mrp_work_t *w, void *user_data);
+
+/** Work completion callback type, invoked in the mainloop. */
+typedef void (*mrp_work_done_cb_t)(mrp_work_t *w, int status,
+                                   void *user_data);
+
+/** Work queue statistics. */
+typedef struct {
+    int      nthread;                    /* worker threads started */
+    int      nidle;                      /* idle worker threads */
+    int      nqueued;                    /* work currently queued */
+    int      nrunning;                   /* work currently running */
+    int      max_queued;                 /* maximum queue depth seen */
+    uint64_t nadded;                     /* work added */
+    uint64_t ndone;                      /* work completed */
+    uint64_t ncancelled;                 /* work cancelled */
+    uint64_t wait_avg;                   /* average time queued (usecs) */
+    uint64_t wait_max;                   /* maximum time queued (usecs) */
+    uint64_t run_avg;                    /* average time running (usecs) */
+    uint64_t run_max;                    /* maximum time running (usecs) */
+} mrp_work_stats_t;
+
+/** Set the maximum number of worker threads and queued work. */
+int mrp_set_work_limits(mrp_mainloop_t *ml, int max_threads, int max_queued);
+
+/** Add work to be done in a worker thread, done must not be NULL. */
+mrp_work_t *mrp_add_work(mrp_mainloop_t *ml, mrp_work_cb_t work,
+                         mrp_work_done_cb_t done, void *user_data);
+
+/**
+ * Cancel work that has not been started yet. Returns FALSE if the work
+ * has already started, finished or been cancelled. Must not be called
+ * once the completion callback of the work has returned.
+ */
+int mrp_cancel_work(mrp_work_t *w);
+
+/** Get the mainloop of work. */
+mrp_mainloop_t *mrp_get_work_mainloop(mrp_work_t *w);
+
+/** Get work queue statistics of the given mainloop. */
+void mrp_get_work_stats(mrp_mainloop_t *ml, mrp_work_stats_t *stats);
+
+
 /*
  * signals
  */
@@ -228,9 +290,25 @@ int mrp_mainloop_unregister(mrp_mainloop_t *ml);
  * mainloop
  */
 
+/** Polling backends a mainloop can use for I/O watches. */
+typedef enum {
+    MRP_MAINLOOP_BACKEND_DEFAULT = 0,    /* environment or epoll */
+    MRP_MAINLOOP_BACKEND_EPOLL,          /* epoll(7) */
+    MRP_MAINLOOP_BACKEND_IO_URING,       /* io_uring, falls back to epoll */
+} mrp_mainloop_backend_t;
+
+/** Environment variable for overriding the default backend. */
+#define MRP_MAINLOOP_BACKEND_ENVVAR "__MURPHY_MAINLOOP_BACKEND"
+
 /** Create a new mainloop. */
 mrp_mainloop_t *mrp_mainloop_create(void);
 
+/** Create a new mainloop using the given polling backend. */
+mrp_mainloop_t *mrp_mainloop_create_backend(mrp_mainloop_backend_t backend);
+
+/** Get the polling backend actually used by a mainloop. */
+mrp_mainloop_backend_t mrp_mainloop_get_backend(mrp_mainloop_t *ml);
+
 /** Destroy an existing mainloop, free all I/O watches, timers, etc. */
 void mrp_mainloop_destroy(mrp_mainloop_t *ml);
 
@@ -252,6 +330,55 @@ int mrp_mainloop_iterate(mrp_mainloop_t *ml);
 /** Quit the mainloop. */
 void mrp_mainloop_quit(mrp_mainloop_t *ml, int exit_code);
 
+
+/*
+ * callback profiling
+ *
+ * When enabled, the time spent in every I/O watch, timer, deferred and
+ * subloop callback is measured and accumulated per callback function.
+ * Callbacks taking longer than the slow callback threshold (if set) are
+ * reported with a warning, naming the offending callback.
+ */
+
+typedef enum {
+    MRP_CALLBACK_IO = 0,                 /* I/O watch callback */
+    MRP_CALLBACK_TIMER,                  /* timer callback */
+    MRP_CALLBACK_DEFERRED,               /* deferred callback */
+    MRP_CALLBACK_SUBLOOP,                /* subloop dispatch callback */
+} mrp_callback_type_t;
+
+/** Accumulated profile of a callback function. */
+typedef struct {
+    mrp_callback_type_t  type;           /* callback type */
+    const char          *name;           /* resolved callback name */
+    uint64_t             count;          /* number of invocations */
+    uint64_t             total;          /* total time spent (usecs) */
+    uint64_t             max;            /* maximum time spent (usecs) */
+} mrp_callback_stat_t;
+
+/** Enable or disable callback profiling (disabled by default). */
+void mrp_mainloop_profile(mrp_mainloop_t *ml, int enable);
+
+/** Check whether callback profiling is enabled. */
+int mrp_mainloop_profiling(mrp_mainloop_t *ml);
+
+/** Set the slow callback warning threshold (usecs, 0 disables warnings). */
+void mrp_mainloop_set_slow_threshold(mrp_mainloop_t *ml, unsigned int usecs);
+
+/** Get the slow callback warning threshold. */
+unsigned int mrp_mainloop_get_slow_threshold(mrp_mainloop_t *ml);
+
+/** Reset all accumulated callback profiles. */
+void mrp_mainloop_reset_profile(mrp_mainloop_t *ml);
+
+/**
+ * Get the top nstat callbacks by total (or by maximum if by_max is set)
+ * time spent. Returns the number of entries filled in. The names stay
+ * valid for the lifetime of the mainloop.
+ */
+int mrp_mainloop_top_callbacks(mrp_mainloop_t *ml, int by_max,
+                               mrp_callback_stat_t *stats, int nstat);
+
 MRP_CDECL_END
 
 #endif /* __MURPHY_MAINLOOP_H__ */
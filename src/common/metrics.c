@@ -0,0 +1,511 @@
+/*
+ * Copyright (c) 2012, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <murphy/common/macros.h>
+#include <murphy/common/mm.h>
+#include <murphy/common/list.h>
+#include <murphy/common/log.h>
+#include <murphy/common/metrics.h>
+
+#define SHARD_MAX  4                     /* number of shards per metric */
+#define CACHE_LINE 64                    /* shard alignment */
+
+/*
+ * a single shard of a metric
+ */
+
+typedef struct {
+    uint64_t count;                      /* counter value, or samples */
+    int64_t  value;                      /* gauge value (only in shard 0) */
+    uint64_t sum;                        /* sum of samples */
+    uint64_t max;                        /* largest sample */
+    uint64_t buckets[0];                 /* histogram buckets */
+} shard_t;
+
+/*
+ * a metric
+ */
+
+struct mrp_metric_s {
+    mrp_list_hook_t    hook;             /* to list of metrics */
+    char              *name;             /* metric name */
+    char              *label;            /* key=value label, or NULL */
+    char              *help;             /* description */
+    mrp_metric_type_t  type;             /* metric type */
+    size_t             stride;           /* distance between shards */
+    void              *mem;              /* allocated shard memory */
+    char              *shards;           /* cache line aligned shards */
+};
+
+
+int mrp_metrics_on = TRUE;
+
+static MRP_LIST_HOOK(metrics);
+static pthread_mutex_t lock;
+static pthread_once_t  lock_once = PTHREAD_ONCE_INIT;
+static __thread int    thread_shard = -1;
+static int             next_shard;
+
+
+static void init_lock(void)
+{
+    pthread_mutexattr_t attr;
+
+    /* recursive, so foreach callbacks may look up or register metrics */
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+
+static inline void lock_metrics(void)
+{
+    pthread_once(&lock_once, init_lock);
+    pthread_mutex_lock(&lock);
+}
+
+
+static inline void unlock_metrics(void)
+{
+    pthread_mutex_unlock(&lock);
+}
+
+
+void mrp_metrics_enable(bool enable)
+{
+    mrp_metrics_on = enable ? TRUE : FALSE;
+}
+
+
+static int label_equal(const char *l1, const char *l2)
+{
+    if (l1 == NULL || l2 == NULL)
+        return l1 == l2;
+    else
+        return !strcmp(l1, l2);
+}
+
+
+static mrp_metric_t *lookup_metric(mrp_metric_type_t type, const char *name,
+                                   const char *label, const char *help)
+{
+    mrp_list_hook_t *p, *n, *last;
+    mrp_metric_t    *m;
+    size_t           size;
+
+    lock_metrics();
+
+    last = NULL;
+    mrp_list_foreach(&metrics, p, n) {
+        m = mrp_list_entry(p, typeof(*m), hook);
+
+        if (strcmp(m->name, name))
+            continue;
+
+        if (label_equal(m->label, label)) {
+            if (m->type != type) {
+                mrp_log_error("metric '%s' already registered with "
+                              "a different type", name);
+                m = NULL;
+            }
+
+            unlock_metrics();
+            return m;
+        }
+
+        last = p;
+    }
+
+    if ((m = mrp_allocz(sizeof(*m))) == NULL)
+        goto fail;
+
+    mrp_list_init(&m->hook);
+    m->type  = type;
+    m->name  = mrp_strdup(name);
+    m->label = label ? mrp_strdup(label) : NULL;
+    m->help  = mrp_strdup(help ? help : "");
+
+    size = sizeof(shard_t);
+    if (type == MRP_METRIC_HISTOGRAM)
+        size += MRP_METRIC_BUCKETS * sizeof(uint64_t);
+
+    m->stride = MRP_ALIGN(size, CACHE_LINE);
+    m->mem    = mrp_allocz(SHARD_MAX * m->stride + CACHE_LINE);
+
+    if (m->name == NULL || (label && m->label == NULL) || m->help == NULL ||
+        m->mem == NULL) {
+        mrp_free(m->name);
+        mrp_free(m->label);
+        mrp_free(m->help);
+        mrp_free(m->mem);
+        mrp_free(m);
+        goto fail;
+    }
+
+    m->shards = (char *)MRP_ALIGN((ptrdiff_t)m->mem, CACHE_LINE);
+
+    /* keep metrics of the same name next to each other */
+    if (last != NULL)
+        mrp_list_insert_after(last, &m->hook);
+    else
+        mrp_list_append(&metrics, &m->hook);
+
+    unlock_metrics();
+
+    return m;
+
+ fail:
+    unlock_metrics();
+    mrp_log_error("failed to allocate metric '%s'", name);
+
+    return NULL;
+}
+
+
+mrp_metric_t *mrp_metric_counter(const char *name, const char *label,
+                                 const char *help)
+{
+    return lookup_metric(MRP_METRIC_COUNTER, name, label, help);
+}
+
+
+mrp_metric_t *mrp_metric_gauge(const char *name, const char *label,
+                               const char *help)
+{
+    return lookup_metric(MRP_METRIC_GAUGE, name, label, help);
+}
+
+
+mrp_metric_t *mrp_metric_histogram(const char *name, const char *label,
+                                   const char *help)
+{
+    return lookup_metric(MRP_METRIC_HISTOGRAM, name, label, help);
+}
+
+
+static inline shard_t *get_shard(mrp_metric_t *m, int idx)
+{
+    return (shard_t *)(m->shards + idx * m->stride);
+}
+
+
+static inline shard_t *this_shard(mrp_metric_t *m)
+{
+    if (MRP_UNLIKELY(thread_shard < 0))
+        thread_shard = __sync_fetch_and_add(&next_shard, 1) % SHARD_MAX;
+
+    return get_shard(m, thread_shard);
+}
+
+
+static inline int bucket_index(uint64_t value)
+{
+    int msb, idx;
+
+    if (value < 4)
+        return (int)value;
+
+    msb = 63 - __builtin_clzll(value);
+    idx = (msb - 1) * 4 + (int)((value >> (msb - 2)) & 0x3);
+
+    return idx < MRP_METRIC_BUCKETS ? idx : MRP_METRIC_BUCKETS - 1;
+}
+
+
+uint64_t mrp_metric_bucket_limit(int bucket)
+{
+    int msb, sub;
+
+    if (bucket < 4)
+        return (uint64_t)(bucket < 0 ? 0 : bucket);
+
+    if (bucket >= MRP_METRIC_BUCKETS - 1)
+        return UINT64_MAX;
+
+    msb = bucket / 4 + 1;
+    sub = bucket % 4;
+
+    return ((uint64_t)(4 + sub + 1) << (msb - 2)) - 1;
+}
+
+
+void mrp_metric_add(mrp_metric_t *m, uint64_t n)
+{
+    if (!mrp_metrics_on || m == NULL)
+        return;
+
+    __sync_fetch_and_add(&this_shard(m)->count, n);
+}
+
+
+void mrp_metric_set(mrp_metric_t *m, int64_t value)
+{
+    if (!mrp_metrics_on || m == NULL)
+        return;
+
+    get_shard(m, 0)->value = value;
+}
+
+
+void mrp_metric_adjust(mrp_metric_t *m, int64_t delta)
+{
+    if (!mrp_metrics_on || m == NULL)
+        return;
+
+    __sync_fetch_and_add(&get_shard(m, 0)->value, delta);
+}
+
+
+void mrp_metric_observe(mrp_metric_t *m, uint64_t value)
+{
+    shard_t  *s;
+    uint64_t  max;
+
+    if (!mrp_metrics_on || m == NULL)
+        return;
+
+    s = this_shard(m);
+
+    __sync_fetch_and_add(&s->count, 1);
+    __sync_fetch_and_add(&s->sum, value);
+    __sync_fetch_and_add(&s->buckets[bucket_index(value)], 1);
+
+    while ((max = s->max) < value)
+        if (__sync_bool_compare_and_swap(&s->max, max, value))
+            break;
+}
+
+
+uint64_t mrp_metric_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+
+void mrp_metric_read(mrp_metric_t *m, mrp_metric_value_t *v)
+{
+    shard_t *s;
+    int      i, j;
+
+    memset(v, 0, sizeof(*v));
+
+    v->name  = m->name;
+    v->label = m->label;
+    v->help  = m->help;
+    v->type  = m->type;
+    v->value = get_shard(m, 0)->value;
+
+    for (i = 0; i < SHARD_MAX; i++) {
+        s = get_shard(m, i);
+
+        v->count += s->count;
+
+        if (m->type != MRP_METRIC_HISTOGRAM)
+            continue;
+
+        v->sum += s->sum;
+
+        if (s->max > v->max)
+            v->max = s->max;
+
+        for (j = 0; j < MRP_METRIC_BUCKETS; j++)
+            v->buckets[j] += s->buckets[j];
+    }
+}
+
+
+uint64_t mrp_metric_percentile(mrp_metric_value_t *v, double percentile)
+{
+    uint64_t target, seen, limit;
+    int      i;
+
+    if (v->type != MRP_METRIC_HISTOGRAM || v->count == 0)
+        return 0;
+
+    target = (uint64_t)(v->count * percentile / 100.0 + 0.5);
+
+    if (target < 1)
+        target = 1;
+
+    for (i = 0, seen = 0; i < MRP_METRIC_BUCKETS; i++) {
+        seen += v->buckets[i];
+
+        if (seen >= target) {
+            limit = mrp_metric_bucket_limit(i);
+            return limit < v->max ? limit : v->max;
+        }
+    }
+
+    return v->max;
+}
+
+
+void mrp_metrics_foreach(mrp_metric_cb_t cb, void *user_data)
+{
+    mrp_list_hook_t *p, *n;
+    mrp_metric_t    *m;
+
+    lock_metrics();
+
+    mrp_list_foreach(&metrics, p, n) {
+        m = mrp_list_entry(p, typeof(*m), hook);
+
+        if (!cb(m, user_data))
+            break;
+    }
+
+    unlock_metrics();
+}
+
+
+void mrp_metrics_reset(void)
+{
+    mrp_list_hook_t *p, *n;
+    mrp_metric_t    *m;
+
+    lock_metrics();
+
+    mrp_list_foreach(&metrics, p, n) {
+        m = mrp_list_entry(p, typeof(*m), hook);
+        memset(m->shards, 0, SHARD_MAX * m->stride);
+    }
+
+    unlock_metrics();
+}
+
+
+static void dump_string(FILE *fp, const char *str)
+{
+    const char *p;
+
+    fputc('"', fp);
+
+    for (p = str; *p; p++) {
+        switch (*p) {
+        case '"':
+        case '\\':
+            fputc('\\', fp);
+            fputc(*p, fp);
+            break;
+        case '\n':
+            fputs("\\n", fp);
+            break;
+        default:
+            if ((unsigned char)*p < 0x20)
+                fprintf(fp, "\\u%04x", *p);
+            else
+                fputc(*p, fp);
+        }
+    }
+
+    fputc('"', fp);
+}
+
+
+static int dump_metric(mrp_metric_t *m, void *user_data)
+{
+    static const char *types[] = {
+        [MRP_METRIC_COUNTER]   = "counter",
+        [MRP_METRIC_GAUGE]     = "gauge",
+        [MRP_METRIC_HISTOGRAM] = "histogram",
+    };
+    FILE               *fp = (FILE *)user_data;
+    mrp_metric_value_t  v;
+    const char         *sep;
+    int                 i;
+
+    mrp_metric_read(m, &v);
+
+    fprintf(fp, "  { \"name\": ");
+    dump_string(fp, v.name);
+    if (v.label != NULL) {
+        fprintf(fp, ", \"label\": ");
+        dump_string(fp, v.label);
+    }
+    fprintf(fp, ", \"type\": \"%s\"", types[v.type]);
+
+    switch (v.type) {
+    case MRP_METRIC_COUNTER:
+        fprintf(fp, ", \"value\": %llu", (unsigned long long)v.count);
+        break;
+
+    case MRP_METRIC_GAUGE:
+        fprintf(fp, ", \"value\": %lld", (long long)v.value);
+        break;
+
+    case MRP_METRIC_HISTOGRAM:
+        fprintf(fp, ", \"count\": %llu, \"sum\": %llu, \"max\": %llu, "
+                "\"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"buckets\": [",
+                (unsigned long long)v.count, (unsigned long long)v.sum,
+                (unsigned long long)v.max,
+                (unsigned long long)mrp_metric_percentile(&v, 50),
+                (unsigned long long)mrp_metric_percentile(&v, 90),
+                (unsigned long long)mrp_metric_percentile(&v, 99));
+
+        for (i = 0, sep = ""; i < MRP_METRIC_BUCKETS; i++) {
+            if (!v.buckets[i])
+                continue;
+
+            fprintf(fp, "%s[%llu, %llu]", sep,
+                    (unsigned long long)mrp_metric_bucket_limit(i),
+                    (unsigned long long)v.buckets[i]);
+            sep = ", ";
+        }
+
+        fprintf(fp, "]");
+        break;
+    }
+
+    fprintf(fp, " }");
+
+    if (m->hook.next != &metrics)
+        fprintf(fp, ",");
+
+    fprintf(fp, "\n");
+
+    return TRUE;
+}
+
+
+void mrp_metrics_dump(FILE *fp)
+{
+    fprintf(fp, "{ \"enabled\": %s, \"metrics\": [\n",
+            mrp_metrics_on ? "true" : "false");
+    mrp_metrics_foreach(dump_metric, fp);
+    fprintf(fp, "] }\n");
+}
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2012, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __MURPHY_METRICS_H__
+#define __MURPHY_METRICS_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <murphy/common/macros.h>
+
+MRP_CDECL_BEGIN
+
+/*
+ * runtime metrics
+ *
+ * A process-wide registry of named counters, gauges and latency
+ * histograms. Metrics are looked up (and created on first use) by name
+ * and an optional label of the form key=value, so several metrics of
+ * the same name, for instance the dispatch times of the different
+ * mainloop phases, form a family distinguished by their labels. Once
+ * registered a metric lives until the process exits, so callers are
+ * expected to look a metric up once and cache the returned pointer.
+ *
+ * Updates go to one of a few per-metric shards, picked per thread, so
+ * threads rarely contend on the same cache lines. Reading a metric sums
+ * up its shards. Histograms are log-linear: below 4 every value has its
+ * own bucket, above that every power of two is split into 4 buckets.
+ * Histogram values are expected to be in microseconds.
+ */
+
+#define MRP_METRIC_BUCKETS 128           /* number of histogram buckets */
+
+typedef enum {
+    MRP_METRIC_COUNTER = 0,              /* monotonically increasing count */
+    MRP_METRIC_GAUGE,                    /* value that can go up and down */
+    MRP_METRIC_HISTOGRAM,                /* distribution of values */
+} mrp_metric_type_t;
+
+typedef struct mrp_metric_s mrp_metric_t;
+
+/** A consistent enough snapshot of the value of a metric. */
+typedef struct {
+    const char        *name;             /* metric name */
+    const char        *label;            /* key=value label, or NULL */
+    const char        *help;             /* description of the metric */
+    mrp_metric_type_t  type;             /* metric type */
+    uint64_t           count;            /* counter value, or samples */
+    int64_t            value;            /* gauge value */
+    uint64_t           sum;              /* sum of histogram samples */
+    uint64_t           max;              /* largest histogram sample */
+    uint64_t           buckets[MRP_METRIC_BUCKETS]; /* histogram buckets */
+} mrp_metric_value_t;
+
+/** Flag for checking in hot paths whether metrics are being collected. */
+extern int mrp_metrics_on;
+
+/** Enable or disable metrics collection (enabled by default). */
+void mrp_metrics_enable(bool enable);
+
+/** Look up or create the counter with the given name and label. */
+mrp_metric_t *mrp_metric_counter(const char *name, const char *label,
+                                 const char *help);
+
+/** Look up or create the gauge with the given name and label. */
+mrp_metric_t *mrp_metric_gauge(const char *name, const char *label,
+                               const char *help);
+
+/** Look up or create the histogram with the given name and label. */
+mrp_metric_t *mrp_metric_histogram(const char *name, const char *label,
+                                   const char *help);
+
+/** Add the given amount to a counter. */
+void mrp_metric_add(mrp_metric_t *m, uint64_t n);
+
+/** Increase a counter by one. */
+static inline void mrp_metric_inc(mrp_metric_t *m)
+{
+    mrp_metric_add(m, 1);
+}
+
+/** Set the value of a gauge. */
+void mrp_metric_set(mrp_metric_t *m, int64_t value);
+
+/** Adjust the value of a gauge by the given (possibly negative) amount. */
+void mrp_metric_adjust(mrp_metric_t *m, int64_t delta);
+
+/** Record a sample in a histogram. */
+void mrp_metric_observe(mrp_metric_t *m, uint64_t value);
+
+/** Get a monotonic timestamp in microseconds for timing with metrics. */
+uint64_t mrp_metric_now(void);
+
+/** Record the time elapsed since start (from mrp_metric_now). */
+static inline void mrp_metric_since(mrp_metric_t *m, uint64_t start)
+{
+    mrp_metric_observe(m, mrp_metric_now() - start);
+}
+
+/** Take a snapshot of the value of a metric. */
+void mrp_metric_read(mrp_metric_t *m, mrp_metric_value_t *v);
+
+/** Get the (inclusive) upper limit of the given histogram bucket. */
+uint64_t mrp_metric_bucket_limit(int bucket);
+
+/** Estimate the given percentile (0 - 100) of a histogram snapshot. */
+uint64_t mrp_metric_percentile(mrp_metric_value_t *v, double percentile);
+
+/** Type of a callback for iterating through all metrics. */
+typedef int (*mrp_metric_cb_t)(mrp_metric_t *m, void *user_data);
+
+/**
+ * Call cb for every registered metric in the order of registration until
+ * it returns zero. Metrics of the same name are iterated in a row.
+ */
+void mrp_metrics_foreach(mrp_metric_cb_t cb, void *user_data);
+
+/** Reset all registered metrics to zero. */
+void mrp_metrics_reset(void);
+
+/** Dump all metrics in JSON format to the given stream. */
+void mrp_metrics_dump(FILE *fp);
+
+MRP_CDECL_END
+
+#endif /* __MURPHY_METRICS_H__ */
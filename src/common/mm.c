@@ -32,7 +32,13 @@
 #include <stdint.h>
 #include <errno.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <malloc.h>
+#include <sys/stat.h>
 #include <execinfo.h>
+#include <pthread.h>
 
 #include <murphy/common/macros.h>
 #include <murphy/common/log.h>
@@ -43,6 +49,8 @@
 
 #define BACKTRACE_DEPTH  8                    /* backtrace depth to save */
 
+static void sample_setup(const char *config);
+
 
 
 /*
@@ -59,7 +67,8 @@ typedef struct {
     uint64_t        max_alloc;                /* max allocated memory */
     int             poison;                   /* poisoning pattern */
     size_t          chunk_size;               /* object pool chunk size */
-    mrp_mm_type_t   mode;                     /* passthru/debug mode */
+    mrp_mm_type_t   mode;                     /* passthru/debug/sample mode */
+    int             ready;                    /* initial mode set up */
 
     void *(*alloc)(size_t size, const char *file, int line, const char *func);
     void *(*realloc)(void *ptr, size_t size, const char *file,
@@ -232,10 +241,16 @@ static void __attribute__((constructor)) setup(void)
     __mm.poison     = get_config_uint32(config, "poison", 0xdeadbeef);
     __mm.chunk_size = sysconf(_SC_PAGESIZE) * 2;
 
-    if (config == NULL || !get_config_bool(config, "debug", FALSE))
-        mrp_mm_config(MRP_MM_PASSTHRU);
-    else
+    sample_setup(config);
+
+    if (config != NULL && get_config_bool(config, "debug", FALSE))
         mrp_mm_config(MRP_MM_DEBUG);
+    else if (config != NULL && get_config_key(config, "sample") != NULL)
+        mrp_mm_config(MRP_MM_SAMPLE);
+    else
+        mrp_mm_config(MRP_MM_PASSTHRU);
+
+    __mm.ready = TRUE;
 }
 
 
@@ -532,7 +547,558 @@ static void __passthru_free(void *ptr, const char *file, int line,
 
 
 /*
- * common public interface - uses either passthru or debugging
+ * sampling allocator
+ *
+ * The sampling allocator is a low-overhead heap profiler meant to be
+ * usable in production. Every block carries a small header. Allocated
+ * bytes are counted down per thread and whenever the countdown expires
+ * the allocation is sampled: its backtrace is recorded in a hash of
+ * deduplicated allocation sites together with the per-site live and
+ * total sampled objects and bytes. The countdown is reset from an
+ * exponential distribution, which makes the sampling a Poisson process
+ * over allocated bytes with the configured mean interval. The collected
+ * profile is written in the heap profile format understood by pprof,
+ * which also takes care of scaling the samples to estimated totals.
+ */
+
+#define SAMPLE_RATE    (512 * 1024)           /* default mean interval */
+#define SAMPLE_DEPTH   32                     /* backtrace depth to save */
+#define SAMPLE_SKIP    2                      /* profiler frames to skip */
+#define SAMPLE_NBUCKET 1021                   /* site hash buckets */
+#define SAMPLE_ALIGNED ((sample_site_t *)1)   /* aligned, unsampled block */
+
+typedef struct sample_site_s sample_site_t;
+
+struct sample_site_s {
+    sample_site_t *next;                      /* next site in bucket */
+    uint32_t       hash;                      /* backtrace hash */
+    int            depth;                     /* backtrace depth */
+    uint64_t       live_objs;                 /* sampled live objects */
+    uint64_t       live_bytes;                /* sampled live bytes */
+    uint64_t       total_objs;                /* sampled allocated objects */
+    uint64_t       total_bytes;               /* sampled allocated bytes */
+    void          *bt[];                      /* backtrace */
+};
+
+typedef struct {
+    sample_site_t *site;                      /* sampled site, or NULL */
+    size_t         size;                      /* size, or offset if aligned */
+} sample_hdr_t;
+
+static struct {
+    uint32_t         rate;                    /* mean sampling interval */
+    pthread_mutex_t  lock;                    /* protects sites */
+    sample_site_t   *sites[SAMPLE_NBUCKET];   /* allocation sites */
+    int              nsite;                   /* number of sites */
+    uint32_t         seq;                     /* last snapshot number */
+    char             dir[256];                /* snapshot directory */
+} sampler = {
+    .rate = SAMPLE_RATE,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static __thread int64_t  sample_left;         /* bytes until next sample */
+static __thread uint64_t sample_rnd;          /* random number state */
+
+
+static void sample_setup(const char *config)
+{
+    void *bt[1];
+
+    sampler.rate = get_config_uint32(config, "sample", SAMPLE_RATE);
+
+    if (sampler.rate == 0)
+        sampler.rate = SAMPLE_RATE;
+
+    /* an empty directory is resolved to a private one on first snapshot */
+    get_config_string(config, "profile-dir", "",
+                      sampler.dir, sizeof(sampler.dir));
+
+    if (get_config_key(config, "sample") != NULL)
+        backtrace(bt, 1);                     /* load unwinder up front */
+}
+
+
+static double fast_log2(double d)
+{
+    union {
+        double   d;
+        uint64_t u;
+    } v = { .d = d };
+    double m;
+    int    e;
+
+    /* split into exponent and mantissa in [1, 2), approximate the rest */
+    e   = (int)((v.u >> 52) & 0x7ff) - 1023;
+    v.u = (v.u & ((1ULL << 52) - 1)) | (1023ULL << 52);
+    m   = v.d - 1.0;
+
+    return e + m * (1.3465553 - 0.3465553 * m);
+}
+
+
+static double fast_expneg(double x)
+{
+    double r;
+    int    n;
+
+    /* e^-x by halving x until the series converges fast, then squaring */
+    if (x > 64.0)
+        return 0.0;
+
+    for (n = 0; x > 0.125; n++)
+        x /= 2;
+
+    r = 1.0 - x * (1.0 - x / 2 * (1.0 - x / 3 * (1.0 - x / 4)));
+
+    while (n-- > 0)
+        r *= r;
+
+    return r;
+}
+
+
+static int64_t sample_interval(void)
+{
+    uint64_t q;
+
+    if (MRP_UNLIKELY(sample_rnd == 0)) {
+        sample_rnd  = (uint64_t)(ptrdiff_t)&sample_rnd;
+        sample_rnd ^= ((uint64_t)getpid() << 32) ^ (uint64_t)time(NULL);
+        sample_rnd |= 1;
+    }
+
+    sample_rnd ^= sample_rnd << 13;
+    sample_rnd ^= sample_rnd >> 7;
+    sample_rnd ^= sample_rnd << 17;
+
+    /* -ln(u) * rate, with u uniform in (0, 1] in steps of 2^-26 */
+    q = (sample_rnd >> 38) + 1;
+
+    return (int64_t)((26.0 - fast_log2(q)) * 0.6931471805599453 *
+                     sampler.rate) + 1;
+}
+
+
+static uint32_t sample_hash(void **bt, int depth)
+{
+    uint32_t h = 0;
+    int      i;
+
+    for (i = 0; i < depth; i++) {
+        h += (uint32_t)((ptrdiff_t)bt[i] >> 2);
+        h += h << 10;
+        h ^= h >> 6;
+    }
+
+    h += h << 3;
+    h ^= h >> 11;
+
+    return h;
+}
+
+
+static sample_site_t *sample_site(void **bt, int depth)
+{
+    sample_site_t *site;
+    uint32_t       hash;
+    int            idx;
+
+    hash = sample_hash(bt, depth);
+    idx  = hash % SAMPLE_NBUCKET;
+
+    for (site = sampler.sites[idx]; site != NULL; site = site->next)
+        if (site->hash == hash && site->depth == depth &&
+            !memcmp(site->bt, bt, depth * sizeof(bt[0])))
+            return site;
+
+    site = calloc(1, sizeof(*site) + depth * sizeof(bt[0]));
+
+    if (site != NULL) {
+        site->hash  = hash;
+        site->depth = depth;
+        memcpy(site->bt, bt, depth * sizeof(bt[0]));
+
+        site->next = sampler.sites[idx];
+        sampler.sites[idx] = site;
+        sampler.nsite++;
+    }
+
+    return site;
+}
+
+
+static void __attribute__((noinline)) sample_record(sample_hdr_t *hdr)
+{
+    void *bt[SAMPLE_SKIP + SAMPLE_DEPTH];
+    int   n;
+
+    /* the first countdown of every thread just sets up the next one */
+    if (sample_rnd != 0) {
+        n = backtrace(bt, MRP_ARRAY_SIZE(bt)) - SAMPLE_SKIP;
+
+        if (n > 0) {
+            pthread_mutex_lock(&sampler.lock);
+
+            if ((hdr->site = sample_site(bt + SAMPLE_SKIP, n)) != NULL) {
+                hdr->site->live_objs++;
+                hdr->site->live_bytes  += hdr->size;
+                hdr->site->total_objs++;
+                hdr->site->total_bytes += hdr->size;
+            }
+
+            pthread_mutex_unlock(&sampler.lock);
+        }
+    }
+
+    sample_left = sample_interval();
+}
+
+
+static void sample_release(sample_hdr_t *hdr)
+{
+    pthread_mutex_lock(&sampler.lock);
+    hdr->site->live_objs--;
+    hdr->site->live_bytes -= hdr->size;
+    pthread_mutex_unlock(&sampler.lock);
+
+    hdr->site = NULL;
+}
+
+
+static inline sample_hdr_t *sample_hdr(void *ptr)
+{
+    return (sample_hdr_t *)ptr - 1;
+}
+
+
+static void *__sample_alloc(size_t size, const char *file, int line,
+                            const char *func)
+{
+    sample_hdr_t *hdr;
+
+    MRP_UNUSED(file);
+    MRP_UNUSED(line);
+    MRP_UNUSED(func);
+
+    if (MRP_UNLIKELY(size == 0))
+        return NULL;
+
+    if ((hdr = malloc(sizeof(*hdr) + size)) == NULL)
+        return NULL;
+
+    hdr->site = NULL;
+    hdr->size = size;
+
+    if (MRP_UNLIKELY((sample_left -= size) < 0))
+        sample_record(hdr);
+
+    return hdr + 1;
+}
+
+
+static void __sample_free(void *ptr, const char *file, int line,
+                          const char *func)
+{
+    sample_hdr_t *hdr;
+
+    MRP_UNUSED(file);
+    MRP_UNUSED(line);
+    MRP_UNUSED(func);
+
+    if (ptr == NULL)
+        return;
+
+    hdr = sample_hdr(ptr);
+
+    if (MRP_LIKELY(hdr->site == NULL))
+        free(hdr);
+    else if (hdr->site == SAMPLE_ALIGNED)
+        free(ptr - hdr->size);
+    else {
+        sample_release(hdr);
+        free(hdr);
+    }
+}
+
+
+static void *__sample_realloc(void *ptr, size_t size, const char *file,
+                              int line, const char *func)
+{
+    sample_hdr_t *hdr;
+    void         *raw, *p;
+    size_t        old;
+
+    if (ptr == NULL)
+        return __sample_alloc(size, file, line, func);
+
+    if (size == 0) {
+        __sample_free(ptr, file, line, func);
+        return NULL;
+    }
+
+    hdr = sample_hdr(ptr);
+
+    if (hdr->site == SAMPLE_ALIGNED) {
+        raw = ptr - hdr->size;
+        old = malloc_usable_size(raw) - hdr->size;
+
+        if ((p = __sample_alloc(size, file, line, func)) != NULL) {
+            memcpy(p, ptr, MRP_MIN(old, size));
+            free(raw);
+        }
+
+        return p;
+    }
+
+    if ((hdr = realloc(hdr, sizeof(*hdr) + size)) == NULL)
+        return NULL;
+
+    /* account the resized block as a new allocation */
+    if (hdr->site != NULL)
+        sample_release(hdr);
+
+    hdr->size = size;
+
+    if (MRP_UNLIKELY((sample_left -= size) < 0))
+        sample_record(hdr);
+
+    return hdr + 1;
+}
+
+
+static int __sample_memalign(void **ptr, size_t align, size_t size,
+                             const char *file, int line, const char *func)
+{
+    sample_hdr_t *hdr;
+    size_t        offs;
+    void         *raw;
+    int           err;
+
+    MRP_UNUSED(file);
+    MRP_UNUSED(line);
+    MRP_UNUSED(func);
+
+    /* aligned blocks are never sampled, their header marks the offset */
+    offs = MRP_ALIGN(sizeof(*hdr), align);
+
+    if ((err = posix_memalign(&raw, align, offs + size)) != 0) {
+        *ptr = NULL;
+        return err;
+    }
+
+    *ptr = raw + offs;
+    hdr  = sample_hdr(*ptr);
+
+    hdr->site = SAMPLE_ALIGNED;
+    hdr->size = offs;
+
+    return 0;
+}
+
+
+static void sample_totals(sample_site_t *site, uint64_t *objs, uint64_t *bytes,
+                          int live)
+{
+    uint64_t n, b;
+    double   avg, scale;
+
+    n = live ? site->live_objs  : site->total_objs;
+    b = live ? site->live_bytes : site->total_bytes;
+
+    if (n == 0)
+        return;
+
+    /* undo the sampling bias the same way pprof does */
+    avg   = (double)b / n;
+    scale = 1.0 / (1.0 - fast_expneg(avg / sampler.rate));
+
+    *objs  += (uint64_t)(n * scale);
+    *bytes += (uint64_t)(b * scale);
+}
+
+
+int mrp_mm_profile_stats(mrp_mm_profile_t *prof)
+{
+    sample_site_t *site;
+    int            i;
+
+    mrp_clear(prof);
+
+    if (__mm.mode != MRP_MM_SAMPLE)
+        return FALSE;
+
+    prof->rate = sampler.rate;
+
+    pthread_mutex_lock(&sampler.lock);
+
+    prof->nsite = sampler.nsite;
+
+    for (i = 0; i < SAMPLE_NBUCKET; i++) {
+        for (site = sampler.sites[i]; site != NULL; site = site->next) {
+            prof->nsample += site->total_objs;
+            sample_totals(site, &prof->live_objs, &prof->live_bytes, TRUE);
+            sample_totals(site, &prof->total_objs, &prof->total_bytes, FALSE);
+        }
+    }
+
+    pthread_mutex_unlock(&sampler.lock);
+
+    return TRUE;
+}
+
+
+int mrp_mm_profile_dump(FILE *fp)
+{
+    sample_site_t *site;
+    uint64_t       lo, lb, to, tb;
+    FILE          *maps;
+    char           buf[1024];
+    size_t         n;
+    int            i, j;
+
+    if (__mm.mode != MRP_MM_SAMPLE) {
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+
+    lo = lb = to = tb = 0;
+
+    pthread_mutex_lock(&sampler.lock);
+
+    for (i = 0; i < SAMPLE_NBUCKET; i++) {
+        for (site = sampler.sites[i]; site != NULL; site = site->next) {
+            lo += site->live_objs;
+            lb += site->live_bytes;
+            to += site->total_objs;
+            tb += site->total_bytes;
+        }
+    }
+
+    fprintf(fp, "heap profile: %llu: %llu [%llu: %llu] @ heap_v2/%u\n",
+            (unsigned long long)lo, (unsigned long long)lb,
+            (unsigned long long)to, (unsigned long long)tb, sampler.rate);
+
+    for (i = 0; i < SAMPLE_NBUCKET; i++) {
+        for (site = sampler.sites[i]; site != NULL; site = site->next) {
+            fprintf(fp, "%llu: %llu [%llu: %llu] @",
+                    (unsigned long long)site->live_objs,
+                    (unsigned long long)site->live_bytes,
+                    (unsigned long long)site->total_objs,
+                    (unsigned long long)site->total_bytes);
+
+            for (j = 0; j < site->depth; j++)
+                fprintf(fp, " %p", site->bt[j]);
+
+            fprintf(fp, "\n");
+        }
+    }
+
+    pthread_mutex_unlock(&sampler.lock);
+
+    /* pprof needs the mappings to symbolize the addresses */
+    fprintf(fp, "\nMAPPED_LIBRARIES:\n");
+
+    if ((maps = fopen("/proc/self/maps", "r")) != NULL) {
+        while ((n = fread(buf, 1, sizeof(buf), maps)) > 0)
+            fwrite(buf, 1, n, fp);
+        fclose(maps);
+    }
+
+    return ferror(fp) ? -1 : 0;
+}
+
+
+/*
+ * Pick the default snapshot directory: $XDG_RUNTIME_DIR if set, otherwise
+ * /tmp/murphy-<euid>, which is created if necessary and only accepted if it
+ * is a directory owned by us and inaccessible to anybody else.
+ */
+static const char *profile_dir(void)
+{
+    const char  *dir;
+    struct stat  st;
+
+    if (sampler.dir[0] != '\0')
+        return sampler.dir;
+
+    if ((dir = getenv("XDG_RUNTIME_DIR")) != NULL && *dir == '/') {
+        snprintf(sampler.dir, sizeof(sampler.dir), "%s", dir);
+        return sampler.dir;
+    }
+
+    snprintf(sampler.dir, sizeof(sampler.dir), "/tmp/murphy-%u",
+             (unsigned int)geteuid());
+
+    if (mkdir(sampler.dir, 0700) < 0 && errno != EEXIST)
+        goto fail;
+
+    if (lstat(sampler.dir, &st) < 0)
+        goto fail;
+
+    if (!S_ISDIR(st.st_mode) || st.st_uid != geteuid() ||
+        (st.st_mode & (S_IRWXG | S_IRWXO))) {
+        errno = EPERM;
+        goto fail;
+    }
+
+    return sampler.dir;
+
+ fail:
+    sampler.dir[0] = '\0';
+    return NULL;
+}
+
+
+int mrp_mm_profile_snapshot(const char *path, char *buf, size_t size)
+{
+    char        name[PATH_MAX];
+    const char *dir;
+    FILE       *fp;
+    int         fd, status;
+
+    if (__mm.mode != MRP_MM_SAMPLE) {
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+
+    if (path == NULL) {
+        if ((dir = profile_dir()) == NULL)
+            return -1;
+
+        snprintf(name, sizeof(name), "%s/murphy.%u.%04u.heap", dir,
+                 (unsigned int)getpid(),
+                 __atomic_add_fetch(&sampler.seq, 1, __ATOMIC_RELAXED));
+        path = name;
+    }
+
+    /* never follow or reuse an existing (possibly planted) file */
+    fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC,
+              0600);
+
+    if (fd < 0)
+        return -1;
+
+    if ((fp = fdopen(fd, "w")) == NULL) {
+        close(fd);
+        return -1;
+    }
+
+    status = mrp_mm_profile_dump(fp);
+
+    if (fclose(fp) != 0)
+        status = -1;
+
+    if (status == 0 && buf != NULL)
+        snprintf(buf, size, "%s", path);
+
+    return status;
+}
+
+
+/*
+ * common public interface - uses either the passthru, debugging or
+ * sampling allocator
  */
 
 void *mrp_mm_alloc(size_t size, const char *file, int line, const char *func)
@@ -585,6 +1151,13 @@ int mrp_mm_config(mrp_mm_type_t type)
     if (__mm.cur_blocks != 0)
         return FALSE;
 
+    /* sampled blocks carry a header, we can't switch to or from them later */
+    if (__mm.ready && type != __mm.mode &&
+        (type == MRP_MM_SAMPLE || __mm.mode == MRP_MM_SAMPLE)) {
+        mrp_log_error("Can't switch to/from the sampling allocator on the fly.");
+        return FALSE;
+    }
+
     switch (type) {
     case MRP_MM_PASSTHRU:
         __mm.alloc    = __passthru_alloc;
@@ -602,6 +1175,14 @@ int mrp_mm_config(mrp_mm_type_t type)
         __mm.mode     = MRP_MM_DEBUG;
         return TRUE;
 
+    case MRP_MM_SAMPLE:
+        __mm.alloc    = __sample_alloc;
+        __mm.realloc  = __sample_realloc;
+        __mm.memalign = __sample_memalign;
+        __mm.free     = __sample_free;
+        __mm.mode     = MRP_MM_SAMPLE;
+        return TRUE;
+
     default:
         mrp_log_error("Invalid memory allocator type 0x%x requested.", type);
         return FALSE;
@@ -609,6 +1190,12 @@ int mrp_mm_config(mrp_mm_type_t type)
 }
 
 
+mrp_mm_type_t mrp_mm_type(void)
+{
+    return __mm.mode;
+}
+
+
 #define NBUCKET 1024
 
 static int btcmp(void **bt1, void **bt2)
@@ -844,9 +1431,13 @@ typedef struct pool_chunk_s pool_chunk_t;
 static int pool_calc_sizes(mrp_objpool_t *pool);
 static int pool_grow(mrp_objpool_t *pool, int nobj);
 static int pool_shrink(mrp_objpool_t *pool, int nobj);
+static int pool_trim(mrp_objpool_t *pool);
+static void *pool_get(mrp_objpool_t *pool, int grow);
+static void cache_flush_all(mrp_objpool_t *pool, int detach);
+static void pool_put(mrp_objpool_t *pool, void *obj);
+static int pool_release(mrp_objpool_t *pool, void *obj);
 static pool_chunk_t *chunk_alloc(int nperchunk);
 static void chunk_free(pool_chunk_t *chunk);
-static inline int chunk_empty(pool_chunk_t *chunk);
 static void pool_foreach_object(mrp_objpool_t *pool,
                                 void (*cb)(void *obj, void *user_data),
                                 void *user_data);
@@ -871,45 +1462,117 @@ struct mrp_objpool_s {
     int               poison;                    /* poisoning pattern */
 
     size_t            nperchunk;                 /* objects per chunk */
-    size_t            dataidx;                   /* data  */
+    size_t            dataoffs;                  /* object offset in chunks */
     mrp_list_hook_t   space;                     /* chunk with frees slots */
     size_t            nspace;                    /* number of such chunks */
     mrp_list_hook_t   full;                      /* fully allocated chunks */
     size_t            nfull;                     /* number of such chunks */
+    size_t            nempty;                    /* number of empty chunks */
+    pthread_mutex_t   lock;                      /* lock protecting the pool */
+    mrp_list_hook_t   hook;                      /* to list of all pools */
+    int               id;                        /* thread cache index */
+    uint32_t          gen;                       /* pool generation */
+    mrp_list_hook_t   caches;                    /* thread caches */
+
+    size_t            peak;                      /* max. objects in use */
+    uint64_t          nalloc;                    /* allocations */
+    uint64_t          nhit;                      /* ... without growing */
+    uint64_t          nfail;                     /* ... failed */
+    uint64_t          ngrow;                     /* chunks allocated */
+    uint64_t          nshrink;                   /* chunks released */
 };
 
 
 /*
  * a chunk of memory allocated to an object pool
+ *
+ * Chunks with free slots are kept ordered by usage: partially used chunks
+ * are at the head of the list of such chunks and empty ones at the tail.
+ * Since we always allocate from the head, objects are packed to as few
+ * chunks as possible while empty chunks are left alone, so they can be
+ * released lazily once the pool has been idle for a while.
  */
 
 struct pool_chunk_s {
     mrp_objpool_t   *pool;                       /* pool we're alloced to */
     mrp_list_hook_t  hook;                       /* hook to chunk list */
+    uint32_t         nused;                      /* number of used slots */
     mask_t           cache;                      /* cache bits */
     mask_t           used[];                     /* allocation mask */
 };
 
 
+/*
+ * a per-thread object cache
+ *
+ * To keep the common allocation and freeing paths free of locking, every
+ * thread caches a small number of free objects per pool. Allocations are
+ * served from and frees are returned to the cache of the calling thread.
+ * The pool itself is only locked to refill an empty or to flush a full
+ * cache, both in batches. Pools with poisoning enabled are not cached, to
+ * keep double-free detection working for them.
+ */
+
+#define POOL_CACHE_MAX  64                       /* max. pools with caches */
+#define POOL_CACHE_SIZE 32                       /* max. objects per cache */
+
+typedef struct {
+    mrp_objpool_t   *pool;                       /* pool we cache for */
+    uint32_t         gen;                        /* generation of pool */
+    mrp_list_hook_t  hook;                       /* to list of pool caches */
+    uint64_t         nalloc;                     /* allocations served */
+    int              n;                          /* number of cached objects */
+    void            *obj[POOL_CACHE_SIZE];       /* cached objects */
+} pool_cache_t;
+
+
+static MRP_LIST_HOOK(pools);                     /* all object pools */
+static pthread_mutex_t pools_lock = PTHREAD_MUTEX_INITIALIZER;
+static int             trim_pending;             /* pools with surplus */
+static mrp_objpool_t  *pool_ids[POOL_CACHE_MAX]; /* pools by cache index */
+static uint32_t        pool_gen;                 /* last pool generation */
+static pthread_key_t   cache_key;                /* for thread exit cleanup */
+static pthread_once_t  cache_once = PTHREAD_ONCE_INIT;
+static __thread pool_cache_t *thread_caches[POOL_CACHE_MAX];
+
+
+static inline void *chunk_data(pool_chunk_t *chunk)
+{
+    return ((void *)chunk) + chunk->pool->dataoffs;
+}
+
 
 mrp_objpool_t *mrp_objpool_create(mrp_objpool_config_t *cfg)
 {
     mrp_objpool_t *pool;
+    const char    *config;
+    char           key[256];
+    int            id;
 
     if ((pool = mrp_allocz(sizeof(*pool))) != NULL) {
-        if ((pool->name = mrp_strdup(cfg->name)) == NULL)
+        mrp_list_init(&pool->space);
+        mrp_list_init(&pool->full);
+        mrp_list_init(&pool->hook);
+        mrp_list_init(&pool->caches);
+        pthread_mutex_init(&pool->lock, NULL);
+        pool->id = -1;
+
+        if ((pool->name = mrp_strdup(cfg->name)) == NULL)
             goto fail;
 
-        pool->limit    = cfg->limit;
+        config = getenv(MRP_MM_CONFIG_ENVVAR);
+
+        snprintf(key, sizeof(key), "%s.limit", cfg->name);
+        pool->limit    = get_config_uint32(config, key, cfg->limit);
+        snprintf(key, sizeof(key), "%s.prealloc", cfg->name);
+        pool->prealloc = get_config_uint32(config, key, cfg->prealloc);
+
         pool->objsize  = MRP_MAX(cfg->objsize, (size_t)MRP_MM_OBJSIZE_MIN);
-        pool->prealloc = cfg->prealloc;
         pool->setup    = cfg->setup;
         pool->cleanup  = cfg->cleanup;
         pool->flags    = cfg->flags;
         pool->poison   = cfg->poison;
 
-        mrp_list_init(&pool->space);
-        mrp_list_init(&pool->full);
         pool->nspace = 0;
         pool->nfull  = 0;
 
@@ -919,6 +1582,20 @@ mrp_objpool_t *mrp_objpool_create(mrp_objpool_config_t *cfg)
         if (!mrp_objpool_grow(pool, pool->prealloc))
             goto fail;
 
+        pthread_mutex_lock(&pools_lock);
+        mrp_list_append(&pools, &pool->hook);
+        pool->gen = ++pool_gen ? pool_gen : ++pool_gen;
+        if (!(pool->flags & MRP_OBJPOOL_FLAG_POISON)) {
+            for (id = 0; id < POOL_CACHE_MAX; id++) {
+                if (pool_ids[id] == NULL) {
+                    pool_ids[id] = pool;
+                    pool->id     = id;
+                    break;
+                }
+            }
+        }
+        pthread_mutex_unlock(&pools_lock);
+
         mrp_debug("pool <%s> created, with %zd/%zd objects.", pool->name,
                   pool->prealloc, pool->limit);
 
@@ -943,35 +1620,267 @@ static void free_object(void *obj, void *user_data)
 
 void mrp_objpool_destroy(mrp_objpool_t *pool)
 {
+    mrp_list_hook_t *p, *n;
+    pool_chunk_t    *chunk;
+
+    if (pool == NULL)
+        return;
+
+    /*
+     * The pool must be quiescent by now: no other thread may allocate
+     * from or free to it any more. Their caches for this pool are then
+     * left alone by their owners, so we can drain them here. Holding
+     * pools_lock keeps exiting threads (cache_exit) and new pools, which
+     * could reuse our cache index, away until we have released the index.
+     */
+
+    pthread_mutex_lock(&pools_lock);
+    pthread_mutex_lock(&pool->lock);
+    cache_flush_all(pool, TRUE);
+    pthread_mutex_unlock(&pool->lock);
+    mrp_list_delete(&pool->hook);
+    if (pool->id >= 0)
+        pool_ids[pool->id] = NULL;
+    pool->id = -1;                               /* free directly from now */
+    pthread_mutex_unlock(&pools_lock);
 
     if (pool->cleanup != NULL)
         pool_foreach_object(pool, free_object, pool);
 
+    mrp_list_foreach(&pool->full, p, n) {
+        chunk = mrp_list_entry(p, pool_chunk_t, hook);
+        mrp_list_delete(&chunk->hook);
+        chunk_free(chunk);
+    }
+
+    mrp_list_foreach(&pool->space, p, n) {
+        chunk = mrp_list_entry(p, pool_chunk_t, hook);
+        mrp_list_delete(&chunk->hook);
+        chunk_free(chunk);
+    }
+
+    pthread_mutex_destroy(&pool->lock);
     mrp_free(pool->name);
     mrp_free(pool);
 }
 
 
+static void cache_exit(void *ptr)
+{
+    pool_cache_t  **caches = (pool_cache_t **)ptr;
+    pool_cache_t   *cache;
+    mrp_objpool_t  *pool;
+    int             i;
+
+    for (i = 0; i < POOL_CACHE_MAX; i++) {
+        if ((cache = caches[i]) == NULL)
+            continue;
+
+        pthread_mutex_lock(&pools_lock);
+
+        if ((pool = pool_ids[i]) != NULL && cache->gen == pool->gen) {
+            pthread_mutex_lock(&pool->lock);
+            pool->nalloc += cache->nalloc;
+            pool->nhit   += cache->nalloc;
+            while (cache->n > 0)
+                pool_release(pool, cache->obj[--cache->n]);
+            mrp_list_delete(&cache->hook);
+            pthread_mutex_unlock(&pool->lock);
+        }
+
+        pthread_mutex_unlock(&pools_lock);
+
+        free(cache);
+        caches[i] = NULL;
+    }
+}
+
+
+static void create_cache_key(void)
+{
+    if (pthread_key_create(&cache_key, cache_exit) != 0)
+        mrp_log_error("Failed to create object pool cache key.");
+}
+
+
+static pool_cache_t *cache_create(mrp_objpool_t *pool)
+{
+    pool_cache_t *cache;
+
+    pthread_once(&cache_once, create_cache_key);
+
+    if ((cache = thread_caches[pool->id]) == NULL) {
+        if ((cache = malloc(sizeof(*cache))) == NULL)
+            return NULL;
+
+        mrp_list_init(&cache->hook);
+        thread_caches[pool->id] = cache;
+        pthread_setspecific(cache_key, thread_caches);
+    }
+
+    /* (re)claim the cache, any old pool has flushed it when destroyed */
+    pthread_mutex_lock(&pool->lock);
+    cache->pool   = pool;
+    cache->gen    = pool->gen;
+    cache->nalloc = 0;
+    cache->n      = 0;
+    mrp_list_delete(&cache->hook);
+    mrp_list_append(&pool->caches, &cache->hook);
+    pthread_mutex_unlock(&pool->lock);
+
+    return cache;
+}
+
+
+static inline pool_cache_t *pool_cache(mrp_objpool_t *pool)
+{
+    pool_cache_t *cache;
+
+    if (pool->id < 0)
+        return NULL;
+
+    cache = thread_caches[pool->id];
+
+    if (MRP_LIKELY(cache != NULL && cache->gen == pool->gen))
+        return cache;
+    else
+        return cache_create(pool);
+}
+
+
+static void cache_flush_all(mrp_objpool_t *pool, int detach)
+{
+    mrp_list_hook_t *p, *n;
+    pool_cache_t    *cache;
+
+    mrp_list_foreach(&pool->caches, p, n) {
+        cache = mrp_list_entry(p, pool_cache_t, hook);
+
+        while (cache->n > 0)
+            pool_release(pool, cache->obj[--cache->n]);
+
+        if (detach) {
+            pool->nalloc += cache->nalloc;
+            pool->nhit   += cache->nalloc;
+            cache->nalloc = 0;
+            cache->gen    = 0;
+            mrp_list_delete(&cache->hook);
+        }
+    }
+}
+
+
 void *mrp_objpool_alloc(mrp_objpool_t *pool)
+{
+    pool_cache_t *cache;
+    void         *obj, *o;
+
+    cache = pool_cache(pool);
+
+    if (MRP_LIKELY(cache != NULL && cache->n > 0)) {
+        obj = cache->obj[--cache->n];
+        cache->nalloc++;
+    }
+    else {
+        pthread_mutex_lock(&pool->lock);
+
+        pool->nalloc++;
+
+        if ((obj = pool_get(pool, TRUE)) != NULL && cache != NULL) {
+            /* refill the cache with a batch, but don't grow for that */
+            while (cache->n < POOL_CACHE_SIZE / 2) {
+                if ((o = pool_get(pool, FALSE)) == NULL)
+                    break;
+                cache->obj[cache->n++] = o;
+            }
+        }
+
+        pthread_mutex_unlock(&pool->lock);
+
+        if (obj == NULL)
+            return NULL;
+    }
+
+    if (pool->flags & MRP_OBJPOOL_FLAG_ZERO)
+        memset(obj, 0, pool->objsize);
+
+    if (pool->setup != NULL && !pool->setup(obj)) {
+        pool_put(pool, obj);
+        return NULL;
+    }
+
+    return obj;
+}
+
+
+void mrp_objpool_free(void *obj)
+{
+    pool_chunk_t  *chunk;
+    mrp_objpool_t *pool;
+
+    if (obj == NULL)
+        return;
+
+    chunk = (pool_chunk_t *)(((ptrdiff_t)obj) & ~(__mm.chunk_size - 1));
+    pool  = chunk->pool;
+
+    if (pool->cleanup != NULL)
+        pool->cleanup(obj);
+
+    if (pool->flags & MRP_OBJPOOL_FLAG_POISON)
+        memset(obj, pool->poison, pool->objsize);
+
+    pool_put(pool, obj);
+}
+
+
+static void pool_put(mrp_objpool_t *pool, void *obj)
+{
+    pool_cache_t *cache;
+
+    cache = pool_cache(pool);
+
+    if (MRP_LIKELY(cache != NULL && cache->n < POOL_CACHE_SIZE)) {
+        cache->obj[cache->n++] = obj;
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+
+    if (cache != NULL) {
+        /* flush a batch from the cache */
+        while (cache->n > POOL_CACHE_SIZE / 2)
+            pool_release(pool, cache->obj[--cache->n]);
+    }
+
+    pool_release(pool, obj);
+
+    pthread_mutex_unlock(&pool->lock);
+}
+
+
+static void *pool_get(mrp_objpool_t *pool, int grow)
 {
     pool_chunk_t *chunk;
     void         *obj;
     unsigned int  cidx, uidx, sidx;
 
     if (pool->limit && pool->nobj >= pool->limit)
-        return NULL;
+        goto fail;
 
     if (mrp_list_empty(&pool->space)) {
-        if (!pool_grow(pool, 1))
-            return NULL;
+        if (!grow || !pool_grow(pool, 1))
+            goto fail;
     }
+    else if (grow)
+        pool->nhit++;
 
     chunk = mrp_list_entry(pool->space.next, pool_chunk_t, hook);
     cidx  = ffs(chunk->cache);
 
     if (!cidx) {
         mrp_log_error("object pool bug: no free slots in cache mask.");
-        return NULL;
+        goto fail;
     }
     else
         cidx--;
@@ -980,21 +1889,21 @@ void *mrp_objpool_alloc(mrp_objpool_t *pool)
 
     if (!uidx) {
         mrp_log_error("object pool bug: no free slots in used mask.");
-        return NULL;
+        goto fail;
     }
     else
         uidx--;
 
     sidx = cidx * MASK_BITS + uidx;
-    obj  = ((void *)&chunk->used[pool->dataidx]) + (sidx * pool->objsize);
+    obj  = chunk_data(chunk) + (sidx * pool->objsize);
 
-    mrp_debug("%p: %u/%u: %u, offs %zd\n", obj, cidx, uidx, sidx,
-              sidx * pool->objsize);
+    chunk->used[cidx] &= ~(1U << uidx);
 
-    chunk->used[cidx] &= ~(1 << uidx);
+    if (chunk->nused++ == 0)
+        pool->nempty--;
 
     if (chunk->used[cidx] == MASK_FULL) {
-        chunk->cache &= ~(1 << cidx);
+        chunk->cache &= ~(1U << cidx);
 
         if (chunk->cache == MASK_FULL) {          /* chunk exhausted */
             mrp_list_delete(&chunk->hook);
@@ -1004,88 +1913,195 @@ void *mrp_objpool_alloc(mrp_objpool_t *pool)
         }
     }
 
-    if (pool->setup == NULL || pool->setup(obj)) {
-        pool->nobj++;
-        return obj;
-    }
-    else {
-        mrp_objpool_free(obj);
-        return NULL;
-    }
+    if (++pool->nobj > pool->peak)
+        pool->peak = pool->nobj;
+
+    return obj;
+
+ fail:
+    if (grow)
+        pool->nfail++;
+    return NULL;
 }
 
 
-void mrp_objpool_free(void *obj)
+static int pool_release(mrp_objpool_t *pool, void *obj)
 {
-    pool_chunk_t  *chunk;
-    mrp_objpool_t *pool;
-    unsigned int   cidx, uidx, sidx;
-    mask_t         cache, used;
-    void          *base;
-
-    if (obj == NULL)
-        return;
+    pool_chunk_t *chunk;
+    unsigned int  cidx, uidx, sidx;
+    mask_t        cache, used;
 
     chunk = (pool_chunk_t *)(((ptrdiff_t)obj) & ~(__mm.chunk_size - 1));
-    pool  = chunk->pool;
-
-    base = (void *)&chunk->used[pool->dataidx];
-    sidx = (obj - base) / pool->objsize;
-    cidx = sidx / MASK_BITS;
-    uidx = sidx & (MASK_BITS - 1);
-
-    mrp_debug("%p: %u/%u: %u, offs %zd\n", obj, cidx, uidx, sidx,
-              sidx * pool->objsize);
+    sidx  = (obj - chunk_data(chunk)) / pool->objsize;
+    cidx  = sidx / MASK_BITS;
+    uidx  = sidx & (MASK_BITS - 1);
 
     cache = chunk->cache;
     used  = chunk->used[cidx];
 
-    if (used & (1 << uidx)) {
+    if (used & (1U << uidx)) {
         mrp_log_error("Trying to free unallocated object %p of pool <%s>.",
                       obj, pool->name);
-        return;
+        return FALSE;
     }
 
-    if (pool->cleanup != NULL)
-        pool->cleanup(obj);
-
-    if (pool->flags & MRP_OBJPOOL_FLAG_POISON)
-        memset(obj, pool->poison, pool->objsize);
-
-    chunk->used[cidx] |= (1 << uidx);
-    chunk->cache      |= (1 << cidx);
+    chunk->used[cidx] |= (1U << uidx);
+    chunk->cache      |= (1U << cidx);
 
     if (cache == MASK_FULL) {                    /* chunk was full */
         mrp_list_delete(&chunk->hook);
         pool->nfull--;
-        mrp_list_append(&pool->space, &chunk->hook);
+        mrp_list_prepend(&pool->space, &chunk->hook);
         pool->nspace++;
     }
 
+    if (--chunk->nused == 0) {                   /* chunk became empty */
+        mrp_list_delete(&chunk->hook);
+        mrp_list_append(&pool->space, &chunk->hook);
+
+        if (++pool->nempty > 1 &&
+            (pool->nspace + pool->nfull - 1) * pool->nperchunk >= pool->prealloc)
+            __atomic_store_n(&trim_pending, 1, __ATOMIC_RELAXED);
+    }
+
     pool->nobj--;
+
+    return TRUE;
 }
 
 
 int mrp_objpool_grow(mrp_objpool_t *pool, int nobj)
 {
     int nchunk = (nobj + pool->nperchunk - 1) / pool->nperchunk;
+    int cnt;
+
+    pthread_mutex_lock(&pool->lock);
+    cnt = pool_grow(pool, nchunk);
+    pthread_mutex_unlock(&pool->lock);
 
-    return pool_grow(pool, nchunk) == nchunk;
+    return cnt == nchunk;
 }
 
 
 int mrp_objpool_shrink(mrp_objpool_t *pool, int nobj)
 {
     int nchunk = (nobj + pool->nperchunk - 1) / pool->nperchunk;
+    int cnt;
 
-    return pool_shrink(pool, nchunk) == nchunk;
+    pthread_mutex_lock(&pool->lock);
+    cnt = pool_shrink(pool, nchunk);
+    pthread_mutex_unlock(&pool->lock);
+
+    return cnt == nchunk;
+}
+
+
+int mrp_objpool_trim(mrp_objpool_t *pool)
+{
+    int cnt;
+
+    pthread_mutex_lock(&pool->lock);
+    cnt = pool_trim(pool);
+    pthread_mutex_unlock(&pool->lock);
+
+    return cnt;
+}
+
+
+int mrp_objpool_trim_all(void)
+{
+    mrp_list_hook_t *p, *n;
+    mrp_objpool_t   *pool;
+    int              cnt;
+
+    __atomic_store_n(&trim_pending, 0, __ATOMIC_RELAXED);
+
+    cnt = 0;
+    pthread_mutex_lock(&pools_lock);
+    mrp_list_foreach(&pools, p, n) {
+        pool = mrp_list_entry(p, mrp_objpool_t, hook);
+        cnt += mrp_objpool_trim(pool);
+    }
+    pthread_mutex_unlock(&pools_lock);
+
+    return cnt;
+}
+
+
+int mrp_objpool_trim_pending(void)
+{
+    return __atomic_load_n(&trim_pending, __ATOMIC_RELAXED);
+}
+
+
+void mrp_objpool_get_stats(mrp_objpool_t *pool, mrp_objpool_stats_t *stats)
+{
+    mrp_list_hook_t *p, *n;
+    pool_cache_t    *cache;
+
+    pthread_mutex_lock(&pool->lock);
+
+    stats->name      = pool->name;
+    stats->objsize   = pool->objsize;
+    stats->nperchunk = pool->nperchunk;
+    stats->prealloc  = pool->prealloc;
+    stats->limit     = pool->limit;
+    stats->nobj      = pool->nobj;
+    stats->peak      = pool->peak;
+    stats->nchunk    = pool->nspace + pool->nfull;
+    stats->nempty    = pool->nempty;
+    stats->nalloc    = pool->nalloc;
+    stats->nhit      = pool->nhit;
+    stats->nfail     = pool->nfail;
+    stats->ngrow     = pool->ngrow;
+    stats->nshrink   = pool->nshrink;
+
+    /* objects in thread caches are free, allocations from them hits */
+    mrp_list_foreach(&pool->caches, p, n) {
+        cache = mrp_list_entry(p, pool_cache_t, hook);
+
+        stats->nobj   -= cache->n;
+        stats->nalloc += cache->nalloc;
+        stats->nhit   += cache->nalloc;
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+}
+
+
+int mrp_objpool_stats(mrp_objpool_stats_t *stats, int nstat)
+{
+    mrp_list_hook_t *p, *n;
+    mrp_objpool_t   *pool;
+    int              cnt;
+
+    cnt = 0;
+    pthread_mutex_lock(&pools_lock);
+    mrp_list_foreach(&pools, p, n) {
+        pool = mrp_list_entry(p, mrp_objpool_t, hook);
+
+        if (cnt < nstat)
+            mrp_objpool_get_stats(pool, stats + cnt);
+
+        cnt++;
+    }
+    pthread_mutex_unlock(&pools_lock);
+
+    return cnt;
+}
+
+
+static size_t pool_data_offset(size_t nobj)
+{
+    return MRP_ALIGN(MRP_OFFSET(pool_chunk_t, used[(nobj + B - 1) / B]),
+                     MRP_MM_ALIGN);
 }
 
 
 static int pool_calc_sizes(mrp_objpool_t *pool)
 {
-    size_t S, C, Hf, Hv, P;
-    size_t n, T;
+    size_t S, C, Hf;
+    size_t n;
 
     if (!pool->objsize)
         return FALSE;
@@ -1096,22 +2112,22 @@ static int pool_calc_sizes(mrp_objpool_t *pool)
      * Pool chunks consist of an administrative header followed by object
      * slots each of which can be either claimed/allocated or free. The
      * header contains a back pointer to the pool, a hook to one of the
-     * chunk lists and a two-level bit-mask for slot allocation status.
-     * The two-level mask consists of a 32-bit cache word and actual slot
-     * status words. The nth bit of the cache word caches whether there are
-     * any free among the nth - (n + 31)th slots. The slot status words keep
-     * the status of the actual slots. To find a free slot we find the idx
-     * of the 1st word with a free slot from the cache and then the free
-     * slot index in that word. To be able to use FFS we use inverted bit
-     * semantics (0=allocated, 1=free) and we populate the words starting
-     * at the LSB.
+     * chunk lists, a usage count and a two-level bit-mask for slot
+     * allocation status. The two-level mask consists of a 32-bit cache
+     * word and actual slot status words. The nth bit of the cache word
+     * caches whether there are any free among the nth - (n + 31)th slots.
+     * The slot status words keep the status of the actual slots. To find
+     * a free slot we find the idx of the 1st word with a free slot from
+     * the cache and then the free slot index in that word. To be able to
+     * use FFS we use inverted bit semantics (0=allocated, 1=free) and we
+     * populate the words starting at the LSB.
      *
      * Here we calculate how many objects we'll be able to squeeze into a
      * single pool chunk and how many mask bits we'll need to administer
      * the status of these. To do this we use the following equations:
      *
      *     1) Hf + Hv + n * S = C
-     *     2) Hv = W + (n + B - 1) / B * W
+     *     2) Hv = (n + B - 1) / B * W
      * where
      *     C: chunk size
      *     S: object size (aligned to our minimum alignment)
@@ -1121,42 +2137,32 @@ static int pool_calc_sizes(mrp_objpool_t *pool)
      *     W: bitmask word size in bytes
      *     B: bitmask word size in bits
      *
-     * Solving the equations for n gives us
-     *     n = (B*C - B*Hf - W*(2*B - 1)) / (B*S + W)
+     * Solving the equations for n gives us (an upper bound of)
+     *     n = (B*C - B*Hf) / (B*S + W)
      *
-     * If any, the only non-obvious thing below is that instead of trying
-     * to express padding as part of the equation system (which seems to be
-     * way beyond my abilities in math nowadays), we initally assume no
-     * padding then check and compensate for it in the end if necessary.
+     * We then compensate for padding the objects to proper alignment by
+     * dropping objects until everything fits, and cap the result to what
+     * the single cache word can administer.
      */
 
     Hf = sizeof(pool_chunk_t);
     C  = __mm.chunk_size;
-    P  = 0;
+    S  = pool->objsize;
+    n  = (B * C - B * Hf) / (B * S + W);
 
-    S  = MRP_ALIGN(pool->objsize, MRP_MM_ALIGN);
-    n  = (B * C - B * Hf - W * (2*B - 1)) / (B * S + W);
-    Hv = W + W * (n + B - 1) / B;
+    if (n > B * B)
+        n = B * B;
 
-    P = (Hf + Hv) % sizeof(void *);
-    if (P != 0) {
-        P = sizeof(void *) - P;
+    while (n > 0 && pool_data_offset(n) + n * S > C)
+        n--;
 
-        if (Hv + Hf + P + n * S > C) {
-            n--;
-            Hv = W + W * (n + B - 1) / B;
-        }
-    }
-
-    T  = Hf + Hv + P + n * S;
-
-    if (T > C) {
+    if (n == 0) {
         mrp_log_error("Could not size pool '%s' properly.", pool->name);
         return FALSE;
     }
 
     pool->nperchunk = n;
-    pool->dataidx   = (n + B - 1) / B;
+    pool->dataoffs  = pool_data_offset(n);
 
     if (pool->limit && (pool->limit % pool->nperchunk) != 0)
         pool->limit += (pool->nperchunk - (pool->limit % pool->nperchunk));
@@ -1177,6 +2183,8 @@ static int pool_grow(mrp_objpool_t *pool, int nchunk)
             chunk->pool = pool;
             mrp_list_append(&pool->space, &chunk->hook);
             pool->nspace++;
+            pool->nempty++;
+            pool->ngrow++;
         }
         else
             break;
@@ -1186,6 +2194,16 @@ static int pool_grow(mrp_objpool_t *pool, int nchunk)
 }
 
 
+static void pool_release_chunk(mrp_objpool_t *pool, pool_chunk_t *chunk)
+{
+    mrp_list_delete(&chunk->hook);
+    chunk_free(chunk);
+    pool->nspace--;
+    pool->nempty--;
+    pool->nshrink++;
+}
+
+
 static int pool_shrink(mrp_objpool_t *pool, int nchunk)
 {
     mrp_list_hook_t *p, *n;
@@ -1193,20 +2211,52 @@ static int pool_shrink(mrp_objpool_t *pool, int nchunk)
     int              cnt;
 
     cnt = 0;
-    mrp_list_foreach(&pool->space, p, n) {
+    mrp_list_foreach_back(&pool->space, p, n) {
+        if (cnt >= nchunk)
+            break;
+
         chunk = mrp_list_entry(p, pool_chunk_t, hook);
 
-        if (chunk_empty(chunk)) {
-            mrp_list_delete(&chunk->hook);
-            chunk_free(chunk);
-            pool->nspace--;
-            cnt++;
-        }
+        if (chunk->nused != 0)
+            break;
 
-        if (cnt >= nchunk)
+        pool_release_chunk(pool, chunk);
+        cnt++;
+    }
+
+    return cnt;
+}
+
+
+static int pool_trim(mrp_objpool_t *pool)
+{
+    mrp_list_hook_t *p, *n;
+    pool_chunk_t    *chunk;
+    size_t           keep;
+    int              cnt;
+
+    /*
+     * Release empty chunks, keeping enough chunks for the preallocated
+     * number of objects and one spare empty chunk to avoid thrashing.
+     */
+
+    keep = (pool->prealloc + pool->nperchunk - 1) / pool->nperchunk;
+    cnt  = 0;
+
+    mrp_list_foreach_back(&pool->space, p, n) {
+        chunk = mrp_list_entry(p, pool_chunk_t, hook);
+
+        if (chunk->nused != 0 || pool->nempty <= 1 ||
+            pool->nspace + pool->nfull <= keep)
             break;
+
+        pool_release_chunk(pool, chunk);
+        cnt++;
     }
 
+    if (cnt > 0)
+        mrp_debug("pool <%s>: released %d empty chunks", pool->name, cnt);
+
     return cnt;
 }
 
@@ -1245,8 +2295,8 @@ static void chunk_foreach_object(pool_chunk_t *chunk,
         uidx = sidx & (MASK_BITS - 1);
         used = chunk->used[cidx];
 
-        if (!(used & (1 << uidx))) {
-            obj = ((void *)&chunk->used[pool->dataidx]) + (sidx*pool->objsize);
+        if (!(used & (1U << uidx))) {
+            obj = chunk_data(chunk) + (sidx * pool->objsize);
             cb(obj, user_data);
             sidx++;
         }
@@ -1260,29 +2310,6 @@ static void chunk_foreach_object(pool_chunk_t *chunk,
 }
 
 
-static inline int chunk_empty(pool_chunk_t *chunk)
-{
-    mask_t mask;
-    int    i, n;
-
-    if (chunk->cache != (MASK_EMPTY & 0xffff))
-        return FALSE;
-    else {
-        for (n = chunk->pool->nperchunk, i = 0; n > 0; n -= MASK_BITS, i++) {
-            if (n >= (int)MASK_BITS)
-                mask = MASK_EMPTY;
-            else
-                mask = (1 << n) - 1;
-
-            if ((chunk->used[i] & mask) != mask)
-                return FALSE;
-        }
-
-        return TRUE;
-    }
-}
-
-
 static void chunk_init(pool_chunk_t *chunk, int nperchunk)
 {
     int nword, left, i;
@@ -1300,7 +2327,8 @@ static void chunk_init(pool_chunk_t *chunk, int nperchunk)
      * code paths simpler.
      */
 
-    chunk->cache = (1 << nword) - 1;
+    chunk->nused = 0;
+    chunk->cache = nword < (int)MASK_BITS ? (1U << nword) - 1 : MASK_EMPTY;
 
     for (i = 0; left > 0; i++) {
         if (left >= (int)MASK_BITS)
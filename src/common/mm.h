@@ -103,11 +103,13 @@ MRP_CDECL_BEGIN
 typedef enum {
     MRP_MM_PASSTHRU = 0,                 /* passthru allocator */
     MRP_MM_DEFAULT  = MRP_MM_PASSTHRU,   /* default is passthru */
-    MRP_MM_DEBUG                         /* debugging allocator */
+    MRP_MM_DEBUG,                        /* debugging allocator */
+    MRP_MM_SAMPLE                        /* sampling heap profiler */
 } mrp_mm_type_t;
 
 
 int mrp_mm_config(mrp_mm_type_t type);
+mrp_mm_type_t mrp_mm_type(void);
 void mrp_mm_check(FILE *fp);
 void mrp_mm_dump(FILE *fp);
 
@@ -120,6 +122,40 @@ int mrp_mm_memalign(void **ptr, size_t align, size_t size, const char *file,
                     int line, const char *func);
 void mrp_mm_free(void *ptr, const char *file, int line, const char *func);
 
+/*
+ * sampling heap profiler
+ *
+ * The sampling allocator is selected by the sample[=<bytes>] key of the
+ * memory management configuration, <bytes> being the mean allocation
+ * interval between two samples (512 KB by default). The profile can be
+ * dumped in the pprof heap profile format. Snapshots taken at different
+ * times can be compared with pprof -base to find memory growth.
+ */
+
+typedef struct {
+    uint32_t rate;                       /* mean sampling interval */
+    int      nsite;                      /* number of allocation sites */
+    uint64_t nsample;                    /* number of samples taken */
+    uint64_t live_objs;                  /* estimated live objects */
+    uint64_t live_bytes;                 /* estimated live bytes */
+    uint64_t total_objs;                 /* estimated allocated objects */
+    uint64_t total_bytes;                /* estimated allocated bytes */
+} mrp_mm_profile_t;
+
+/** Get the current heap profile summary, FALSE if not sampling. */
+int mrp_mm_profile_stats(mrp_mm_profile_t *prof);
+
+/** Dump the heap profile to the given stream in pprof format. */
+int mrp_mm_profile_dump(FILE *fp);
+
+/**
+ * Save a heap profile snapshot, to a generated path if path is NULL. The
+ * generated path is in the profile-dir directory, or by default in
+ * $XDG_RUNTIME_DIR or a private /tmp/murphy-<euid> directory. The file is
+ * always created anew, existing files or symlinks are never written to.
+ */
+int mrp_mm_profile_snapshot(const char *path, char *buf, size_t size);
+
 
 
 
@@ -127,6 +163,7 @@ void mrp_mm_free(void *ptr, const char *file, int line, const char *func);
 
 enum {
     MRP_OBJPOOL_FLAG_POISON = 0x1,               /* poison free'd objects */
+    MRP_OBJPOOL_FLAG_ZERO   = 0x2,               /* zero allocated objects */
 };
 
 
@@ -151,7 +188,8 @@ typedef struct mrp_objpool_s mrp_objpool_t;
 /** Create a new object pool with the given configuration. */
 mrp_objpool_t *mrp_objpool_create(mrp_objpool_config_t *cfg);
 
-/** Destroy an object pool, freeing all associated memory. */
+/** Destroy an object pool, freeing all associated memory. The pool must
+    be quiescent: no other thread may use it during or after the call. */
 void mrp_objpool_destroy(mrp_objpool_t *pool);
 
 /** Allocate a new object from the pool. */
@@ -166,6 +204,43 @@ int mrp_objpool_grow(mrp_objpool_t *pool, int nobj);
 /** Shrink @pool by @nobj new objects, if possible. */
 int mrp_objpool_shrink(mrp_objpool_t *pool, int nobj);
 
+/** Release surplus empty chunks of @pool, return the number released. */
+int mrp_objpool_trim(mrp_objpool_t *pool);
+
+/** Release surplus empty chunks of all pools. */
+int mrp_objpool_trim_all(void);
+
+/** Check if any pool has surplus empty chunks to release. */
+int mrp_objpool_trim_pending(void);
+
+
+/*
+ * object pool statistics
+ */
+
+typedef struct {
+    const char *name;                            /* pool name */
+    size_t      objsize;                         /* object size */
+    size_t      nperchunk;                       /* objects per chunk */
+    size_t      prealloc;                        /* preallocated objects */
+    size_t      limit;                           /* max. number of objects */
+    size_t      nobj;                            /* objects in use */
+    size_t      peak;                            /* max. objects in use */
+    size_t      nchunk;                          /* chunks allocated */
+    size_t      nempty;                          /* empty chunks */
+    uint64_t    nalloc;                          /* allocations */
+    uint64_t    nhit;                            /* ... served without growing */
+    uint64_t    nfail;                           /* ... failed */
+    uint64_t    ngrow;                           /* chunks allocated */
+    uint64_t    nshrink;                         /* chunks released */
+} mrp_objpool_stats_t;
+
+/** Get statistics about @pool. */
+void mrp_objpool_get_stats(mrp_objpool_t *pool, mrp_objpool_stats_t *stats);
+
+/** Get statistics about up to @nstat pools, return the number of pools. */
+int mrp_objpool_stats(mrp_objpool_stats_t *stats, int nstat);
+
 /** Get the value of a boolean key from the configuration. */
 int mrp_mm_config_bool(const char *key, int defval);
 
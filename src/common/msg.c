@@ -31,6 +31,7 @@
 #include <errno.h>
 #include <stdarg.h>
 #include <ctype.h>
+#include <pthread.h>
 #include <arpa/inet.h>
 
 #include <murphy/common/macros.h>
@@ -46,6 +47,49 @@ static mrp_data_descr_t **other_types;   /* linearly searched types */
 static int                nother_type;
 
 
+/*
+ * object pools for messages and message fields
+ */
+
+static mrp_objpool_t *msg_pool;
+static mrp_objpool_t *field_pool;
+static pthread_once_t pools_once = PTHREAD_ONCE_INIT;
+
+static void create_pools(void)
+{
+    mrp_objpool_config_t cfg;
+
+    mrp_clear(&cfg);
+    cfg.flags    = MRP_OBJPOOL_FLAG_ZERO;
+    cfg.prealloc = 64;
+
+    cfg.name    = "msg";
+    cfg.objsize = sizeof(mrp_msg_t);
+    msg_pool = mrp_objpool_create(&cfg);
+
+    cfg.name     = "msg-field";
+    cfg.objsize  = MRP_OFFSET(mrp_msg_field_t, size[1]);
+    cfg.prealloc = 256;
+    field_pool = mrp_objpool_create(&cfg);
+}
+
+
+static inline mrp_msg_t *alloc_msg(void)
+{
+    pthread_once(&pools_once, create_pools);
+
+    return msg_pool ? mrp_objpool_alloc(msg_pool) : NULL;
+}
+
+
+static inline mrp_msg_field_t *alloc_field(void)
+{
+    pthread_once(&pools_once, create_pools);
+
+    return field_pool ? mrp_objpool_alloc(field_pool) : NULL;
+}
+
+
 static inline void destroy_field(mrp_msg_field_t *f)
 {
     uint32_t i;
@@ -75,7 +119,7 @@ static inline void destroy_field(mrp_msg_field_t *f)
             break;
         }
 
-        mrp_free(f);
+        mrp_objpool_free(f);
     }
 }
 
@@ -91,8 +135,7 @@ static inline mrp_msg_field_t *create_field(uint16_t tag, va_list *ap)
 
 #define CREATE(_f, _tag, _type, _fldtype, _fld, _last, _errlbl) do {      \
                                                                           \
-            (_f) = mrp_allocz(MRP_OFFSET(typeof(*_f), _last) +            \
-                              sizeof(_f->_last));                         \
+            (_f) = alloc_field();                                         \
                                                                           \
             if ((_f) != NULL) {                                           \
                 mrp_list_init(&(_f)->hook);                             \
@@ -109,7 +152,7 @@ static inline mrp_msg_field_t *create_field(uint16_t tag, va_list *ap)
             uint16_t _base;                                               \
             uint32_t _i;                                                  \
                                                                           \
-            (_f) = mrp_allocz(MRP_OFFSET(typeof(*_f), size[1]));          \
+            (_f) = alloc_field();                                         \
                                                                           \
             if ((_f) != NULL) {                                           \
                 (_f)->tag  = _tag;                                        \
@@ -265,7 +308,7 @@ static void msg_destroy(mrp_msg_t *msg)
             destroy_field(f);
         }
 
-        mrp_free(msg);
+        mrp_objpool_free(msg);
     }
 }
 
@@ -277,7 +320,7 @@ mrp_msg_t *mrp_msg_createv(uint16_t tag, va_list ap)
     va_list          aq;
 
     va_copy(aq, ap);
-    if ((msg = mrp_allocz(sizeof(*msg))) != NULL) {
+    if ((msg = alloc_msg()) != NULL) {
         mrp_list_init(&msg->fields);
         mrp_refcnt_init(&msg->refcnt);
 
@@ -928,7 +971,28 @@ int mrp_msg_dump(mrp_msg_t *msg, FILE *fp)
 
 #define MSG_MIN_CHUNK 32
 
-ssize_t mrp_msg_default_encode(mrp_msg_t *msg, void **bufp)
+
+/*
+ * Start encoding either into a freshly allocated buffer or, if sizep
+ * is given, into the caller-provided buffer *bufp of *sizep bytes. In
+ * the latter case the buffer is grown (reallocated) as necessary.
+ */
+
+static void *msgbuf_init(mrp_msgbuf_t *mb, void *buf, size_t *sizep,
+                         size_t size)
+{
+    if (sizep == NULL)
+        return mrp_msgbuf_write(mb, size);
+
+    mb->buf  = mb->p = buf;
+    mb->size = mb->l = (buf != NULL ? *sizep : 0);
+
+    return mrp_msgbuf_ensure(mb, size);
+}
+
+
+static ssize_t msg_encode(mrp_msg_t *msg, void **bufp, size_t *sizep,
+                          size_t reserve)
 {
     mrp_msg_field_t *f;
     mrp_list_hook_t *p, *n;
@@ -937,9 +1001,12 @@ ssize_t mrp_msg_default_encode(mrp_msg_t *msg, void **bufp)
     uint16_t         type;
     size_t           size;
 
-    size = msg->nfield * (2 * sizeof(uint16_t) + sizeof(uint64_t));
+    size = reserve + msg->nfield * (2 * sizeof(uint16_t) + sizeof(uint64_t));
+
+    if (msgbuf_init(&mb, *bufp, sizep, size)) {
+        if (reserve)
+            mrp_msgbuf_reserve(&mb, reserve, 1);
 
-    if (mrp_msgbuf_write(&mb, size)) {
         MRP_MSGBUF_PUSH(&mb, htobe16(MRP_MSG_TAG_DEFAULT), 1, nomem);
         MRP_MSGBUF_PUSH(&mb, htobe16(msg->nfield), 1, nomem);
 
@@ -1069,6 +1136,8 @@ ssize_t mrp_msg_default_encode(mrp_msg_t *msg, void **bufp)
                     mrp_msgbuf_cancel(&mb);
                 nomem:
                     *bufp = NULL;
+                    if (sizep != NULL)
+                        *sizep = 0;
                     return -1;
                 }
             }
@@ -1076,10 +1145,28 @@ ssize_t mrp_msg_default_encode(mrp_msg_t *msg, void **bufp)
     }
 
     *bufp = mb.buf;
+    if (sizep != NULL)
+        *sizep = (mb.buf != NULL ? mb.size : 0);
+
     return mb.p - mb.buf;
 }
 
 
+ssize_t mrp_msg_default_encode(mrp_msg_t *msg, void **bufp)
+{
+    *bufp = NULL;
+
+    return msg_encode(msg, bufp, NULL, 0);
+}
+
+
+ssize_t mrp_msg_default_encode_buf(mrp_msg_t *msg, void **bufp, size_t *sizep,
+                                   size_t reserve)
+{
+    return msg_encode(msg, bufp, sizep, reserve);
+}
+
+
 mrp_msg_t *mrp_msg_default_decode(void *buf, size_t size)
 {
     mrp_msg_t       *msg;
@@ -1540,8 +1627,8 @@ static __attribute__((destructor)) void cleanup_types(void)
 }
 
 
-size_t mrp_data_encode(void **bufp, void *data, mrp_data_descr_t *descr,
-                       size_t reserve)
+static size_t data_encode(void **bufp, size_t *sizep, void *data,
+                          mrp_data_descr_t *descr, size_t reserve)
 {
     mrp_data_member_t *fields, *f;
     int                nfield;
@@ -1556,7 +1643,7 @@ size_t mrp_data_encode(void **bufp, void *data, mrp_data_descr_t *descr,
     nfield = descr->nfield;
     size   = reserve + nfield * (2 * sizeof(uint16_t) + sizeof(uint64_t));
 
-    if (mrp_msgbuf_write(&mb, size)) {
+    if (msgbuf_init(&mb, *bufp, sizep, size)) {
         if (reserve)
             mrp_msgbuf_reserve(&mb, reserve, 1);
 
@@ -1694,6 +1781,8 @@ size_t mrp_data_encode(void **bufp, void *data, mrp_data_descr_t *descr,
                     mrp_msgbuf_cancel(&mb);
                 nomem:
                     *bufp = NULL;
+                    if (sizep != NULL)
+                        *sizep = 0;
                     return 0;
                 }
             }
@@ -1701,10 +1790,29 @@ size_t mrp_data_encode(void **bufp, void *data, mrp_data_descr_t *descr,
     }
 
     *bufp = mb.buf;
+    if (sizep != NULL)
+        *sizep = (mb.buf != NULL ? mb.size : 0);
+
     return (size_t)(mb.p - mb.buf);
 }
 
 
+size_t mrp_data_encode(void **bufp, void *data, mrp_data_descr_t *descr,
+                       size_t reserve)
+{
+    *bufp = NULL;
+
+    return data_encode(bufp, NULL, data, descr, reserve);
+}
+
+
+size_t mrp_data_encode_buf(void **bufp, size_t *sizep, void *data,
+                           mrp_data_descr_t *descr, size_t reserve)
+{
+    return data_encode(bufp, sizep, data, descr, reserve);
+}
+
+
 static mrp_data_member_t *member_type(mrp_data_member_t *fields, int nfield,
                                       uint16_t tag)
 {
@@ -236,6 +236,15 @@ int mrp_msg_dump(mrp_msg_t *msg, FILE *fp);
 /** Encode the given message using the default message encoder. */
 ssize_t mrp_msg_default_encode(mrp_msg_t *msg, void **bufp);
 
+/**
+ * Encode the given message into the buffer *bufp of *sizep bytes, leaving
+ * reserve bytes free in front. The buffer is reallocated as necessary
+ * and both *bufp and *sizep are updated accordingly. Returns the number
+ * of bytes used, including the reserved ones.
+ */
+ssize_t mrp_msg_default_encode_buf(mrp_msg_t *msg, void **bufp, size_t *sizep,
+                                   size_t reserve);
+
 /** Decode the given message using the default message decoder. */
 mrp_msg_t *mrp_msg_default_decode(void *buf, size_t size);
 
@@ -331,6 +340,10 @@ typedef struct {
 size_t mrp_data_encode(void **bufp, void *data, mrp_data_descr_t *descr,
                        size_t reserve);
 
+/** Encode a structure into an existing buffer, growing it as necessary. */
+size_t mrp_data_encode_buf(void **bufp, size_t *sizep, void *data,
+                           mrp_data_descr_t *descr, size_t reserve);
+
 /** Decode a structure using the given message descriptor. */
 void *mrp_data_decode(void **bufp, size_t *sizep, mrp_data_descr_t *descr);
 
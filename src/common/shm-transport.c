@@ -0,0 +1,1078 @@
+/*
+ * Copyright (c) 2012, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+
+#include <murphy/common/macros.h>
+#include <murphy/common/mm.h>
+#include <murphy/common/log.h>
+#include <murphy/common/debug.h>
+#include <murphy/common/msg.h>
+#include <murphy/common/transport.h>
+#include <murphy/common/shm-transport.h>
+
+#define SHMT  "shm"
+#define SHMTL 3
+
+#define SHM_MAGIC        0x4d524853      /* shm setup message magic */
+#define SHM_VERSION      1               /* shm setup message version */
+#define SHM_TIMEOUT      1000            /* setup message timeout (msecs) */
+#define RECORD_ALIGN     8               /* ring record alignment */
+#define RECORD_WRAP      0xffffffffU     /* record wraps to ring start */
+
+#ifndef MFD_CLOEXEC
+#    define MFD_CLOEXEC  0x0001U
+#endif
+#ifndef MFD_ALLOW_SEALING
+#    define MFD_ALLOW_SEALING 0x0002U
+#endif
+#ifndef F_ADD_SEALS
+#    define F_ADD_SEALS   1033
+#    define F_GET_SEALS   1034
+#    define F_SEAL_SEAL   0x0001
+#    define F_SEAL_SHRINK 0x0002
+#    define F_SEAL_GROW   0x0004
+#endif
+
+#define SHM_SEALS (F_SEAL_SHRINK | F_SEAL_GROW) /* seals we require */
+
+/*
+ * A single-producer/single-consumer ring in shared memory.
+ *
+ * Both offsets are free-running and only ever increased, by the producer
+ * (head) and the consumer (tail) respectively. Records consist of a
+ * 32-bit payload size followed by the payload, padded to RECORD_ALIGN.
+ * A record never wraps around the end of the ring. If it would, the
+ * producer writes a RECORD_WRAP marker instead and continues from the
+ * beginning of the ring. The consumer sets sleeping before it goes back
+ * to wait for its doorbell, and the producer only rings the doorbell
+ * if it finds sleeping set.
+ */
+
+typedef struct {
+    uint32_t head;                       /* producer offset */
+    uint8_t  __head_pad[60];             /* keep head on its own line */
+    uint32_t tail;                       /* consumer offset */
+    uint32_t sleeping;                   /* consumer waits for doorbell */
+    uint8_t  __tail_pad[56];             /* keep tail on its own line */
+    uint8_t  data[];                     /* ring data */
+} shmt_ring_t;
+
+
+/*
+ * setup message passed with the memfd and the doorbell eventfds
+ */
+
+typedef struct {
+    uint32_t magic;                      /* SHM_MAGIC */
+    uint32_t version;                    /* SHM_VERSION */
+    uint32_t ringsize;                   /* data size of a single ring */
+} shmt_setup_t;
+
+enum {
+    FD_MEMORY = 0,                       /* memfd with the rings */
+    FD_TOSERVER,                         /* client->server doorbell */
+    FD_TOCLIENT,                         /* server->client doorbell */
+    FD_MAX
+};
+
+
+typedef struct {
+    MRP_TRANSPORT_PUBLIC_FIELDS;         /* common transport fields */
+    int             sock;                /* rendezvous/liveness socket */
+    mrp_io_watch_t *iow;                 /* socket I/O watch */
+    uint32_t        ringsize;            /* data size of a single ring */
+    void           *map;                 /* mapped rings */
+    size_t          mapsize;             /* size of mapped rings */
+    shmt_ring_t   *in;                  /* ring we consume */
+    shmt_ring_t   *out;                 /* ring we produce */
+    int             infd;                /* our doorbell */
+    int             outfd;               /* peer doorbell */
+    mrp_io_watch_t *inw;                 /* doorbell I/O watch */
+    void           *ibuf;                /* private copy of input record */
+    size_t          isize;               /* input copy buffer size */
+    int             setup;               /* waiting for client setup */
+    mrp_timer_t    *timer;               /* client setup timeout */
+    void           *pbuf;                /* output queued during setup */
+    size_t          psize;               /* allocated queue size */
+    size_t          pused;               /* amount of queued output */
+} shmt_t;
+
+
+static void shmt_sock_cb(mrp_io_watch_t *w, int fd, mrp_io_event_t events,
+                        void *user_data);
+static void shmt_bell_cb(mrp_io_watch_t *w, int fd, mrp_io_event_t events,
+                        void *user_data);
+static int shmt_disconnect(mrp_transport_t *mt);
+static void closed(shmt_t *t, int error);
+
+
+static socklen_t shmt_resolve(const char *str, mrp_sockaddr_t *addr,
+                             socklen_t size, const char **typep)
+{
+    struct sockaddr_un *un;
+    const char         *path;
+    socklen_t           len;
+
+    if (strncmp(str, SHMT":", SHMTL + 1))
+        return 0;
+
+    path = str + SHMTL + 1;
+
+    if (path[0] != '/' && path[0] != '@')
+        return 0;
+
+    un  = &addr->unx;
+    len = MRP_OFFSET(typeof(*un), sun_path) + strlen(path);
+
+    if (size < len || strlen(path) >= sizeof(un->sun_path)) {
+        errno = ENOMEM;
+        return 0;
+    }
+
+    un->sun_family = AF_UNIX;
+    strcpy(un->sun_path, path);
+    if (un->sun_path[0] == '@')
+        un->sun_path[0] = '\0';
+
+    if (typep != NULL)
+        *typep = SHMT;
+
+    return len;
+}
+
+
+static int shmt_open(mrp_transport_t *mt)
+{
+    shmt_t *t = (shmt_t *)mt;
+
+    t->sock     = -1;
+    t->infd     = -1;
+    t->outfd    = -1;
+    t->ringsize = MRP_SHM_RINGSIZE_DEFAULT;
+
+    return TRUE;
+}
+
+
+static int valid_ringsize(uint32_t size)
+{
+    return (size >= MRP_SHM_RINGSIZE_MIN && size <= MRP_SHM_RINGSIZE_MAX &&
+            !(size & (size - 1)));
+}
+
+
+static int shmt_setopt(mrp_transport_t *mt, const char *opt, const void *val)
+{
+    shmt_t   *t = (shmt_t *)mt;
+    uint32_t  size;
+
+    if (!strcmp(opt, MRP_SHM_OPT_RINGSIZE) && val != NULL) {
+        size = *(const uint32_t *)val;
+
+        if (!valid_ringsize(size) || t->map != NULL) {
+            errno = EINVAL;
+            return FALSE;
+        }
+
+        t->ringsize = size;
+
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+
+static void set_flags(shmt_t *t, int fd)
+{
+    int  on;
+    long nb;
+
+    if (t->flags & MRP_TRANSPORT_REUSEADDR) {
+        on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    }
+    if (t->flags & MRP_TRANSPORT_NONBLOCK) {
+        nb = 1;
+        fcntl(fd, F_SETFL, O_NONBLOCK, nb);
+    }
+    if (t->flags & MRP_TRANSPORT_CLOEXEC) {
+        on = 1;
+        fcntl(fd, F_SETFL, O_CLOEXEC, on);
+    }
+}
+
+
+/*
+ * The server refuses to map memory the client could still shrink (which
+ * would fault the server on access), so we need a sealable memfd here.
+ */
+
+static int create_memfd(size_t size)
+{
+    int fd;
+
+#ifdef __NR_memfd_create
+    fd = syscall(__NR_memfd_create, "murphy-shm",
+                 MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#else
+    fd    = -1;
+    errno = ENOSYS;
+#endif
+
+    if (fd < 0)
+        return -1;
+
+    if (ftruncate(fd, size) < 0 ||
+        fcntl(fd, F_ADD_SEALS, SHM_SEALS | F_SEAL_SEAL) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+
+static int is_sealed(int fd)
+{
+    int seals = fcntl(fd, F_GET_SEALS);
+
+    return seals >= 0 && (seals & SHM_SEALS) == SHM_SEALS;
+}
+
+
+static int is_eventfd(int fd)
+{
+    char    path[64], link[64];
+    ssize_t n;
+
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+
+    if ((n = readlink(path, link, sizeof(link) - 1)) < 0)
+        return FALSE;
+
+    link[n] = '\0';
+
+    return !strcmp(link, "anon_inode:[eventfd]");
+}
+
+
+static int map_rings(shmt_t *t, int memfd, int server)
+{
+    shmt_ring_t *toserver, *toclient;
+    size_t      ringlen;
+
+    ringlen    = sizeof(shmt_ring_t) + t->ringsize;
+    t->mapsize = 2 * ringlen;
+    t->map     = mmap(NULL, t->mapsize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      memfd, 0);
+
+    if (t->map == MAP_FAILED) {
+        t->map = NULL;
+        return FALSE;
+    }
+
+    toserver = t->map;
+    toclient = t->map + ringlen;
+
+    t->in  = server ? toserver : toclient;
+    t->out = server ? toclient : toserver;
+
+    return TRUE;
+}
+
+
+static void unmap_rings(shmt_t *t)
+{
+    if (t->map != NULL) {
+        munmap(t->map, t->mapsize);
+        t->map = NULL;
+    }
+
+    t->in  = NULL;
+    t->out = NULL;
+}
+
+
+static int add_watches(shmt_t *t)
+{
+    mrp_io_event_t events;
+
+    events = MRP_IO_EVENT_IN | MRP_IO_EVENT_HUP;
+    t->iow = mrp_add_io_watch(t->ml, t->sock, events, shmt_sock_cb, t);
+    t->inw = mrp_add_io_watch(t->ml, t->infd, MRP_IO_EVENT_IN, shmt_bell_cb, t);
+
+    if (t->iow != NULL && t->inw != NULL) {
+        /*
+         * The peer might have produced records before we got here. Ring
+         * our own doorbell once to pick those up, then go to sleep.
+         */
+        eventfd_write(t->infd, 1);
+        return TRUE;
+    }
+
+    mrp_del_io_watch(t->iow);
+    mrp_del_io_watch(t->inw);
+    t->iow = NULL;
+    t->inw = NULL;
+
+    return FALSE;
+}
+
+
+static void teardown(shmt_t *t)
+{
+    mrp_del_io_watch(t->inw);
+    t->inw = NULL;
+
+    mrp_del_timer(t->timer);
+    t->timer = NULL;
+    t->setup = FALSE;
+
+    mrp_free(t->ibuf);
+    t->ibuf  = NULL;
+    t->isize = 0;
+
+    mrp_free(t->pbuf);
+    t->pbuf  = NULL;
+    t->psize = 0;
+    t->pused = 0;
+
+    unmap_rings(t);
+
+    if (t->infd >= 0) {
+        close(t->infd);
+        t->infd = -1;
+    }
+
+    if (t->outfd >= 0) {
+        close(t->outfd);
+        t->outfd = -1;
+    }
+}
+
+
+static int send_setup(shmt_t *t, int *fds)
+{
+    shmt_setup_t    setup;
+    struct msghdr   msg;
+    struct iovec    iov;
+    struct cmsghdr *cmsg;
+    char            ctl[CMSG_SPACE(FD_MAX * sizeof(int))];
+
+    setup.magic    = SHM_MAGIC;
+    setup.version  = SHM_VERSION;
+    setup.ringsize = t->ringsize;
+
+    iov.iov_base = &setup;
+    iov.iov_len  = sizeof(setup);
+
+    mrp_clear(&msg);
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = ctl;
+    msg.msg_controllen = sizeof(ctl);
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type  = SCM_RIGHTS;
+    cmsg->cmsg_len   = CMSG_LEN(FD_MAX * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), fds, FD_MAX * sizeof(int));
+
+    return sendmsg(t->sock, &msg, MSG_NOSIGNAL) == (ssize_t)sizeof(setup);
+}
+
+
+static int recv_setup(shmt_t *t, shmt_setup_t *setup, int *fds)
+{
+    struct msghdr   msg;
+    struct iovec    iov;
+    struct cmsghdr *cmsg;
+    char            ctl[CMSG_SPACE(FD_MAX * sizeof(int))];
+    ssize_t         n;
+    int             i;
+
+    for (i = 0; i < FD_MAX; i++)
+        fds[i] = -1;
+
+    iov.iov_base = setup;
+    iov.iov_len  = sizeof(*setup);
+
+    mrp_clear(&msg);
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = ctl;
+    msg.msg_controllen = sizeof(ctl);
+
+    n = recvmsg(t->sock, &msg, MSG_CMSG_CLOEXEC | MSG_DONTWAIT);
+
+    if (n < 0 && (errno == EAGAIN || errno == EINTR))
+        return FALSE;
+
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+            cmsg->cmsg_len == CMSG_LEN(FD_MAX * sizeof(int)))
+            memcpy(fds, CMSG_DATA(cmsg), FD_MAX * sizeof(int));
+    }
+
+    if (n != (ssize_t)sizeof(*setup) || fds[FD_MAX - 1] < 0 ||
+        setup->magic != SHM_MAGIC || setup->version != SHM_VERSION ||
+        !valid_ringsize(setup->ringsize)) {
+        for (i = 0; i < FD_MAX; i++)
+            if (fds[i] >= 0)
+                close(fds[i]);
+        errno = EPROTO;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+static int flush_pending(shmt_t *t);
+static int ring_write(shmt_t *t, void *data, size_t size);
+
+
+/*
+ * Complete the server side of a connection once the setup message of
+ * the client has arrived. We only take what the client passes us if
+ * it cannot be used against us: the memory must be sealed against
+ * resizing and both doorbells must be eventfds, which we set to
+ * non-blocking mode, so ringing the client can never block us.
+ */
+
+static int finish_setup(shmt_t *t, shmt_setup_t *setup, int *fds)
+{
+    struct stat st;
+    int         i, success;
+
+    t->ringsize = setup->ringsize;
+
+    success = FALSE;
+
+    if (!is_eventfd(fds[FD_TOSERVER]) || !is_eventfd(fds[FD_TOCLIENT])) {
+        mrp_log_error("shm-transport: client doorbells are not eventfds.");
+        goto out;
+    }
+
+    if (fstat(fds[FD_MEMORY], &st) < 0 || !S_ISREG(st.st_mode) ||
+        st.st_size < (off_t)(2 * (sizeof(shmt_ring_t) + t->ringsize))) {
+        mrp_log_error("shm-transport: invalid client memory.");
+        goto out;
+    }
+
+    if (!is_sealed(fds[FD_MEMORY])) {
+        mrp_log_error("shm-transport: client memory is not sealed.");
+        goto out;
+    }
+
+    if (!map_rings(t, fds[FD_MEMORY], TRUE))
+        goto out;
+
+    t->infd  = fds[FD_TOSERVER];
+    t->outfd = fds[FD_TOCLIENT];
+    fds[FD_TOSERVER] = fds[FD_TOCLIENT] = -1;
+
+    fcntl(t->infd, F_SETFL, O_NONBLOCK);
+    fcntl(t->outfd, F_SETFL, O_NONBLOCK);
+
+    t->inw = mrp_add_io_watch(t->ml, t->infd, MRP_IO_EVENT_IN,
+                              shmt_bell_cb, t);
+
+    if (t->inw != NULL) {
+        /* pick up anything the client produced before we got here */
+        eventfd_write(t->infd, 1);
+        success = flush_pending(t);
+    }
+
+ out:
+    for (i = 0; i < FD_MAX; i++)
+        if (fds[i] >= 0)
+            close(fds[i]);
+
+    return success;
+}
+
+
+static void setup_timeout_cb(mrp_timer_t *tmr, void *user_data)
+{
+    shmt_t *t = (shmt_t *)user_data;
+
+    MRP_UNUSED(tmr);
+
+    mrp_log_error("shm-transport: timed out waiting for client setup.");
+
+    mrp_del_timer(t->timer);
+    t->timer = NULL;
+
+    closed(t, ETIMEDOUT);
+}
+
+
+/*
+ * Try to complete a pending server-side setup. Returns TRUE if the
+ * setup is complete or still pending, FALSE if it failed.
+ */
+
+static int check_setup(shmt_t *t)
+{
+    shmt_setup_t setup;
+    int          fds[FD_MAX];
+
+    if (!recv_setup(t, &setup, fds)) {
+        if (errno == EAGAIN || errno == EINTR)
+            return TRUE;
+
+        mrp_log_error("shm-transport: invalid setup from client (%d: %s).",
+                      errno, strerror(errno));
+        return FALSE;
+    }
+
+    mrp_del_timer(t->timer);
+    t->timer = NULL;
+    t->setup = FALSE;
+
+    if (!finish_setup(t, &setup, fds))
+        return FALSE;
+
+    mrp_debug("shm-transport: accepted client with %u byte rings",
+              t->ringsize);
+
+    return TRUE;
+}
+
+
+static int shmt_bind(mrp_transport_t *mt, mrp_sockaddr_t *addr,
+                    socklen_t addrlen)
+{
+    shmt_t         *t = (shmt_t *)mt;
+    mrp_io_event_t  events;
+
+    if (t->sock != -1 || addr->any.sa_family != AF_UNIX)
+        return FALSE;
+
+    if ((t->sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+        return FALSE;
+
+    set_flags(t, t->sock);
+
+    events = MRP_IO_EVENT_IN | MRP_IO_EVENT_HUP;
+    t->iow = mrp_add_io_watch(t->ml, t->sock, events, shmt_sock_cb, t);
+
+    if (t->iow != NULL && bind(t->sock, &addr->any, addrlen) == 0)
+        return TRUE;
+
+    mrp_del_io_watch(t->iow);
+    t->iow = NULL;
+    close(t->sock);
+    t->sock = -1;
+
+    return FALSE;
+}
+
+
+static int shmt_listen(mrp_transport_t *mt, int backlog)
+{
+    shmt_t *t = (shmt_t *)mt;
+
+    if (t->sock != -1 && t->iow != NULL && t->evt.connection != NULL) {
+        if (listen(t->sock, backlog) == 0) {
+            t->listened = TRUE;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+
+/*
+ * The client sends its setup message right after connecting, but it
+ * need not have arrived by the time we accept. Rather than blocking
+ * the mainloop for it, we complete the setup from the socket watch
+ * (or fail it after SHM_TIMEOUT). Output sent before that is queued.
+ */
+
+static int shmt_accept(mrp_transport_t *mt, mrp_transport_t *mlt)
+{
+    shmt_t         *t, *lt;
+    mrp_io_event_t  events;
+
+    t  = (shmt_t *)mt;
+    lt = (shmt_t *)mlt;
+
+    t->sock  = accept(lt->sock, NULL, NULL);
+    t->infd  = -1;
+    t->outfd = -1;
+
+    if (t->sock < 0)
+        return FALSE;
+
+    set_flags(t, t->sock);
+
+    t->setup = TRUE;
+    t->timer = mrp_add_timer(t->ml, SHM_TIMEOUT, setup_timeout_cb, t);
+
+    events = MRP_IO_EVENT_IN | MRP_IO_EVENT_HUP;
+    t->iow = mrp_add_io_watch(t->ml, t->sock, events, shmt_sock_cb, t);
+
+    if (t->timer != NULL && t->iow != NULL && check_setup(t))
+        return TRUE;
+
+    mrp_del_io_watch(t->iow);
+    t->iow = NULL;
+
+    teardown(t);
+    close(t->sock);
+    t->sock = -1;
+
+    return FALSE;
+}
+
+
+static int shmt_connect(mrp_transport_t *mt, mrp_sockaddr_t *addr,
+                       socklen_t addrlen)
+{
+    shmt_t *t = (shmt_t *)mt;
+    int    fds[FD_MAX] = { -1, -1, -1 };
+    int    memfd;
+
+    if (addr->any.sa_family != AF_UNIX)
+        return FALSE;
+
+    if ((t->sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+        return FALSE;
+
+    if (connect(t->sock, &addr->any, addrlen) < 0)
+        goto fail;
+
+    memfd = create_memfd(2 * (sizeof(shmt_ring_t) + t->ringsize));
+    fds[FD_MEMORY]   = memfd;
+    fds[FD_TOSERVER] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    fds[FD_TOCLIENT] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (memfd < 0 || fds[FD_TOSERVER] < 0 || fds[FD_TOCLIENT] < 0)
+        goto fail;
+
+    if (!map_rings(t, memfd, FALSE) || !send_setup(t, fds))
+        goto fail;
+
+    close(memfd);
+    fds[FD_MEMORY] = -1;
+
+    t->infd  = fds[FD_TOCLIENT];
+    t->outfd = fds[FD_TOSERVER];
+
+    set_flags(t, t->sock);
+
+    if (add_watches(t)) {
+        mrp_debug("shm-transport: connected with %u byte rings", t->ringsize);
+        return TRUE;
+    }
+
+    fds[FD_TOCLIENT] = fds[FD_TOSERVER] = -1;
+
+ fail:
+    if (fds[FD_MEMORY] >= 0)
+        close(fds[FD_MEMORY]);
+    if (fds[FD_TOSERVER] >= 0 && fds[FD_TOSERVER] != t->outfd)
+        close(fds[FD_TOSERVER]);
+    if (fds[FD_TOCLIENT] >= 0 && fds[FD_TOCLIENT] != t->infd)
+        close(fds[FD_TOCLIENT]);
+
+    teardown(t);
+    close(t->sock);
+    t->sock = -1;
+
+    return FALSE;
+}
+
+
+static int shmt_disconnect(mrp_transport_t *mt)
+{
+    shmt_t *t = (shmt_t *)mt;
+
+    if (t->connected) {
+        mrp_del_io_watch(t->iow);
+        t->iow = NULL;
+
+        teardown(t);
+
+        shutdown(t->sock, SHUT_RDWR);
+
+        return TRUE;
+    }
+    else
+        return FALSE;
+}
+
+
+static void shmt_close(mrp_transport_t *mt)
+{
+    shmt_t *t = (shmt_t *)mt;
+
+    mrp_del_io_watch(t->iow);
+    t->iow = NULL;
+
+    teardown(t);
+
+    if (t->sock >= 0) {
+        close(t->sock);
+        t->sock = -1;
+    }
+}
+
+
+static void closed(shmt_t *t, int error)
+{
+    mrp_transport_t *mt = (mrp_transport_t *)t;
+
+    shmt_disconnect(mt);
+
+    if (t->evt.closed != NULL)
+        MRP_TRANSPORT_BUSY(mt, {
+                mt->evt.closed(mt, error, mt->user_data);
+            });
+
+    t->check_destroy(mt);
+}
+
+
+static void shmt_sock_cb(mrp_io_watch_t *w, int fd, mrp_io_event_t events,
+                        void *user_data)
+{
+    shmt_t          *t  = (shmt_t *)user_data;
+    mrp_transport_t *mt = (mrp_transport_t *)t;
+    char             buf[64];
+    ssize_t          n;
+
+    MRP_UNUSED(w);
+
+    if (events & MRP_IO_EVENT_IN) {
+        if (MRP_UNLIKELY(mt->listened != 0)) {
+            MRP_TRANSPORT_BUSY(mt, {
+                    mt->evt.connection(mt, mt->user_data);
+                });
+
+            t->check_destroy(mt);
+            return;
+        }
+
+        if (MRP_UNLIKELY(t->setup)) {
+            if (!check_setup(t))
+                closed(t, EPROTO);
+            return;
+        }
+
+        /* nothing but the peer closing is expected on the socket */
+        n = read(fd, buf, sizeof(buf));
+
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+            closed(t, n < 0 ? EIO : 0);
+            return;
+        }
+    }
+
+    if (events & MRP_IO_EVENT_HUP)
+        closed(t, 0);
+}
+
+
+static void shmt_bell_cb(mrp_io_watch_t *w, int fd, mrp_io_event_t events,
+                        void *user_data)
+{
+    shmt_t          *t  = (shmt_t *)user_data;
+    mrp_transport_t *mt = (mrp_transport_t *)t;
+    shmt_ring_t     *r;
+    uint64_t         cnt;
+    uint32_t         head, tail, offs, size, need, mask;
+    int              error;
+
+    MRP_UNUSED(w);
+    MRP_UNUSED(events);
+
+    if (read(fd, &cnt, sizeof(cnt)) < 0 && errno != EAGAIN)
+        mrp_debug("shm-transport: failed to read doorbell");
+
+    mask = t->ringsize - 1;
+
+    while ((r = t->in) != NULL) {
+        tail = r->tail;
+        head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+
+        if (tail == head) {
+            /*
+             * Announce that we're going to sleep, then check once more
+             * to close the race with a producer that has just added a
+             * record without seeing sleeping set.
+             */
+            __atomic_store_n(&r->sleeping, 1, __ATOMIC_SEQ_CST);
+
+            if (__atomic_load_n(&r->head, __ATOMIC_SEQ_CST) == tail)
+                return;
+
+            continue;
+        }
+
+        offs = tail & mask;
+        size = *(volatile uint32_t *)(r->data + offs);
+
+        if (size == RECORD_WRAP) {
+            __atomic_store_n(&r->tail, tail + (t->ringsize - offs),
+                             __ATOMIC_RELEASE);
+            continue;
+        }
+
+        need = MRP_ALIGN(sizeof(uint32_t) + size, RECORD_ALIGN);
+
+        if (size > t->ringsize || offs + need > t->ringsize ||
+            need > head - tail) {
+            error = EPROTO;
+            goto fatal_error;
+        }
+
+        /*
+         * The peer can still write the ring, so we decode from a private
+         * copy of the payload to rule out any changes under our feet.
+         */
+        if (t->isize < size) {
+            if (mrp_realloc(t->ibuf, size) == NULL) {
+                error = ENOMEM;
+                goto fatal_error;
+            }
+            t->isize = size;
+        }
+
+        memcpy(t->ibuf, r->data + offs + sizeof(uint32_t), size);
+
+        error = t->recv_data(mt, t->ibuf, size, NULL, 0);
+
+        if (t->in != NULL)
+            __atomic_store_n(&r->tail, tail + need, __ATOMIC_RELEASE);
+
+        if (error)
+            goto fatal_error;
+
+        if (t->check_destroy(mt))
+            return;
+    }
+
+    return;
+
+ fatal_error:
+    closed(t, error < 0 ? -error : error);
+}
+
+
+/*
+ * Queue output sent before the client setup is complete. We allow at
+ * most as much as the default ring would hold.
+ */
+
+static int queue_pending(shmt_t *t, void *data, size_t size)
+{
+    uint32_t len;
+    size_t   need;
+
+    need = t->pused + sizeof(len) + size;
+
+    if (need > MRP_SHM_RINGSIZE_DEFAULT) {
+        mrp_log_error("shm-transport: too much output before setup.");
+        errno = ENOBUFS;
+        return FALSE;
+    }
+
+    if (need > t->psize) {
+        if (mrp_realloc(t->pbuf, need) == NULL)
+            return FALSE;
+        t->psize = need;
+    }
+
+    len = size;
+    memcpy(t->pbuf + t->pused, &len, sizeof(len));
+    memcpy(t->pbuf + t->pused + sizeof(len), data, size);
+    t->pused = need;
+
+    return TRUE;
+}
+
+
+static int flush_pending(shmt_t *t)
+{
+    uint32_t len;
+    size_t   offs;
+    int      success;
+
+    success = TRUE;
+
+    for (offs = 0; success && offs < t->pused; offs += sizeof(len) + len) {
+        memcpy(&len, t->pbuf + offs, sizeof(len));
+        success = ring_write(t, t->pbuf + offs + sizeof(len), len);
+    }
+
+    mrp_free(t->pbuf);
+    t->pbuf  = NULL;
+    t->psize = 0;
+    t->pused = 0;
+
+    return success;
+}
+
+
+static int ring_write(shmt_t *t, void *data, size_t size)
+{
+    shmt_ring_t *r;
+    uint32_t    head, tail, offs, skip, need, mask;
+    uint64_t    one;
+
+    if (t->connected && t->setup)
+        return queue_pending(t, data, size);
+
+    if (!t->connected || (r = t->out) == NULL) {
+        errno = ENOTCONN;
+        return FALSE;
+    }
+
+    mask = t->ringsize - 1;
+    need = MRP_ALIGN(sizeof(uint32_t) + size, RECORD_ALIGN);
+
+    if (size > t->ringsize / 2) {
+        errno = EMSGSIZE;
+        return FALSE;
+    }
+
+    head = r->head;
+    tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+    offs = head & mask;
+    skip = (offs + need > t->ringsize) ? t->ringsize - offs : 0;
+
+    if (t->ringsize - (head - tail) < skip + need) {
+        mrp_log_error("shm-transport: outgoing ring full, peer not reading.");
+        errno = ENOBUFS;
+        return FALSE;
+    }
+
+    if (skip) {
+        *(uint32_t *)(r->data + offs) = RECORD_WRAP;
+        head += skip;
+        offs  = 0;
+    }
+
+    *(uint32_t *)(r->data + offs) = size;
+    memcpy(r->data + offs + sizeof(uint32_t), data, size);
+
+    __atomic_store_n(&r->head, head + need, __ATOMIC_SEQ_CST);
+
+    if (__atomic_exchange_n(&r->sleeping, 0, __ATOMIC_SEQ_CST)) {
+        one = 1;
+        if (write(t->outfd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+            mrp_debug("shm-transport: failed to ring doorbell");
+    }
+
+    return TRUE;
+}
+
+
+static int shmt_send(mrp_transport_t *mt, mrp_msg_t *msg)
+{
+    shmt_t  *t = (shmt_t *)mt;
+    void    *buf;
+    ssize_t  size;
+    int      success;
+
+    if (!t->connected)
+        return FALSE;
+
+    size = mrp_msg_default_encode(msg, &buf);
+
+    if (size < 0)
+        return FALSE;
+
+    success = ring_write(t, buf, size);
+    mrp_free(buf);
+
+    return success;
+}
+
+
+static int shmt_sendraw(mrp_transport_t *mt, void *data, size_t size)
+{
+    return ring_write((shmt_t *)mt, data, size);
+}
+
+
+static int shmt_senddata(mrp_transport_t *mt, void *data, uint16_t tag)
+{
+    shmt_t           *t = (shmt_t *)mt;
+    mrp_data_descr_t *type;
+    void             *buf;
+    size_t            size;
+    uint16_t         *tagp;
+    int               success;
+
+    if (!t->connected || (type = mrp_msg_find_type(tag)) == NULL)
+        return FALSE;
+
+    size = mrp_data_encode(&buf, data, type, sizeof(*tagp));
+
+    if (size == 0)
+        return FALSE;
+
+    tagp  = buf;
+    *tagp = htobe16(tag);
+
+    success = ring_write(t, buf, size);
+    mrp_free(buf);
+
+    return success;
+}
+
+
+MRP_REGISTER_TRANSPORT(shm, SHMT, shmt_t, shmt_resolve,
+                       shmt_open, NULL, shmt_close, shmt_setopt,
+                       shmt_bind, shmt_listen, shmt_accept,
+                       shmt_connect, shmt_disconnect,
+                       shmt_send, NULL,
+                       shmt_sendraw, NULL,
+                       shmt_senddata, NULL,
+                       NULL, NULL);
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2012, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __MURPHY_SHM_TRANSPORT_H__
+#define __MURPHY_SHM_TRANSPORT_H__
+
+#include <murphy/common/macros.h>
+#include <murphy/common/transport.h>
+
+MRP_CDECL_BEGIN
+
+/*
+ * shared memory ring transport
+ *
+ * The shm transport is a connection-oriented transport for peers on
+ * the same host. Addresses look like unxs ones with an shm prefix, for
+ * instance shm:/run/murphy/shm or shm:@murphy-shm. The address is used
+ * for a Unix stream socket over which the client passes a memfd with
+ * a pair of single-producer/single-consumer rings and two eventfd
+ * doorbells to the server. The server only accepts a memfd sealed
+ * against resizing. After this handshake messages are passed through
+ * the rings and the socket is only used to detect the peer going away.
+ * Messages the server sends before the handshake completes are queued.
+ *
+ * Unlike stream sockets, the rings have a fixed capacity. A message
+ * which does not fit into the free space of the outgoing ring fails
+ * to be sent with errno set to ENOBUFS. The ring size (in bytes, a
+ * power of two) can be set with the MRP_SHM_OPT_RINGSIZE option before
+ * connecting. Setting it on a server transport has no effect, since the
+ * rings are always set up by the connecting side.
+ */
+
+#define MRP_SHM_OPT_RINGSIZE "ring-size"   /* uint32_t *, ring size */
+
+#define MRP_SHM_RINGSIZE_DEFAULT (256 * 1024)
+#define MRP_SHM_RINGSIZE_MIN     (4 * 1024)
+#define MRP_SHM_RINGSIZE_MAX     (16 * 1024 * 1024)
+
+MRP_CDECL_END
+
+#endif /* __MURPHY_SHM_TRANSPORT_H__ */
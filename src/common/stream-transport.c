@@ -45,6 +45,7 @@
 #include <murphy/common/msg.h>
 #include <murphy/common/fragbuf.h>
 #include <murphy/common/transport.h>
+#include <murphy/common/io-worker.h>
 
 #define TCP4  "tcp4"
 #define TCP4L 4
@@ -57,16 +58,20 @@
 
 typedef struct {
     MRP_TRANSPORT_PUBLIC_FIELDS;         /* common transport fields */
-    int             sock;                /* TCP socket */
-    mrp_io_watch_t *iow;                 /* socket I/O watch */
-    mrp_fragbuf_t  *buf;                 /* fragment buffer */
+    int               sock;              /* TCP socket */
+    mrp_io_watch_t   *iow;               /* socket I/O watch */
+    mrp_fragbuf_t    *buf;               /* fragment buffer */
+    mrp_io_channel_t *ioc;               /* I/O worker channel, if any */
 } strm_t;
 
 
 static void strm_recv_cb(mrp_io_watch_t *w, int fd, mrp_io_event_t events,
                          void *user_data);
+static void strm_channel_cb(mrp_io_channel_t *ch, void *data, size_t size,
+                            mrp_msg_t *msg, int error, void *user_data);
 static int strm_disconnect(mrp_transport_t *mt);
 static int open_socket(strm_t *t, int family);
+static int watch_connected(strm_t *t);
 
 
 
@@ -251,7 +256,6 @@ static int strm_open(mrp_transport_t *mt)
 static int strm_createfrom(mrp_transport_t *mt, void *conn)
 {
     strm_t           *t = (strm_t *)mt;
-    mrp_io_event_t   events;
     int              on;
     long             nb;
 
@@ -267,21 +271,8 @@ static int strm_createfrom(mrp_transport_t *mt, void *conn)
             fcntl(t->sock, F_SETFL, O_NONBLOCK, nb);
         }
 
-        if (t->connected) {
-            t->buf = mrp_fragbuf_create(TRUE, 0);
-
-            if (t->buf != NULL) {
-                events = MRP_IO_EVENT_IN | MRP_IO_EVENT_HUP;
-                t->iow = mrp_add_io_watch(t->ml, t->sock, events,
-                                          strm_recv_cb, t);
-
-                if (t->iow != NULL)
-                    return TRUE;
-
-                mrp_fragbuf_destroy(t->buf);
-                t->buf = NULL;
-            }
-        }
+        if (t->connected && watch_connected(t))
+            return TRUE;
     }
 
     return FALSE;
@@ -322,7 +313,6 @@ static int strm_accept(mrp_transport_t *mt, mrp_transport_t *mlt)
     strm_t         *t, *lt;
     mrp_sockaddr_t  addr;
     socklen_t       addrlen;
-    mrp_io_event_t  events;
     int             on;
     long            nb;
 
@@ -331,9 +321,8 @@ static int strm_accept(mrp_transport_t *mt, mrp_transport_t *mlt)
 
     addrlen = sizeof(addr);
     t->sock = accept(lt->sock, &addr.any, &addrlen);
-    t->buf  = mrp_fragbuf_create(TRUE, 0);
 
-    if (t->sock >= 0 && t->buf != NULL) {
+    if (t->sock >= 0) {
         if (mt->flags & MRP_TRANSPORT_REUSEADDR) {
             on = 1;
             setsockopt(t->sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
@@ -347,18 +336,13 @@ static int strm_accept(mrp_transport_t *mt, mrp_transport_t *mlt)
             fcntl(t->sock, F_SETFL, O_CLOEXEC, on);
         }
 
-        events = MRP_IO_EVENT_IN | MRP_IO_EVENT_HUP;
-        t->iow = mrp_add_io_watch(t->ml, t->sock, events, strm_recv_cb, t);
-
-        if (t->iow != NULL)
+        if (watch_connected(t))
             return TRUE;
         else {
             close(t->sock);
             t->sock = -1;
         }
     }
-    else
-        mrp_fragbuf_destroy(t->buf);
 
     return FALSE;
 }
@@ -368,6 +352,12 @@ static void strm_close(mrp_transport_t *mt)
 {
     strm_t *t = (strm_t *)mt;
 
+    if (t->ioc != NULL) {                /* the worker closes the socket */
+        mrp_io_channel_detach(t->ioc);
+        t->ioc  = NULL;
+        t->sock = -1;
+    }
+
     mrp_del_io_watch(t->iow);
     t->iow = NULL;
 
@@ -427,6 +417,9 @@ static void strm_recv_cb(mrp_io_watch_t *w, int fd, mrp_io_event_t events,
             if (n >= 0) {
                 if (n < (ssize_t)pending)
                     mrp_fragbuf_trim(t->buf, buf, pending, n);
+
+                mrp_metric_add(mrp_transport_io_metrics(mt->descr)->bytes_in,
+                               n);
             }
 
             if (n < 0 && errno != EAGAIN) {
@@ -455,6 +448,76 @@ static void strm_recv_cb(mrp_io_watch_t *w, int fd, mrp_io_event_t events,
 }
 
 
+static void strm_channel_cb(mrp_io_channel_t *ch, void *data, size_t size,
+                            mrp_msg_t *msg, int error, void *user_data)
+{
+    strm_t          *t  = (strm_t *)user_data;
+    mrp_transport_t *mt = (mrp_transport_t *)t;
+
+    MRP_UNUSED(ch);
+
+    if (msg != NULL) {                   /* decoded by the I/O worker */
+        mrp_metric_inc(mt->descr->metrics.msg_in);
+
+        MRP_TRANSPORT_BUSY(mt, {
+                mt->evt.recvmsg(mt, msg, mt->user_data);
+            });
+
+        t->check_destroy(mt);
+        return;
+    }
+
+    if (data != NULL) {
+        mrp_metric_add(mrp_transport_io_metrics(mt->descr)->bytes_in, size);
+
+        error = t->recv_data(mt, data, size, NULL, 0);
+
+        if (!error) {
+            t->check_destroy(mt);
+            return;
+        }
+    }
+
+    strm_disconnect(mt);
+
+    if (t->evt.closed != NULL)
+        MRP_TRANSPORT_BUSY(mt, {
+                mt->evt.closed(mt, error, mt->user_data);
+            });
+
+    t->check_destroy(mt);
+}
+
+
+static int watch_connected(strm_t *t)
+{
+    mrp_io_event_t events;
+    int            decode;
+
+    if ((t->flags & MRP_TRANSPORT_IOWORKER) && mrp_io_workers_running(t->ml)) {
+        decode = (t->mode == MRP_TRANSPORT_MODE_MSG);
+        t->ioc = mrp_io_channel_attach(t->sock, decode, strm_channel_cb, t);
+
+        return t->ioc != NULL;
+    }
+
+    t->buf = mrp_fragbuf_create(TRUE, 0);
+
+    if (t->buf != NULL) {
+        events = MRP_IO_EVENT_IN | MRP_IO_EVENT_HUP;
+        t->iow = mrp_add_io_watch(t->ml, t->sock, events, strm_recv_cb, t);
+
+        if (t->iow != NULL)
+            return TRUE;
+
+        mrp_fragbuf_destroy(t->buf);
+        t->buf = NULL;
+    }
+
+    return FALSE;
+}
+
+
 static int open_socket(strm_t *t, int family)
 {
     mrp_io_event_t events;
@@ -498,7 +561,6 @@ static int strm_connect(mrp_transport_t *mt, mrp_sockaddr_t *addr,
     strm_t         *t    = (strm_t *)mt;
     int             on;
     long            nb;
-    mrp_io_event_t  events;
 
     t->sock = socket(addr->any.sa_family, SOCK_STREAM, 0);
 
@@ -506,23 +568,13 @@ static int strm_connect(mrp_transport_t *mt, mrp_sockaddr_t *addr,
         return FALSE;
 
     if (connect(t->sock, &addr->any, addrlen) == 0) {
-        t->buf = mrp_fragbuf_create(TRUE, 0);
-
-        if (t->buf != NULL) {
-            events = MRP_IO_EVENT_IN | MRP_IO_EVENT_HUP;
-            t->iow = mrp_add_io_watch(t->ml, t->sock, events, strm_recv_cb, t);
-
-            if (t->iow != NULL) {
-                on = 1;
-                setsockopt(t->sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
-                nb = 1;
-                fcntl(t->sock, F_SETFL, O_NONBLOCK, nb);
-
-                return TRUE;
-            }
+        if (watch_connected(t)) {
+            on = 1;
+            setsockopt(t->sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+            nb = 1;
+            fcntl(t->sock, F_SETFL, O_NONBLOCK, nb);
 
-            mrp_fragbuf_destroy(t->buf);
-            t->buf = NULL;
+            return TRUE;
         }
     }
 
@@ -543,7 +595,13 @@ static int strm_disconnect(mrp_transport_t *mt)
         mrp_del_io_watch(t->iow);
         t->iow = NULL;
 
-        shutdown(t->sock, SHUT_RDWR);
+        if (t->ioc != NULL) {            /* the worker closes the socket */
+            mrp_io_channel_detach(t->ioc);
+            t->ioc  = NULL;
+            t->sock = -1;
+        }
+        else
+            shutdown(t->sock, SHUT_RDWR);
 
         mrp_fragbuf_destroy(t->buf);
         t->buf = NULL;
@@ -555,6 +613,35 @@ static int strm_disconnect(mrp_transport_t *mt)
 }
 
 
+static ssize_t strm_writev(strm_t *t, struct iovec *iov, int iovcnt)
+{
+    mrp_transport_metrics_t *m = mrp_transport_io_metrics(t->descr);
+    ssize_t                  size;
+    int                      i;
+
+    if (t->ioc == NULL) {
+        size = writev(t->sock, iov, iovcnt);
+
+        if (size >= 0)
+            mrp_metric_add(m->bytes_out, size);
+        else if (errno == EAGAIN)
+            mrp_metric_inc(m->eagain);
+
+        return size;
+    }
+
+    if (mrp_io_channel_write(t->ioc, iov, iovcnt) < 0)
+        return -1;
+
+    for (i = 0, size = 0; i < iovcnt; i++)
+        size += iov[i].iov_len;
+
+    mrp_metric_add(m->bytes_out, size);
+
+    return size;
+}
+
+
 static int strm_send(mrp_transport_t *mt, mrp_msg_t *msg)
 {
     strm_t        *t = (strm_t *)mt;
@@ -573,7 +660,7 @@ static int strm_send(mrp_transport_t *mt, mrp_msg_t *msg)
             iov[1].iov_base = buf;
             iov[1].iov_len  = size;
 
-            n = writev(t->sock, iov, 2);
+            n = strm_writev(t, iov, 2);
             mrp_free(buf);
 
             if (n == (ssize_t)(size + sizeof(len)))
@@ -594,11 +681,15 @@ static int strm_send(mrp_transport_t *mt, mrp_msg_t *msg)
 
 static int strm_sendraw(mrp_transport_t *mt, void *data, size_t size)
 {
-    strm_t  *t = (strm_t *)mt;
-    ssize_t  n;
+    strm_t       *t = (strm_t *)mt;
+    struct iovec  iov;
+    ssize_t       n;
 
     if (t->connected) {
-        n = write(t->sock, data, size);
+        iov.iov_base = data;
+        iov.iov_len  = size;
+
+        n = strm_writev(t, &iov, 1);
 
         if (n == (ssize_t)size)
             return TRUE;
@@ -619,6 +710,7 @@ static int strm_senddata(mrp_transport_t *mt, void *data, uint16_t tag)
 {
     strm_t           *t = (strm_t *)mt;
     mrp_data_descr_t *type;
+    struct iovec      iov;
     ssize_t           n;
     void             *buf;
     size_t            size, reserve, len;
@@ -639,7 +731,10 @@ static int strm_senddata(mrp_transport_t *mt, void *data, uint16_t tag)
                 *lenp = htobe32(len);
                 *tagp = htobe16(tag);
 
-                n = write(t->sock, buf, len + sizeof(*lenp));
+                iov.iov_base = buf;
+                iov.iov_len  = len + sizeof(*lenp);
+
+                n = strm_writev(t, &iov, 1);
 
                 mrp_free(buf);
 
@@ -0,0 +1,232 @@
+/*
+ * Copyright (c) 2012, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include <murphy/common/macros.h>
+#include <murphy/common/mm.h>
+#include <murphy/common/log.h>
+#include <murphy/common/mainloop.h>
+#include <murphy/common/metrics.h>
+
+/*
+ * Compare synchronous and asynchronous logging to the same sink, by
+ *
+ *   1) the number of log calls per second, and the time spent per call,
+ *   2) the time a mainloop timer callback logging a burst of messages
+ *      blocks the mainloop for.
+ */
+
+typedef struct {
+    int              ncall;              /* log calls to time */
+    int              ntick;              /* mainloop ticks to run */
+    int              burst;              /* messages per tick */
+    const char      *sink;               /* log sink to use */
+} config_t;
+
+typedef struct {
+    mrp_mainloop_t  *ml;                 /* mainloop */
+    mrp_metric_t    *cbtime;             /* callback duration histogram */
+    config_t        *cfg;                /* benchmark configuration */
+    int              ntick;              /* ticks so far */
+} bench_t;
+
+
+static void print_usage(const char *argv0, int exit_code)
+{
+    printf("usage: %s [options]\n\n"
+           "The possible options are:\n"
+           "  -n, --calls=N       number of log calls to time\n"
+           "  -k, --ticks=N       number of mainloop ticks to run\n"
+           "  -b, --burst=N       number of messages logged per tick\n"
+           "  -s, --sink=SINK     log sink (stdout, stderr, syslog or\n"
+           "                      file:<path>, default file:/dev/null)\n"
+           "  -h, --help          show this help\n", argv0);
+
+    exit(exit_code);
+}
+
+
+static void parse_cmdline(config_t *cfg, int argc, char **argv)
+{
+    struct option options[] = {
+        { "calls", required_argument, NULL, 'n' },
+        { "ticks", required_argument, NULL, 'k' },
+        { "burst", required_argument, NULL, 'b' },
+        { "sink" , required_argument, NULL, 's' },
+        { "help" , no_argument      , NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    int opt;
+
+    cfg->ncall = 200000;
+    cfg->ntick = 500;
+    cfg->burst = 50;
+    cfg->sink  = "file:/dev/null";
+
+    while ((opt = getopt_long(argc, argv, "n:k:b:s:h", options, NULL)) != -1) {
+        switch (opt) {
+        case 'n': cfg->ncall = atoi(optarg); break;
+        case 'k': cfg->ntick = atoi(optarg); break;
+        case 'b': cfg->burst = atoi(optarg); break;
+        case 's': cfg->sink  = optarg;       break;
+        case 'h': print_usage(argv[0], 0);   break;
+        default:  print_usage(argv[0], 1);
+        }
+    }
+}
+
+
+static void report(const char *what, mrp_metric_t *m)
+{
+    mrp_metric_value_t v;
+
+    mrp_metric_read(m, &v);
+
+    if (!v.count)
+        return;
+
+    printf("    %s: avg %llu, p50 %llu, p99 %llu, max %llu usecs\n", what,
+           (unsigned long long)(v.sum / v.count),
+           (unsigned long long)mrp_metric_percentile(&v, 50),
+           (unsigned long long)mrp_metric_percentile(&v, 99),
+           (unsigned long long)v.max);
+}
+
+
+static void bench_calls(config_t *cfg, const char *name)
+{
+    mrp_metric_t *calltime;
+    uint64_t      start, t, total;
+    int           i;
+
+    calltime = mrp_metric_histogram("log_call_usecs", name, NULL);
+    total    = mrp_metric_now();
+
+    for (i = 0; i < cfg->ncall; i++) {
+        start = mrp_metric_now();
+        mrp_log_info("benchmark message #%d from %s (%s:%d)", i, __FUNCTION__,
+                     __FILE__, __LINE__);
+        t = mrp_metric_now();
+        mrp_metric_observe(calltime, t - start);
+    }
+
+    total = mrp_metric_now() - total;
+
+    printf("  %d log calls in %.3f secs, %.0f calls/sec\n", cfg->ncall,
+           total / 1000000.0, cfg->ncall / (total / 1000000.0));
+    report("per call", calltime);
+}
+
+
+static void tick_cb(mrp_timer_t *timer, void *user_data)
+{
+    bench_t  *b = (bench_t *)user_data;
+    uint64_t  start;
+    int       i;
+
+    MRP_UNUSED(timer);
+
+    start = mrp_metric_now();
+
+    for (i = 0; i < b->cfg->burst; i++)
+        mrp_log_info("tick %d, message %d of a burst of %d", b->ntick, i,
+                     b->cfg->burst);
+
+    mrp_metric_since(b->cbtime, start);
+
+    if (++b->ntick >= b->cfg->ntick)
+        mrp_mainloop_quit(b->ml, 0);
+}
+
+
+static void bench_mainloop(config_t *cfg, const char *name)
+{
+    bench_t      b;
+    mrp_timer_t *t;
+
+    mrp_clear(&b);
+    b.cfg    = cfg;
+    b.ml     = mrp_mainloop_create();
+    b.cbtime = mrp_metric_histogram("log_tick_usecs", name, NULL);
+
+    if (b.ml == NULL || (t = mrp_add_timer(b.ml, 1, tick_cb, &b)) == NULL) {
+        fprintf(stderr, "failed to set up mainloop\n");
+        exit(1);
+    }
+
+    mrp_mainloop_run(b.ml);
+
+    printf("  %d ticks of %d messages each\n", cfg->ntick, cfg->burst);
+    report("mainloop blocked", b.cbtime);
+
+    mrp_del_timer(t);
+    mrp_mainloop_destroy(b.ml);
+}
+
+
+int main(int argc, char *argv[])
+{
+    config_t cfg;
+    char     target[1024];
+
+    parse_cmdline(&cfg, argc, argv);
+
+    mrp_log_set_mask(MRP_LOG_UPTO(MRP_LOG_INFO));
+
+    if (!mrp_log_set_target(cfg.sink)) {
+        fprintf(stderr, "failed to set log target '%s'\n", cfg.sink);
+        exit(1);
+    }
+
+    printf("synchronous logging to %s:\n", cfg.sink);
+    bench_calls(&cfg, "mode=sync");
+    bench_mainloop(&cfg, "mode=sync");
+
+    snprintf(target, sizeof(target), "async:%s", cfg.sink);
+
+    if (!mrp_log_set_target(target)) {
+        fprintf(stderr, "failed to set log target '%s'\n", target);
+        exit(1);
+    }
+
+    printf("asynchronous logging to %s:\n", cfg.sink);
+    bench_calls(&cfg, "mode=async");
+    bench_mainloop(&cfg, "mode=async");
+
+    mrp_log_set_target(MRP_LOG_TO_STDERR);
+
+    printf("%llu messages dropped by the asynchronous target\n",
+           (unsigned long long)mrp_log_dropped());
+
+    return 0;
+}
@@ -0,0 +1,364 @@
+/*
+ * Copyright (c) 2012, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/eventfd.h>
+
+#include <murphy/common/macros.h>
+#include <murphy/common/mm.h>
+#include <murphy/common/log.h>
+#include <murphy/common/mainloop.h>
+
+
+#define fatal(fmt, args...) do {                \
+        mrp_log_error(fmt, ## args);            \
+        exit(1);                                \
+    } while (0)
+
+
+typedef struct {
+    int              nfd;                /* number of watched fds */
+    int              ntoken;             /* tokens passed around */
+    int              nwakeup;            /* wakeups to run for */
+    int              nchurn;             /* watch updates to do */
+    int              backends;           /* backends to benchmark */
+    int              log_mask;
+    const char      *log_target;
+} config_t;
+
+
+typedef struct bench_s bench_t;
+
+typedef struct {
+    bench_t         *b;                  /* benchmark */
+    int              idx;                /* index of this fd */
+} slot_t;
+
+struct bench_s {
+    mrp_mainloop_t  *ml;                 /* mainloop */
+    int             *fds;                /* eventfds */
+    mrp_io_watch_t **w;                  /* watches for the eventfds */
+    slot_t          *slots;              /* watch user data */
+    int              nwakeup;            /* wakeups so far */
+    config_t        *cfg;                /* benchmark configuration */
+};
+
+
+/*
+ * Tokens are spaced evenly and each moves the same stride forward on
+ * every wakeup, so they never collide and every wakeup is a separate
+ * I/O event.
+ */
+
+#define STRIDE 7919
+
+
+static config_t cfg;
+
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+
+static void token_cb(mrp_io_watch_t *w, int fd, mrp_io_event_t events,
+                     void *user_data)
+{
+    slot_t   *s = (slot_t *)user_data;
+    bench_t  *b = s->b;
+    uint64_t  cnt;
+    int       next;
+
+    MRP_UNUSED(w);
+
+    if (!(events & MRP_IO_EVENT_IN))
+        return;
+
+    if (read(fd, &cnt, sizeof(cnt)) != sizeof(cnt))
+        return;
+
+    next = (s->idx + STRIDE) % b->cfg->nfd;
+
+    if (write(b->fds[next], &cnt, sizeof(cnt)) != sizeof(cnt))
+        fatal("failed to pass token to fd %d (%d: %s)", b->fds[next],
+              errno, strerror(errno));
+
+    if (++b->nwakeup >= b->cfg->nwakeup)
+        mrp_mainloop_quit(b->ml, 0);
+}
+
+
+static void run_backend(config_t *c, mrp_mainloop_backend_t backend,
+                        const char *name)
+{
+    mrp_io_event_t events = MRP_IO_EVENT_IN;
+    bench_t        b;
+    uint64_t       one;
+    double         start, add, run, churn;
+    int            i, j;
+
+    mrp_clear(&b);
+    b.cfg = c;
+    b.ml  = mrp_mainloop_create_backend(backend);
+
+    if (b.ml == NULL)
+        fatal("failed to create %s mainloop", name);
+
+    if (mrp_mainloop_get_backend(b.ml) != backend) {
+        printf("%-8s: not available, skipped\n", name);
+        mrp_mainloop_destroy(b.ml);
+        return;
+    }
+
+    b.fds   = mrp_allocz_array(int, c->nfd);
+    b.w     = mrp_allocz_array(mrp_io_watch_t *, c->nfd);
+    b.slots = mrp_allocz_array(slot_t, c->nfd);
+
+    if (b.fds == NULL || b.w == NULL || b.slots == NULL)
+        fatal("failed to allocate benchmark buffers");
+
+    for (i = 0; i < c->nfd; i++) {
+        if ((b.fds[i] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+            fatal("failed to create eventfd #%d (%d: %s)", i,
+                  errno, strerror(errno));
+
+        b.slots[i].b   = &b;
+        b.slots[i].idx = i;
+    }
+
+    start = now();
+    for (i = 0; i < c->nfd; i++)
+        if ((b.w[i] = mrp_add_io_watch(b.ml, b.fds[i], events,
+                                       token_cb, b.slots + i)) == NULL)
+            fatal("failed to add I/O watch #%d", i);
+    add = now() - start;
+
+    start = now();
+    for (i = 0; i < c->nchurn; i++) {
+        j = (int)(((uint64_t)i * STRIDE) % c->nfd);
+
+        mrp_del_io_watch(b.w[j]);
+        b.w[j] = mrp_add_io_watch(b.ml, b.fds[j], events, token_cb,
+                                  b.slots + j);
+
+        if (b.w[j] == NULL)
+            fatal("failed to readd I/O watch #%d", j);
+
+        if (!(i & 0xff) || i == c->nchurn - 1) {
+            mrp_mainloop_prepare(b.ml);
+            mrp_mainloop_poll(b.ml, FALSE);
+            mrp_mainloop_dispatch(b.ml);
+        }
+    }
+    churn = now() - start;
+
+    one = 1;
+    for (i = 0; i < c->ntoken; i++)
+        if (write(b.fds[(i * c->nfd) / c->ntoken], &one, sizeof(one)) < 0)
+            fatal("failed to inject token #%d", i);
+
+    start = now();
+    mrp_mainloop_run(b.ml);
+    run = now() - start;
+
+    printf("%-8s: %d watches added in %.3f ms\n", name, c->nfd, add * 1000);
+    printf("%-8s: %d wakeups (%d tokens) in %.3f s, %.0f wakeups/s\n", name,
+           b.nwakeup, c->ntoken, run, b.nwakeup / run);
+    printf("%-8s: %d watch delete/add pairs in %.3f ms, %.0f pairs/s\n",
+           name, c->nchurn, churn * 1000, c->nchurn / churn);
+
+    for (i = 0; i < c->nfd; i++) {
+        mrp_del_io_watch(b.w[i]);
+        close(b.fds[i]);
+    }
+
+    mrp_mainloop_destroy(b.ml);
+    mrp_free(b.fds);
+    mrp_free(b.w);
+    mrp_free(b.slots);
+}
+
+
+static void print_usage(const char *argv0, int exit_code, const char *fmt, ...)
+{
+    va_list ap;
+
+    if (fmt && *fmt) {
+        va_start(ap, fmt);
+        vprintf(fmt, ap);
+        va_end(ap);
+    }
+
+    printf("usage: %s [options]\n\n"
+           "The possible options are:\n"
+           "  -n, --fds=N                    number of watched fds\n"
+           "  -t, --tokens=N                 number of tokens passed around\n"
+           "  -w, --wakeups=N                number of wakeups to run for\n"
+           "  -c, --churn=N                  number of watch updates\n"
+           "  -b, --backend=BACKEND          backend to benchmark\n"
+           "      BACKEND is one of epoll, io_uring, or all\n"
+           "  -o, --log-target=TARGET        log target to use\n"
+           "      TARGET is one of stderr,stdout,syslog, or a logfile path\n"
+           "  -l, --log-level=LEVELS         logging level to use\n"
+           "      LEVELS is a comma separated list of info, error and warning\n"
+           "  -h, --help                     show help on usage\n",
+           argv0);
+
+    if (exit_code < 0)
+        return;
+    else
+        exit(exit_code);
+}
+
+
+static int parse_number(const char *argv0, const char *arg, const char *what)
+{
+    char *end;
+    int   n;
+
+    n = (int)strtol(arg, &end, 10);
+
+    if ((end && *end) || n < 0)
+        print_usage(argv0, EINVAL, "invalid %s '%s'.\n", what, arg);
+
+    return n;
+}
+
+
+#define BACKEND_EPOLL    0x1
+#define BACKEND_IO_URING 0x2
+
+
+static void parse_cmdline(config_t *c, int argc, char **argv)
+{
+#   define OPTIONS "n:t:w:c:b:l:o:h"
+    struct option options[] = {
+        { "fds"       , required_argument, NULL, 'n' },
+        { "tokens"    , required_argument, NULL, 't' },
+        { "wakeups"   , required_argument, NULL, 'w' },
+        { "churn"     , required_argument, NULL, 'c' },
+        { "backend"   , required_argument, NULL, 'b' },
+        { "log-level" , required_argument, NULL, 'l' },
+        { "log-target", required_argument, NULL, 'o' },
+        { "help"      , no_argument      , NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    int opt;
+
+    c->nfd        = 10000;
+    c->ntoken     = 16;
+    c->nwakeup    = 1000000;
+    c->nchurn     = 100000;
+    c->backends   = BACKEND_EPOLL | BACKEND_IO_URING;
+    c->log_mask   = MRP_LOG_UPTO(MRP_LOG_WARNING);
+    c->log_target = MRP_LOG_TO_STDERR;
+
+    while ((opt = getopt_long(argc, argv, OPTIONS, options, NULL)) != -1) {
+        switch (opt) {
+        case 'n':
+            c->nfd = parse_number(argv[0], optarg, "number of fds");
+            break;
+        case 't':
+            c->ntoken = parse_number(argv[0], optarg, "number of tokens");
+            break;
+        case 'w':
+            c->nwakeup = parse_number(argv[0], optarg, "number of wakeups");
+            break;
+        case 'c':
+            c->nchurn = parse_number(argv[0], optarg, "number of updates");
+            break;
+
+        case 'b':
+            if (!strcmp(optarg, "epoll"))
+                c->backends = BACKEND_EPOLL;
+            else if (!strcmp(optarg, "io_uring"))
+                c->backends = BACKEND_IO_URING;
+            else if (!strcmp(optarg, "all"))
+                c->backends = BACKEND_EPOLL | BACKEND_IO_URING;
+            else
+                print_usage(argv[0], EINVAL, "invalid backend '%s'.\n",
+                            optarg);
+            break;
+
+        case 'l':
+            c->log_mask = mrp_log_parse_levels(optarg);
+            if (c->log_mask < 0)
+                print_usage(argv[0], EINVAL, "invalid log level '%s'\n",
+                            optarg);
+            break;
+
+        case 'o':
+            c->log_target = mrp_log_parse_target(optarg);
+            if (!c->log_target)
+                print_usage(argv[0], EINVAL, "invalid log target '%s'\n",
+                            optarg);
+            break;
+
+        case 'h':
+            print_usage(argv[0], 0, "");
+            break;
+
+        default:
+            print_usage(argv[0], EINVAL, "invalid option '%c'", opt);
+        }
+    }
+
+    if (c->nfd < 1 || c->ntoken < 1 || c->ntoken > c->nfd)
+        print_usage(argv[0], EINVAL, "invalid number of fds or tokens.\n");
+}
+
+
+int main(int argc, char *argv[])
+{
+    parse_cmdline(&cfg, argc, argv);
+
+    mrp_log_set_mask(cfg.log_mask);
+    mrp_log_set_target(cfg.log_target);
+
+    if (cfg.backends & BACKEND_EPOLL)
+        run_backend(&cfg, MRP_MAINLOOP_BACKEND_EPOLL, "epoll");
+
+    if (cfg.backends & BACKEND_IO_URING)
+        run_backend(&cfg, MRP_MAINLOOP_BACKEND_IO_URING, "io_uring");
+
+    return 0;
+}
@@ -120,6 +120,7 @@ typedef struct {
     int ntimer;
     int deferred;
     int nsignal;
+    int nwork;
 
     int ngio;
     int ngtimer;
@@ -581,6 +582,133 @@ static void check_signals(void)
 }
 
 
+/*
+ * work offloaded to worker threads
+ */
+
+#define WORK_DELAYS 5, 1, 10, 2, 0, 20, 3, 7
+
+typedef struct {
+    int         id;
+    int         delay;                   /* msecs to keep busy */
+    mrp_work_t *work;
+    int         ran;                     /* whether work_cb was run */
+    int         status;                  /* completion status */
+    int         order;                   /* order of completion */
+    int         cancelled;               /* whether cancelled */
+} test_work_t;
+
+
+static test_work_t    *works;
+static int             nwork_done;
+static mrp_mainloop_t *work_ml;
+
+
+static void work_cb(mrp_work_t *w, void *user_data)
+{
+    test_work_t *t = (test_work_t *)user_data;
+
+    MRP_UNUSED(w);
+
+    usleep(t->delay * 1000);
+    t->ran = TRUE;
+}
+
+
+static void work_done_cb(mrp_work_t *w, int status, void *user_data)
+{
+    test_work_t *t = (test_work_t *)user_data;
+
+    MRP_UNUSED(w);
+
+    t->status = status;
+    t->order  = nwork_done++;
+    t->work   = NULL;
+
+    info("MRPH work #%d: done, status %d (%s)", t->id, status,
+         t->ran ? "was run" : "was not run");
+
+    if (nwork_done == cfg.nwork)
+        cfg.nrunning--;
+}
+
+
+static void setup_work(mrp_mainloop_t *ml)
+{
+    test_work_t *t;
+    int          delays[] = { WORK_DELAYS, -1 }, *dl = delays;
+    int          i;
+
+    if (cfg.nwork <= 0)
+        return;
+
+    work_ml = ml;
+
+    if (!mrp_set_work_limits(ml, 2, cfg.nwork))
+        fatal("failed to set work limits");
+
+    if ((works = mrp_allocz_array(test_work_t, cfg.nwork)) == NULL)
+        fatal("could not allocate %d work items", cfg.nwork);
+
+    for (i = 0, t = works; i < cfg.nwork; i++, t++) {
+        t->id    = i;
+        t->delay = *dl;
+        t->order = -1;
+        t->work  = mrp_add_work(ml, work_cb, work_done_cb, t);
+
+        if (t->work == NULL)
+            fatal("MRPH work #%d: failed to add", t->id);
+
+        if (*++dl < 0)
+            dl = delays;
+    }
+
+    /* cancel every fourth, the ones still queued must not get run */
+    for (i = 3, t = works + 3; i < cfg.nwork; i += 4, t += 4) {
+        t->cancelled = mrp_cancel_work(t->work);
+        info("MRPH work #%d: %s", t->id,
+             t->cancelled ? "cancelled" : "too late to cancel");
+    }
+
+    cfg.nrunning++;
+}
+
+
+static void check_work(void)
+{
+    test_work_t      *t;
+    mrp_work_stats_t  st;
+    int               i;
+
+    if (cfg.nwork <= 0)
+        return;
+
+    for (i = 0, t = works; i < cfg.nwork; i++, t++) {
+        if (t->order != t->id)
+            warning("MRPH work #%d: FAIL (completed as #%d)", t->id,
+                    t->order);
+        else if (t->cancelled && (t->ran || t->status != ECANCELED))
+            warning("MRPH work #%d: FAIL (run despite being cancelled)",
+                    t->id);
+        else if (!t->cancelled && (!t->ran || t->status != 0))
+            warning("MRPH work #%d: FAIL (not run, status %d)", t->id,
+                    t->status);
+        else
+            info("MRPH work #%d: OK", t->id);
+    }
+
+    mrp_get_work_stats(work_ml, &st);
+
+    info("MRPH work: %d threads, %llu added, %llu done, %llu cancelled, "
+         "max. %d queued", st.nthread, (unsigned long long)st.nadded,
+         (unsigned long long)st.ndone, (unsigned long long)st.ncancelled,
+         st.max_queued);
+    info("MRPH work: queued %llu/%llu, ran %llu/%llu usecs (avg/max)",
+         (unsigned long long)st.wait_avg, (unsigned long long)st.wait_max,
+         (unsigned long long)st.run_avg, (unsigned long long)st.run_max);
+}
+
+
 static void wakeup_cb(mrp_wakeup_t *w, mrp_wakeup_event_t event,
                       void *user_data)
 {
@@ -1304,6 +1432,7 @@ static void config_set_defaults(test_config_t *cfg)
     cfg->nio     = 5;
     cfg->ntimer  = 10;
     cfg->nsignal = 5;
+    cfg->nwork   = 16;
     cfg->ngio    = 5;
     cfg->ngtimer = 10;
 
@@ -1333,6 +1462,7 @@ static void print_usage(const char *argv0, int exit_code, const char *fmt, ...)
            "  -i, --ios                      number of I/O watches\n"
            "  -t, --timers                   number of timers\n"
            "  -s, --signals                  number of POSIX signals\n"
+           "  -w, --works                    number of work items for threads\n"
            "  -I, --glib-ios                 number of glib I/O watches\n"
            "  -T, --glib-timers              number of glib timers\n"
            "  -S, --dbus-signals             number of D-Bus signals\n"
@@ -1389,13 +1519,14 @@ int parse_cmdline(test_config_t *cfg, int argc, char **argv)
 #endif
 
 
-#   define OPTIONS "r:i:t:s:I:T:S:M:l:o:vd:h" \
+#   define OPTIONS "r:i:t:s:w:I:T:S:M:l:o:vd:h" \
         PULSE_OPTION""ECORE_OPTION""GLIB_OPTION""QT_OPTION
     struct option options[] = {
         { "runtime"     , required_argument, NULL, 'r' },
         { "ios"         , required_argument, NULL, 'i' },
         { "timers"      , required_argument, NULL, 't' },
         { "signals"     , required_argument, NULL, 's' },
+        { "works"       , required_argument, NULL, 'w' },
         { "glib-ios"    , required_argument, NULL, 'I' },
         { "glib-timers" , required_argument, NULL, 'T' },
         { "dbus-signals", required_argument, NULL, 'S' },
@@ -1454,6 +1585,13 @@ int parse_cmdline(test_config_t *cfg, int argc, char **argv)
                             "invalid number of signals '%s'.", optarg);
             break;
 
+        case 'w':
+            cfg->nwork = (int)strtoul(optarg, &end, 10);
+            if (end && *end)
+                print_usage(argv[0], EINVAL,
+                            "invalid number of work items '%s'.", optarg);
+            break;
+
         case 'I':
             cfg->ngio = (int)strtoul(optarg, &end, 10);
             if (end && *end)
@@ -1692,6 +1830,7 @@ int main(int argc, char *argv[])
     setup_timers(ml);
     setup_io(ml);
     setup_signals(ml);
+    setup_work(ml);
     MRP_UNUSED(setup_deferred);   /* XXX TODO: add deferred tests... */
 
 #ifdef GLIB_ENABLED
@@ -1714,6 +1853,7 @@ int main(int argc, char *argv[])
     check_io();
     check_timers();
     check_signals();
+    check_work();
 
 #ifdef GLIB_ENABLED
     check_glib_io();
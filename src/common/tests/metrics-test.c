@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2012, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <murphy/common/macros.h>
+#include <murphy/common/log.h>
+#include <murphy/common/metrics.h>
+
+#define NTHREAD 8
+#define NLOOP   100000
+
+#define fatal(fmt, args...) do {                \
+        mrp_log_error(fmt, ## args);            \
+        exit(1);                                \
+    } while (0)
+
+
+static mrp_metric_t *counter;
+static mrp_metric_t *histogram;
+
+
+static void *thread_main(void *arg)
+{
+    int i;
+
+    MRP_UNUSED(arg);
+
+    for (i = 0; i < NLOOP; i++) {
+        mrp_metric_inc(counter);
+        mrp_metric_observe(histogram, i % 1000);
+    }
+
+    return NULL;
+}
+
+
+static void check_buckets(void)
+{
+    uint64_t prev, limit;
+    int      i;
+
+    for (i = 0, prev = 0; i < MRP_METRIC_BUCKETS; i++) {
+        limit = mrp_metric_bucket_limit(i);
+
+        if (i > 0 && limit <= prev)
+            fatal("bucket %d: limit %llu not above %llu", i,
+                  (unsigned long long)limit, (unsigned long long)prev);
+
+        prev = limit;
+    }
+
+    printf("bucket limits: OK\n");
+}
+
+
+static void check_threads(void)
+{
+    pthread_t          tids[NTHREAD];
+    mrp_metric_value_t v;
+    uint64_t           p50;
+    int                i;
+
+    counter   = mrp_metric_counter("test_total", NULL, "test counter");
+    histogram = mrp_metric_histogram("test_usecs", "kind=test", "test times");
+
+    if (counter == NULL || histogram == NULL)
+        fatal("failed to create metrics");
+
+    if (mrp_metric_counter("test_total", NULL, NULL) != counter)
+        fatal("metric lookup returned a new metric");
+
+    if (mrp_metric_gauge("test_total", NULL, NULL) != NULL)
+        fatal("metric lookup ignored type mismatch");
+
+    for (i = 0; i < NTHREAD; i++)
+        pthread_create(tids + i, NULL, thread_main, NULL);
+
+    for (i = 0; i < NTHREAD; i++)
+        pthread_join(tids[i], NULL);
+
+    mrp_metric_read(counter, &v);
+
+    if (v.count != NTHREAD * NLOOP)
+        fatal("counter is %llu instead of %d", (unsigned long long)v.count,
+              NTHREAD * NLOOP);
+
+    mrp_metric_read(histogram, &v);
+
+    if (v.count != NTHREAD * NLOOP || v.max != 999)
+        fatal("histogram has %llu samples, max %llu",
+              (unsigned long long)v.count, (unsigned long long)v.max);
+
+    p50 = mrp_metric_percentile(&v, 50);
+
+    if (p50 < 500 || p50 > 500 + 500 / 4)
+        fatal("histogram median %llu is off", (unsigned long long)p50);
+
+    printf("threaded updates: OK\n");
+}
+
+
+int main(int argc, char *argv[])
+{
+    mrp_metric_t *g;
+
+    mrp_log_set_mask(MRP_LOG_UPTO(MRP_LOG_INFO));
+    mrp_log_set_target(MRP_LOG_TO_STDOUT);
+
+    check_buckets();
+    check_threads();
+
+    g = mrp_metric_gauge("test_gauge", NULL, "test gauge");
+    mrp_metric_set(g, 10);
+    mrp_metric_adjust(g, -3);
+
+    if (argc > 1 && !strcmp(argv[1], "-d"))
+        mrp_metrics_dump(stdout);
+
+    return 0;
+}
@@ -589,12 +589,94 @@ static void test_basic(void)
 }
 
 
+static void test_array_blob_encode_decode(void)
+{
+    mrp_msg_t       *msg, *decoded;
+    mrp_msg_field_t *f;
+    void            *encoded;
+    ssize_t          size;
+    char            *strs[] = { "one", "two", "three" };
+    uint32_t         u32s[] = { 1, 2, 3, 4, 5 };
+    char             blob[] = { 0xde, 0xad, 0xbe, 0xef, 0x00, 0x01 };
+    int              i, round;
+
+    /* loop to make sure recycled pool objects are exercised, too */
+    for (round = 0; round < 16; round++) {
+        msg = mrp_msg_create(MRP_MSG_TAG_STRING_ARRAY(0x1, 3, strs),
+                             MRP_MSG_TAG_UINT32_ARRAY(0x2, 5, u32s),
+                             0x3, MRP_MSG_FIELD_BLOB, sizeof(blob), blob,
+                             MRP_MSG_TAG_UINT16(0x4, 4),
+                             MRP_MSG_END);
+
+        if (msg == NULL) {
+            mrp_log_error("Failed to create array/blob message.");
+            exit(1);
+        }
+
+        size = mrp_msg_default_encode(msg, &encoded);
+
+        if (size <= 0) {
+            mrp_log_error("Failed to encode array/blob message.");
+            exit(1);
+        }
+
+        /* skip the default encoder tag, like transports do */
+        decoded = mrp_msg_default_decode(encoded + sizeof(uint16_t),
+                                         size - sizeof(uint16_t));
+
+        if (decoded == NULL) {
+            mrp_log_error("Failed to decode array/blob message.");
+            exit(1);
+        }
+
+        f = mrp_msg_find(decoded, 0x1);
+        if (f == NULL || f->size[0] != 3) {
+            mrp_log_error("String array mismatch after decoding.");
+            exit(1);
+        }
+        for (i = 0; i < 3; i++) {
+            if (strcmp(f->astr[i], strs[i])) {
+                mrp_log_error("String array item #%d mismatch.", i);
+                exit(1);
+            }
+        }
+
+        f = mrp_msg_find(decoded, 0x2);
+        if (f == NULL || f->size[0] != 5 ||
+            memcmp(f->au32, u32s, sizeof(u32s))) {
+            mrp_log_error("Integer array mismatch after decoding.");
+            exit(1);
+        }
+
+        f = mrp_msg_find(decoded, 0x3);
+        if (f == NULL || f->size[0] != sizeof(blob) ||
+            memcmp(f->blb, blob, sizeof(blob))) {
+            mrp_log_error("Blob mismatch after decoding.");
+            exit(1);
+        }
+
+        f = mrp_msg_find(decoded, 0x4);
+        if (f == NULL || f->u16 != 4) {
+            mrp_log_error("Trailing field mismatch after decoding.");
+            exit(1);
+        }
+
+        mrp_free(encoded);
+        mrp_msg_unref(msg);
+        mrp_msg_unref(decoded);
+    }
+
+    mrp_log_info("array/blob encoding/decoding OK.");
+}
+
+
 int main(int argc, char *argv[])
 {
     mrp_log_set_mask(MRP_LOG_UPTO(MRP_LOG_DEBUG));
     mrp_log_set_target(MRP_LOG_TO_STDOUT);
 
     test_basic();
+    test_array_blob_encode_decode();
 
     test_default_encode_decode(argc, argv);
     test_custom_encode_decode();
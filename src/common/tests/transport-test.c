@@ -34,11 +34,13 @@
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <time.h>
 
 #define _GNU_SOURCE
 #include <getopt.h>
 
 #include <murphy/common.h>
+#include <murphy/common/io-worker.h>
 
 
 /*
@@ -146,6 +148,17 @@ typedef struct {
     int              log_mask;
     const char      *log_target;
     uint32_t         seqno;
+    int              bench;              /* round-trips to benchmark */
+    int              nreply;             /* replies received so far */
+    uint64_t         start;              /* benchmark start (usecs) */
+    uint64_t         sent;               /* last request sent (usecs) */
+    uint64_t         rtt_min;            /* shortest round-trip */
+    uint64_t         rtt_max;            /* longest round-trip */
+    uint64_t         rtt_sum;            /* sum of round-trips */
+    int              flood;              /* messages to flood with */
+    int              nrecv;              /* flood messages received */
+    int              batch;              /* datagrams per wakeup */
+    int              workers;            /* I/O worker threads */
 } context_t;
 
 
@@ -160,6 +173,106 @@ void recvfrom_data(mrp_transport_t *t, void *data, uint16_t tag,
 void recvraw(mrp_transport_t *t, void *data, size_t size, void *user_data);
 void recvrawfrom(mrp_transport_t *t, void *data, size_t size,
                  mrp_sockaddr_t *addr, socklen_t addrlen, void *user_data);
+void send_cb(mrp_timer_t *t, void *user_data);
+
+
+static uint64_t time_usecs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+void bench_start(context_t *c)
+{
+    c->start   = time_usecs();
+    c->sent    = c->start;
+    c->rtt_min = (uint64_t)-1;
+
+    send_cb(NULL, c);
+}
+
+
+void bench_reply(context_t *c)
+{
+    uint64_t now, rtt;
+    double   secs;
+
+    now = time_usecs();
+    rtt = now - c->sent;
+
+    if (rtt < c->rtt_min)
+        c->rtt_min = rtt;
+    if (rtt > c->rtt_max)
+        c->rtt_max = rtt;
+    c->rtt_sum += rtt;
+
+    if (++c->nreply < c->bench) {
+        c->sent = now;
+        send_cb(NULL, c);
+        return;
+    }
+
+    secs = (now - c->start) / 1000000.0;
+
+    printf("%s: %d round-trips in %.3f s, %.1f round-trips/s\n",
+           c->atype, c->nreply, secs, secs > 0 ? c->nreply / secs : 0.0);
+    printf("%s: round-trip min/avg/max %llu/%.1f/%llu usecs\n", c->atype,
+           (unsigned long long)c->rtt_min, (double)c->rtt_sum / c->nreply,
+           (unsigned long long)c->rtt_max);
+
+    exit(0);
+}
+
+
+void flood_recv(context_t *c)
+{
+    uint64_t now;
+    double   secs;
+
+    now = time_usecs();
+
+    if (c->nrecv++ == 0)
+        c->start = now;
+
+    if (c->nrecv < c->flood)
+        return;
+
+    secs = (now - c->start) / 1000000.0;
+
+    printf("%s: received %d messages in %.3f s, %.1f messages/s\n",
+           c->atype, c->nrecv, secs, secs > 0 ? (c->nrecv - 1) / secs : 0.0);
+
+    exit(0);
+}
+
+
+void flood_send(context_t *c)
+{
+    uint64_t start;
+    double   secs;
+    int      i;
+
+    start = time_usecs();
+
+    for (i = 0; i < c->flood; i++)
+        send_cb(NULL, c);
+
+    if (c->workers) {                    /* wait for queued output */
+        mrp_transport_destroy(c->t);
+        mrp_io_workers_stop();
+    }
+
+    secs = (time_usecs() - start) / 1000000.0;
+
+    printf("%s: sent %d messages in %.3f s, %.1f messages/s\n",
+           c->atype, c->flood, secs, secs > 0 ? c->flood / secs : 0.0);
+
+    exit(0);
+}
 
 
 void dump_msg(mrp_msg_t *msg, FILE *fp)
@@ -177,8 +290,15 @@ void recvfrom_msg(mrp_transport_t *t, mrp_msg_t *msg, mrp_sockaddr_t *addr,
     char             buf[256];
     int              status;
 
-    mrp_log_info("received a message");
-    dump_msg(msg, stdout);
+    if (c->flood) {
+        flood_recv(c);
+        return;
+    }
+
+    if (!c->bench) {
+        mrp_log_info("received a message");
+        dump_msg(msg, stdout);
+    }
 
     if (c->server) {
         seq = 0;
@@ -207,6 +327,8 @@ void recvfrom_msg(mrp_transport_t *t, mrp_msg_t *msg, mrp_sockaddr_t *addr,
 
         /* message unreffed by transport layer */
     }
+    else if (c->bench)
+        bench_reply(c);
 }
 
 
@@ -257,8 +379,16 @@ void recvfrom_data(mrp_transport_t *t, void *data, uint16_t tag,
     uint32_t   au32[] = { 9, 8, 7, 6, 5, -1 };
     int        status;
 
-    mrp_log_info("received custom message of type 0x%x", tag);
-    dump_custom(data, stdout);
+    if (c->flood) {
+        free_custom(msg);
+        flood_recv(c);
+        return;
+    }
+
+    if (!c->bench) {
+        mrp_log_info("received custom message of type 0x%x", tag);
+        dump_custom(data, stdout);
+    }
 
     if (tag != data_descr->tag) {
         mrp_log_error("Tag 0x%x != our custom type (0x%x).",
@@ -284,6 +414,9 @@ void recvfrom_data(mrp_transport_t *t, void *data, uint16_t tag,
     }
 
     free_custom(msg);
+
+    if (!c->server && c->bench)
+        bench_reply(c);
 }
 
 
@@ -312,8 +445,15 @@ void recvfrom_raw(mrp_transport_t *t, void *data, size_t size,
     rpl_size = snprintf(rpl, sizeof(rpl), "reply to message [%*.*s]",
                         (int)size, (int)size, (char *)data);
 
-    mrp_log_info("received raw message");
-    dump_raw(data, size, stdout);
+    if (c->flood) {
+        flood_recv(c);
+        return;
+    }
+
+    if (!c->bench) {
+        mrp_log_info("received raw message");
+        dump_raw(data, size, stdout);
+    }
 
     if (strncmp((char *)data, "reply to ", 9) != 0) {
         if (c->connect)
@@ -326,6 +466,8 @@ void recvfrom_raw(mrp_transport_t *t, void *data, size_t size,
         else
             mrp_log_error("failed to send reply");
     }
+    else if (c->bench)
+        bench_reply(c);
 }
 
 
@@ -361,6 +503,8 @@ void connection_evt(mrp_transport_t *lt, void *user_data)
     int        flags;
 
     flags = MRP_TRANSPORT_REUSEADDR | MRP_TRANSPORT_NONBLOCK;
+    if (c->workers)
+        flags |= MRP_TRANSPORT_IOWORKER;
     c->t = mrp_transport_accept(lt, c, flags);
 
     if (c->t == NULL) {
@@ -435,6 +579,10 @@ void server_init(context_t *c)
         exit(1);
     }
 
+    if (c->batch &&
+        !mrp_transport_setopt(c->lt, MRP_TRANSPORT_OPT_RECVBATCH, &c->batch))
+        mrp_log_warning("Failed to set receive batch size to %d.", c->batch);
+
     if (!mrp_transport_bind(c->lt, &c->addr, c->alen)) {
         mrp_log_error("Failed to bind transport to address %s.", c->addrstr);
         exit(1);
@@ -607,6 +755,9 @@ void client_init(context_t *c)
         flags            = MRP_TRANSPORT_MODE_MSG;
     }
 
+    if (c->workers)
+        flags |= MRP_TRANSPORT_IOWORKER;
+
     c->t = mrp_transport_create(c->ml, c->atype, &evt, c, flags);
 
     if (c->t == NULL) {
@@ -639,6 +790,14 @@ void client_init(context_t *c)
     }
 
 
+    if (c->bench > 0) {
+        bench_start(c);
+        return;
+    }
+
+    if (c->flood > 0)
+        flood_send(c);
+
     c->timer = mrp_add_timer(c->ml, 1000, send_cb, c);
 
     if (c->timer == NULL) {
@@ -668,6 +827,14 @@ static void print_usage(const char *argv0, int exit_code, const char *fmt, ...)
            "  -m, --message                  use generic messages (default)\n"
            "  -r, --raw                      use raw messages\n"
            "  -b, --buggy                    use buggy data descriptors\n"
+           "  -B, --bench=N                  time N request-reply round-trips\n"
+           "      Run against a server with the same mode and -B, and compare\n"
+           "      transports by using eg. unxs:@test and shm:@test addresses.\n"
+           "  -F, --flood=N                  send N messages back-to-back\n"
+           "      Run against a server with the same mode and -F to measure\n"
+           "      the received messages per second.\n"
+           "  -R, --recv-batch=N             receive up to N datagrams per wakeup\n"
+           "  -W, --io-workers=N             do stream I/O in N worker threads\n"
            "  -t, --log-target=TARGET        log target to use\n"
            "      TARGET is one of stderr,stdout,syslog, or a logfile path\n"
            "  -l, --log-level=LEVELS         logging level to use\n"
@@ -696,7 +863,7 @@ static void config_set_defaults(context_t *ctx)
 
 int parse_cmdline(context_t *ctx, int argc, char **argv)
 {
-#   define OPTIONS "scmrbCa:l:t:v:d:h"
+#   define OPTIONS "scmrbB:F:R:W:Ca:l:t:v:d:h"
     struct option options[] = {
         { "server"    , no_argument      , NULL, 's' },
         { "address"   , required_argument, NULL, 'a' },
@@ -706,6 +873,10 @@ int parse_cmdline(context_t *ctx, int argc, char **argv)
         { "connect"   , no_argument      , NULL, 'C' },
 
         { "buggy"     , no_argument      , NULL, 'b' },
+        { "bench"     , required_argument, NULL, 'B' },
+        { "flood"     , required_argument, NULL, 'F' },
+        { "recv-batch", required_argument, NULL, 'R' },
+        { "io-workers", required_argument, NULL, 'W' },
         { "log-level" , required_argument, NULL, 'l' },
         { "log-target", required_argument, NULL, 't' },
         { "verbose"   , optional_argument, NULL, 'v' },
@@ -755,6 +926,30 @@ int parse_cmdline(context_t *ctx, int argc, char **argv)
             ctx->buggy = TRUE;
             break;
 
+        case 'B':
+            ctx->bench = (int)strtol(optarg, NULL, 10);
+            if (ctx->bench <= 0)
+                print_usage(argv[0], EINVAL, "invalid count '%s'", optarg);
+            break;
+
+        case 'F':
+            ctx->flood = (int)strtol(optarg, NULL, 10);
+            if (ctx->flood <= 0)
+                print_usage(argv[0], EINVAL, "invalid count '%s'", optarg);
+            break;
+
+        case 'R':
+            ctx->batch = (int)strtol(optarg, NULL, 10);
+            if (ctx->batch <= 0)
+                print_usage(argv[0], EINVAL, "invalid batch '%s'", optarg);
+            break;
+
+        case 'W':
+            ctx->workers = (int)strtol(optarg, NULL, 10);
+            if (ctx->workers <= 0)
+                print_usage(argv[0], EINVAL, "invalid count '%s'", optarg);
+            break;
+
         case 'C':
             ctx->connect = TRUE;
             break;
@@ -807,6 +1002,9 @@ int main(int argc, char *argv[])
     if (!parse_cmdline(&c, argc, argv))
         exit(1);
 
+    if (c.bench || c.flood)
+        c.log_mask &= ~(MRP_LOG_MASK_INFO | MRP_LOG_MASK_DEBUG);
+
     mrp_log_set_mask(c.log_mask);
     mrp_log_set_target(c.log_target);
 
@@ -823,7 +1021,7 @@ int main(int argc, char *argv[])
     }
 
     if (!strncmp(c.addrstr, "tcp", 3) || !strncmp(c.addrstr, "unxs", 4) ||
-        !strncmp(c.addrstr, "wsck", 4)) {
+        !strncmp(c.addrstr, "wsck", 4) || !strncmp(c.addrstr, "shm:", 4)) {
         c.stream  = TRUE;
         c.connect = TRUE;
     }
@@ -837,6 +1035,11 @@ int main(int argc, char *argv[])
 
     c.ml = mrp_mainloop_create();
 
+    if (c.workers && !mrp_io_workers_start(c.ml, c.workers)) {
+        mrp_log_error("Failed to start %d I/O workers.", c.workers);
+        exit(1);
+    }
+
     if (c.server)
         server_init(&c);
     else
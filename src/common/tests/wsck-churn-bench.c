@@ -0,0 +1,478 @@
+/*
+ * Copyright (c) 2012, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <time.h>
+
+#include <murphy/common/macros.h>
+#include <murphy/common/mm.h>
+#include <murphy/common/log.h>
+#include <murphy/common/list.h>
+#include <murphy/common/mainloop.h>
+#include <murphy/common/transport.h>
+#include <murphy/common/wsck-transport.h>
+
+
+/*
+ * websocket accept/close churn benchmark
+ *
+ * We keep a number of idle websocket connections open to a listening
+ * wsck transport, then measure how fast connections can be set up and
+ * torn down next to them. A cycle consists of a client connecting, the
+ * server accepting and then closing the connection, and the client
+ * noticing the close. The cost of a cycle should be independent of the
+ * number of idle connections.
+ */
+
+#define fatal(fmt, args...) do {                \
+        mrp_log_error(fmt, ## args);            \
+        exit(1);                                \
+    } while (0)
+
+
+typedef struct {
+    const char      *addr;               /* address to listen on */
+    int              nidle;              /* number of idle connections */
+    int              ncycle;             /* number of cycles to run */
+    int              nparallel;          /* concurrent cycles */
+    int              log_mask;
+    const char      *log_target;
+} config_t;
+
+
+typedef enum {
+    PHASE_IDLE = 0,                      /* setting up idle connections */
+    PHASE_CHURN,                         /* running accept/close cycles */
+    PHASE_DONE,                          /* all done */
+} phase_t;
+
+
+typedef struct bench_s bench_t;
+
+typedef struct {
+    bench_t         *b;                  /* benchmark */
+    mrp_transport_t *t;                  /* transport */
+    mrp_list_hook_t  hook;               /* to connection list */
+} conn_t;
+
+struct bench_s {
+    mrp_mainloop_t  *ml;                 /* mainloop */
+    config_t        *cfg;                /* benchmark configuration */
+    mrp_sockaddr_t   addr;               /* resolved server address */
+    socklen_t        alen;               /* address length */
+    const char      *type;               /* transport type */
+    mrp_transport_t *lt;                 /* listening transport */
+    mrp_list_hook_t  servers;            /* server-side connections */
+    mrp_list_hook_t  clients;            /* client-side connections */
+    mrp_list_hook_t  closing;            /* connections to close */
+    mrp_deferred_t  *closer;             /* deferred closing callback */
+    phase_t          phase;              /* current phase */
+    int              nidle;              /* idle connections accepted */
+    int              nstarted;           /* cycles started */
+    int              ncycle;             /* cycles completed */
+    double           start;              /* churn start time */
+};
+
+
+static config_t cfg;
+
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+
+static void destroy_conn(conn_t *c)
+{
+    mrp_list_delete(&c->hook);
+
+    if (c->t != NULL) {
+        mrp_transport_disconnect(c->t);
+        mrp_transport_destroy(c->t);
+    }
+
+    mrp_free(c);
+}
+
+
+static void start_client(bench_t *b);
+
+
+static void client_recv(mrp_transport_t *t, void *data, void *user_data)
+{
+    MRP_UNUSED(t);
+    MRP_UNUSED(data);
+    MRP_UNUSED(user_data);
+}
+
+
+static void client_closed(mrp_transport_t *t, int error, void *user_data)
+{
+    conn_t  *c = (conn_t *)user_data;
+    bench_t *b = c->b;
+
+    MRP_UNUSED(error);
+
+    mrp_transport_destroy(t);
+    c->t = NULL;
+    destroy_conn(c);
+
+    if (b->phase != PHASE_CHURN)
+        return;
+
+    if (++b->ncycle >= b->cfg->ncycle) {
+        b->phase = PHASE_DONE;
+        mrp_mainloop_quit(b->ml, 0);
+    }
+    else if (b->nstarted < b->cfg->ncycle)
+        start_client(b);
+}
+
+
+static void start_client(bench_t *b)
+{
+    static mrp_transport_evt_t evt = {
+        { .recvcustom     = client_recv },
+        { .recvcustomfrom = NULL        },
+        .closed           = client_closed,
+        .connection       = NULL,
+    };
+
+    conn_t *c;
+    int     flags;
+
+    c = mrp_allocz(sizeof(*c));
+
+    if (c == NULL)
+        fatal("failed to allocate client connection");
+
+    mrp_list_init(&c->hook);
+    c->b  = b;
+
+    flags = MRP_TRANSPORT_MODE_CUSTOM;
+    c->t  = mrp_transport_create(b->ml, b->type, &evt, c, flags);
+
+    if (c->t == NULL || !mrp_transport_connect(c->t, &b->addr, b->alen))
+        fatal("failed to connect to '%s'", b->cfg->addr);
+
+    mrp_list_append(&b->clients, &c->hook);
+
+    if (b->phase == PHASE_CHURN)
+        b->nstarted++;
+}
+
+
+static void server_recv(mrp_transport_t *t, void *data, void *user_data)
+{
+    MRP_UNUSED(t);
+    MRP_UNUSED(data);
+    MRP_UNUSED(user_data);
+}
+
+
+static void server_closed(mrp_transport_t *t, int error, void *user_data)
+{
+    conn_t *c = (conn_t *)user_data;
+
+    MRP_UNUSED(error);
+
+    mrp_transport_destroy(t);
+    c->t = NULL;
+    destroy_conn(c);
+}
+
+
+static void close_cb(mrp_deferred_t *d, void *user_data)
+{
+    bench_t         *b = (bench_t *)user_data;
+    mrp_list_hook_t *p, *n;
+    conn_t          *c;
+
+    mrp_disable_deferred(d);
+
+    mrp_list_foreach(&b->closing, p, n) {
+        c = mrp_list_entry(p, typeof(*c), hook);
+        destroy_conn(c);
+    }
+}
+
+
+static void server_connection(mrp_transport_t *lt, void *user_data)
+{
+    bench_t *b = (bench_t *)user_data;
+    conn_t  *c;
+    int      i;
+
+    c = mrp_allocz(sizeof(*c));
+
+    if (c == NULL)
+        fatal("failed to allocate server connection");
+
+    mrp_list_init(&c->hook);
+    c->b = b;
+    c->t = mrp_transport_accept(lt, c, MRP_TRANSPORT_MODE_CUSTOM);
+
+    if (c->t == NULL)
+        fatal("failed to accept connection");
+
+    /*
+     * Idle connections are kept around. Churn connections are closed
+     * from a deferred callback, once the handshake has been completed.
+     */
+
+    if (b->phase == PHASE_IDLE) {
+        mrp_list_append(&b->servers, &c->hook);
+
+        if (++b->nidle == b->cfg->nidle) {
+            printf("%d idle connections set up\n", b->nidle);
+
+            b->phase = PHASE_CHURN;
+            b->start = now();
+
+            for (i = 0; i < b->cfg->nparallel; i++)
+                start_client(b);
+        }
+    }
+    else {
+        mrp_list_append(&b->closing, &c->hook);
+        mrp_enable_deferred(b->closer);
+    }
+}
+
+
+static void run_bench(config_t *c)
+{
+    static mrp_transport_evt_t evt = {
+        { .recvcustom     = server_recv },
+        { .recvcustomfrom = NULL        },
+        .closed           = server_closed,
+        .connection       = server_connection,
+    };
+
+    mrp_list_hook_t *p, *n;
+    bench_t          b;
+    double           run;
+    int              flags, i;
+
+    mrp_clear(&b);
+    mrp_list_init(&b.servers);
+    mrp_list_init(&b.clients);
+    mrp_list_init(&b.closing);
+    b.cfg = c;
+    b.ml  = mrp_mainloop_create();
+
+    if (b.ml == NULL)
+        fatal("failed to create mainloop");
+
+    b.alen = mrp_transport_resolve(NULL, c->addr, &b.addr, sizeof(b.addr),
+                                   &b.type);
+
+    if (b.alen <= 0)
+        fatal("failed to resolve address '%s'", c->addr);
+
+    flags = MRP_TRANSPORT_REUSEADDR | MRP_TRANSPORT_MODE_CUSTOM;
+    b.lt  = mrp_transport_create(b.ml, b.type, &evt, &b, flags);
+
+    if (b.lt == NULL ||
+        !mrp_transport_bind(b.lt, &b.addr, b.alen) ||
+        !mrp_transport_listen(b.lt, 0))
+        fatal("failed to listen on '%s'", c->addr);
+
+    b.closer = mrp_add_deferred(b.ml, close_cb, &b);
+
+    if (b.closer == NULL)
+        fatal("failed to create deferred callback");
+
+    mrp_disable_deferred(b.closer);
+
+    if (c->nidle > 0) {
+        for (i = 0; i < c->nidle; i++)
+            start_client(&b);
+    }
+    else {
+        b.phase = PHASE_CHURN;
+        b.start = now();
+
+        for (i = 0; i < c->nparallel; i++)
+            start_client(&b);
+    }
+
+    mrp_mainloop_run(b.ml);
+    run = now() - b.start;
+
+    printf("%d accept/close cycles next to %d idle connections in %.3f s, "
+           "%.0f cycles/s\n", b.ncycle, b.nidle, run, b.ncycle / run);
+
+    mrp_list_foreach(&b.clients, p, n)
+        destroy_conn(mrp_list_entry(p, conn_t, hook));
+    mrp_list_foreach(&b.servers, p, n)
+        destroy_conn(mrp_list_entry(p, conn_t, hook));
+    mrp_list_foreach(&b.closing, p, n)
+        destroy_conn(mrp_list_entry(p, conn_t, hook));
+
+    mrp_del_deferred(b.closer);
+    mrp_transport_destroy(b.lt);
+    mrp_mainloop_destroy(b.ml);
+}
+
+
+static void print_usage(const char *argv0, int exit_code, const char *fmt, ...)
+{
+    va_list ap;
+
+    if (fmt && *fmt) {
+        va_start(ap, fmt);
+        vprintf(fmt, ap);
+        va_end(ap);
+    }
+
+    printf("usage: %s [options]\n\n"
+           "The possible options are:\n"
+           "  -a, --address=ADDRESS          wsck address to listen on\n"
+           "  -i, --idle=N                   number of idle connections\n"
+           "  -n, --cycles=N                 number of accept/close cycles\n"
+           "  -p, --parallel=N               number of concurrent cycles\n"
+           "  -o, --log-target=TARGET        log target to use\n"
+           "      TARGET is one of stderr,stdout,syslog, or a logfile path\n"
+           "  -l, --log-level=LEVELS         logging level to use\n"
+           "      LEVELS is a comma separated list of info, error and warning\n"
+           "  -h, --help                     show help on usage\n",
+           argv0);
+
+    if (exit_code < 0)
+        return;
+    else
+        exit(exit_code);
+}
+
+
+static int parse_number(const char *argv0, const char *arg, const char *what)
+{
+    char *end;
+    int   n;
+
+    n = (int)strtol(arg, &end, 10);
+
+    if ((end && *end) || n < 0)
+        print_usage(argv0, EINVAL, "invalid %s '%s'.\n", what, arg);
+
+    return n;
+}
+
+
+static void parse_cmdline(config_t *c, int argc, char **argv)
+{
+#   define OPTIONS "a:i:n:p:l:o:h"
+    struct option options[] = {
+        { "address"   , required_argument, NULL, 'a' },
+        { "idle"      , required_argument, NULL, 'i' },
+        { "cycles"    , required_argument, NULL, 'n' },
+        { "parallel"  , required_argument, NULL, 'p' },
+        { "log-level" , required_argument, NULL, 'l' },
+        { "log-target", required_argument, NULL, 'o' },
+        { "help"      , no_argument      , NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    int opt;
+
+    c->addr       = "wsck:127.0.0.1:3300/murphy";
+    c->nidle      = 1000;
+    c->ncycle     = 10000;
+    c->nparallel  = 16;
+    c->log_mask   = MRP_LOG_UPTO(MRP_LOG_WARNING);
+    c->log_target = MRP_LOG_TO_STDERR;
+
+    while ((opt = getopt_long(argc, argv, OPTIONS, options, NULL)) != -1) {
+        switch (opt) {
+        case 'a':
+            c->addr = optarg;
+            break;
+        case 'i':
+            c->nidle = parse_number(argv[0], optarg, "number of connections");
+            break;
+        case 'n':
+            c->ncycle = parse_number(argv[0], optarg, "number of cycles");
+            break;
+        case 'p':
+            c->nparallel = parse_number(argv[0], optarg, "parallelism");
+            break;
+
+        case 'l':
+            c->log_mask = mrp_log_parse_levels(optarg);
+            if (c->log_mask < 0)
+                print_usage(argv[0], EINVAL, "invalid log level '%s'\n",
+                            optarg);
+            break;
+
+        case 'o':
+            c->log_target = mrp_log_parse_target(optarg);
+            if (!c->log_target)
+                print_usage(argv[0], EINVAL, "invalid log target '%s'\n",
+                            optarg);
+            break;
+
+        case 'h':
+            print_usage(argv[0], 0, "");
+            break;
+
+        default:
+            print_usage(argv[0], EINVAL, "invalid option '%c'", opt);
+        }
+    }
+
+    if (strncmp(c->addr, "wsck:", 5))
+        print_usage(argv[0], EINVAL, "not a wsck address '%s'.\n", c->addr);
+
+    if (c->ncycle < 1 || c->nparallel < 1 || c->nparallel > c->ncycle)
+        print_usage(argv[0], EINVAL, "invalid number of cycles.\n");
+}
+
+
+int main(int argc, char *argv[])
+{
+    parse_cmdline(&cfg, argc, argv);
+
+    mrp_log_set_mask(cfg.log_mask);
+    mrp_log_set_target(cfg.log_target);
+
+    run_bench(&cfg);
+
+    return 0;
+}
@@ -27,6 +27,7 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <stdio.h>
 #include <string.h>
 #include <errno.h>
 
@@ -69,6 +70,50 @@ static int check_request_callbacks(mrp_transport_req_t *req)
 }
 
 
+static void register_metrics(mrp_transport_descr_t *d)
+{
+    mrp_transport_metrics_t *m = &d->metrics;
+    char                     label[64];
+
+    snprintf(label, sizeof(label), "type=%s", d->type);
+
+    m->msg_in    = mrp_metric_counter("transport_messages_in_total", label,
+                                      "messages received by transport type");
+    m->msg_out   = mrp_metric_counter("transport_messages_out_total", label,
+                                      "messages sent by transport type");
+    m->send_fail = mrp_metric_counter("transport_send_failures_total", label,
+                                      "failed sends by transport type");
+}
+
+
+mrp_transport_metrics_t *mrp_transport_io_metrics(mrp_transport_descr_t *d)
+{
+    mrp_transport_metrics_t *m = &d->metrics;
+    char                     label[64];
+
+    /*
+     * Notes:
+     *     Not every transport does its own byte-level I/O, so the byte and
+     *     EAGAIN counters are only registered for the ones that ask for
+     *     them, on first use.
+     */
+
+    if (MRP_UNLIKELY(m->bytes_in == NULL)) {
+        snprintf(label, sizeof(label), "type=%s", d->type);
+
+        m->bytes_in  = mrp_metric_counter("transport_bytes_in_total", label,
+                                          "bytes received by transport type");
+        m->bytes_out = mrp_metric_counter("transport_bytes_out_total", label,
+                                          "bytes sent by transport type");
+        m->eagain    = mrp_metric_counter("transport_eagain_total", label,
+                                          "writes failed with EAGAIN by "
+                                          "transport type");
+    }
+
+    return m;
+}
+
+
 int mrp_transport_register(mrp_transport_descr_t *d)
 {
     if (!check_request_callbacks(&d->req))
@@ -77,6 +122,7 @@ int mrp_transport_register(mrp_transport_descr_t *d)
     if (d->size >= sizeof(mrp_transport_t)) {
         mrp_list_init(&d->hook);
         mrp_list_append(&transports, &d->hook);
+        register_metrics(d);
 
         return TRUE;
     }
@@ -425,6 +471,17 @@ int mrp_transport_disconnect(mrp_transport_t *t)
 }
 
 
+static inline int count_send(mrp_transport_t *t, int result)
+{
+    if (result)
+        mrp_metric_inc(t->descr->metrics.msg_out);
+    else
+        mrp_metric_inc(t->descr->metrics.send_fail);
+
+    return result;
+}
+
+
 int mrp_transport_send(mrp_transport_t *t, mrp_msg_t *msg)
 {
     int result;
@@ -439,7 +496,7 @@ int mrp_transport_send(mrp_transport_t *t, mrp_msg_t *msg)
     else
         result = FALSE;
 
-    return result;
+    return count_send(t, result);
 }
 
 
@@ -458,7 +515,7 @@ int mrp_transport_sendto(mrp_transport_t *t, mrp_msg_t *msg,
     else
         result = FALSE;
 
-    return result;
+    return count_send(t, result);
 }
 
 
@@ -477,7 +534,7 @@ int mrp_transport_sendraw(mrp_transport_t *t, void *data, size_t size)
     else
         result = FALSE;
 
-    return result;
+    return count_send(t, result);
 }
 
 
@@ -496,7 +553,7 @@ int mrp_transport_sendrawto(mrp_transport_t *t, void *data, size_t size,
     else
         result = FALSE;
 
-    return result;
+    return count_send(t, result);
 }
 
 
@@ -515,7 +572,7 @@ int mrp_transport_senddata(mrp_transport_t *t, void *data, uint16_t tag)
     else
         result = FALSE;
 
-    return result;
+    return count_send(t, result);
 }
 
 
@@ -534,7 +591,7 @@ int mrp_transport_senddatato(mrp_transport_t *t, void *data, uint16_t tag,
     else
         result = FALSE;
 
-    return result;
+    return count_send(t, result);
 }
 
 
@@ -552,7 +609,7 @@ int mrp_transport_sendcustom(mrp_transport_t *t, void *data)
     else
         result = FALSE;
 
-    return result;
+    return count_send(t, result);
 }
 
 
@@ -571,7 +628,7 @@ int mrp_transport_sendcustomto(mrp_transport_t *t, void *data,
     else
         result = FALSE;
 
-    return result;
+    return count_send(t, result);
 }
 
 
@@ -583,6 +640,8 @@ static int recv_data(mrp_transport_t *t, void *data, size_t size,
     mrp_msg_t        *msg;
     void             *decoded;
 
+    mrp_metric_inc(t->descr->metrics.msg_in);
+
     switch (t->mode) {
     case MRP_TRANSPORT_MODE_DATA:
         tag   = be16toh(*(uint16_t *)data);
@@ -38,6 +38,7 @@
 #include <murphy/common/list.h>
 #include <murphy/common/mainloop.h>
 #include <murphy/common/msg.h>
+#include <murphy/common/metrics.h>
 
 MRP_CDECL_BEGIN
 
@@ -86,10 +87,24 @@ typedef enum {
     MRP_TRANSPORT_REUSEADDR = 0x10,
     MRP_TRANSPORT_NONBLOCK  = 0x20,
     MRP_TRANSPORT_CLOEXEC   = 0x40,
+    MRP_TRANSPORT_IOWORKER  = 0x80,      /* use I/O workers if running */
 } mrp_transport_flag_t;
 
 #define MRP_TRANSPORT_MODE(t) ((t)->flags & MRP_TRANSPORT_MODE_MASK)
 
+/*
+ * generic transport options
+ *
+ * These can be set with mrp_transport_setopt on any transport type that
+ * supports them. Transports ignore (fail to set) options they don't know.
+ */
+
+/**
+ * Max. number of datagrams to receive per wakeup (int *, 1 disables). Off
+ * by default. While on, datagrams larger than 64 KB are dropped.
+ */
+#define MRP_TRANSPORT_OPT_RECVBATCH "recv-batch"
+
 /*
  * transport requests
  *
@@ -196,6 +211,20 @@ typedef struct {
 } mrp_transport_evt_t;
 
 
+/*
+ * per transport type metrics
+ */
+
+typedef struct {
+    mrp_metric_t        *msg_in;         /* messages received */
+    mrp_metric_t        *msg_out;        /* messages sent */
+    mrp_metric_t        *send_fail;      /* failed send attempts */
+    mrp_metric_t        *bytes_in;       /* bytes received, if counted */
+    mrp_metric_t        *bytes_out;      /* bytes sent, if counted */
+    mrp_metric_t        *eagain;         /* EAGAIN writes, if counted */
+} mrp_transport_metrics_t;
+
+
 /*
  * transport descriptor
  */
@@ -207,6 +236,7 @@ typedef struct {
     socklen_t          (*resolve)(const char *str, mrp_sockaddr_t *addr,
                                   socklen_t addrlen, const char **typep);
     mrp_list_hook_t      hook;           /* to list of registered transports */
+    mrp_transport_metrics_t metrics;     /* metrics of this transport type */
 } mrp_transport_descr_t;
 
 
@@ -410,6 +440,9 @@ int mrp_transport_register(mrp_transport_descr_t *d);
 /** Unregister a transport. */
 void mrp_transport_unregister(mrp_transport_descr_t *d);
 
+/** Get the metrics of a transport type, registering its I/O counters. */
+mrp_transport_metrics_t *mrp_transport_io_metrics(mrp_transport_descr_t *d);
+
 /** Create a new transport. */
 mrp_transport_t *mrp_transport_create(mrp_mainloop_t *ml, const char *type,
                                       mrp_transport_evt_t *evt,
@@ -35,6 +35,10 @@
 #include <net/if.h>
 #include <arpa/inet.h>
 
+#ifdef WEBSOCKETS_DEFLATE
+#    include <zlib.h>
+#endif
+
 #include <murphy/common/macros.h>
 #include <murphy/common/mm.h>
 #include <murphy/common/log.h>
@@ -42,6 +46,7 @@
 #include <murphy/common/mainloop.h>
 #include <murphy/common/fragbuf.h>
 #include <murphy/common/hashtbl.h>
+#include <murphy/common/metrics.h>
 
 #include "websocklib.h"
 
@@ -68,6 +73,9 @@
 typedef struct libwebsocket                  lws_t;
 typedef struct libwebsocket_context          lws_ctx_t;
 typedef struct libwebsocket_extension        lws_ext_t;
+typedef extension_callback_function          lws_ext_cb_t;
+typedef enum   libwebsocket_extension_callback_reasons lws_ext_event_t;
+typedef struct lws_tokens                    lws_tokens_t;
 typedef struct libwebsocket_protocols        lws_proto_t;
 typedef enum   libwebsocket_callback_reasons lws_event_t;
 #ifdef WEBSOCKETS_CONTEXT_INFO
@@ -103,8 +111,17 @@ static lws_ext_t *lws_get_internal_extensions(void);
  * bookkeeping: we need to to keep track of the current event mask for
  * all descriptors just to figure out the new mask when libwebsockets
  * hands us a diff.
+ *
+ * We keep these in a table directly indexed by the file descriptor,
+ * growing it geometrically as necessary. Unused slots have fd -1. This
+ * way adding, removing, and looking up descriptors (including mapping
+ * epoll events back to their descriptor) is O(1) regardless of the
+ * number of connections.
  */
 
+#define WSL_FDTBL_MIN 64                 /* initial fd table size */
+#define WSL_EVENT_MAX 256                /* max. epoll events per round */
+
 typedef struct {
     int      fd;                         /* libwebsocket file descriptor */
     uint32_t events;                     /* monitored (epoll) events */
@@ -125,13 +142,17 @@ struct wsl_ctx_s {
     int              epollfd;             /* epoll descriptor */
     mrp_io_watch_t  *w;                   /* I/O watch for epollfd */
     mrp_mainloop_t  *ml;                  /* pumping mainloop */
-    pollfd_t        *fds;                 /* polled descriptors */
+    pollfd_t        *fds;                 /* polled descriptors, by fd */
     int              nfd;                 /* number descriptors */
+    int              fdsize;              /* size of fds */
     void            *user_data;           /* opaque user data */
     lws_t           *pending;             /* pending connection */
     void            *pending_user;        /* user_data of pending */
     wsl_proto_t     *pending_proto;       /* protocol of pending */
     mrp_list_hook_t  pure_http;           /* pure HTTP sockets */
+    lws_ext_t       *lws_exts;            /* wrapped deflate extensions */
+    wsl_deflate_t    deflate;             /* compression configuration */
+    wsl_deflate_stats_t stats;            /* compression statistics */
 };
 
 /*
@@ -150,9 +171,38 @@ struct wsl_sck_s {
     int              pure_http : 1;      /* pure HTTP socket */
     int              busy;               /* upper-layer callback(s) active */
     mrp_list_hook_t  hook;               /* to pure HTTP list, if such */
+    void            *sendbuf;            /* reusable padded send buffer */
+    size_t           sendsize;           /* send buffer size */
+    mrp_list_hook_t  sendq;              /* queued outgoing frames */
+    char            *http_body;          /* pending HTTP response body */
+    size_t           http_size;          /* HTTP response body size */
+    size_t           http_sent;          /* amount of body written so far */
 };
 
 
+/*
+ * an outgoing frame queued until the socket becomes writable
+ *
+ * Frames are queued in their padded send buffers, so queueing costs us
+ * no extra copying of the payload.
+ */
+
+#define WSL_SENDBUF_MIN   4096           /* initial send buffer size */
+#define WSL_SENDBUF_MAX  65536           /* max. send buffer size kept */
+
+typedef struct {
+    mrp_list_hook_t  hook;               /* to send queue */
+    void            *buf;                /* padded send buffer */
+    size_t           size;               /* send buffer size */
+    size_t           len;                /* amount of data to write */
+    wsl_sendmode_t   mode;               /* libwebsocket write mode */
+} sendq_frame_t;
+
+static mrp_metric_t *sendq_bytes;        /* total queued bytes, all sockets */
+
+#define WSL_HTTP_CHUNK    4096           /* HTTP body written per round */
+
+
 /*
  * mark a socket busy while executing a piece of code
  */
@@ -170,6 +220,8 @@ static int http_event(lws_ctx_t *ws_ctx, lws_t *ws, lws_event_t event,
 static int wsl_event(lws_ctx_t *ws_ctx, lws_t *ws, lws_event_t event,
                      void *user, void *in, size_t len);
 static void destroy_context(wsl_ctx_t *ctx);
+static void purge_sendq(wsl_sck_t *sck);
+static int  write_http_body(wsl_sck_t *sck);
 
 static void MRP_EXIT destroy_context_table(void);
 
@@ -202,25 +254,59 @@ static inline short map_event_to_poll(uint32_t in)
 }
 
 
+static int grow_fds(wsl_ctx_t *wsc, int fd)
+{
+    int size, i;
+
+    if (fd < wsc->fdsize)
+        return TRUE;
+
+    size = wsc->fdsize ? wsc->fdsize : WSL_FDTBL_MIN;
+
+    while (size <= fd)
+        size *= 2;
+
+    if (mrp_reallocz(wsc->fds, wsc->fdsize, size) == NULL)
+        return FALSE;
+
+    for (i = wsc->fdsize; i < size; i++)
+        wsc->fds[i].fd = -1;
+
+    wsc->fdsize = size;
+
+    return TRUE;
+}
+
+
+static pollfd_t *find_fd(wsl_ctx_t *wsc, int fd)
+{
+    if (wsc != NULL && fd >= 0 && fd < wsc->fdsize) {
+        if (wsc->fds[fd].fd == fd)
+            return wsc->fds + fd;
+    }
+
+    return NULL;
+}
+
+
 static int add_fd(wsl_ctx_t *wsc, int fd, int events)
 {
     struct epoll_event e;
 
-    if (wsc != NULL) {
+    if (wsc != NULL && fd >= 0) {
+        if (find_fd(wsc, fd) != NULL || !grow_fds(wsc, fd))
+            return FALSE;
+
         e.data.u64 = 0;
         e.data.fd  = fd;
         e.events   = map_poll_to_event(events);
 
         if (epoll_ctl(wsc->epollfd, EPOLL_CTL_ADD, fd, &e) == 0) {
-            if (mrp_reallocz(wsc->fds, wsc->nfd, wsc->nfd + 1) != NULL) {
-                wsc->fds[wsc->nfd].fd     = fd;
-                wsc->fds[wsc->nfd].events = e.events;
-                wsc->nfd++;
+            wsc->fds[fd].fd     = fd;
+            wsc->fds[fd].events = e.events;
+            wsc->nfd++;
 
-                return TRUE;
-            }
-            else
-                epoll_ctl(wsc->epollfd, EPOLL_CTL_DEL, fd, &e);
+            return TRUE;
         }
     }
 
@@ -230,8 +316,8 @@ static int add_fd(wsl_ctx_t *wsc, int fd, int events)
 
 static int del_fd(wsl_ctx_t *wsc, int fd)
 {
-    struct epoll_event e;
-    int                i;
+    struct epoll_event  e;
+    pollfd_t           *wfd;
 
     if (wsc != NULL) {
         e.data.u64 = 0;
@@ -239,17 +325,14 @@ static int del_fd(wsl_ctx_t *wsc, int fd)
         e.events   = 0;
         epoll_ctl(wsc->epollfd, EPOLL_CTL_DEL, fd, &e);
 
-        for (i = 0; i < wsc->nfd; i++) {
-            if (wsc->fds[i].fd == fd) {
-                if (i < wsc->nfd - 1)
-                    memmove(wsc->fds + i, wsc->fds + i + 1,
-                            (wsc->nfd - i - 1) * sizeof(*wsc->fds));
+        wfd = find_fd(wsc, fd);
 
-                mrp_reallocz(wsc->fds, wsc->nfd, wsc->nfd - 1);
-                wsc->nfd--;
+        if (wfd != NULL) {
+            wfd->fd     = -1;
+            wfd->events = 0;
+            wsc->nfd--;
 
-                return TRUE;
-            }
+            return TRUE;
         }
     }
 
@@ -257,20 +340,6 @@ static int del_fd(wsl_ctx_t *wsc, int fd)
 }
 
 
-static pollfd_t *find_fd(wsl_ctx_t *wsc, int fd)
-{
-    int i;
-
-    if (wsc != NULL) {
-        for (i = 0; i < wsc->nfd; i++)
-            if (wsc->fds[i].fd == fd)
-                return wsc->fds + i;
-    }
-
-    return NULL;
-}
-
-
 static int mod_fd(wsl_ctx_t *wsc, int fd, int events, int clear)
 {
     struct epoll_event  e;
@@ -288,8 +357,11 @@ static int mod_fd(wsl_ctx_t *wsc, int fd, int events, int clear)
             else
                 e.events = wfd->events |  map_poll_to_event(events);
 
-            if (epoll_ctl(wsc->epollfd, EPOLL_CTL_MOD, fd, &e) == 0)
+            if (epoll_ctl(wsc->epollfd, EPOLL_CTL_MOD, fd, &e) == 0) {
+                wfd->events = e.events;
+
                 return TRUE;
+            }
         }
     }
 
@@ -301,8 +373,9 @@ static void purge_fds(wsl_ctx_t *wsc)
 {
     if (wsc != NULL) {
         mrp_free(wsc->fds);
-        wsc->fds = NULL;
-        wsc->nfd = 0;
+        wsc->fds    = NULL;
+        wsc->nfd    = 0;
+        wsc->fdsize = 0;
     }
 }
 
@@ -322,7 +395,7 @@ static void epoll_event(mrp_io_watch_t *w, int fd, mrp_io_event_t mask,
     if (wsc->nfd <= 0 || !(mask & MRP_IO_EVENT_IN))
         return;
 
-    nevent = wsc->nfd;
+    nevent = MRP_MIN(wsc->nfd, WSL_EVENT_MAX);
     events = alloca(nevent * sizeof(*events));
 
     while ((n = epoll_wait(wsc->epollfd, events, nevent, 0)) > 0) {
@@ -564,6 +637,230 @@ static lws_ext_t *lws_get_internal_extensions(void)
 #endif
 }
 
+
+/*
+ * compression extension support
+ *
+ * libwebsockets implements the actual compression extensions. We only
+ * pick the deflate-based ones from its builtin set and wrap their
+ * callbacks to collect statistics and to tune our outgoing stream. The
+ * original callback is stashed in the per-context private data of our
+ * copy of the extension.
+ */
+
+static int is_deflate_ext(const char *name)
+{
+    return (!strcmp(name, "permessage-deflate") ||
+            !strcmp(name, "deflate-frame")      ||
+            !strcmp(name, "x-webkit-deflate-frame"));
+}
+
+
+static int is_deflate_frame(lws_ext_t *ext)
+{
+    return (!strcmp(ext->name, "deflate-frame") ||
+            !strcmp(ext->name, "x-webkit-deflate-frame"));
+}
+
+
+#ifdef WEBSOCKETS_DEFLATE
+
+/*
+ * leading part of the libwebsockets deflate-frame per-session data
+ */
+
+typedef struct {
+    z_stream zin;                        /* inflate stream */
+    z_stream zout;                       /* deflate stream */
+} lws_deflate_frame_t;
+
+
+static int setup_deflate_stream(wsl_ctx_t *ctx, lws_ext_t *ext, void *user)
+{
+    lws_deflate_frame_t *df = user;
+    int                  level, wbits;
+
+    if (!is_deflate_frame(ext))
+        return 0;
+
+    level = ctx->deflate.level;
+    wbits = ctx->deflate.wbits;
+
+    deflateEnd(&df->zout);
+    mrp_clear(&df->zout);
+
+    if (deflateInit2(&df->zout, level, Z_DEFLATED, -wbits, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        mrp_log_error("websock: failed to set up deflate stream (%d, %d).",
+                      level, wbits);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static void set_deflate_level(lws_ext_t *ext, void *user, int level)
+{
+    lws_deflate_frame_t *df = user;
+
+    if (!is_deflate_frame(ext))
+        return;
+
+    /*
+     * We only switch levels between messages, when there is no pending
+     * input. Make sure zlib does not try to flush to a stale buffer.
+     */
+
+    df->zout.avail_out = 0;
+    deflateParams(&df->zout, level, Z_DEFAULT_STRATEGY);
+}
+
+#else /* !WEBSOCKETS_DEFLATE */
+
+static int setup_deflate_stream(wsl_ctx_t *ctx, lws_ext_t *ext, void *user)
+{
+    MRP_UNUSED(ctx);
+    MRP_UNUSED(ext);
+    MRP_UNUSED(user);
+
+    return 0;
+}
+
+
+static void set_deflate_level(lws_ext_t *ext, void *user, int level)
+{
+    MRP_UNUSED(ext);
+    MRP_UNUSED(user);
+    MRP_UNUSED(level);
+}
+
+#endif /* !WEBSOCKETS_DEFLATE */
+
+
+static int deflate_ext_event(lws_ctx_t *ws_ctx, lws_ext_t *ext, lws_t *ws,
+                             lws_ext_event_t event, void *user, void *in,
+                             size_t len)
+{
+    lws_ext_cb_t *cb  = (lws_ext_cb_t *)ext->per_context_private_data;
+    wsl_ctx_t    *ctx = NULL;
+    lws_tokens_t *buf = (lws_tokens_t *)in;
+    size_t        plain;
+    int           status, small;
+
+    switch (event) {
+    case LWS_EXT_CALLBACK_CONSTRUCT:
+    case LWS_EXT_CALLBACK_CLIENT_CONSTRUCT:
+    case LWS_EXT_CALLBACK_PAYLOAD_TX:
+    case LWS_EXT_CALLBACK_PAYLOAD_RX:
+        ctx = get_context_userdata(ws_ctx);
+        break;
+    default:
+        break;
+    }
+
+    if (ctx == NULL)
+        return cb(ws_ctx, ext, ws, event, user, in, len);
+
+    switch (event) {
+    case LWS_EXT_CALLBACK_CONSTRUCT:
+    case LWS_EXT_CALLBACK_CLIENT_CONSTRUCT:
+        status = cb(ws_ctx, ext, ws, event, user, in, len);
+
+        if (status == 0) {
+            mrp_debug("websocket %p negotiated extension '%s'", ws, ext->name);
+
+            if ((status = setup_deflate_stream(ctx, ext, user)) == 0)
+                ctx->stats.nsession++;
+        }
+        return status;
+
+    case LWS_EXT_CALLBACK_PAYLOAD_TX:
+        plain = buf->token_len;
+        small = plain < ctx->deflate.min_size;
+
+        if (small)
+            set_deflate_level(ext, user, 0);         /* stored */
+
+        status = cb(ws_ctx, ext, ws, event, user, in, len);
+
+        if (small)
+            set_deflate_level(ext, user, ctx->deflate.level);
+
+        if (status >= 0) {
+            ctx->stats.tx_plain    += plain;
+            ctx->stats.tx_deflated += buf->token_len;
+        }
+        return status;
+
+    case LWS_EXT_CALLBACK_PAYLOAD_RX:
+        plain = buf->token_len;
+        status = cb(ws_ctx, ext, ws, event, user, in, len);
+
+        if (status >= 0) {
+            ctx->stats.rx_deflated += plain;
+            ctx->stats.rx_plain    += buf->token_len;
+        }
+        return status;
+
+    default:
+        return cb(ws_ctx, ext, ws, event, user, in, len);
+    }
+}
+
+
+static int setup_extensions(wsl_ctx_t *ctx, wsl_ctx_cfg_t *cfg)
+{
+    lws_ext_t *builtin = lws_get_internal_extensions();
+    lws_ext_t *ext, *e;
+    int        n;
+
+    ctx->deflate = cfg->deflate;
+
+    if (!ctx->deflate.enable)
+        return 0;
+
+    if (ctx->deflate.level < 0 || ctx->deflate.level > 9)
+        ctx->deflate.level = WSL_DEFLATE_LEVEL;
+    if (ctx->deflate.wbits < 9 || ctx->deflate.wbits > 15)
+        ctx->deflate.wbits = WSL_DEFLATE_WBITS;
+
+    for (n = 0, e = builtin; e != NULL && e->name != NULL; e++)
+        if (is_deflate_ext(e->name))
+            n++;
+
+    if (n == 0) {
+        mrp_log_warning("websock: libwebsockets has no deflate extensions.");
+        ctx->deflate.enable = FALSE;
+        return 0;
+    }
+
+    ext = mrp_allocz_array(lws_ext_t, n + 1);
+
+    if (ext == NULL)
+        return -1;
+
+    for (n = 0, e = builtin; e->name != NULL; e++) {
+        if (!is_deflate_ext(e->name))
+            continue;
+
+        ext[n] = *e;
+        ext[n].callback = deflate_ext_event;
+        ext[n].per_context_private_data = (void *)e->callback;
+        n++;
+    }
+
+    ctx->lws_exts = ext;
+
+    return 0;
+}
+
+
+void wsl_get_deflate_stats(wsl_ctx_t *ctx, wsl_deflate_stats_t *stats)
+{
+    *stats = ctx->stats;
+}
+
 static int find_device(struct sockaddr *sa, char *buf, size_t size)
 {
     struct sockaddr *ia;
@@ -718,8 +1015,11 @@ wsl_ctx_t *wsl_create_context(mrp_mainloop_t *ml, wsl_ctx_cfg_t *cfg)
     if (ctx->w == NULL)
         goto fail;
 
+    if (setup_extensions(ctx, cfg) < 0)
+        goto fail;
+
     cci.protocols  = lws_protos;
-    cci.extensions = builtin;
+    cci.extensions = ctx->lws_exts ? ctx->lws_exts : builtin;
     cci.user       = ctx;
     cci.gid        = cfg->gid;
     cci.uid        = cfg->uid;
@@ -749,6 +1049,7 @@ wsl_ctx_t *wsl_create_context(mrp_mainloop_t *ml, wsl_ctx_cfg_t *cfg)
             close(ctx->epollfd);
         }
 
+        mrp_free(ctx->lws_exts);
         mrp_free(ctx);
     }
 
@@ -790,6 +1091,16 @@ static void destroy_context(wsl_ctx_t *ctx)
             libwebsocket_context_destroy(ctx->ctx);
         }
 
+        if (ctx->deflate.enable)
+            mrp_debug("deflate: sent %llu/%llu, received %llu/%llu bytes "
+                      "(compressed/plain) in %u sessions",
+                      (unsigned long long)ctx->stats.tx_deflated,
+                      (unsigned long long)ctx->stats.tx_plain,
+                      (unsigned long long)ctx->stats.rx_deflated,
+                      (unsigned long long)ctx->stats.rx_plain,
+                      ctx->stats.nsession);
+
+        mrp_free(ctx->lws_exts);
         mrp_free(ctx->lws_protos);
         mrp_free(ctx);
     }
@@ -906,6 +1217,7 @@ wsl_sck_t *wsl_connect(wsl_ctx_t *ctx, struct sockaddr *sa,
          */
 
         mrp_list_init(&sck->hook);
+        mrp_list_init(&sck->sendq);
         sck->ctx   = wsl_ref_context(ctx);
         sck->proto = up;
         sck->buf   = mrp_fragbuf_create(/*up->framed*/TRUE, 0);
@@ -957,6 +1269,7 @@ wsl_sck_t *wsl_accept_pending(wsl_ctx_t *ctx, void *user_data)
 
     if (sck != NULL) {
         mrp_list_init(&sck->hook);
+        mrp_list_init(&sck->sendq);
 
         /*
          * Notes:
@@ -1052,6 +1365,12 @@ void *wsl_close(wsl_sck_t *sck)
             mrp_fragbuf_destroy(sck->buf);
             sck->buf = NULL;
 
+            purge_sendq(sck);
+            mrp_free(sck->sendbuf);
+            sck->sendbuf = NULL;
+            mrp_free(sck->http_body);
+            sck->http_body = NULL;
+
             mrp_debug("freeing websocket %p", sck);
             mrp_free(sck);
         }
@@ -1093,42 +1412,217 @@ int wsl_set_sendmode(wsl_sck_t *sck, wsl_sendmode_t mode)
 }
 
 
-int wsl_send(wsl_sck_t *sck, void *payload, size_t size)
+static int send_pipe_choked(wsl_sck_t *sck)
+{
+#ifndef WEBSOCKETS_OLD
+    return lws_send_pipe_choked(sck->sck);
+#else
+    MRP_UNUSED(sck);
+
+    return FALSE;
+#endif
+}
+
+
+static void release_sendbuf(wsl_sck_t *sck, void *buf, size_t size)
 {
-    unsigned char *buf;
-    size_t         pre, post, total;
-    uint32_t      *len;
+    if (sck->sendbuf == NULL && size <= WSL_SENDBUF_MAX) {
+        sck->sendbuf  = buf;
+        sck->sendsize = size;
+    }
+    else
+        mrp_free(buf);
+}
 
-    if (sck != NULL && sck->sck != NULL) {
-        if (sck->proto->framed) {
-            pre  = LWS_SEND_BUFFER_PRE_PADDING;
-            post = LWS_SEND_BUFFER_POST_PADDING;
-            buf  = alloca(pre + sizeof(*len) + size + post);
-            len  = (uint32_t *)(buf + pre);
-            *len = htobe32(size);
 
-            memcpy(buf + pre + sizeof(*len), payload, size);
-            total = sizeof(*len) + size;
+static int write_frame(wsl_sck_t *sck, void *buf, size_t len,
+                       wsl_sendmode_t mode)
+{
+    unsigned char *data = (unsigned char *)buf + LWS_SEND_BUFFER_PRE_PADDING;
+
+    if (libwebsocket_write(sck->sck, data, len, mode) >= 0)
+        return TRUE;
+    else
+        return FALSE;
+}
+
+
+static void purge_sendq(wsl_sck_t *sck)
+{
+    mrp_list_hook_t *p, *n;
+    sendq_frame_t   *f;
+
+    mrp_list_foreach(&sck->sendq, p, n) {
+        f = mrp_list_entry(p, typeof(*f), hook);
+
+        mrp_metric_adjust(sendq_bytes, -(int64_t)f->len);
+        mrp_list_delete(&f->hook);
+        mrp_free(f->buf);
+        mrp_free(f);
+    }
+}
+
+
+static void flush_sendq(wsl_sck_t *sck)
+{
+    mrp_list_hook_t *p, *n;
+    sendq_frame_t   *f;
+
+    mrp_list_foreach(&sck->sendq, p, n) {
+        if (sck->sck == NULL)
+            return;
+
+        if (send_pipe_choked(sck)) {
+            libwebsocket_callback_on_writable(sck->ctx->ctx, sck->sck);
+            return;
         }
-        else {
-            pre  = LWS_SEND_BUFFER_PRE_PADDING;
-            post = LWS_SEND_BUFFER_POST_PADDING;
-            buf  = alloca(pre + size + post);
 
-            memcpy(buf + pre, payload, size);
-            total = size;
+        f = mrp_list_entry(p, typeof(*f), hook);
+
+        if (!write_frame(sck, f->buf, f->len, f->mode))
+            mrp_log_error("Failed to write queued frame to websocket %p.",
+                          sck);
+
+        mrp_metric_adjust(sendq_bytes, -(int64_t)f->len);
+        mrp_list_delete(&f->hook);
+        release_sendbuf(sck, f->buf, f->size);
+        mrp_free(f);
+    }
+}
+
+
+void *wsl_get_sendbuf(wsl_sck_t *sck, size_t *size, size_t *reserve)
+{
+    void *buf;
+
+    *reserve = LWS_SEND_BUFFER_PRE_PADDING;
+
+    if (sck == NULL) {
+        *size = 0;
+        return NULL;
+    }
+
+    if (sck->proto != NULL && sck->proto->framed)
+        *reserve += sizeof(uint32_t);
+
+    if (sck->sendbuf != NULL) {
+        buf   = sck->sendbuf;
+        *size = sck->sendsize;
+
+        sck->sendbuf  = NULL;
+        sck->sendsize = 0;
+    }
+    else {
+        buf   = mrp_alloc(WSL_SENDBUF_MIN);
+        *size = buf != NULL ? WSL_SENDBUF_MIN : 0;
+    }
+
+    return buf;
+}
+
+
+int wsl_send_sendbuf(wsl_sck_t *sck, void *buf, size_t size, size_t len)
+{
+    sendq_frame_t *f;
+    size_t         pre, hdr, need;
+    uint32_t       total;
+    int            status;
+
+    if (buf == NULL)
+        return FALSE;
+
+    if (sck == NULL || sck->sck == NULL) {
+        mrp_free(buf);
+        return FALSE;
+    }
+
+    pre  = LWS_SEND_BUFFER_PRE_PADDING;
+    hdr  = sck->proto->framed ? sizeof(total) : 0;
+    need = pre + hdr + len + LWS_SEND_BUFFER_POST_PADDING;
+
+    if (size < need) {
+        if (mrp_realloc(buf, need) == NULL) {
+            mrp_free(buf);
+            return FALSE;
         }
 
+        size = need;
+    }
+
+    if (hdr) {                           /* write frame header in place */
+        total = htobe32(len);
+        memcpy((char *)buf + pre, &total, sizeof(total));
+    }
+
 #if (WSL_SEND_TEXT != 0)
-        if (!sck->send_mode)
-            sck->send_mode = WSL_SEND_TEXT;
+    if (!sck->send_mode)
+        sck->send_mode = WSL_SEND_TEXT;
 #endif
 
-        if (libwebsocket_write(sck->sck, buf + pre, total, sck->send_mode) >= 0)
-            return TRUE;
+    /*
+     * Notes:
+     *     If libwebsockets still has data pending from an earlier partial
+     *     write, or we have frames queued, we cannot write now. Queue the
+     *     frame together with its buffer and ask to be notified once the
+     *     socket becomes writable.
+     */
+
+    if (!mrp_list_empty(&sck->sendq) || send_pipe_choked(sck)) {
+        if ((f = mrp_allocz(sizeof(*f))) == NULL) {
+            mrp_free(buf);
+            return FALSE;
+        }
+
+        mrp_list_init(&f->hook);
+        f->buf  = buf;
+        f->size = size;
+        f->len  = hdr + len;
+        f->mode = sck->send_mode;
+
+        if (sendq_bytes == NULL)
+            sendq_bytes = mrp_metric_gauge("websocket_sendq_bytes", NULL,
+                                           "websocket send queue size in "
+                                           "bytes");
+
+        mrp_metric_adjust(sendq_bytes, f->len);
+        mrp_list_append(&sck->sendq, &f->hook);
+        libwebsocket_callback_on_writable(sck->ctx->ctx, sck->sck);
+
+        mrp_debug("queued %zu bytes for websocket %p", hdr + len, sck);
+
+        return TRUE;
     }
 
-    return FALSE;
+    status = write_frame(sck, buf, hdr + len, sck->send_mode);
+    release_sendbuf(sck, buf, size);
+
+    return status;
+}
+
+
+int wsl_send(wsl_sck_t *sck, void *payload, size_t size)
+{
+    void   *buf;
+    size_t  bsize, reserve, need;
+
+    if (sck == NULL || sck->sck == NULL)
+        return FALSE;
+
+    buf  = wsl_get_sendbuf(sck, &bsize, &reserve);
+    need = reserve + size + LWS_SEND_BUFFER_POST_PADDING;
+
+    if (bsize < need) {
+        if (mrp_realloc(buf, need) == NULL) {
+            mrp_free(buf);
+            return FALSE;
+        }
+
+        bsize = need;
+    }
+
+    memcpy((char *)buf + reserve, payload, size);
+
+    return wsl_send_sendbuf(sck, buf, bsize, size);
 }
 
 
@@ -1150,6 +1644,118 @@ int wsl_serve_http_file(wsl_sck_t *sck, const char *path, const char *type)
 }
 
 
+int wsl_serve_http_data(wsl_sck_t *sck, const char *type, const void *data,
+                        size_t size)
+{
+    char hdr[256];
+    int  n;
+
+    if (sck == NULL || sck->sck == NULL || sck->http_body != NULL)
+        return FALSE;
+
+    mrp_debug("serving %zu bytes of %s over websocket %p", size, type,
+              sck->sck);
+
+    n = snprintf(hdr, sizeof(hdr),
+                 "HTTP/1.0 200 OK\r\n"
+                 "Server: murphy\r\n"
+                 "Content-Type: %s\r\n"
+                 "Content-Length: %zu\r\n"
+                 "Connection: close\r\n"
+                 "\r\n", type, size);
+
+    if (n < 0 || n >= (int)sizeof(hdr))
+        return FALSE;
+
+    /*
+     * Notes:
+     *     The body is copied and written out in chunks whenever the socket
+     *     becomes writable. Completion is signalled to the upper layer via
+     *     the http_done callback, just like for wsl_serve_http_file.
+     */
+
+    if ((sck->http_body = mrp_alloc(size ? size : 1)) == NULL)
+        return FALSE;
+
+    memcpy(sck->http_body, data, size);
+    sck->http_size = size;
+    sck->http_sent = 0;
+
+    if (libwebsocket_write(sck->sck, (unsigned char *)hdr, n,
+                           LWS_WRITE_HTTP) < 0) {
+        mrp_free(sck->http_body);
+        sck->http_body = NULL;
+        return FALSE;
+    }
+
+#ifndef WEBSOCKETS_OLD
+    libwebsocket_callback_on_writable(sck->ctx->ctx, sck->sck);
+#else
+    /* no HTTP writability events, we can only write it all out now */
+    if (write_http_body(sck) < 0)
+        return FALSE;
+#endif
+
+    return TRUE;
+}
+
+
+/*
+ * Write the pending HTTP body, as much of it as the socket takes, and let
+ * the upper layer know once it's all out. Returns 0 if there is more to
+ * write, 1 if the body is done (and the socket might have been closed),
+ * and -1 upon error.
+ */
+static int write_http_body(wsl_sck_t *sck)
+{
+    wsl_proto_t *up;
+    size_t       n;
+
+    while (sck->http_sent < sck->http_size) {
+        if (send_pipe_choked(sck)) {
+            libwebsocket_callback_on_writable(sck->ctx->ctx, sck->sck);
+            return 0;
+        }
+
+        n = sck->http_size - sck->http_sent;
+
+        if (n > WSL_HTTP_CHUNK)
+            n = WSL_HTTP_CHUNK;
+
+        if (libwebsocket_write(sck->sck,
+                               (unsigned char *)sck->http_body + sck->http_sent,
+                               n, LWS_WRITE_HTTP) < 0) {
+            mrp_log_error("Failed to write HTTP body to websocket %p.", sck);
+            mrp_free(sck->http_body);
+            sck->http_body = NULL;
+            return -1;
+        }
+
+        sck->http_sent += n;
+    }
+
+    mrp_debug("serving %zu bytes of HTTP body over websocket %p completed",
+              sck->http_size, sck);
+
+    mrp_free(sck->http_body);
+    sck->http_body = NULL;
+
+    up = sck->proto;
+
+    if (up != NULL) {
+        SOCKET_BUSY_REGION(sck, {
+                up->cbs.http_done(sck, "<generated>", sck->user_data,
+                                  up->proto_data);
+                up->cbs.check(sck, sck->user_data, up->proto_data);
+            });
+
+        check_closed(sck);
+    }
+
+    return 1;
+}
+
+
 #ifdef LWS_OPENSSL_SUPPORT
 
 static void load_extra_certs(wsl_ctx_t *ctx, void *user, lws_event_t event)
@@ -1428,6 +2034,17 @@ static int http_event(lws_ctx_t *ws_ctx, lws_t *ws, lws_event_t event,
         }
 
         return LWS_EVENT_OK;
+
+    case LWS_CALLBACK_HTTP_WRITEABLE:
+        sck = find_pure_http(ctx, ws);
+
+        if (sck == NULL || sck->http_body == NULL)
+            return LWS_EVENT_OK;
+
+        if (write_http_body(sck) < 0)
+            return LWS_EVENT_ERROR;
+
+        return LWS_EVENT_OK;
 #endif
 
         /*
@@ -1479,13 +2096,21 @@ static int http_event(lws_ctx_t *ws_ctx, lws_t *ws, lws_event_t event,
 
     case LWS_CALLBACK_CONFIRM_EXTENSION_OKAY:
         ext = (const char *)in;
-        /* deny all extensions on the server side */
+        /* deny all but the deflate extensions, if enabled */
+        if (ctx != NULL && ctx->deflate.enable && is_deflate_ext(ext)) {
+            mrp_debug("accepting server extension '%s'", ext);
+            return LWS_EVENT_OK;
+        }
         mrp_debug("denying server extension '%s'", ext);
         return LWS_EVENT_DENY;
 
     case LWS_CALLBACK_CLIENT_CONFIRM_EXTENSION_SUPPORTED:
         ext = (const char *)in;
-        /* deny all extensions on the client side */
+        /* deny all but the deflate extensions, if enabled */
+        if (ctx != NULL && ctx->deflate.enable && is_deflate_ext(ext)) {
+            mrp_debug("accepting client extension '%s'", ext);
+            return LWS_EVENT_OK;
+        }
         mrp_debug("denying client extension '%s'", ext);
         return LWS_EVENT_DENY;
 
@@ -1668,11 +2293,14 @@ static int wsl_event(lws_ctx_t *ws_ctx, lws_t *ws, lws_event_t event,
         return LWS_EVENT_OK;
 
     case LWS_CALLBACK_SERVER_WRITEABLE:
-        mrp_debug("socket server side writeable again");
-        return LWS_EVENT_OK;
-
     case LWS_CALLBACK_CLIENT_WRITEABLE:
-        mrp_debug("socket client side writeable again");
+        mrp_debug("socket %s side writeable again",
+                  event == LWS_CALLBACK_SERVER_WRITEABLE ? "server" : "client");
+
+        sck = user ? *(wsl_sck_t **)user : NULL;
+
+        if (sck != NULL)
+            flush_sendq(sck);
         return LWS_EVENT_OK;
 
     default:
@@ -30,6 +30,7 @@
 #ifndef __MURPHY_WEBSOCKLIB_H__
 #define __MURPHY_WEBSOCKLIB_H__
 
+#include <stdint.h>
 #include <sys/socket.h>
 
 #include <libwebsockets.h>
@@ -182,6 +183,41 @@ typedef enum {
 #define WSL_NO_GID -1
 #define WSL_NO_UID -1
 
+/*
+ * websocket compression (deflate extension) configuration
+ *
+ * If enabled, the context offers and accepts the compression extensions
+ * provided by libwebsockets (permessage-deflate, and/or deflate-frame).
+ * Compression uses a persistent per-connection deflate stream, so the
+ * sliding window is shared across messages. Level, window bits and the
+ * minimum payload size are applied to our outgoing deflate-frame stream.
+ * Payloads smaller than the minimum size are sent as stored (level 0)
+ * deflate blocks, which keeps the stream valid without wasting cycles.
+ */
+
+#define WSL_DEFLATE_LEVEL   1            /* default compression level */
+#define WSL_DEFLATE_WBITS   15           /* default window bits */
+#define WSL_DEFLATE_MINSIZE 64           /* default minimum payload size */
+
+typedef struct {
+    int    enable;                       /* negotiate compression */
+    int    level;                        /* compression level, 0 - 9 */
+    int    wbits;                        /* window bits, 9 - 15 */
+    size_t min_size;                     /* minimum size to compress */
+} wsl_deflate_t;
+
+/*
+ * websocket compression statistics
+ */
+
+typedef struct {
+    uint64_t tx_plain;                   /* outgoing bytes uncompressed */
+    uint64_t tx_deflated;                /* outgoing bytes compressed */
+    uint64_t rx_deflated;                /* incoming bytes compressed */
+    uint64_t rx_plain;                   /* incoming bytes uncompressed */
+    uint32_t nsession;                   /* sessions with compression */
+} wsl_deflate_stats_t;
+
 typedef struct {
     struct sockaddr *addr;               /* address/port to listen on */
     wsl_proto_t     *protos;             /* protocols to serve */
@@ -196,6 +232,7 @@ typedef struct {
     int              timeout;            /* keepalive timeout */
     int              nprobe;             /* number of keepalive probes */
     int              interval;           /* keepalive probe interval */
+    wsl_deflate_t    deflate;            /* compression configuration */
 } wsl_ctx_cfg_t;
 
 
@@ -211,6 +248,9 @@ wsl_ctx_t *wsl_ref_context(wsl_ctx_t *ctx);
 /** Remove a context reference, destroying it once the last is gone. */
 int wsl_unref_context(wsl_ctx_t *ctx);
 
+/** Get the compression statistics of a context. */
+void wsl_get_deflate_stats(wsl_ctx_t *ctx, wsl_deflate_stats_t *stats);
+
 /** Create a new websocket connection using a given protocol. */
 wsl_sck_t *wsl_connect(wsl_ctx_t *ctx, struct sockaddr *sa,
                        const char *protocol, wsl_ssl_t ssl, void *user_data);
@@ -230,9 +270,29 @@ int wsl_set_sendmode(wsl_sck_t *sck, wsl_sendmode_t mode);
 /** Send data over a wbesocket. */
 int wsl_send(wsl_sck_t *sck, void *payload, size_t size);
 
+/**
+ * Take the reusable send buffer of a websocket for encoding in place.
+ * The payload needs to be written after the first *reserve bytes of
+ * the buffer. The buffer can be reallocated if it needs to grow. It
+ * must be handed back using wsl_send_sendbuf.
+ */
+void *wsl_get_sendbuf(wsl_sck_t *sck, size_t *size, size_t *reserve);
+
+/** Send len bytes of payload from a send buffer, taking it back. */
+int wsl_send_sendbuf(wsl_sck_t *sck, void *buf, size_t size, size_t len);
+
 /** Serve the given file over the given socket. */
 int wsl_serve_http_file(wsl_sck_t *sck, const char *path, const char *mime);
 
+/**
+ * Serve a complete in-memory HTTP response body of the given content
+ * type over the given socket. The data is copied and written out as the
+ * socket becomes writable. Once all of it is out, the http_done callback
+ * of the socket is called, like for wsl_serve_http_file.
+ */
+int wsl_serve_http_data(wsl_sck_t *sck, const char *type, const void *data,
+                        size_t size);
+
 MRP_CDECL_END
 
 #endif /* __MURPHY_WEBSOCKLIB_H__ */
@@ -66,11 +66,13 @@ typedef struct {
     int                 send_mode;       /* websocket send mode */
     const char         *http_root;       /* HTTP content root */
     mrp_wsck_urimap_t  *uri_table;       /* URI-to-path table */
+    mrp_wsck_urigen_t  *gen_table;       /* URI-to-generator table */
     mrp_wsck_mimemap_t *mime_table;      /* suffix to MIME-type table */
     const char         *ssl_cert;        /* path to SSL certificate */
     const char         *ssl_pkey;        /* path to SSL private key */
     const char         *ssl_ca;          /* path to SSL CA */
     wsl_ssl_t           ssl;             /* SSL mode (wsl_ssl_t) */
+    wsl_deflate_t       deflate;         /* compression settings */
     mrp_list_hook_t     http_clients;    /* pure HTTP clients */
 } wsck_t;
 
@@ -84,6 +86,7 @@ typedef struct {
     mrp_list_hook_t     hook;            /* hook to listening socket */
     const char         *http_root;       /* HTTP content root */
     mrp_wsck_urimap_t  *uri_table;       /* URI to path mapping */
+    mrp_wsck_urigen_t  *gen_table;       /* URI to generator mapping */
     mrp_wsck_mimemap_t *mime_table;      /* suffix to MIME type mapping */
 } http_client_t;
 
@@ -180,6 +183,20 @@ static void wsck_close(mrp_transport_t *mt)
 }
 
 
+static void set_deflate(wsck_t *t, const mrp_wsck_deflate_t *d)
+{
+    mrp_clear(&t->deflate);
+
+    if (d == NULL)
+        return;
+
+    t->deflate.enable   = TRUE;
+    t->deflate.level    = d->level       ? d->level       : WSL_DEFLATE_LEVEL;
+    t->deflate.wbits    = d->window_bits ? d->window_bits : WSL_DEFLATE_WBITS;
+    t->deflate.min_size = d->min_size    ? d->min_size    : WSL_DEFLATE_MINSIZE;
+}
+
+
 static int wsck_setopt(mrp_transport_t *mt, const char *opt, const void *val)
 {
     wsck_t *t = (wsck_t *)mt;
@@ -207,6 +224,8 @@ static int wsck_setopt(mrp_transport_t *mt, const char *opt, const void *val)
         t->mime_table = (void *)val;
     else if (!strcmp(opt, MRP_WSCK_OPT_URIMAP))
         t->uri_table = (void *)val;
+    else if (!strcmp(opt, MRP_WSCK_OPT_URIGEN))
+        t->gen_table = (void *)val;
     else if (!strcmp(opt, MRP_WSCK_OPT_SSL_CERT))
         t->ssl_cert = (const char *)val;
     else if (!strcmp(opt, MRP_WSCK_OPT_SSL_PKEY))
@@ -215,6 +234,8 @@ static int wsck_setopt(mrp_transport_t *mt, const char *opt, const void *val)
         t->ssl_ca = (const char *)val;
     else if (!strcmp(opt, MRP_WSCK_OPT_SSL))
         t->ssl = *(wsl_ssl_t *)val;
+    else if (!strcmp(opt, MRP_WSCK_OPT_DEFLATE))
+        set_deflate(t, (const mrp_wsck_deflate_t *)val);
     else
         success = FALSE;
 
@@ -281,6 +302,7 @@ static int wsck_bind(mrp_transport_t *mt, mrp_sockaddr_t *addr,
     cfg.gid       = WSL_NO_GID;
     cfg.uid       = WSL_NO_UID;
     cfg.user_data = t;
+    cfg.deflate   = t->deflate;
 
     t->ctx = wsl_create_context(t->ml, &cfg);
 
@@ -319,6 +341,7 @@ static int wsck_accept(mrp_transport_t *mt, mrp_transport_t *mlt)
         /* inherit pure HTTP settings by default */
         t->http_root  = lt->http_root;
         t->uri_table  = lt->uri_table;
+        t->gen_table  = lt->gen_table;
         t->mime_table = lt->mime_table;
 
         return TRUE;
@@ -374,6 +397,7 @@ static int wsck_connect(mrp_transport_t *mt, mrp_sockaddr_t *addr,
     cfg.gid       = WSL_NO_GID;
     cfg.uid       = WSL_NO_UID;
     cfg.user_data = t;
+    cfg.deflate   = t->deflate;
 
     t->ctx = wsl_create_context(t->ml, &cfg);
 
@@ -419,19 +443,19 @@ static int wsck_send(mrp_transport_t *mt, mrp_msg_t *msg)
 {
     wsck_t  *t = (wsck_t *)mt;
     void    *buf;
-    ssize_t  size;
-    int      success;
-
-    size = mrp_msg_default_encode(msg, &buf);
+    size_t   size, reserve;
+    ssize_t  len;
 
-    if (wsl_send(t->sck, buf, size))
-        success = TRUE;
-    else
-        success = FALSE;
+    /* encode directly into the padded send buffer of the socket */
+    buf = wsl_get_sendbuf(t->sck, &size, &reserve);
+    len = mrp_msg_default_encode_buf(msg, &buf, &size, reserve);
 
-    mrp_free(buf);
+    if (len < (ssize_t)reserve) {
+        mrp_free(buf);
+        return FALSE;
+    }
 
-    return success;
+    return wsl_send_sendbuf(t->sck, buf, size, len - reserve);
 }
 
 
@@ -448,25 +472,25 @@ static int wsck_senddata(mrp_transport_t *mt, void *data, uint16_t tag)
     wsck_t           *t = (wsck_t *)mt;
     mrp_data_descr_t *type;
     void             *buf;
-    size_t            size, reserve;
-    uint16_t         *tagp;
-    int               status;
+    size_t            size, reserve, len;
+    uint16_t          tagbe;
 
     type = mrp_msg_find_type(tag);
 
     if (type != NULL) {
-        reserve = sizeof(*tagp);
-        size    = mrp_data_encode(&buf, data, type, reserve);
+        /* encode directly into the padded send buffer of the socket */
+        buf = wsl_get_sendbuf(t->sck, &size, &reserve);
+        len = mrp_data_encode_buf(&buf, &size, data, type,
+                                  reserve + sizeof(tagbe));
 
-        if (size > 0) {
-            tagp  = buf;
-            *tagp = htobe16(tag);
+        if (len > reserve) {
+            tagbe = htobe16(tag);
+            memcpy((char *)buf + reserve, &tagbe, sizeof(tagbe));
 
-            status = wsl_send(t->sck, buf, size);
-
-            mrp_free(buf);
-            return status;
+            return wsl_send_sendbuf(t->sck, buf, size, len - reserve);
         }
+
+        mrp_free(buf);
     }
 
     return FALSE;
@@ -794,6 +818,7 @@ static http_client_t *http_create_client(wsck_t *lt)
         if (c->sck != NULL) {
             c->http_root  = lt->http_root;
             c->uri_table  = lt->uri_table;
+            c->gen_table  = lt->gen_table;
             c->mime_table = lt->mime_table;
 
             return c;
@@ -886,7 +911,7 @@ static void http_connection_cb(wsl_ctx_t *ctx, char *addr, const char *protocol,
 
     mrp_debug("incoming %s connection for context %p", protocol, ctx);
 
-    if (t->http_root != NULL || t->uri_table != NULL) {
+    if (t->http_root != NULL || t->uri_table != NULL || t->gen_table != NULL) {
         c = http_create_client(t);
 
         if (c != NULL)
@@ -916,6 +941,44 @@ static void http_closed_cb(wsl_sck_t *sck, int error, void *user_data,
 }
 
 
+static int http_generate(http_client_t *c, wsl_sck_t *sck, const char *uri)
+{
+    mrp_wsck_urigen_t *ug;
+    const char        *data;
+    size_t             size;
+
+    if (c->gen_table == NULL)
+        return FALSE;
+
+    for (ug = c->gen_table; ug->uri != NULL; ug++) {
+        if (strcmp(uri, ug->uri))
+            continue;
+
+        data = NULL;
+        size = 0;
+
+        if (ug->generate(uri, &data, &size, ug->user_data)) {
+            mrp_debug("serving generated content for '%s' (%s)", uri,
+                      ug->type);
+
+            /* the client is closed from http_done_cb once it's all out */
+            if (wsl_serve_http_data(sck, ug->type, data, size))
+                return TRUE;
+
+            mrp_debug("failed to serve generated content for '%s'", uri);
+        }
+        else
+            mrp_debug("failed to generate content for '%s'", uri);
+
+        http_destroy_client(c);
+
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+
 static void http_req_cb(wsl_sck_t *sck, void *data, size_t size,
                         void *user_data, void *proto_data)
 {
@@ -929,6 +992,9 @@ static void http_req_cb(wsl_sck_t *sck, void *data, size_t size,
 
     mrp_debug("HTTP request for URI '%s' on socket %p", uri, c->sck);
 
+    if (http_generate(c, sck, uri))
+        return;
+
     type = http_mapuri(c, uri, path, sizeof(path));
 
     if (type != NULL) {
@@ -77,10 +77,28 @@ typedef struct {
 #define MRP_WSCK_OPT_HTTPDIR  "http-dir"      /* HTTP content root */
 #define MRP_WSCK_OPT_MIMEMAP  "mime-map"      /* suffix-MIME table */
 #define MRP_WSCK_OPT_URIMAP   "uri-map"       /* URI-path table */
+#define MRP_WSCK_OPT_URIGEN   "uri-gen"       /* URI-generator table */
 #define MRP_WSCK_OPT_SSL_CERT "ssl-cert"      /* path to SSL certificate */
 #define MRP_WSCK_OPT_SSL_PKEY "ssl-pkey"      /* path to SSL priv. key */
 #define MRP_WSCK_OPT_SSL_CA   "ssl-ca"        /* path to SSL CA */
 #define MRP_WSCK_OPT_SSL      "ssl"           /* whether to connect with SSL */
+#define MRP_WSCK_OPT_DEFLATE  "deflate"       /* compression settings */
+
+/*
+ * websocket compression settings
+ *
+ * Pass a pointer to these as the MRP_WSCK_OPT_DEFLATE option before
+ * binding (or connecting) a transport to negotiate per-message deflate
+ * compression with its peers. Pass NULL to turn compression off. Fields
+ * left zero select the defaults. The settings are inherited by all
+ * transports accepted on a listening transport.
+ */
+
+typedef struct {
+    int    level;                        /* compression level, 1 - 9 */
+    int    window_bits;                  /* compression window bits, 9 - 15 */
+    size_t min_size;                     /* don't compress smaller payloads */
+} mrp_wsck_deflate_t;
 
 /*
  * It is also possible to serve content over HTTP on a websocket transport.
@@ -105,7 +123,14 @@ typedef struct {
  *    type pairs. You can push this table down to the transport as
  *    the MRP_WSCK_URIMAP transport option.
  *
- *  HTTPROOT takes a char *, URIMAP takes a mrp_wsck_urimap_t *, and
+ * 3) You can use a table that maps URIs to content generator callbacks.
+ *    Requests for these URIs are answered with whatever the generator
+ *    produces at the time of the request. You can push this table down
+ *    to the transport as the MRP_WSCK_OPT_URIGEN transport option. This
+ *    table is consulted before any of the above.
+ *
+ *  HTTPROOT takes a char *, URIMAP takes a mrp_wsck_urimap_t *, URIGEN
+ *  takes a mrp_wsck_urigen_t *, and
  *  MIMEMAP takes a mrp_wsck_mimemap_t * as their values. Both URI
  *  and MIME type tables need to be NULL-terminated. If you set both
  *  HTTPROOT and URIMAP, URIMAP entries with relative path names will
@@ -134,6 +159,21 @@ typedef struct {
     const char *type;                    /* MIME type */
 } mrp_wsck_mimemap_t;
 
+/*
+ * A generator produces the full content for a request in *data and
+ * *size. The content needs to stay valid until the generator is called
+ * again or the transport is closed. Return FALSE to refuse the request.
+ */
+typedef int (*mrp_wsck_urigen_cb_t)(const char *uri, const char **data,
+                                    size_t *size, void *user_data);
+
+typedef struct {
+    const char           *uri;           /* exported URI */
+    const char           *type;          /* MIME type to use */
+    mrp_wsck_urigen_cb_t  generate;      /* content generator */
+    void                 *user_data;     /* opaque generator data */
+} mrp_wsck_urigen_t;
+
 
 
 
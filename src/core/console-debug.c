@@ -111,6 +111,83 @@ static void debug_reset(mrp_console_t *c, void *user_data,
 }
 
 
+static void debug_trace(mrp_console_t *c, void *user_data,
+                        int argc, char **argv)
+{
+    const char *path;
+    size_t      nrecord;
+    char       *end;
+
+    MRP_UNUSED(c);
+    MRP_UNUSED(user_data);
+
+    if (argc == 2) {
+        if ((path = mrp_debug_trace_path()) != NULL)
+            printf("Debug messages are traced to %s.\n", path);
+        else
+            printf("Debug tracing is disabled.\n");
+        return;
+    }
+
+    if (!strcmp(argv[2], "stop") && argc == 3) {
+        mrp_debug_trace_stop();
+        printf("Debug tracing is now disabled.\n");
+        return;
+    }
+
+    if (strcmp(argv[2], "start") || argc > 5) {
+        printf("%s/%s invoked with wrong arguments\n", argv[0], argv[1]);
+        return;
+    }
+
+    path    = argc > 3 ? argv[3] : NULL;
+    nrecord = 0;
+
+    if (argc > 4) {
+        nrecord = (size_t)strtoul(argv[4], &end, 10);
+
+        if (*end || end == argv[4]) {
+            printf("Invalid number of records '%s'.\n", argv[4]);
+            return;
+        }
+    }
+
+    if (mrp_debug_trace_start(path, nrecord) < 0)
+        printf("Failed to start debug tracing (%d: %s).\n", errno,
+               strerror(errno));
+    else
+        printf("Debug messages are now traced to %s.\n",
+               mrp_debug_trace_path());
+}
+
+
+static void debug_dump(mrp_console_t *c, void *user_data,
+                       int argc, char **argv)
+{
+    const char *path;
+    int         cnt, i;
+    char       *end;
+
+    MRP_UNUSED(user_data);
+
+    path = NULL;
+    cnt  = 0;
+
+    for (i = 2; i < argc; i++) {
+        cnt = (int)strtol(argv[i], &end, 10);
+
+        if (*end || end == argv[i] || cnt < 0) {
+            path = argv[i];
+            cnt  = 0;
+        }
+    }
+
+    if (mrp_debug_trace_dump(c->stdout, path, cnt) < 0)
+        fprintf(c->stdout, "Failed to dump debug trace %s (%d: %s).\n",
+                path ? path : "buffer", errno, strerror(errno));
+}
+
+
 #define DEBUG_GROUP_DESCRIPTION                                           \
     "Debugging commands provide fine-grained control over runtime\n"      \
     "debugging messages produced by the murphy daemon or any of the\n"    \
@@ -172,6 +249,22 @@ static void debug_reset(mrp_console_t *c, void *user_data,
     "List all known debug sites of the murphy daemon itself as\n"         \
     "as well as from any loaded murphy plugins.\n"
 
+#define TRACE_SYNTAX        "trace [start [path [records]]|stop]"
+#define TRACE_SUMMARY       "control the binary debug trace buffer"
+#define TRACE_DESCRIPTION                                                 \
+    "Start or stop recording enabled debug messages into a binary\n"      \
+    "trace buffer, or show where they are being recorded. The buffer\n"   \
+    "is a memory-mapped ring of fixed-size records which overwrites\n"    \
+    "the oldest records. It is left behind when tracing is stopped or\n"  \
+    "the daemon exits, and can be decoded with murphy-trace. Debug\n"     \
+    "messages are only logged as text when debug logging is on.\n"
+
+#define DUMP_SYNTAX         "dump [count] [path]"
+#define DUMP_SUMMARY        "decode the binary debug trace buffer"
+#define DUMP_DESCRIPTION                                                  \
+    "Decode the last count (or all) records of the active debug trace\n"  \
+    "buffer, or of the trace file at the given path.\n"
+
 MRP_CORE_CONSOLE_GROUP(debug_group, "debug", DEBUG_GROUP_DESCRIPTION, NULL, {
         MRP_TOKENIZED_CMD("enable", debug_enable, FALSE,
                           ENABLE_SYNTAX, ENABLE_SUMMARY, ENABLE_DESCRIPTION),
@@ -184,5 +277,9 @@ MRP_CORE_CONSOLE_GROUP(debug_group, "debug", DEBUG_GROUP_DESCRIPTION, NULL, {
         MRP_TOKENIZED_CMD("reset", debug_reset, FALSE,
                           RESET_SYNTAX, RESET_SUMMARY, RESET_DESCRIPTION),
         MRP_TOKENIZED_CMD("list", debug_list, FALSE,
-                          LIST_SYNTAX, LIST_SUMMARY, LIST_DESCRIPTION)
+                          LIST_SYNTAX, LIST_SUMMARY, LIST_DESCRIPTION),
+        MRP_TOKENIZED_CMD("trace", debug_trace, FALSE,
+                          TRACE_SYNTAX, TRACE_SUMMARY, TRACE_DESCRIPTION),
+        MRP_TOKENIZED_CMD("dump", debug_dump, FALSE,
+                          DUMP_SYNTAX, DUMP_SUMMARY, DUMP_DESCRIPTION)
 });
@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2012, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * metrics commands
+ */
+
+#include <murphy/common/metrics.h>
+
+typedef struct {
+    mrp_console_t *c;
+    const char    *prefix;
+    int            cnt;
+} metrics_show_t;
+
+
+static int show_metric(mrp_metric_t *m, void *user_data)
+{
+    metrics_show_t     *show = (metrics_show_t *)user_data;
+    FILE               *fp   = show->c->stdout;
+    mrp_metric_value_t  v;
+
+    mrp_metric_read(m, &v);
+
+    if (show->prefix && strncmp(v.name, show->prefix, strlen(show->prefix)))
+        return TRUE;
+
+    fprintf(fp, "    %s%s%s%s: ", v.name, v.label ? "{" : "",
+            v.label ? v.label : "", v.label ? "}" : "");
+
+    switch (v.type) {
+    case MRP_METRIC_COUNTER:
+        fprintf(fp, "%llu\n", (unsigned long long)v.count);
+        break;
+
+    case MRP_METRIC_GAUGE:
+        fprintf(fp, "%lld\n", (long long)v.value);
+        break;
+
+    case MRP_METRIC_HISTOGRAM:
+        if (!v.count) {
+            fprintf(fp, "no samples\n");
+            break;
+        }
+        fprintf(fp, "%llu samples, avg %llu, p50 %llu, p90 %llu, p99 %llu, "
+                "max %llu\n", (unsigned long long)v.count,
+                (unsigned long long)(v.sum / v.count),
+                (unsigned long long)mrp_metric_percentile(&v, 50),
+                (unsigned long long)mrp_metric_percentile(&v, 90),
+                (unsigned long long)mrp_metric_percentile(&v, 99),
+                (unsigned long long)v.max);
+        break;
+    }
+
+    show->cnt++;
+
+    return TRUE;
+}
+
+
+static void metrics_show(mrp_console_t *c, void *user_data,
+                         int argc, char **argv)
+{
+    metrics_show_t show;
+
+    MRP_UNUSED(user_data);
+
+    show.c      = c;
+    show.prefix = argc > 2 ? argv[2] : NULL;
+    show.cnt    = 0;
+
+    fprintf(c->stdout, "Metrics collection is %s.\n",
+            mrp_metrics_on ? "enabled" : "disabled");
+    mrp_metrics_foreach(show_metric, &show);
+
+    if (!show.cnt)
+        fprintf(c->stdout, "No matching metrics.\n");
+}
+
+
+static void metrics_dump(mrp_console_t *c, void *user_data,
+                         int argc, char **argv)
+{
+    MRP_UNUSED(user_data);
+    MRP_UNUSED(argc);
+    MRP_UNUSED(argv);
+
+    mrp_metrics_dump(c->stdout);
+}
+
+
+static void metrics_reset(mrp_console_t *c, void *user_data,
+                          int argc, char **argv)
+{
+    MRP_UNUSED(c);
+    MRP_UNUSED(user_data);
+    MRP_UNUSED(argc);
+    MRP_UNUSED(argv);
+
+    mrp_metrics_reset();
+
+    printf("All metrics have been reset.\n");
+}
+
+
+static void metrics_enable(mrp_console_t *c, void *user_data,
+                           int argc, char **argv)
+{
+    MRP_UNUSED(c);
+    MRP_UNUSED(user_data);
+    MRP_UNUSED(argc);
+    MRP_UNUSED(argv);
+
+    mrp_metrics_enable(TRUE);
+
+    printf("Metrics collection is now enabled.\n");
+}
+
+
+static void metrics_disable(mrp_console_t *c, void *user_data,
+                            int argc, char **argv)
+{
+    MRP_UNUSED(c);
+    MRP_UNUSED(user_data);
+    MRP_UNUSED(argc);
+    MRP_UNUSED(argv);
+
+    mrp_metrics_enable(FALSE);
+
+    printf("Metrics collection is now disabled.\n");
+}
+
+
+#define METRICS_GROUP_DESCRIPTION                                         \
+    "Metrics commands provide access to the runtime counters, gauges\n"   \
+    "and latency histograms collected by the murphy daemon, for\n"        \
+    "instance mainloop dispatch times, transport traffic, MQL statement\n"\
+    "execution times, resolver target update times and resource zone\n"  \
+    "update times. Histogram values are in microseconds.\n"
+
+#define METRICS_SHOW_SYNTAX       "show [prefix]"
+#define METRICS_SHOW_SUMMARY      "show metrics"
+#define METRICS_SHOW_DESCRIPTION                                          \
+    "Show all metrics, or the ones with a name starting with the given\n" \
+    "prefix, in a human-readable format.\n"
+
+#define METRICS_DUMP_SYNTAX       "dump"
+#define METRICS_DUMP_SUMMARY      "dump metrics in JSON format"
+#define METRICS_DUMP_DESCRIPTION                                          \
+    "Dump all metrics, including the non-empty histogram buckets, in a\n" \
+    "machine-readable JSON format.\n"
+
+#define METRICS_RESET_SYNTAX      "reset"
+#define METRICS_RESET_SUMMARY     "reset all metrics"
+#define METRICS_RESET_DESCRIPTION                                         \
+    "Reset all counters, gauges and histograms to zero.\n"
+
+#define METRICS_ENABLE_SYNTAX     "enable"
+#define METRICS_ENABLE_SUMMARY    "enable metrics collection"
+#define METRICS_ENABLE_DESCRIPTION                                        \
+    "Enable the collection of metrics. This is the default.\n"
+
+#define METRICS_DISABLE_SYNTAX    "disable"
+#define METRICS_DISABLE_SUMMARY   "disable metrics collection"
+#define METRICS_DISABLE_DESCRIPTION                                       \
+    "Disable the collection of metrics. Already collected values are\n"   \
+    "kept but not updated until collection is enabled again.\n"
+
+MRP_CORE_CONSOLE_GROUP(metrics_group, "metrics", METRICS_GROUP_DESCRIPTION,
+                       NULL, {
+        MRP_TOKENIZED_CMD("show", metrics_show, FALSE,
+                          METRICS_SHOW_SYNTAX, METRICS_SHOW_SUMMARY,
+                          METRICS_SHOW_DESCRIPTION),
+        MRP_TOKENIZED_CMD("dump", metrics_dump, FALSE,
+                          METRICS_DUMP_SYNTAX, METRICS_DUMP_SUMMARY,
+                          METRICS_DUMP_DESCRIPTION),
+        MRP_TOKENIZED_CMD("reset", metrics_reset, FALSE,
+                          METRICS_RESET_SYNTAX, METRICS_RESET_SUMMARY,
+                          METRICS_RESET_DESCRIPTION),
+        MRP_TOKENIZED_CMD("enable", metrics_enable, FALSE,
+                          METRICS_ENABLE_SYNTAX, METRICS_ENABLE_SUMMARY,
+                          METRICS_ENABLE_DESCRIPTION),
+        MRP_TOKENIZED_CMD("disable", metrics_disable, FALSE,
+                          METRICS_DISABLE_SYNTAX, METRICS_DISABLE_SUMMARY,
+                          METRICS_DISABLE_DESCRIPTION)
+});
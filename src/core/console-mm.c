@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2012, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * memory management commands
+ */
+
+#define MM_POOLS_MAX 64                  /* max. number of pools shown */
+
+
+static void mm_pools(mrp_console_t *c, void *user_data,
+                     int argc, char **argv)
+{
+    mrp_objpool_stats_t  stats[MM_POOLS_MAX], *s;
+    FILE                *fp = c->stdout;
+    int                  n, i;
+    double               hits;
+
+    MRP_UNUSED(user_data);
+    MRP_UNUSED(argc);
+    MRP_UNUSED(argv);
+
+    n = mrp_objpool_stats(stats, MRP_ARRAY_SIZE(stats));
+
+    if (n == 0) {
+        fprintf(fp, "No object pools.\n");
+        return;
+    }
+
+    fprintf(fp, "%-20s %6s %8s %8s %6s %6s %10s %6s %8s %8s\n", "pool",
+            "size", "in use", "peak", "chunks", "empty", "allocs", "hit%",
+            "grows", "shrinks");
+
+    for (i = 0, s = stats; i < n && i < MM_POOLS_MAX; i++, s++) {
+        hits = s->nalloc ? 100.0 * s->nhit / s->nalloc : 100.0;
+
+        fprintf(fp, "%-20s %6zu %8zu %8zu %6zu %6zu %10llu %5.1f%% "
+                "%8llu %8llu\n", s->name, s->objsize, s->nobj, s->peak,
+                s->nchunk, s->nempty, (unsigned long long)s->nalloc, hits,
+                (unsigned long long)s->ngrow, (unsigned long long)s->nshrink);
+    }
+
+    if (n > MM_POOLS_MAX)
+        fprintf(fp, "(%d more pools not shown)\n", n - MM_POOLS_MAX);
+}
+
+
+static void mm_trim(mrp_console_t *c, void *user_data,
+                    int argc, char **argv)
+{
+    MRP_UNUSED(user_data);
+    MRP_UNUSED(argc);
+    MRP_UNUSED(argv);
+
+    fprintf(c->stdout, "Released %d empty object pool chunks.\n",
+            mrp_objpool_trim_all());
+}
+
+
+static void mm_heap(mrp_console_t *c, void *user_data,
+                    int argc, char **argv)
+{
+    mrp_mm_profile_t  prof;
+    FILE             *fp = c->stdout;
+
+    MRP_UNUSED(user_data);
+    MRP_UNUSED(argc);
+    MRP_UNUSED(argv);
+
+    if (!mrp_mm_profile_stats(&prof)) {
+        fprintf(fp, "Heap profiling is disabled. Start the daemon with\n"
+                "%s=sample[=<bytes>] to enable it.\n", MRP_MM_CONFIG_ENVVAR);
+        return;
+    }
+
+    fprintf(fp, "sampling interval: %u bytes\n", prof.rate);
+    fprintf(fp, "samples taken:     %llu from %d sites\n",
+            (unsigned long long)prof.nsample, prof.nsite);
+    fprintf(fp, "estimated live:    %llu bytes in %llu objects\n",
+            (unsigned long long)prof.live_bytes,
+            (unsigned long long)prof.live_objs);
+    fprintf(fp, "estimated total:   %llu bytes in %llu objects\n",
+            (unsigned long long)prof.total_bytes,
+            (unsigned long long)prof.total_objs);
+}
+
+
+static void mm_snapshot(mrp_console_t *c, void *user_data,
+                        int argc, char **argv)
+{
+    char path[PATH_MAX];
+
+    MRP_UNUSED(user_data);
+
+    if (argc > 3) {
+        fprintf(c->stdout, "Invalid arguments, expecting at most a path.\n");
+        return;
+    }
+
+    if (mrp_mm_profile_snapshot(argc == 3 ? argv[2] : NULL,
+                                path, sizeof(path)) < 0)
+        fprintf(c->stdout, "Failed to save heap profile (%d: %s).\n",
+                errno, strerror(errno));
+    else
+        fprintf(c->stdout, "Heap profile saved to %s.\n", path);
+}
+
+
+#define MM_GROUP_DESCRIPTION                                               \
+    "Memory management commands provide information about the object\n"   \
+    "pools used for frequently allocated fixed-size objects, such as\n"    \
+    "mainloop watches, timers and deferred callbacks, messages, event\n"   \
+    "watches and resource sets, and about the heap profile collected\n"   \
+    "when the sampling allocator is enabled.\n"
+
+#define MM_POOLS_SYNTAX             "pools"
+#define MM_POOLS_SUMMARY            "show object pool statistics"
+#define MM_POOLS_DESCRIPTION                                               \
+    "Show the object size, current and peak number of objects in use,\n"  \
+    "the number of allocated and empty chunks, the number of allocations\n"\
+    "and the share of them served without growing the pool, and the\n"    \
+    "number of chunks allocated and released for every object pool.\n"
+
+#define MM_TRIM_SYNTAX              "trim"
+#define MM_TRIM_SUMMARY             "release empty object pool chunks"
+#define MM_TRIM_DESCRIPTION                                                \
+    "Release surplus empty chunks of all object pools right away. This\n" \
+    "is otherwise done automatically once the daemon is idle.\n"
+
+#define MM_HEAP_SYNTAX              "heap"
+#define MM_HEAP_SUMMARY             "show heap profile summary"
+#define MM_HEAP_DESCRIPTION                                                \
+    "Show the sampling interval, the number of samples and allocation\n"  \
+    "sites, and the live and total heap usage estimated from them.\n"
+
+#define MM_SNAPSHOT_SYNTAX          "snapshot [path]"
+#define MM_SNAPSHOT_SUMMARY         "save a heap profile snapshot"
+#define MM_SNAPSHOT_DESCRIPTION                                            \
+    "Save the heap profile in pprof format to the given new file, or\n"  \
+    "to a numbered file in the profile directory ($XDG_RUNTIME_DIR or\n" \
+    "/tmp/murphy-<uid> by default). Existing files are not overwritten.\n"\
+    "Sending SIGUSR2 to the daemon saves a numbered snapshot, too. Growth\n"\
+    "can be found by comparing two snapshots with pprof -base <older>.\n"
+
+MRP_CORE_CONSOLE_GROUP(mm_group, "mm", MM_GROUP_DESCRIPTION, NULL, {
+        MRP_TOKENIZED_CMD("pools", mm_pools, FALSE,
+                          MM_POOLS_SYNTAX, MM_POOLS_SUMMARY,
+                          MM_POOLS_DESCRIPTION),
+        MRP_TOKENIZED_CMD("trim", mm_trim, FALSE,
+                          MM_TRIM_SYNTAX, MM_TRIM_SUMMARY,
+                          MM_TRIM_DESCRIPTION),
+        MRP_TOKENIZED_CMD("heap", mm_heap, FALSE,
+                          MM_HEAP_SYNTAX, MM_HEAP_SUMMARY,
+                          MM_HEAP_DESCRIPTION),
+        MRP_TOKENIZED_CMD("snapshot", mm_snapshot, FALSE,
+                          MM_SNAPSHOT_SYNTAX, MM_SNAPSHOT_SUMMARY,
+                          MM_SNAPSHOT_DESCRIPTION)
+});
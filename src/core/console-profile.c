@@ -0,0 +1,219 @@
+/*
+ * Copyright (c) 2012, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * mainloop callback profiling commands
+ */
+
+#define PROFILE_TOP_MAX 64               /* max. number of entries shown */
+
+
+static void profile_enable(mrp_console_t *c, void *user_data,
+                           int argc, char **argv)
+{
+    MRP_UNUSED(user_data);
+    MRP_UNUSED(argc);
+    MRP_UNUSED(argv);
+
+    mrp_mainloop_profile(c->ctx->ml, TRUE);
+
+    printf("Mainloop callback profiling is now enabled.\n");
+}
+
+
+static void profile_disable(mrp_console_t *c, void *user_data,
+                            int argc, char **argv)
+{
+    MRP_UNUSED(user_data);
+    MRP_UNUSED(argc);
+    MRP_UNUSED(argv);
+
+    mrp_mainloop_profile(c->ctx->ml, FALSE);
+
+    printf("Mainloop callback profiling is now disabled.\n");
+}
+
+
+static void profile_threshold(mrp_console_t *c, void *user_data,
+                              int argc, char **argv)
+{
+    mrp_mainloop_t *ml = c->ctx->ml;
+    unsigned int    usecs;
+    char           *end;
+
+    MRP_UNUSED(user_data);
+
+    if (argc == 3) {
+        usecs = (unsigned int)strtoul(argv[2], &end, 10);
+
+        if (*end || end == argv[2]) {
+            printf("Invalid threshold '%s'.\n", argv[2]);
+            return;
+        }
+
+        mrp_mainloop_set_slow_threshold(ml, usecs);
+    }
+    else if (argc != 2) {
+        printf("%s/%s invoked with wrong number of arguments\n",
+               argv[0], argv[1]);
+        return;
+    }
+
+    usecs = mrp_mainloop_get_slow_threshold(ml);
+
+    if (usecs)
+        printf("Slow callback threshold is %u usecs.\n", usecs);
+    else
+        printf("Slow callback warnings are disabled.\n");
+}
+
+
+static void profile_top(mrp_console_t *c, void *user_data,
+                        int argc, char **argv)
+{
+    static const char *types[] = {
+        [MRP_CALLBACK_IO]       = "io",
+        [MRP_CALLBACK_TIMER]    = "timer",
+        [MRP_CALLBACK_DEFERRED] = "deferred",
+        [MRP_CALLBACK_SUBLOOP]  = "subloop",
+    };
+
+    mrp_callback_stat_t  stats[PROFILE_TOP_MAX], *s;
+    int                  by_max, nstat, n, i;
+
+    MRP_UNUSED(user_data);
+
+    by_max = FALSE;
+    nstat  = 10;
+
+    for (i = 2; i < argc; i++) {
+        if (!strcmp(argv[i], "max"))
+            by_max = TRUE;
+        else if (!strcmp(argv[i], "total"))
+            by_max = FALSE;
+        else {
+            nstat = (int)strtol(argv[i], NULL, 10);
+
+            if (nstat <= 0 || nstat > PROFILE_TOP_MAX) {
+                printf("Invalid number of entries '%s' (1 - %d).\n",
+                       argv[i], PROFILE_TOP_MAX);
+                return;
+            }
+        }
+    }
+
+    if (!mrp_mainloop_profiling(c->ctx->ml))
+        printf("Mainloop callback profiling is disabled.\n");
+
+    n = mrp_mainloop_top_callbacks(c->ctx->ml, by_max, stats, nstat);
+
+    if (n == 0) {
+        printf("No callbacks profiled.\n");
+        return;
+    }
+
+    printf("%-8s %10s %12s %10s %10s  %s\n", "type", "calls", "total",
+           "avg", "max", "callback");
+
+    for (i = 0, s = stats; i < n; i++, s++)
+        printf("%-8s %10llu %12llu %10llu %10llu  %s\n", types[s->type],
+               (unsigned long long)s->count, (unsigned long long)s->total,
+               (unsigned long long)(s->total / s->count),
+               (unsigned long long)s->max, s->name);
+}
+
+
+static void profile_reset(mrp_console_t *c, void *user_data,
+                          int argc, char **argv)
+{
+    MRP_UNUSED(user_data);
+    MRP_UNUSED(argc);
+    MRP_UNUSED(argv);
+
+    mrp_mainloop_reset_profile(c->ctx->ml);
+
+    printf("Mainloop callback profiles have been reset.\n");
+}
+
+
+#define PROFILE_GROUP_DESCRIPTION                                          \
+    "Profile commands control the profiling of mainloop callbacks. When\n" \
+    "enabled, the time spent in every I/O watch, timer, deferred and\n"    \
+    "subloop callback is accumulated per callback function and callbacks\n"\
+    "exceeding the slow callback threshold are logged as warnings. All\n"  \
+    "times are in microseconds.\n"
+
+#define PROFILE_ENABLE_SYNTAX       "enable"
+#define PROFILE_ENABLE_SUMMARY      "enable callback profiling"
+#define PROFILE_ENABLE_DESCRIPTION                                         \
+    "Enable the profiling of mainloop callbacks.\n"
+
+#define PROFILE_DISABLE_SYNTAX      "disable"
+#define PROFILE_DISABLE_SUMMARY     "disable callback profiling"
+#define PROFILE_DISABLE_DESCRIPTION                                        \
+    "Disable the profiling of mainloop callbacks. Accumulated profiles\n"  \
+    "are kept until reset.\n"
+
+#define PROFILE_THRESHOLD_SYNTAX    "threshold [usecs]"
+#define PROFILE_THRESHOLD_SUMMARY   "change or show the slow callback threshold"
+#define PROFILE_THRESHOLD_DESCRIPTION                                      \
+    "Set the threshold above which profiled callbacks are reported as\n"   \
+    "slow. 0 turns off slow callback warnings. Without arguments it\n"     \
+    "prints out the current threshold.\n"
+
+#define PROFILE_TOP_SYNTAX          "top [total|max] [count]"
+#define PROFILE_TOP_SUMMARY         "show the most expensive callbacks"
+#define PROFILE_TOP_DESCRIPTION                                            \
+    "Show the given number (by default 10) of callbacks with the largest\n"\
+    "total, or maximum, time spent in them.\n"
+
+#define PROFILE_RESET_SYNTAX        "reset"
+#define PROFILE_RESET_SUMMARY       "reset callback profiles"
+#define PROFILE_RESET_DESCRIPTION                                          \
+    "Reset all accumulated callback profiles to zero.\n"
+
+MRP_CORE_CONSOLE_GROUP(profile_group, "profile", PROFILE_GROUP_DESCRIPTION,
+                       NULL, {
+        MRP_TOKENIZED_CMD("enable", profile_enable, FALSE,
+                          PROFILE_ENABLE_SYNTAX, PROFILE_ENABLE_SUMMARY,
+                          PROFILE_ENABLE_DESCRIPTION),
+        MRP_TOKENIZED_CMD("disable", profile_disable, FALSE,
+                          PROFILE_DISABLE_SYNTAX, PROFILE_DISABLE_SUMMARY,
+                          PROFILE_DISABLE_DESCRIPTION),
+        MRP_TOKENIZED_CMD("threshold", profile_threshold, FALSE,
+                          PROFILE_THRESHOLD_SYNTAX, PROFILE_THRESHOLD_SUMMARY,
+                          PROFILE_THRESHOLD_DESCRIPTION),
+        MRP_TOKENIZED_CMD("top", profile_top, FALSE,
+                          PROFILE_TOP_SYNTAX, PROFILE_TOP_SUMMARY,
+                          PROFILE_TOP_DESCRIPTION),
+        MRP_TOKENIZED_CMD("reset", profile_reset, FALSE,
+                          PROFILE_RESET_SYNTAX, PROFILE_RESET_SUMMARY,
+                          PROFILE_RESET_DESCRIPTION)
+});
@@ -33,6 +33,7 @@
 #include <unistd.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 
 #include <murphy/common/mm.h>
 #include <murphy/common/list.h>
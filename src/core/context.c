@@ -31,6 +31,7 @@
 #include <murphy/common/log.h>
 #include <murphy/common/mm.h>
 #include <murphy/core/context.h>
+#include <murphy/core/event.h>
 #include <murphy/core/console-priv.h>
 
 mrp_context_t *mrp_context_create(void)
@@ -46,6 +47,8 @@ mrp_context_t *mrp_context_create(void)
             mrp_free(c);
             c = NULL;
         }
+        else
+            mrp_set_event_mainloop(c->ml);
     }
 
     return c;
@@ -56,6 +59,7 @@ void mrp_context_destroy(mrp_context_t *c)
 {
     if (c != NULL) {
         console_cleanup(c);
+        mrp_set_event_mainloop(NULL);
         mrp_mainloop_destroy(c->ml);
         mrp_free(c);
     }
@@ -57,6 +57,7 @@ struct mrp_context_s {
     const char *config_dir;                /* plugin configuration directory */
     const char *plugin_dir;                /* plugin directory */
     bool        foreground;                /* whether to stay in foreground*/
+    bool        startup_profile;           /* report startup timing */
 
     char       *resolver_ruleset;          /* resolver ruleset file */
 
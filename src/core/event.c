@@ -42,12 +42,26 @@
  */
 
 typedef struct {
-    char            *name;                    /* event name */
-    int              id;                      /* associated event id */
-    mrp_list_hook_t  watches;                 /* single-event watches */
+    char               *name;                 /* event name */
+    int                 id;                   /* associated event id */
+    int                 flags;                /* MRP_EVENT_FLAG_* */
+    mrp_list_hook_t     watches;              /* single-event watches */
+    mrp_event_watch_t **multi;                /* multi-event watches */
+    int                 nmulti;               /* number of multi-event ones */
+    int                 queued;               /* queue index + 1, or 0 */
 } event_def_t;
 
 
+/*
+ * an asynchronously emitted event
+ */
+
+typedef struct {
+    int        id;                            /* event id */
+    mrp_msg_t *data;                          /* event data */
+} queued_event_t;
+
+
 /*
  * an event watch
  */
@@ -64,11 +78,21 @@ struct mrp_event_watch_s {
 static event_def_t     events[MRP_EVENT_MAX]; /* event table */
 static int             nevent;                /* number of events */
 static int             nemit;                 /* events being emitted */
-static mrp_list_hook_t watches;               /* multi-event watches */
 static mrp_list_hook_t deleted;               /* events deleted during emit */
+static mrp_objpool_t  *watch_pool;            /* event watch pool */
+
+static struct {
+    mrp_mainloop_t *ml;                       /* mainloop for delivery */
+    mrp_deferred_t *deliver;                  /* batch delivery callback */
+    queued_event_t *events;                   /* queued events */
+    int             nevent;                   /* number of queued events */
+    int             size;                     /* allocated queue size */
+} queue;
 
 
 static int single_event(mrp_event_mask_t *mask);
+static int index_watch(mrp_event_watch_t *w);
+static void unindex_watch(mrp_event_watch_t *w);
 
 
 MRP_INIT static void init_watch_lists(void)
@@ -78,7 +102,6 @@ MRP_INIT static void init_watch_lists(void)
     for (i = 0; i < MRP_EVENT_MAX; i++)
         mrp_list_init(&events[i].watches);
 
-    mrp_list_init(&watches);
     mrp_list_init(&deleted);
 }
 
@@ -91,7 +114,20 @@ mrp_event_watch_t *mrp_add_event_watch(mrp_event_mask_t *mask,
     int                id;
 
     if (cb != NULL) {
-        w = mrp_allocz(sizeof(*w));
+        if (watch_pool == NULL) {
+            mrp_objpool_config_t cfg;
+
+            mrp_clear(&cfg);
+            cfg.name     = "event-watch";
+            cfg.objsize  = sizeof(*w);
+            cfg.prealloc = 32;
+            cfg.flags    = MRP_OBJPOOL_FLAG_ZERO;
+
+            if ((watch_pool = mrp_objpool_create(&cfg)) == NULL)
+                return NULL;
+        }
+
+        w = mrp_objpool_alloc(watch_pool);
 
         if (w != NULL) {
             mrp_list_init(&w->hook);
@@ -109,17 +145,21 @@ mrp_event_watch_t *mrp_add_event_watch(mrp_event_mask_t *mask,
                     if (def->name != NULL)
                         mrp_list_append(&def->watches, &w->hook);
                     else {
-                        mrp_free(w);
+                        mrp_objpool_free(w);
                         w = NULL;
                     }
                 }
                 else {
-                    mrp_free(w);
+                    mrp_objpool_free(w);
+                    w = NULL;
+                }
+            }
+            else {
+                if (!index_watch(w)) {
+                    mrp_objpool_free(w);
                     w = NULL;
                 }
             }
-            else
-                mrp_list_append(&watches, &w->hook);
         }
     }
     else
@@ -155,11 +195,69 @@ mrp_event_watch_t *mrp_add_event_watch(mrp_event_mask_t *mask,
 }
 
 
+/*
+ * Multi-event watches are indexed by event: every event has an array of
+ * the multi-event watches interested in it. This keeps the cost of an
+ * emit proportional to the number of interested watches instead of the
+ * number of all multi-event watches. The arrays are only shrunk when a
+ * watch is purged, which never happens during an emit, so emitting can
+ * safely iterate over them by index even if callbacks add new watches.
+ */
+
+static int index_watch(mrp_event_watch_t *w)
+{
+    event_def_t *def;
+    int          id;
+
+    for (id = 1; id < MRP_EVENT_MAX; id++) {
+        if (!mrp_test_event(&w->events, id))
+            continue;
+
+        def = events + id;
+
+        if (!mrp_reallocz(def->multi, def->nmulti, def->nmulti + 1)) {
+            unindex_watch(w);
+            return FALSE;
+        }
+
+        def->multi[def->nmulti++] = w;
+    }
+
+    return TRUE;
+}
+
+
+static void unindex_watch(mrp_event_watch_t *w)
+{
+    event_def_t *def;
+    int          id, i;
+
+    for (id = 1; id < MRP_EVENT_MAX; id++) {
+        if (!mrp_test_event(&w->events, id))
+            continue;
+
+        def = events + id;
+
+        for (i = 0; i < def->nmulti; i++) {
+            if (def->multi[i] == w) {
+                memmove(def->multi + i, def->multi + i + 1,
+                        (def->nmulti - i - 1) * sizeof(def->multi[0]));
+                def->nmulti--;
+                break;
+            }
+        }
+    }
+}
+
+
 static void delete_watch(mrp_event_watch_t *w)
 {
+    if (single_event(&w->events) == MRP_EVENT_UNKNOWN)
+        unindex_watch(w);
+
     mrp_list_delete(&w->hook);
     mrp_list_delete(&w->purge);
-    mrp_free(w);
+    mrp_objpool_free(w);
 }
 
 
@@ -233,6 +331,7 @@ int mrp_emit_event_msg(int id, mrp_msg_t *event_data)
     event_def_t       *def;
     mrp_list_hook_t   *p, *n;
     mrp_event_watch_t *w;
+    int                i;
 
     if (MRP_EVENT_UNKNOWN < id && id <= nevent) {
         def = events + id;
@@ -248,32 +347,177 @@ int mrp_emit_event_msg(int id, mrp_msg_t *event_data)
 
             mrp_list_foreach(&def->watches, p, n) {
                 w = mrp_list_entry(p, typeof(*w), hook);
-                w->cb(w, def->id, event_data, w->user_data);
+                if (mrp_list_empty(&w->purge))
+                    w->cb(w, def->id, event_data, w->user_data);
             }
 
-            mrp_list_foreach(&watches, p, n) {
-                w = mrp_list_entry(p, typeof(*w), hook);
-                if (mrp_test_event(&w->events, id))
+            for (i = 0; i < def->nmulti; i++) {
+                w = def->multi[i];
+                if (mrp_list_empty(&w->purge))
                     w->cb(w, def->id, event_data, w->user_data);
             }
 
             nemit--;
             mrp_msg_unref(event_data);
+
+            if (nemit <= 0)
+                purge_deleted();
         }
 
         return TRUE;
     }
     else
         return FALSE;
+}
+
+
+int mrp_emit_event(int id, ...)
+{
+    mrp_msg_t *msg;
+    uint16_t   tag;
+    va_list    ap;
+    int        success;
+
+    va_start(ap, id);
+    tag = va_arg(ap, unsigned int);
+    if (tag != MRP_MSG_FIELD_INVALID)
+        msg = mrp_msg_createv(tag, ap);
+    else
+        msg = NULL;
+    va_end(ap);
+
+    success = mrp_emit_event_msg(id, msg);
+    mrp_msg_unref(msg);
+
+    return success;
+}
+
+
+static void deliver_queued(mrp_deferred_t *d, void *user_data)
+{
+    queued_event_t *batch, *e;
+    int             n, i;
+
+    MRP_UNUSED(user_data);
+
+    mrp_disable_deferred(d);
+
+    /* take the current batch, anything queued during delivery goes later */
+    batch = queue.events;
+    n     = queue.nevent;
+
+    queue.events = NULL;
+    queue.nevent = 0;
+    queue.size   = 0;
+
+    for (i = 0, e = batch; i < n; i++, e++)
+        events[e->id].queued = 0;
+
+    for (i = 0, e = batch; i < n; i++, e++) {
+        mrp_emit_event_msg(e->id, e->data);
+        mrp_msg_unref(e->data);
+    }
+
+    mrp_free(batch);
+}
+
+
+static void drop_queued(void)
+{
+    queued_event_t *e;
+    int             i;
+
+    for (i = 0, e = queue.events; i < queue.nevent; i++, e++) {
+        mrp_debug("dropping queued event 0x%x (%s)", e->id,
+                  mrp_get_event_name(e->id));
+        events[e->id].queued = 0;
+        mrp_msg_unref(e->data);
+    }
+
+    mrp_free(queue.events);
+    queue.events = NULL;
+    queue.nevent = 0;
+    queue.size   = 0;
+}
+
+
+int mrp_set_event_mainloop(mrp_mainloop_t *ml)
+{
+    if (queue.ml == ml)
+        return TRUE;
+
+    drop_queued();
+    mrp_del_deferred(queue.deliver);
+    queue.deliver = NULL;
+    queue.ml      = NULL;
+
+    if (ml != NULL) {
+        queue.deliver = mrp_add_deferred(ml, deliver_queued, NULL);
+
+        if (queue.deliver == NULL)
+            return FALSE;
+
+        mrp_disable_deferred(queue.deliver);
+        queue.ml = ml;
+    }
+
+    return TRUE;
+}
+
+
+int mrp_set_event_flags(int id, int flags)
+{
+    if (MRP_EVENT_UNKNOWN < id && id <= nevent) {
+        events[id].flags = flags;
+        return TRUE;
+    }
+    else
+        return FALSE;
+}
 
 
+int mrp_queue_event_msg(int id, mrp_msg_t *event_data)
+{
+    event_def_t    *def;
+    queued_event_t *e;
 
-    if (nemit <= 0)
-        purge_deleted();
+    if (!(MRP_EVENT_UNKNOWN < id && id <= nevent))
+        return FALSE;
+
+    if (queue.ml == NULL)
+        return mrp_emit_event_msg(id, event_data);
+
+    def = events + id;
+
+    if ((def->flags & MRP_EVENT_FLAG_COALESCE) && def->queued) {
+        mrp_debug("coalescing queued event 0x%x (%s)", def->id, def->name);
+
+        e = queue.events + def->queued - 1;
+        mrp_msg_unref(e->data);
+        e->data = mrp_msg_ref(event_data);
+
+        return TRUE;
+    }
+
+    if (queue.nevent >= queue.size) {
+        if (!mrp_reallocz(queue.events, queue.size, 2 * queue.size + 8))
+            return FALSE;
+        queue.size = 2 * queue.size + 8;
+    }
+
+    e       = queue.events + queue.nevent++;
+    e->id   = id;
+    e->data = mrp_msg_ref(event_data);
+
+    def->queued = queue.nevent;
+
+    mrp_enable_deferred(queue.deliver);
+
+    return TRUE;
 }
 
 
-int mrp_emit_event(int id, ...)
+int mrp_queue_event(int id, ...)
 {
     mrp_msg_t *msg;
     uint16_t   tag;
@@ -288,7 +532,7 @@ int mrp_emit_event(int id, ...)
         msg = NULL;
     va_end(ap);
 
-    success = mrp_emit_event_msg(id, msg);
+    success = mrp_queue_event_msg(id, msg);
     mrp_msg_unref(msg);
 
     return success;
@@ -345,7 +589,7 @@ static int lowest_bit(mrp_event_mask_t *mask)
 {
     uint64_t bits = *mask;
 
-    return __builtin_ffs(bits);
+    return __builtin_ffsll(bits);
 }
 
 
@@ -34,6 +34,7 @@
 #include <murphy/common/log.h>
 #include <murphy/common/list.h>
 #include <murphy/common/msg.h>
+#include <murphy/common/mainloop.h>
 
 MRP_CDECL_BEGIN
 
@@ -125,6 +126,32 @@ int mrp_emit_event_msg(int id, mrp_msg_t *event_data);
 /** Emit an event with a message constructed from the given parameters. */
 int mrp_emit_event(int id, ...) MRP_NULLTERM;
 
+/*
+ * asynchronous event emission
+ *
+ * Queued events are delivered in a batch from a deferred callback of
+ * the event mainloop, in the order they were queued. If an event is
+ * marked coalescing, queuing it again while it is still pending only
+ * replaces the data of the pending one. Without a mainloop, queued
+ * events are emitted synchronously.
+ */
+
+enum {
+    MRP_EVENT_FLAG_COALESCE = 0x1,       /* pending duplicates coalesce */
+};
+
+/** Set the mainloop used to deliver queued events. */
+int mrp_set_event_mainloop(mrp_mainloop_t *ml);
+
+/** Set the flags (MRP_EVENT_FLAG_*) of the given event. */
+int mrp_set_event_flags(int id, int flags);
+
+/** Queue the given event for delivery from the mainloop. */
+int mrp_queue_event_msg(int id, mrp_msg_t *event_data);
+
+/** Queue the given event with data given as message fields. */
+int mrp_queue_event(int id, ...) MRP_NULLTERM;
+
 /** Initialize an event mask to be empty. */
 static inline void mrp_reset_event_mask(mrp_event_mask_t *mask)
 {
@@ -134,19 +161,19 @@ static inline void mrp_reset_event_mask(mrp_event_mask_t *mask)
 /** Turn on the bit corresponding to id in mask. */
 static inline void mrp_add_event(mrp_event_mask_t *mask, int id)
 {
-    *mask |= (1 << (id - 1));
+    *mask |= (1ULL << (id - 1));
 }
 
 /** Turn off the bit corresponding to id in mask. */
 static inline void mrp_del_event(mrp_event_mask_t *mask, int id)
 {
-    *mask &= ~(1 << (id - 1));
+    *mask &= ~(1ULL << (id - 1));
 }
 
 /** Test if the bit corresponding to id in mask is on. */
 static inline int mrp_test_event(mrp_event_mask_t *mask, int id)
 {
-    return *mask & (1 << (id - 1));
+    return (*mask & (1ULL << (id - 1))) != 0;
 }
 
 /** Turn on the bit corresponding to the named event in mask. */
@@ -129,6 +129,9 @@ static mrp_lua_element_input_t *element_input_create_userdata(lua_State *,
                                                      int, size_t *,
                                                      mrp_lua_element_mask_t *);
 
+static mrp_htbl_t *element_input_map(mrp_lua_element_input_t *, size_t);
+static int element_input_index(mrp_lua_element_t *, const char *);
+
 static mrp_lua_mdb_table_t **element_output_check(lua_State *, int, size_t *);
 
 
@@ -217,15 +220,8 @@ const char *mrp_lua_element_get_input_name(mrp_lua_element_t *el, int inpidx)
 
 int mrp_lua_element_get_input_index(mrp_lua_element_t *el, const char *inpnam)
 {
-    mrp_lua_element_input_t *inp;
-    size_t inpidx;
-
-    if (el && inpnam && (inp = el->inputs)) {
-        for (inpidx = 0;   inpidx < el->ninput;   inpidx++) {
-            if (!strcmp(inpnam, el->inputs[inpidx].name))
-                return inpidx;
-        }
-    }
+    if (el && inpnam && el->inputs)
+        return element_input_index(el, inpnam);
 
     return -1;
 }
@@ -438,6 +434,7 @@ static int element_create_from_lua(lua_State *L)
         case INPUTS:
             el->inputs = element_input_create_userdata(L, -1, &el->ninput,
                                                        &el->inpmask);
+            el->inpmap = element_input_map(el->inputs, el->ninput);
             break;
 
         case OUTPUTS:
@@ -531,6 +528,7 @@ static void element_destroy_from_lua(void *data)
     MRP_LUA_ENTER;
 
     if (el) {
+        mrp_htbl_destroy(el->inpmap, FALSE);
         mrp_free((void *)el->name);
     }
 
@@ -555,10 +553,11 @@ static int element_update_cb(mrp_scriptlet_t *script, mrp_context_tbl_t *ctbl)
     mrp_debug("'%s'", el->name);
 
     if (el->update) {
-        if (!mrp_funcbridge_call_from_c(L, el->update, "o", args, &t, &ret)) {
+        if (!mrp_funcbridge_call_sig(L, el->update,
+                                     MRP_FUNCBRIDGE_SIGNATURE("o"),
+                                     args, &t, &ret)) {
             mrp_log_error("failed to call element.lua.%s:update method (%s)",
                           el->name, ret.string);
-            mrp_free((void *)ret.string);
             return FALSE;
         }
     }
@@ -664,6 +663,7 @@ static int sink_create_from_lua(lua_State *L)
         case INPUTS:
             sink->inputs = element_input_create_userdata(L, -1, &sink->ninput,
                                                          &sink->inpmask);
+            sink->inpmap = element_input_map(sink->inputs, sink->ninput);
             break;
 
         case OUTPUTS:
@@ -778,6 +778,7 @@ static void sink_destroy_from_lua(void *data)
     MRP_LUA_ENTER;
 
     if (sink) {
+        mrp_htbl_destroy(sink->inpmap, FALSE);
         mrp_free((void *)sink->name);
         mrp_free((void *)sink->object);
         mrp_free((void *)sink->interface);
@@ -806,10 +807,11 @@ static int sink_update_cb(mrp_scriptlet_t *script, mrp_context_tbl_t *ctbl)
     mrp_debug("'%s'", sink->name);
 
     if (sink->update) {
-        if (!mrp_funcbridge_call_from_c(L, sink->update, "o",args, &t,&ret)) {
+        if (!mrp_funcbridge_call_sig(L, sink->update,
+                                     MRP_FUNCBRIDGE_SIGNATURE("o"),
+                                     args, &t, &ret)) {
             mrp_log_error("failed to call sink.lua.%s:update method (%s)",
                           sink->name, ret.string);
-            mrp_free((void *)ret.string);
             return FALSE;
         }
     }
@@ -853,10 +855,11 @@ static void sink_install(lua_State *L, void *void_sink)
     }
 
     if (sink->initiate) {
-        if (!mrp_funcbridge_call_from_c(L, sink->initiate, "o",args, &t,&ret)){
+        if (!mrp_funcbridge_call_sig(L, sink->initiate,
+                                     MRP_FUNCBRIDGE_SIGNATURE("o"),
+                                     args, &t, &ret)) {
             mrp_log_error("failed to call sink.lua.%s:initiate method (%s)",
                           sink->name, ret.string);
-            mrp_free((void *)ret.string);
             return;
         }
         if (t != MRP_FUNCBRIDGE_BOOLEAN) {
@@ -936,7 +939,7 @@ static int element_input_getfield(lua_State *L)
     mrp_lua_element_t *el;
     const char *inpnam;
     mrp_lua_element_input_t *inp;
-    size_t i;
+    int i;
 
     MRP_LUA_ENTER;
 
@@ -948,20 +951,18 @@ static int element_input_getfield(lua_State *L)
 
     mrp_debug("reading %s.inputs.%s", el->name, inpnam);
 
-    for (i = 0;  i < el->ninput;  i++) {
+    if ((i = element_input_index(el, inpnam)) >= 0) {
         inp = el->inputs + i;
-        if (!strcmp(inpnam, inp->name)) {
-            switch (inp->type) {
-            case NUMBER:    lua_pushnumber(L, inp->constant.floating);   break;
-            case STRING:    lua_pushstring(L, inp->constant.string);     break;
-            case SELECT:    mrp_lua_push_select(L, inp->select, false);  break;
-            default:        lua_pushnil(L);                              break;
-            }
-            return 1;
+
+        switch (inp->type) {
+        case NUMBER:    lua_pushnumber(L, inp->constant.floating);   break;
+        case STRING:    lua_pushstring(L, inp->constant.string);     break;
+        case SELECT:    mrp_lua_push_select(L, inp->select, false);  break;
+        default:        lua_pushnil(L);                              break;
         }
     }
-
-    lua_pushnil(L);
+    else
+        lua_pushnil(L);
 
     MRP_LUA_LEAVE(1);
 }
@@ -971,7 +972,7 @@ static int element_input_setfield(lua_State *L)
     mrp_lua_element_t *el;
     const char *inpnam;
     mrp_lua_element_input_t *inp;
-    size_t i;
+    int i;
 
     MRP_LUA_ENTER;
 
@@ -983,39 +984,35 @@ static int element_input_setfield(lua_State *L)
 
     mrp_debug("writing %s.inputs.%s", el->name, inpnam);
 
-    for (i = 0; i < el->ninput;  i++) {
+    if ((i = element_input_index(el, inpnam)) >= 0) {
         inp = el->inputs + i;
 
-        if (!strcmp(inpnam, inp->name)) {
-            luaL_argcheck(L, !inp->type, 1, "input already assigned");
+        luaL_argcheck(L, !inp->type, 1, "input already assigned");
 
-            switch (lua_type(L, 3)) {
-            case LUA_TNUMBER:
-                inp->type = NUMBER;
-                inp->constant.floating = lua_tonumber(L, 3);
-                break;
-            case LUA_TSTRING:
-                inp->type = STRING;
-                inp->constant.string = lua_tolstring(L, 3, NULL);
-                break;
-            case LUA_TTABLE:
-                if ((inp->select = mrp_lua_to_select(L, 3))) {
-                    inp->type = SELECT;
-                    break;
-                }
-                /* intentional fall through */
-            default:
-                luaL_error(L, "invalid input type '%s' for %s",
-                           lua_typename(L, lua_type(L, 3)), inpnam);
+        switch (lua_type(L, 3)) {
+        case LUA_TNUMBER:
+            inp->type = NUMBER;
+            inp->constant.floating = lua_tonumber(L, 3);
+            break;
+        case LUA_TSTRING:
+            inp->type = STRING;
+            inp->constant.string = lua_tolstring(L, 3, NULL);
+            break;
+        case LUA_TTABLE:
+            if ((inp->select = mrp_lua_to_select(L, 3))) {
+                inp->type = SELECT;
                 break;
-            } /* switch type */
-
-            if ((el->inpmask |= INPUT_BIT(i)) == INPUT_MASK(el->ninput))
-                el->install(L, el);
-
+            }
+            /* intentional fall through */
+        default:
+            luaL_error(L, "invalid input type '%s' for %s",
+                       lua_typename(L, lua_type(L, 3)), inpnam);
             break;
-        }
-    } /* for inp */
+        } /* switch type */
+
+        if ((el->inpmask |= INPUT_BIT(i)) == INPUT_MASK(el->ninput))
+            el->install(L, el);
+    }
 
     MRP_LUA_LEAVE(0);
 }
@@ -1099,6 +1096,51 @@ static mrp_lua_element_input_t *element_input_create_userdata(lua_State *L,
     return inp;
 }
 
+/*
+ * Input names are resolved through a hash table mapping the name to
+ * the input index + 1, so that a failed lookup (NULL) can be told apart
+ * from the first input.
+ */
+static mrp_htbl_t *element_input_map(mrp_lua_element_input_t *inputs,
+                                     size_t ninput)
+{
+    mrp_htbl_config_t hcfg;
+    mrp_htbl_t *map;
+    size_t i;
+
+    mrp_clear(&hcfg);
+    hcfg.nentry = ninput;
+    hcfg.comp   = mrp_string_comp;
+    hcfg.hash   = mrp_string_hash;
+    hcfg.free   = NULL;
+
+    if (!(map = mrp_htbl_create(&hcfg)))
+        return NULL;
+
+    for (i = 0; i < ninput; i++) {
+        if (inputs[i].name && !mrp_htbl_lookup(map, (void *)inputs[i].name))
+            mrp_htbl_insert(map, (void *)inputs[i].name,
+                            (void *)(ptrdiff_t)(i + 1));
+    }
+
+    return map;
+}
+
+static int element_input_index(mrp_lua_element_t *el, const char *inpnam)
+{
+    size_t i;
+
+    if (el->inpmap)
+        return (int)(ptrdiff_t)mrp_htbl_lookup(el->inpmap, (void *)inpnam) - 1;
+
+    for (i = 0; i < el->ninput; i++) {
+        if (!strcmp(inpnam, el->inputs[i].name))
+            return (int)i;
+    }
+
+    return -1;
+}
+
 static mrp_lua_mdb_table_t **element_output_check(lua_State *L,
                                                   int idx,
                                                   size_t *ret_len)
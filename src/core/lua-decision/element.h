@@ -32,12 +32,14 @@
 
 #include <lua.h>
 #include <murphy-db/mqi-types.h>
+#include <murphy/common/hashtbl.h>
 
 #define MRP_LUA_ELEMENT_FIELDS                                  \
     const char              *name;                              \
     mrp_lua_element_mask_t   inpmask;                           \
     size_t                   ninput;                            \
     mrp_lua_element_input_t *inputs;                            \
+    mrp_htbl_t              *inpmap;                            \
     size_t                   noutput;                           \
     mrp_lua_mdb_table_t    **outputs;                           \
     void                   (*install)(lua_State *, void *);     \
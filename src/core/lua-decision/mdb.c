@@ -90,6 +90,7 @@ struct mrp_lua_mdb_select_s {
     const char *name;
     const char *table_name;
     mrp_lua_strarray_t *columns;
+    mrp_htbl_t *colmap;
     const char *condition;
     struct {
         const char *string;
@@ -97,6 +98,13 @@ struct mrp_lua_mdb_select_s {
     } statement;
     mql_result_t *result;
     size_t nrow;
+    struct {
+        mqi_handle_t table;     /* source table with our triggers */
+        bool dirty;             /* result needs a full re-query */
+        int keycol;             /* varchar column identifying rows, or -1 */
+        int keyoffs;            /* offset of keycol in trigger row data */
+        mrp_htbl_t *rows;       /* row data address -> result row index+1 */
+    } track;
 };
 
 struct mrp_lua_mdb_dependency_s {
@@ -151,6 +159,14 @@ static int  select_update(lua_State *, int, mrp_lua_mdb_select_t *);
 static int  select_update_from_lua(lua_State *);
 static int  select_update_from_resolver(mrp_scriptlet_t *,mrp_context_tbl_t *);
 static void select_install(lua_State *, mrp_lua_mdb_select_t *);
+static mrp_htbl_t *select_column_map(mrp_lua_strarray_t *);
+static int  select_column_index(mrp_lua_mdb_select_t *, const char *);
+static void select_track(mrp_lua_mdb_select_t *);
+static void select_untrack(mrp_lua_mdb_select_t *);
+static void select_index_rows(mrp_lua_mdb_select_t *);
+static void select_table_event(mqi_event_t *, void *);
+static void select_change_event(mqi_event_t *, void *);
+static bool select_patch_row(mrp_lua_mdb_select_t *, mqi_event_type_t, void *);
 
 static void select_row_class_create(lua_State *);
 /* static int  select_row_create(lua_State *, int, void *, int); */
@@ -365,15 +381,8 @@ const char *mrp_lua_select_name(mrp_lua_mdb_select_t *sel)
 int mrp_lua_select_get_column_index(mrp_lua_mdb_select_t *sel,
                                     const char *colnam)
 {
-    mrp_lua_strarray_t *cols;
-    size_t colidx;
-
-    if (sel && colnam && (cols = sel->columns)) {
-        for (colidx = 0;   colidx < cols->nstring;   colidx++) {
-            if (!strcmp(colnam, cols->strings[colidx]))
-                return (int)colidx;
-        }
-    }
+    if (sel && colnam)
+        return select_column_index(sel, colnam);
 
     return -1;
 }
@@ -817,7 +826,8 @@ static void table_row_class_create(lua_State *L)
     lua_pushliteral(L, "__index");
     lua_pushvalue(L, -2);
     lua_settable(L, -3);        /* metatable.__index = metatable */
-    luaL_openlib(L, NULL, table_row_overrides, 0);
+    lua_pushvalue(L, -1);       /* metatable as upvalue for row_check */
+    luaL_openlib(L, NULL, table_row_overrides, 1);
 }
 
 #if 0
@@ -987,6 +997,10 @@ static int select_create_from_lua(lua_State *L)
 
     sel = (mrp_lua_mdb_select_t *)mrp_lua_create_object(L,SELECT_CLASS,NULL,0);
 
+    sel->track.table  = MQI_HANDLE_INVALID;
+    sel->track.dirty  = true;
+    sel->track.keycol = -1;
+
     MRP_LUA_FOREACH_FIELD(L, 2, fldnam, fldnamlen) {
 
         switch (field_name_to_type(fldnam, fldnamlen)) {
@@ -1025,6 +1039,9 @@ static int select_create_from_lua(lua_State *L)
     if (!sel->columns || !sel->columns->nstring)
         luaL_error(L, "mandatory 'column' field is missing or invalid");
 
+    if (!(sel->colmap = select_column_map(sel->columns)))
+        luaL_error(L, "can't allocate memory");
+
     mrp_lua_print_strarray(sel->columns, cols, sizeof(cols));
 
     if (!sel->condition) {
@@ -1112,6 +1129,12 @@ static void select_destroy_from_lua(void *data)
     MRP_LUA_ENTER;
 
     if (sel) {
+        select_untrack(sel);
+        mqi_drop_table_trigger(select_table_event, sel);
+        if (sel->track.rows)
+            mrp_htbl_destroy(sel->track.rows, FALSE);
+        mql_result_free(sel->result);
+        mrp_htbl_destroy(sel->colmap, FALSE);
         mrp_lua_free_strarray(sel->columns);
         mrp_free((void *)sel->name);
         mrp_free((void *)sel->table_name);
@@ -1145,8 +1168,13 @@ static int select_update(lua_State *L, int tbl, mrp_lua_mdb_select_t *sel)
         }
         else {
             sel->result = result;
+            sel->track.dirty = false;
             nrow = mql_result_rows_get_row_count(result);
         }
+
+        /* the row triggers deliver rows in the layout of the result */
+        select_track(sel);
+        select_index_rows(sel);
     }
 
     mrp_debug("\"%s\" resulted %d rows", sel->statement.string, nrow);
@@ -1195,7 +1223,27 @@ static int select_update_from_resolver(mrp_scriptlet_t *script,
 
     mrp_lua_push_object(L, sel);
 
-    nrow = select_update(L, -1, sel);
+    /*
+     * The resolver updates every select of a table whenever the table
+     * stamp changes. Unless our triggers asked for a full re-query, the
+     * result has already been patched row by row, so only the number of
+     * row objects might need adjusting.
+     */
+    if (sel->result && sel->track.table != MQI_HANDLE_INVALID &&
+        !sel->track.dirty)
+    {
+        nrow = mql_result_rows_get_row_count(sel->result);
+
+        mrp_debug("select '%s' is up to date (%d rows)", sel->name, nrow);
+
+        if (nrow >= 0 && (size_t)nrow != sel->nrow) {
+            adjust_lua_table_size(L, -1, sel, sel->nrow, nrow,
+                                  SELECT_ROW_CLASSID);
+            sel->nrow = nrow;
+        }
+    }
+    else
+        nrow = select_update(L, -1, sel);
 
     lua_pop(L, 1);
 
@@ -1264,6 +1312,321 @@ static void select_install(lua_State *L, mrp_lua_mdb_select_t *sel)
     MRP_LUA_LEAVE_NOARG;
 }
 
+static int row_key_cmp(const void *key1, const void *key2)
+{
+    return key2 - key1;
+}
+
+static uint32_t row_key_hash(const void *key)
+{
+    uint64_t h;
+
+    h = (ptrdiff_t)key;
+
+    return (uint32_t)((h >> 3) & 0xffffffff);
+}
+
+/*
+ * Column names are resolved through a hash table built when the select
+ * is created. The table maps a column name to its index + 1, so that a
+ * failed lookup (NULL) can be told apart from column 0.
+ */
+static mrp_htbl_t *select_column_map(mrp_lua_strarray_t *cols)
+{
+    mrp_htbl_config_t hcfg;
+    mrp_htbl_t *map;
+    size_t i;
+
+    mrp_clear(&hcfg);
+    hcfg.nentry = cols->nstring;
+    hcfg.comp   = mrp_string_comp;
+    hcfg.hash   = mrp_string_hash;
+    hcfg.free   = NULL;
+
+    if (!(map = mrp_htbl_create(&hcfg)))
+        return NULL;
+
+    for (i = 0; i < cols->nstring; i++) {
+        /* keep the first one if a column is selected more than once */
+        if (!mrp_htbl_lookup(map, (void *)cols->strings[i]))
+            mrp_htbl_insert(map, (void *)cols->strings[i],
+                            (void *)(ptrdiff_t)(i + 1));
+    }
+
+    return map;
+}
+
+static int select_column_index(mrp_lua_mdb_select_t *sel, const char *colnam)
+{
+    ptrdiff_t idx;
+
+    if (!sel->colmap)
+        return -1;
+
+    idx = (ptrdiff_t)mrp_htbl_lookup(sel->colmap, (void *)colnam);
+
+    return (int)idx - 1;
+}
+
+/*
+ * Change tracking keeps the result of a select in sync with its table.
+ * If the select has no condition and selects at least one varchar column,
+ * the row and column triggers deliver the changed row in the layout of
+ * the result and the result is patched in place: inserted rows are
+ * appended, deleted rows are replaced by the last row and updated rows
+ * are overwritten. Varchar columns are read as pointers into the table
+ * row, so the address of the first selected varchar column identifies a
+ * row. Anything else (a condition, no varchar column, a row we can't
+ * find) just marks the result dirty and the next update re-runs the
+ * whole query.
+ */
+static void select_track(mrp_lua_mdb_select_t *sel)
+{
+    mqi_column_def_t defs[MQI_COLUMN_MAX];
+    mqi_column_desc_t rcds[MQI_COLUMN_MAX + 1], *cds;
+    mrp_htbl_config_t hcfg;
+    mqi_handle_t table;
+    int ncol, cidx;
+    size_t i;
+
+    if (sel->track.table != MQI_HANDLE_INVALID)
+        return;
+
+    mqi_create_table_trigger(select_table_event, sel);
+
+    table = mqi_get_table_handle((char *)sel->table_name);
+
+    if (table == MQI_HANDLE_INVALID)
+        return;
+
+    cds = NULL;
+    sel->track.keycol = -1;
+
+    if (!sel->condition && sel->result) {
+        ncol = mql_result_rows_get_column_descs(sel->result, rcds,
+                                                MQI_DIMENSION(rcds));
+
+        for (cidx = 0; cidx < ncol; cidx++) {
+            if (mql_result_rows_get_row_column_type(sel->result, cidx) ==
+                mqi_varchar) {
+                sel->track.keycol  = cidx;
+                sel->track.keyoffs = rcds[cidx].offset;
+                cds = rcds;
+                break;
+            }
+        }
+    }
+
+    if (cds && !sel->track.rows) {
+        mrp_clear(&hcfg);
+        hcfg.nentry = 64;
+        hcfg.comp   = row_key_cmp;
+        hcfg.hash   = row_key_hash;
+        hcfg.free   = NULL;
+
+        if (!(sel->track.rows = mrp_htbl_create(&hcfg))) {
+            sel->track.keycol = -1;
+            cds = NULL;
+        }
+    }
+
+    if (mqi_create_row_trigger(table, select_change_event, sel, cds) < 0)
+        goto failed;
+
+    sel->track.table = table;
+
+    /*
+     * Watch only the selected columns, unless there is a condition which
+     * might depend on any of the columns (or we can't resolve a column).
+     */
+    for (i = 0; !sel->condition && i < sel->columns->nstring; i++) {
+        cidx = mqi_get_column_index(table, (char *)sel->columns->strings[i]);
+
+        if (cidx < 0)
+            break;
+
+        if (mqi_create_column_trigger(table, cidx, select_change_event, sel,
+                                      cds) < 0)
+            goto failed;
+    }
+
+    if (sel->condition || i < sel->columns->nstring) {
+        if ((ncol = mqi_describe(table, defs, MQI_DIMENSION(defs))) < 0)
+            goto failed;
+
+        for (cidx = 0; cidx < ncol; cidx++) {
+            if (mqi_create_column_trigger(table, cidx, select_change_event,
+                                          sel, cds) < 0)
+                goto failed;
+        }
+    }
+
+    mrp_debug("select '%s' tracks changes in table '%s' (%s)", sel->name,
+              sel->table_name, cds ? "patching rows" : "re-querying");
+
+    return;
+
+ failed:
+    mrp_log_error("Failed to set up change tracking for select '%s' (%d: %s).",
+                  sel->name, errno, strerror(errno));
+    select_untrack(sel);
+}
+
+static void select_untrack(mrp_lua_mdb_select_t *sel)
+{
+    mqi_column_def_t defs[MQI_COLUMN_MAX];
+    mqi_handle_t table = sel->track.table;
+    int ncol, cidx;
+
+    if (table == MQI_HANDLE_INVALID)
+        return;
+
+    mqi_drop_row_trigger(table, select_change_event, sel);
+
+    ncol = mqi_describe(table, defs, MQI_DIMENSION(defs));
+
+    for (cidx = 0; cidx < ncol; cidx++)
+        mqi_drop_column_trigger(table, cidx, select_change_event, sel);
+
+    sel->track.table  = MQI_HANDLE_INVALID;
+    sel->track.dirty  = true;
+    sel->track.keycol = -1;
+}
+
+static void select_index_rows(mrp_lua_mdb_select_t *sel)
+{
+    const char *key;
+    int nrow, i;
+
+    if (!sel->track.rows)
+        return;
+
+    mrp_htbl_reset(sel->track.rows, FALSE);
+
+    if (sel->track.keycol < 0 || !sel->result)
+        return;
+
+    nrow = mql_result_rows_get_row_count(sel->result);
+
+    for (i = 0; i < nrow; i++) {
+        key = mql_result_rows_get_string(sel->result, sel->track.keycol, i,
+                                         NULL, 0);
+        mrp_htbl_insert(sel->track.rows, (void *)key,
+                        (void *)(ptrdiff_t)(i + 1));
+    }
+}
+
+static void select_table_event(mqi_event_t *evt, void *user_data)
+{
+    mrp_lua_mdb_select_t *sel = (mrp_lua_mdb_select_t *)user_data;
+    mqi_table_event_t *te = &evt->table;
+
+    if (!te->table.name || strcmp(te->table.name, sel->table_name))
+        return;
+
+    switch (te->event) {
+    case mqi_table_dropped:
+        /* the triggers go away with the table */
+        sel->track.table  = MQI_HANDLE_INVALID;
+        sel->track.dirty  = true;
+        sel->track.keycol = -1;
+        break;
+    case mqi_table_created:
+        sel->track.dirty = true;
+        break;
+    default:
+        break;
+    }
+}
+
+static void select_change_event(mqi_event_t *evt, void *user_data)
+{
+    mrp_lua_mdb_select_t *sel = (mrp_lua_mdb_select_t *)user_data;
+    void *data;
+
+    if (sel->track.dirty)
+        return;
+
+    switch (evt->event) {
+    case mqi_row_inserted:
+    case mqi_row_deleted:
+        data = evt->row.select.data;
+        break;
+    case mqi_column_changed:
+        data = evt->column.select.data;
+        break;
+    default:
+        data = NULL;
+        break;
+    }
+
+    if (!data || !select_patch_row(sel, evt->event, data)) {
+        mrp_debug("select '%s' needs to be re-queried", sel->name);
+        sel->track.dirty = true;
+    }
+}
+
+static bool select_patch_row(mrp_lua_mdb_select_t *sel,
+                             mqi_event_type_t event,
+                             void *data)
+{
+    mql_result_t *result;
+    void *key, *moved;
+    int rowidx, last;
+
+    if (sel->track.keycol < 0 || !sel->result || !sel->track.rows)
+        return false;
+
+    key    = *(void **)(data + sel->track.keyoffs);
+    rowidx = (int)(ptrdiff_t)mrp_htbl_lookup(sel->track.rows, key) - 1;
+
+    switch (event) {
+    case mqi_row_inserted:
+        if (rowidx >= 0)
+            return mql_result_rows_replace(sel->result, rowidx, data) == 0;
+
+        if (!(result = mql_result_rows_append(sel->result, data)))
+            return false;
+
+        sel->result = result;
+        rowidx = mql_result_rows_get_row_count(result) - 1;
+
+        return mrp_htbl_insert(sel->track.rows, key,
+                               (void *)(ptrdiff_t)(rowidx + 1));
+
+    case mqi_row_deleted:
+        if (rowidx < 0)
+            return false;
+
+        last = mql_result_rows_get_row_count(sel->result) - 1;
+
+        if (mql_result_rows_remove(sel->result, rowidx) < 0)
+            return false;
+
+        mrp_htbl_remove(sel->track.rows, key, FALSE);
+
+        if (rowidx != last) {
+            moved = (void *)mql_result_rows_get_string(sel->result,
+                                                       sel->track.keycol,
+                                                       rowidx, NULL, 0);
+            mrp_htbl_remove(sel->track.rows, moved, FALSE);
+            return mrp_htbl_insert(sel->track.rows, moved,
+                                   (void *)(ptrdiff_t)(rowidx + 1));
+        }
+
+        return true;
+
+    case mqi_column_changed:
+        if (rowidx < 0)
+            return false;
+
+        return mql_result_rows_replace(sel->result, rowidx, data) == 0;
+
+    default:
+        return false;
+    }
+}
+
 static void select_row_class_create(lua_State *L)
 {
     /* create a metatable for row's */
@@ -1271,7 +1634,8 @@ static void select_row_class_create(lua_State *L)
     lua_pushliteral(L, "__index");
     lua_pushvalue(L, -2);
     lua_settable(L, -3);        /* metatable.__index = metatable */
-    luaL_openlib(L, NULL, select_row_overrides, 0);
+    lua_pushvalue(L, -1);       /* metatable as upvalue for row_check */
+    luaL_openlib(L, NULL, select_row_overrides, 1);
 }
 
 #if 0
@@ -1315,10 +1679,7 @@ static int select_row_getfield(lua_State *L)
     switch (lua_type(L, 2)) {
     case LUA_TSTRING:
         fldnam = lua_tostring(L, 2);
-        for (colidx = 0;   colidx < (int)cols->nstring;   colidx++) {
-            if (!strcmp(fldnam, cols->strings[colidx]))
-                break;
-        }
+        colidx = select_column_index(sel, fldnam);
         goto get_data;
 
     case LUA_TNUMBER:
@@ -1650,13 +2011,23 @@ static int row_create(lua_State *L, int tbl, void *data, int rowidx,
     return 1;
 }
 
+/*
+ * Row methods are registered with the row metatable as their first
+ * upvalue, so a row can be type-checked without a registry lookup.
+ */
 static row_t *row_check(lua_State *L, int  idx, const char *class_id)
 {
     row_t *row;
 
     idx = (idx < 0) ? lua_gettop(L) + idx + 1 : idx;
 
-    row = (row_t *)luaL_checkudata(L, idx, class_id);
+    if (!(row = (row_t *)lua_touserdata(L, idx)) || !lua_getmetatable(L, idx))
+        luaL_typerror(L, idx, class_id);
+    else {
+        if (!lua_rawequal(L, -1, lua_upvalueindex(1)))
+            luaL_typerror(L, idx, class_id);
+        lua_pop(L, 1);
+    }
 
     return row;
 }
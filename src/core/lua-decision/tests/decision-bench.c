@@ -0,0 +1,248 @@
+/*
+ * Copyright (c) 2012, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Intel Corporation nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <getopt.h>
+
+#include <lualib.h>
+#include <lauxlib.h>
+
+#include <murphy/common/mm.h>
+#include <murphy/core/lua-utils/funcbridge.h>
+#include <murphy/core/lua-decision/mdb.h>
+
+/*
+ * Time field reads of a select row, by column name and by column index,
+ * from Lua. Every read goes through the select row __index override.
+ */
+
+static const char bench_script[] =
+    "local nread = ...\n"
+    "\n"
+    "mdb.table {\n"
+    "    name    = 'amb',\n"
+    "    index   = {'key'},\n"
+    "    columns = {{'key', mdb.string, 16}, {'value', mdb.floating}}\n"
+    "}\n"
+    "\n"
+    "mdb.table.amb[1] = { key = 'foo', value = 3.1415 }\n"
+    "\n"
+    "mdb.select {\n"
+    "    name    = 'bench',\n"
+    "    table   = 'amb',\n"
+    "    columns = {'key', 'value'}\n"
+    "}\n"
+    "\n"
+    "local row = mdb.select.bench[1]\n"
+    "local v, start\n"
+    "\n"
+    "start = os.clock()\n"
+    "for i = 1, nread do\n"
+    "    v = row.value\n"
+    "end\n"
+    "print(string.format('%d select row reads by name: %.3f s',\n"
+    "                    nread, os.clock() - start))\n"
+    "\n"
+    "start = os.clock()\n"
+    "for i = 1, nread do\n"
+    "    v = row[2]\n"
+    "end\n"
+    "print(string.format('%d select row reads by index: %.3f s',\n"
+    "                    nread, os.clock() - start))\n";
+
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000000.0 + ts.tv_nsec;
+}
+
+
+/*
+ * Time calls shaped like the two hot paths using funcbridges: element
+ * updates (a lua method taking the element object) and resource vetoes
+ * (an array of lua functions taking zone, resource set, grant mask and
+ * owners, all of which must return true).
+ */
+
+#define NVETO 3
+
+static void measure_call_overhead(lua_State *L, void *object, int ncall)
+{
+    mrp_funcbridge_sig_t *usig = mrp_funcbridge_signature("o");
+    mrp_funcbridge_sig_t *vsig = mrp_funcbridge_signature("sodo");
+    mrp_funcbridge_value_t uargs[1], vargs[4], ret;
+    mrp_funcbridge_t *update;
+    mrp_funcarray_t *fa;
+    double start, by_name, by_sig;
+    char t;
+    int i;
+
+    if (ncall <= 0)
+        return;
+
+    if (luaL_dostring(L, "return function(self) return true end, "
+                         "function(z, rs, grant, o) return grant >= 0 end")) {
+        fprintf(stderr, "failed to create benchmark functions\n");
+        lua_pop(L, 1);
+        return;
+    }
+
+    /* the array owns its bridges, like one set up from lua */
+    fa = mrp_funcarray_create(L);
+    fa->funcs = calloc(NVETO, sizeof(mrp_funcbridge_t *));
+
+    if (fa->funcs == NULL) {
+        lua_pop(L, 3);
+        return;
+    }
+
+    fa->nfunc = NVETO;
+    for (i = 0;  i < NVETO;  i++)
+        fa->funcs[i] = mrp_funcbridge_create_luafunc(L, -2);
+
+    update = mrp_funcbridge_create_luafunc(L, -3);
+
+    uargs[0].pointer = object;
+
+    vargs[0].string  = "driver";
+    vargs[1].pointer = object;
+    vargs[2].integer = 0x5;
+    vargs[3].pointer = object;
+
+    start = now_ns();
+    for (i = 0;  i < ncall;  i++) {
+        if (!mrp_funcbridge_call_from_c(L, update, "o", uargs, &t, &ret) ||
+            t == MRP_FUNCBRIDGE_STRING)
+            mrp_free((void *)ret.string);
+    }
+    by_name = (now_ns() - start) / ncall;
+
+    start = now_ns();
+    for (i = 0;  i < ncall;  i++)
+        mrp_funcbridge_call_sig(L, update, usig, uargs, &t, &ret);
+    by_sig = (now_ns() - start) / ncall;
+
+    printf("element update: %.1f ns/call by name, "
+           "%.1f ns/call precompiled\n", by_name, by_sig);
+
+    start = now_ns();
+    for (i = 0;  i < ncall;  i++)
+        mrp_funcarray_call_from_c(L, fa, "sodo", vargs);
+    by_name = (now_ns() - start) / ncall;
+
+    start = now_ns();
+    for (i = 0;  i < ncall;  i++)
+        mrp_funcarray_call_sig(L, fa, vsig, vargs);
+    by_sig = (now_ns() - start) / ncall;
+
+    printf("%d resource vetoes: %.1f ns/call by name, "
+           "%.1f ns/call precompiled\n", NVETO, by_name, by_sig);
+
+    mrp_funcbridge_unref(L, update);
+    lua_pop(L, 3);
+}
+
+
+static void print_usage(const char *argv0, int exit_code)
+{
+    printf("usage: %s [options]\n\n"
+           "The possible options are:\n"
+           "  -n, --count=N       number of row field reads and of\n"
+           "                      funcbridge calls to time\n"
+           "  -h, --help          show this help\n", argv0);
+
+    exit(exit_code);
+}
+
+
+int main(int argc, char *argv[])
+{
+    struct option options[] = {
+        { "count", required_argument, NULL, 'n' },
+        { "help" , no_argument      , NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    lua_State            *L;
+    mrp_lua_mdb_select_t *sel;
+    int                   n, opt;
+
+    n = 1000000;
+
+    while ((opt = getopt_long(argc, argv, "n:h", options, NULL)) != -1) {
+        switch (opt) {
+        case 'n': n = atoi(optarg);        break;
+        case 'h': print_usage(argv[0], 0); break;
+        default:  print_usage(argv[0], 1);
+        }
+    }
+
+    if ((L = luaL_newstate()) == NULL) {
+        fprintf(stderr, "failed to initialize Lua\n");
+        exit(1);
+    }
+
+    luaL_openlibs(L);
+    mrp_create_funcbridge_class(L);
+    mrp_lua_create_mdb_class(L);
+
+    if (luaL_loadbuffer(L, bench_script, sizeof(bench_script) - 1,
+                        "decision-bench") != 0) {
+        fprintf(stderr, "%s\n", lua_tostring(L, -1));
+        exit(1);
+    }
+
+    lua_pushinteger(L, n);
+
+    if (lua_pcall(L, 1, 0, 0) != 0) {
+        fprintf(stderr, "%s\n", lua_tostring(L, -1));
+        exit(1);
+    }
+
+    /* the calls take the select as their object argument */
+    if (luaL_dostring(L, "return mdb.select.bench") != 0) {
+        fprintf(stderr, "%s\n", lua_tostring(L, -1));
+        exit(1);
+    }
+
+    sel = mrp_lua_to_select(L, -1);
+    lua_pop(L, 1);
+
+    if (sel != NULL)
+        measure_call_overhead(L, sel, n);
+
+    lua_close(L);
+
+    return 0;
+}
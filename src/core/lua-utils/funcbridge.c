@@ -59,6 +59,11 @@ static mrp_funcarray_t *to_funcarray(lua_State *, int);
 static int funcarray_destructor(lua_State *);
 
 static int make_lua_call(lua_State *, mrp_funcbridge_t *, int);
+static bool call_from_c(lua_State *, mrp_funcbridge_t *,
+                        mrp_funcbridge_sig_t *, mrp_funcbridge_value_t *,
+                        char *, mrp_funcbridge_value_t *, bool);
+
+static mrp_htbl_t *signatures;
 
 
 void mrp_create_funcbridge_class(lua_State *L)
@@ -143,6 +148,7 @@ mrp_funcbridge_t *mrp_funcbridge_create_cfunc(lua_State *L, const char *name,
 
         fb->type = MRP_C_FUNCTION;
         fb->c.signature = strdup(signature);
+        fb->c.sig = mrp_funcbridge_signature(signature);
         fb->c.func = func;
         fb->c.data = data;
 
@@ -209,6 +215,7 @@ void mrp_funcbridge_unref(lua_State *L, mrp_funcbridge_t *fb)
     else {
         free((void *)fb->c.signature);
         fb->c.signature = NULL;
+        fb->c.sig = NULL;
 
         if (fb->luatbl) {
             luaL_unref(L, LUA_REGISTRYINDEX, fb->luatbl);
@@ -217,6 +224,60 @@ void mrp_funcbridge_unref(lua_State *L, mrp_funcbridge_t *fb)
     }
 }
 
+mrp_funcbridge_sig_t *mrp_funcbridge_signature(const char *signature)
+{
+    mrp_htbl_config_t hcfg;
+    mrp_funcbridge_sig_t *sig;
+    const char *t;
+
+    if (!signature)
+        return NULL;
+
+    if (!signatures) {
+        hcfg.nentry  = 16;
+        hcfg.comp    = mrp_string_comp;
+        hcfg.hash    = mrp_string_hash;
+        hcfg.free    = NULL;
+        hcfg.nbucket = 16;
+
+        if (!(signatures = mrp_htbl_create(&hcfg)))
+            return NULL;
+    }
+
+    if ((sig = mrp_htbl_lookup(signatures, (void *)signature)))
+        return sig;
+
+    for (t = signature;  *t;  t++) {
+        switch (*t) {
+        case MRP_FUNCBRIDGE_STRING:
+        case MRP_FUNCBRIDGE_INTEGER:
+        case MRP_FUNCBRIDGE_FLOATING:
+        case MRP_FUNCBRIDGE_BOOLEAN:
+        case MRP_FUNCBRIDGE_OBJECT:
+            break;
+        default:
+            mrp_log_error("invalid type '%c' in funcbridge signature '%s'",
+                          *t, signature);
+            return NULL;
+        }
+    }
+
+    if (!(sig = mrp_allocz(sizeof(*sig))))
+        return NULL;
+
+    sig->signature = mrp_strdup(signature);
+    sig->narg      = t - signature;
+
+    if (!sig->signature ||
+        !mrp_htbl_insert(signatures, (void *)sig->signature, sig)) {
+        mrp_free((void *)sig->signature);
+        mrp_free(sig);
+        return NULL;
+    }
+
+    return sig;
+}
+
 bool mrp_funcbridge_call_from_c(lua_State *L,
                                 mrp_funcbridge_t *fb,
                                 const char *signature,
@@ -224,38 +285,107 @@ bool mrp_funcbridge_call_from_c(lua_State *L,
                                 char *ret_type,
                                 mrp_funcbridge_value_t *ret_value)
 {
-    char t;
+    mrp_funcbridge_sig_t *sig = mrp_funcbridge_signature(signature);
+
+    return call_from_c(L, fb, sig, args, ret_type, ret_value, true);
+}
+
+/*
+ * Unlike with mrp_funcbridge_call_from_c, the caller never owns a string
+ * returned by mrp_funcbridge_call_sig. Strings returned by lua functions
+ * are not copied, and strings returned by C functions (which, as always,
+ * must be allocated) are moved into lua and freed. Either way, they are
+ * anchored to the bridge and stay valid until the next call through it.
+ * On failure a string describing the error is always returned.
+ */
+bool mrp_funcbridge_call_sig(lua_State *L,
+                             mrp_funcbridge_t *fb,
+                             mrp_funcbridge_sig_t *sig,
+                             mrp_funcbridge_value_t *args,
+                             char *ret_type,
+                             mrp_funcbridge_value_t *ret_value)
+{
+    return call_from_c(L, fb, sig, args, ret_type, ret_value, false);
+}
+
+static const char *anchor_string(lua_State *L, mrp_funcbridge_t *fb,
+                                 const char *str)
+{
+    const char *anchored;
+
+    mrp_funcbridge_push(L, fb);
+    lua_pushstring(L, str);
+    anchored = lua_tostring(L, -1);
+    lua_rawseti(L, -2, 2);
+    lua_pop(L, 1);
+
+    return anchored;
+}
+
+static bool call_error(const char *error, char *ret_type,
+                       mrp_funcbridge_value_t *ret_value, bool copy)
+{
+    *ret_type = MRP_FUNCBRIDGE_STRING;
+    ret_value->string = copy ? mrp_strdup(error) : error;
+
+    return false;
+}
+
+static bool call_from_c(lua_State *L,
+                        mrp_funcbridge_t *fb,
+                        mrp_funcbridge_sig_t *sig,
+                        mrp_funcbridge_value_t *args,
+                        char *ret_type,
+                        mrp_funcbridge_value_t *ret_value,
+                        bool copy)
+{
+    static const char *mismatch = "mismatching signature @ C invocation";
+    static const char *invalid  = "invalid function bridge or signature";
+    static const char *failed   = "C function failed";
+
     int i;
-    int sp;
+    int sp, tbl;
     mrp_funcbridge_value_t *a;
     int sts;
     bool success;
+    const char *str;
 
-    if (!fb)
-        success = false;
+    *ret_type = MRP_FUNCBRIDGE_NO_DATA;
+    memset(ret_value, 0, sizeof(*ret_value));
+
+    if (!fb || !sig)
+        success = call_error(invalid, ret_type, ret_value, copy);
     else {
         switch (fb->type) {
 
         case MRP_C_FUNCTION:
-            if (!strcmp(signature, fb->c.signature))
-                success = fb->c.func(L, fb->c.data, signature, args, ret_type,
-                                     ret_value);
-            else {
-                *ret_type = MRP_FUNCBRIDGE_STRING;
-                ret_value->string = mrp_strdup("mismatching signature "
-                                               "@ C invocation");
-                success = false;
+            if (sig != fb->c.sig) {
+                success = call_error(mismatch, ret_type, ret_value, copy);
+                break;
+            }
+
+            success = fb->c.func(L, fb->c.data, sig->signature, args,
+                                 ret_type, ret_value);
+
+            if (*ret_type == MRP_FUNCBRIDGE_STRING && ret_value->string) {
+                if (!copy) {
+                    str = ret_value->string;
+                    ret_value->string = anchor_string(L, fb, str);
+                    mrp_free((void *)str);
+                }
             }
+            else if (!success)
+                success = call_error(failed, ret_type, ret_value, copy);
             break;
 
         case MRP_LUA_FUNCTION:
             sp = lua_gettop(L);
             mrp_funcbridge_push(L, fb);
+            tbl = sp + 1;
             lua_rawgeti(L, -1, 1);
             luaL_checktype(L, -1, LUA_TFUNCTION);
-            for (i = 0;   (t = signature[i]);   i++) {
-                a = args + i;
-                switch (t) {
+            for (i = 0, a = args;   i < sig->narg;   i++, a++) {
+                switch (sig->signature[i]) {
                 case MRP_FUNCBRIDGE_STRING:
                     lua_pushstring(L, a->string);
                     break;
@@ -271,13 +401,10 @@ bool mrp_funcbridge_call_from_c(lua_State *L,
                 case MRP_FUNCBRIDGE_OBJECT:
                     mrp_lua_push_object(L, a->pointer);
                     break;
-                default:
-                    success = false;
-                    goto done;
                 }
             }
 
-            sts = lua_pcall(L, i, 1, 0);
+            sts = lua_pcall(L, sig->narg, 1, 0);
 
             MRP_ASSERT(!sts || (sts && lua_type(L, -1) == LUA_TSTRING),
                        "lua pcall did not return error string when failed");
@@ -285,7 +412,14 @@ bool mrp_funcbridge_call_from_c(lua_State *L,
             switch (lua_type(L, -1)) {
             case LUA_TSTRING:
                 *ret_type = MRP_FUNCBRIDGE_STRING;
-                ret_value->string = mrp_strdup(lua_tolstring(L, -1, NULL));
+                if (copy)
+                    ret_value->string = mrp_strdup(lua_tostring(L, -1));
+                else {
+                    /* anchor the string to the bridge until the next call */
+                    ret_value->string = lua_tostring(L, -1);
+                    lua_pushvalue(L, -1);
+                    lua_rawseti(L, tbl, 2);
+                }
                 break;
             case LUA_TNUMBER:
                 *ret_type = MRP_FUNCBRIDGE_FLOATING;
@@ -301,12 +435,11 @@ bool mrp_funcbridge_call_from_c(lua_State *L,
                 break;
             }
             success = !sts;
-        done:
             lua_settop(L, sp);
             break;
 
         default:
-            success = false;
+            success = call_error(invalid, ret_type, ret_value, copy);
             break;
         }
     }
@@ -355,20 +488,30 @@ bool mrp_funcarray_call_from_c(lua_State *L,
                                mrp_funcarray_t *fa,
                                const char *signature,
                                mrp_funcbridge_value_t *args)
+{
+    mrp_funcbridge_sig_t *sig = mrp_funcbridge_signature(signature);
+
+    return mrp_funcarray_call_sig(L, fa, sig, args);
+}
+
+bool mrp_funcarray_call_sig(lua_State *L,
+                            mrp_funcarray_t *fa,
+                            mrp_funcbridge_sig_t *sig,
+                            mrp_funcbridge_value_t *args)
 {
     size_t i;
     bool success, ok;
     char rtyp;
     mrp_funcbridge_value_t rval;
 
-    if (!fa || (fa->nfunc > 0 && !fa->funcs))
+    if (!fa || !sig || (fa->nfunc > 0 && !fa->funcs))
         success = false;
     else {
         success = true;
 
         for (i = 0;   i < fa->nfunc;   i++) {
-            ok = mrp_funcbridge_call_from_c(L, fa->funcs[i], signature, args,
-                                            &rtyp, &rval);
+            ok = call_from_c(L, fa->funcs[i], sig, args, &rtyp, &rval, false);
+
             if (!ok || rtyp != MRP_FUNCBRIDGE_BOOLEAN || !rval.boolean)
                 success = false;
         }
@@ -624,7 +767,7 @@ static int make_lua_call(lua_State *L, mrp_funcbridge_t *fb, int f)
     switch (fb->type) {
 
     case MRP_C_FUNCTION:
-        m = strlen(fb->c.signature);
+        m = fb->c.sig ? fb->c.sig->narg : (int)strlen(fb->c.signature);
 
         if (n >= ARG_MAX - 1 || n > m)
             return luaL_error(L, "too many arguments");
@@ -33,6 +33,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include <murphy/common/macros.h>
+
 #define MRP_FUNCBRIDGE_NO_DATA      0
 #define MRP_FUNCBRIDGE_UNSUPPORTED '?'
 #define MRP_FUNCBRIDGE_STRING      's'
@@ -47,6 +49,7 @@ typedef union  mrp_funcbridge_value_u  mrp_funcbridge_value_t;
 typedef enum   mrp_funcbridge_type_e   mrp_funcbridge_type_t;
 typedef struct mrp_funcbridge_s        mrp_funcbridge_t;
 typedef struct mrp_funcarray_s         mrp_funcarray_t;
+typedef struct mrp_funcbridge_sig_s    mrp_funcbridge_sig_t;
 
 typedef bool (*mrp_funcbridge_cfunc_t)(lua_State *, void *,
                                        const char *, mrp_funcbridge_value_t *,
@@ -60,6 +63,29 @@ union mrp_funcbridge_value_u {
     void       *pointer;
 };
 
+/*
+ * a precompiled call signature
+ *
+ * Signatures are interned, so two signatures with the same text are
+ * always the same object and can be compared by their address.
+ */
+struct mrp_funcbridge_sig_s {
+    const char *signature;                  /* interned signature string */
+    int         narg;                       /* number of arguments */
+};
+
+/*
+ * compile a signature only once per call site
+ */
+#define MRP_FUNCBRIDGE_SIGNATURE(_signature) ({                           \
+            static mrp_funcbridge_sig_t *_sig;                            \
+                                                                          \
+            if (MRP_UNLIKELY(_sig == NULL))                               \
+                _sig = mrp_funcbridge_signature(_signature);              \
+                                                                          \
+            _sig;                                                         \
+        })
+
 enum mrp_funcbridge_type_e {
     MRP_C_FUNCTION = 1,
     MRP_LUA_FUNCTION
@@ -69,6 +95,7 @@ struct mrp_funcbridge_s {
     mrp_funcbridge_type_t   type;
     struct {
         const char *signature;
+        mrp_funcbridge_sig_t *sig;
         mrp_funcbridge_cfunc_t func;
         void *data;
     }                       c;
@@ -99,13 +126,23 @@ bool              mrp_funcbridge_call_from_c(lua_State *,  mrp_funcbridge_t *,
                                              mrp_funcbridge_value_t *,
                                              char *,
                                              mrp_funcbridge_value_t *);
+bool              mrp_funcbridge_call_sig(lua_State *, mrp_funcbridge_t *,
+                                          mrp_funcbridge_sig_t *,
+                                          mrp_funcbridge_value_t *,
+                                          char *,
+                                          mrp_funcbridge_value_t *);
 mrp_funcbridge_t *mrp_funcbridge_check(lua_State *, int);
+
+mrp_funcbridge_sig_t *mrp_funcbridge_signature(const char *);
 int               mrp_funcbridge_push(lua_State *, mrp_funcbridge_t *);
 
 mrp_funcarray_t  *mrp_funcarray_create(lua_State *);
 bool              mrp_funcarray_call_from_c(lua_State *, mrp_funcarray_t *,
                                             const char *,
                                             mrp_funcbridge_value_t *);
+bool              mrp_funcarray_call_sig(lua_State *, mrp_funcarray_t *,
+                                         mrp_funcbridge_sig_t *,
+                                         mrp_funcbridge_value_t *);
 mrp_funcarray_t  *mrp_funcarray_check(lua_State *, int);
 
 
@@ -52,10 +52,58 @@ struct userdata_s {
 static bool valid_id(const char *);
 static int  userdata_destructor(lua_State *);
 
+/*
+ * The userdata of an object is stored in the object table under a light
+ * userdata key, so it is found with a pointer hash instead of a string
+ * key. The address of userdata_key is only used as a unique value.
+ */
+static char userdata_key;
+
+#define push_userdata_key(L) lua_pushlightuserdata(L, (void *)&userdata_key)
+
+/*
+ * Resolve the userdata at idx. Besides its type and size, check the self
+ * pointer every object userdata carries and, if the class is given, its
+ * metatable against the one cached in the classdef when the class was
+ * created. The class itself is verified by the callers by comparing the
+ * cached classdef.
+ */
+static inline userdata_t *to_userdata(lua_State *L, int idx,
+                                      mrp_lua_classdef_t *def)
+{
+    userdata_t *userdata;
+    const void *meta;
+
+    idx = (idx < 0) ? lua_gettop(L) + idx + 1 : idx;
+
+    if (lua_type(L, idx) != LUA_TUSERDATA ||
+        lua_objlen(L, idx) < sizeof(userdata_t))
+        return NULL;
+
+    userdata = (userdata_t *)lua_touserdata(L, idx);
+
+    if (userdata != userdata->self)
+        return NULL;
+
+    if (def != NULL) {
+        if (!lua_getmetatable(L, idx))
+            return NULL;
+
+        meta = lua_topointer(L, -1);
+        lua_pop(L, 1);
+
+        if (meta != def->userdata_meta)
+            return NULL;
+    }
+
+    return userdata;
+}
+
 void mrp_lua_create_object_class(lua_State *L, mrp_lua_classdef_t *def)
 {
     /* make a metatatable for userdata, ie for 'c' part of object instances*/
     luaL_newmetatable(L, def->userdata_id);
+    def->userdata_meta = lua_topointer(L, -1);
     lua_pushliteral(L, "__index");
     lua_pushvalue(L, -2);
     lua_settable(L, -3);        /* metatable.__index = metatable */
@@ -130,7 +178,7 @@ void *mrp_lua_create_object(lua_State          *L,
     luaL_getmetatable(L, def->class_id);
     lua_setmetatable(L, -2);
 
-    lua_pushliteral(L, "userdata");
+    push_userdata_key(L);
 
     size = sizeof(userdata_t) + def->userdata_size;
     userdata = (userdata_t *)lua_newuserdata(L, size);
@@ -203,7 +251,7 @@ void mrp_lua_destroy_object(lua_State *L, const char *name,int idx, void *data)
         def = userdata->def;
 
         lua_rawgeti(L, LUA_REGISTRYINDEX, userdata->luatbl);
-        lua_pushstring(L, "userdata");
+        push_userdata_key(L);
         lua_pushnil(L);
         lua_rawset(L, -3);
         lua_pop(L, -1);
@@ -252,64 +300,53 @@ int mrp_lua_find_object(lua_State *L, mrp_lua_classdef_t *def,const char *name)
 void *mrp_lua_check_object(lua_State *L, mrp_lua_classdef_t *def, int idx)
 {
     userdata_t *userdata;
-    char errmsg[256];
+
+    idx = (idx < 0) ? lua_gettop(L) + idx + 1 : idx;
 
     luaL_checktype(L, idx, LUA_TTABLE);
 
-    lua_pushvalue(L, idx);
-    lua_pushliteral(L, "userdata");
-    lua_rawget(L, -2);
+    push_userdata_key(L);
+    lua_rawget(L, idx);
 
-    if (!def)
-        userdata = (userdata_t *)lua_touserdata(L, -1);
-    else {
-        userdata = (userdata_t *)luaL_checkudata(L, -1, def->userdata_id);
+    userdata = to_userdata(L, -1, def);
+
+    lua_pop(L, 1);
 
+    if (!def) {
+        if (!userdata)
+            luaL_error(L, "invalid userdata");
+    }
+    else {
         if (!userdata || def != userdata->def) {
-            snprintf(errmsg, sizeof(errmsg), "'%s' expected", def->class_name);
-            luaL_argerror(L, idx, errmsg);
+            luaL_argerror(L, idx, lua_pushfstring(L, "'%s' expected",
+                                                  def->class_name));
             userdata = NULL;
         }
     }
 
-    if (userdata != userdata->self) {
-        luaL_error(L, "invalid userdata");
-        userdata = NULL;
-    }
-
-    lua_pop(L, 2);
-
     return userdata ? (void *)(userdata + 1) : NULL;
 }
 
 void *mrp_lua_to_object(lua_State *L, mrp_lua_classdef_t *def, int idx)
 {
     userdata_t *userdata;
-    int top = lua_gettop(L);
 
     idx = (idx < 0) ? lua_gettop(L) + idx + 1 : idx;
 
     if (!lua_istable(L, idx))
         return NULL;
 
-    lua_pushliteral(L, "userdata");
+    push_userdata_key(L);
     lua_rawget(L, idx);
 
-    userdata = (userdata_t *)lua_touserdata(L, -1);
-
-    if (!userdata || !lua_getmetatable(L, -1)) {
-        lua_settop(L, top);
-        return NULL;
-    }
+    userdata = to_userdata(L, -1, def);
 
-    lua_getfield(L, LUA_REGISTRYINDEX, def->userdata_id);
-
-    if (!lua_rawequal(L, -1, -2) || userdata != userdata->self)
-        userdata = NULL;
+    lua_pop(L, 1);
 
-    lua_settop(L, top);
+    if (!userdata || def != userdata->def)
+        return NULL;
 
-    return userdata ? (void *)(userdata + 1) : NULL;
+    return (void *)(userdata + 1);
 }
 
 
@@ -365,8 +402,7 @@ static int userdata_destructor(lua_State *L)
         luaL_error(L, "attempt to destroy unknown type of userdata");
     else {
         def = userdata->def;
-        lua_getfield(L, LUA_REGISTRYINDEX, def->userdata_id);
-        if (!lua_rawequal(L, -1, -2))
+        if (lua_topointer(L, -1) != def->userdata_meta)
             luaL_typerror(L, -2, def->userdata_id);
         else
             def->destructor((void *)(userdata + 1));
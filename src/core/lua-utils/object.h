@@ -119,6 +119,7 @@ struct mrp_lua_classdef_s {
     const char   *constructor;
     void        (*destructor)(void *);
     const char   *userdata_id;
+    const void   *userdata_meta;
     size_t        userdata_size;
     luaL_reg     *methods;
     luaL_reg     *overrides;
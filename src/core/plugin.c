@@ -31,6 +31,7 @@
 #include <errno.h>
 #include <stdarg.h>
 #include <limits.h>
+#include <time.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
@@ -41,6 +42,7 @@
 
 
 #define PLUGIN_PREFIX "plugin-"
+#define START_TIMEOUT (30 * 1000)        /* async plugin init timeout */
 
 static mrp_plugin_descr_t *open_builtin(const char *name);
 static mrp_plugin_descr_t *open_dynamic(const char *path, void **handle);
@@ -54,6 +56,14 @@ static int export_plugin_methods(mrp_plugin_t *plugin);
 static int remove_plugin_methods(mrp_plugin_t *plugin);
 static int import_plugin_methods(mrp_plugin_t *plugin);
 static int release_plugin_methods(mrp_plugin_t *plugin);
+static int check_dependencies(mrp_plugin_t *plugin, int verbose);
+static void unload_failed(mrp_plugin_t *plugin);
+
+enum {
+    DEPS_READY = 0,                      /* all dependencies running */
+    DEPS_PENDING,                        /* some not running yet */
+    DEPS_FAILED,                         /* some failed to start */
+};
 
 
 /*
@@ -90,6 +100,16 @@ MRP_REGISTER_EVENTS(events,
                     { MRP_PLUGIN_EVENT_UNLOADED, PLUGIN_EVENT_UNLOADED });
 
 
+static uint64_t time_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+
 static int emit_plugin_event(int idx, mrp_plugin_t *plugin)
 {
     uint16_t name = MRP_PLUGIN_TAG_PLUGIN;
@@ -182,10 +202,13 @@ mrp_plugin_t *mrp_load_plugin(mrp_context_t *ctx, const char *name,
     void                *handle;
     mrp_console_group_t *cmds;
     char                 grpbuf[PATH_MAX], *cmdgrp;
+    uint64_t             start;
 
     if (name == NULL)
         return NULL;
 
+    start = time_now();
+
     if (instance == NULL)
         instance = name;
 
@@ -284,10 +307,30 @@ mrp_plugin_t *mrp_load_plugin(mrp_context_t *ctx, const char *name,
 
         mrp_list_append(&ctx->plugins, &plugin->hook);
 
+        plugin->load_usecs = time_now() - start;
+
         emit_plugin_event(PLUGIN_EVENT_LOADED, plugin);
 
-        if (ctx->state == MRP_STATE_STARTING || ctx->state == MRP_STATE_RUNNING)
+        /*
+         * While starting up, plugins with dependencies are started later.
+         * Once running, nothing would start them later, so fail the load.
+         */
+        if (ctx->state == MRP_STATE_RUNNING) {
+            if (check_dependencies(plugin, TRUE) != DEPS_READY) {
+                mrp_log_error("Failed to start plugin %s (%s), dependencies "
+                              "not running.", plugin->instance, descr->name);
+                emit_plugin_event(PLUGIN_EVENT_FAILED, plugin);
+                unload_failed(plugin);
+
+                return NULL;
+            }
+
             mrp_start_plugin(plugin);
+        }
+        else if (ctx->state == MRP_STATE_STARTING) {
+            if (check_dependencies(plugin, FALSE) == DEPS_READY)
+                mrp_start_plugin(plugin);
+        }
 
         return plugin;
     }
@@ -444,53 +487,288 @@ int mrp_unload_plugin(mrp_plugin_t *plugin)
 }
 
 
+static mrp_plugin_t *find_dependency(mrp_context_t *ctx, const char *name)
+{
+    mrp_plugin_t *dep;
+
+    if ((dep = find_plugin_instance(ctx, name)) == NULL)
+        dep = find_plugin(ctx, (char *)name);
+
+    return dep;
+}
+
+
+static int check_dependencies(mrp_plugin_t *plugin, int verbose)
+{
+    const char   **deps = plugin->descriptor->depends;
+    mrp_plugin_t  *dep;
+    int            status;
+
+    if (deps == NULL)
+        return DEPS_READY;
+
+    for (status = DEPS_READY; *deps != NULL; deps++) {
+        dep = find_dependency(plugin->ctx, *deps);
+
+        if (dep == NULL || dep == plugin) {
+            if (verbose)
+                mrp_log_error("Plugin %s depends on missing plugin %s.",
+                              plugin->instance, *deps);
+            status = MRP_MAX(status, DEPS_PENDING);
+            continue;
+        }
+
+        switch (dep->state) {
+        case MRP_PLUGIN_RUNNING:
+            break;
+        case MRP_PLUGIN_LOADED:
+        case MRP_PLUGIN_STARTING:
+            if (verbose)
+                mrp_log_error("Plugin %s depends on plugin %s, which has "
+                              "not been started.", plugin->instance, *deps);
+            status = MRP_MAX(status, DEPS_PENDING);
+            break;
+        default:
+            if (verbose)
+                mrp_log_error("Plugin %s depends on failed plugin %s.",
+                              plugin->instance, *deps);
+            return DEPS_FAILED;
+        }
+    }
+
+    return status;
+}
+
+
+static void unload_failed(mrp_plugin_t *plugin)
+{
+    /* a plugin that never got running is only referenced by itself */
+    if (plugin->refcnt <= 1) {
+        plugin->refcnt = 0;
+        mrp_unload_plugin(plugin);
+    }
+}
+
+
+static int start_failed(mrp_plugin_t *plugin)
+{
+    plugin->state = MRP_PLUGIN_FAILED;
+
+    if (!plugin->may_fail)
+        return FALSE;
+
+    unload_failed(plugin);
+    return TRUE;
+}
+
+
+/*
+ * Start all plugins whose dependencies are running, until no more
+ * plugins can be started. Return FALSE if a plugin, which is not
+ * allowed to fail, failed to start.
+ */
+
+static int start_ready_plugins(mrp_context_t *ctx)
+{
+    mrp_list_hook_t *p, *n;
+    mrp_plugin_t    *plugin;
+    int              progress;
+
+    do {
+        progress = FALSE;
+
+        mrp_list_foreach(&ctx->plugins, p, n) {
+            plugin = mrp_list_entry(p, typeof(*plugin), hook);
+
+            switch (plugin->state) {
+            case MRP_PLUGIN_FAILED:         /* asynchronous init failed */
+                if (!start_failed(plugin))
+                    return FALSE;
+                continue;
+
+            case MRP_PLUGIN_LOADED:
+                break;
+
+            default:
+                continue;
+            }
+
+            switch (check_dependencies(plugin, FALSE)) {
+            case DEPS_PENDING:
+                continue;
+
+            case DEPS_FAILED:
+                check_dependencies(plugin, TRUE);
+                mrp_log_error("Failed to start plugin %s (%s).",
+                              plugin->instance, plugin->descriptor->name);
+                emit_plugin_event(PLUGIN_EVENT_FAILED, plugin);
+                if (!start_failed(plugin))
+                    return FALSE;
+                progress = TRUE;
+                continue;
+
+            default:
+                break;
+            }
+
+            progress = TRUE;
+
+            if (!import_plugin_methods(plugin) || !mrp_start_plugin(plugin)) {
+                if (!start_failed(plugin))
+                    return FALSE;
+                continue;
+            }
+
+            /* XXX TODO: argh, ugly kludge for plugins loading plugins... */
+            if (plugin->hook.next != n)
+                n = plugin->hook.next;
+        }
+    } while (progress);
+
+    return TRUE;
+}
+
+
+static void start_timeout(mrp_timer_t *t, void *user_data)
+{
+    int *expired = (int *)user_data;
+
+    mrp_del_timer(t);
+    *expired = TRUE;
+}
+
+
 int mrp_start_plugins(mrp_context_t *ctx)
 {
     mrp_list_hook_t *p, *n;
     mrp_plugin_t    *plugin;
+    mrp_timer_t     *t;
+    int              npending, nwaiting, expired;
 
-    mrp_list_foreach(&ctx->plugins, p, n) {
-        plugin = mrp_list_entry(p, typeof(*plugin), hook);
+    t       = NULL;
+    expired = FALSE;
 
-        if (!import_plugin_methods(plugin)) {
-            if (!plugin->may_fail)
-                return FALSE;
-            else
-                goto unload;
+    for (;;) {
+        if (!start_ready_plugins(ctx))
+            goto fail;
+
+        npending = nwaiting = 0;
+
+        mrp_list_foreach(&ctx->plugins, p, n) {
+            plugin = mrp_list_entry(p, typeof(*plugin), hook);
+
+            if (plugin->state == MRP_PLUGIN_STARTING)
+                npending++;
+            else if (plugin->state == MRP_PLUGIN_LOADED)
+                nwaiting++;
         }
 
-        if (!mrp_start_plugin(plugin)) {
-            if (!plugin->may_fail)
-                return FALSE;
-            else {
-            unload:
-                mrp_unload_plugin(plugin);
+        if (npending == 0)
+            break;
+
+        if (t == NULL && !expired)
+            t = mrp_add_timer(ctx->ml, START_TIMEOUT, start_timeout, &expired);
+
+        if (expired) {
+            t = NULL;
+
+            mrp_list_foreach(&ctx->plugins, p, n) {
+                plugin = mrp_list_entry(p, typeof(*plugin), hook);
+
+                if (plugin->state == MRP_PLUGIN_STARTING) {
+                    mrp_log_error("Plugin %s did not finish initializing in "
+                                  "%d seconds.", plugin->instance,
+                                  START_TIMEOUT / 1000);
+                    plugin->descriptor->exit(plugin);
+                    plugin->pending = FALSE;
+                    emit_plugin_event(PLUGIN_EVENT_FAILED, plugin);
+
+                    if (!start_failed(plugin))
+                        goto fail;
+                }
             }
+
+            expired = FALSE;
+            continue;
         }
 
-        /* XXX TODO: argh, ugly kludge for plugins loading plugins... */
-        if (plugin->hook.next != n)
-            n = plugin->hook.next;
+        mrp_debug("waiting for %d plugins to finish initializing", npending);
+        mrp_mainloop_iterate(ctx->ml);
+    }
+
+    mrp_del_timer(t);
+    t = NULL;
+
+    /* whatever is left waits for missing plugins or a dependency loop */
+    if (nwaiting > 0) {
+        mrp_list_foreach(&ctx->plugins, p, n) {
+            plugin = mrp_list_entry(p, typeof(*plugin), hook);
+
+            if (plugin->state != MRP_PLUGIN_LOADED)
+                continue;
+
+            check_dependencies(plugin, TRUE);
+            mrp_log_error("Failed to start plugin %s (%s), unresolvable "
+                          "dependencies.", plugin->instance,
+                          plugin->descriptor->name);
+
+            emit_plugin_event(PLUGIN_EVENT_FAILED, plugin);
+
+            if (!start_failed(plugin))
+                return FALSE;
+        }
     }
 
     return TRUE;
+
+ fail:
+    mrp_del_timer(t);
+    return FALSE;
+}
+
+
+static void plugin_ready(mrp_plugin_t *plugin)
+{
+    plugin->ready_usecs = time_now() - plugin->init_start;
+    plugin->state       = MRP_PLUGIN_RUNNING;
+
+    emit_plugin_event(PLUGIN_EVENT_STARTED, plugin);
 }
 
 
 int mrp_start_plugin(mrp_plugin_t *plugin)
 {
+    int success;
+
     if (plugin != NULL) {
         if (plugin->state == MRP_PLUGIN_LOADED) {
-            if (!plugin->descriptor->init(plugin)) {
+            plugin->state      = MRP_PLUGIN_STARTING;
+            plugin->pending    = FALSE;
+            plugin->init_start = time_now();
+
+            success = plugin->descriptor->init(plugin);
+
+            plugin->init_usecs = time_now() - plugin->init_start;
+
+            if (!success) {
                 mrp_log_error("Failed to start plugin %s (%s).",
                               plugin->instance, plugin->descriptor->name);
 
+                plugin->state   = MRP_PLUGIN_LOADED;
+                plugin->pending = FALSE;
                 emit_plugin_event(PLUGIN_EVENT_FAILED, plugin);
                 return FALSE;
             }
-            else {
-                plugin->state = MRP_PLUGIN_RUNNING;
-                emit_plugin_event(PLUGIN_EVENT_STARTED, plugin);
+
+            if (plugin->state == MRP_PLUGIN_FAILED)
+                return FALSE;
+
+            if (plugin->state == MRP_PLUGIN_STARTING) {
+                if (plugin->pending)
+                    mrp_log_info("Plugin %s initializing asynchronously.",
+                                 plugin->instance);
+                else
+                    plugin_ready(plugin);
             }
         }
 
@@ -501,6 +779,39 @@ int mrp_start_plugin(mrp_plugin_t *plugin)
 }
 
 
+void mrp_plugin_init_pending(mrp_plugin_t *plugin)
+{
+    if (plugin->state == MRP_PLUGIN_STARTING)
+        plugin->pending = TRUE;
+    else
+        mrp_log_error("Plugin %s is not being initialized.", plugin->instance);
+}
+
+
+void mrp_plugin_init_done(mrp_plugin_t *plugin, int success)
+{
+    if (plugin->state != MRP_PLUGIN_STARTING || !plugin->pending) {
+        mrp_log_error("Plugin %s has no pending initialization.",
+                      plugin->instance);
+        return;
+    }
+
+    plugin->pending = FALSE;
+
+    if (success) {
+        mrp_log_info("Plugin %s finished initializing.", plugin->instance);
+        plugin_ready(plugin);
+    }
+    else {
+        mrp_log_error("Failed to start plugin %s (%s).",
+                      plugin->instance, plugin->descriptor->name);
+
+        plugin->state = MRP_PLUGIN_FAILED;
+        emit_plugin_event(PLUGIN_EVENT_FAILED, plugin);
+    }
+}
+
+
 int mrp_stop_plugin(mrp_plugin_t *plugin)
 {
     if (plugin != NULL) {
@@ -219,6 +219,19 @@ struct mrp_plugin_arg_s {
     [idx] MRP_PLUGIN_ARG_##type(name, defval)
 
 
+/*
+ * plugin dependencies
+ *
+ * A plugin can declare the plugins (instances or plugin names) which
+ * need to be up and running before it can be started. Plugins without
+ * dependencies on each other are started independently, so asynchronous
+ * initializations of unrelated plugins can overlap.
+ */
+
+#define MRP_PLUGIN_DEPENDENCIES(table, ...)                              \
+    static const char *table[] = { __VA_ARGS__, NULL }
+
+
 /*
  * plugin API version
  */
@@ -265,6 +278,7 @@ typedef struct {
     int                  nexport;              /* number of exported methods */
     mrp_method_descr_t  *imports;              /* imported methods */
     int                  nimport;              /* number of imported methods */
+    const char         **depends;              /* plugins we depend on */
 } mrp_plugin_descr_t;
 
 
@@ -276,6 +290,8 @@ typedef enum {
     MRP_PLUGIN_LOADED = 0,                     /* has been loaded */
     MRP_PLUGIN_RUNNING,                        /* has been started */
     MRP_PLUGIN_STOPPED,                        /* has been stopped */
+    MRP_PLUGIN_STARTING,                       /* being (async) started */
+    MRP_PLUGIN_FAILED,                         /* async start failed */
 } mrp_plugin_state_t;
 
 struct mrp_plugin_s {
@@ -291,6 +307,11 @@ struct mrp_plugin_s {
     mrp_plugin_arg_t    *args;                 /* plugin arguments */
     mrp_console_group_t *cmds;                 /* default console commands */
     int                  may_fail : 1;         /* load / start may fail */
+    int                  pending : 1;          /* async init in progress */
+    uint64_t             load_usecs;           /* time spent loading */
+    uint64_t             init_usecs;           /* time spent in init */
+    uint64_t             ready_usecs;          /* time from init to ready */
+    uint64_t             init_start;           /* when init was started */
 };
 
 
@@ -311,7 +332,8 @@ struct mrp_plugin_s {
                                      _nexport,                            \
                                      _imports,                            \
                                      _nimport,                            \
-                                     _cmds)                               \
+                                     _cmds,                               \
+                                     _depends)                            \
                                                                           \
     static void register_plugin(void) __attribute__((constructor));       \
                                                                           \
@@ -336,6 +358,7 @@ struct mrp_plugin_s {
             .nexport     = _nexport,                                      \
             .imports     = _imports,                                      \
             .nimport     = _nimport,                                      \
+            .depends     = _depends,                                      \
         };                                                                \
                                                                           \
         if ((base = strrchr(path, '/')) != NULL)                          \
@@ -362,7 +385,8 @@ struct mrp_plugin_s {
                                      _nexport,                            \
                                      _imports,                            \
                                      _nimport,                            \
-                                     _cmds)                               \
+                                     _cmds,                               \
+                                     _depends)                            \
                                                                           \
     mrp_plugin_descr_t *mrp_get_plugin_descriptor(void) {                 \
         static mrp_plugin_descr_t descriptor = {                          \
@@ -384,6 +408,7 @@ struct mrp_plugin_s {
             .nexport     = _nexport,                                      \
             .imports     = _imports,                                      \
             .nimport     = _nimport,                                      \
+            .depends     = _depends,                                      \
         };                                                                \
                                                                           \
         return &descriptor;                                               \
@@ -401,7 +426,18 @@ struct mrp_plugin_s {
                              _args, _narg,                              \
                              _exports, _nexport,                        \
                              _imports, _nimport,                        \
-                             _cmds)
+                             _cmds, NULL)
+
+#define MURPHY_REGISTER_PLUGIN_DEPS(_n, _v, _d, _a, _h, _s, _i, _e,     \
+                                    _args, _narg,                       \
+                                    _exports, _nexport,                 \
+                                    _imports, _nimport,                 \
+                                    _cmds, _depends)                    \
+    __MURPHY_REGISTER_PLUGIN(_n, _v, _d, _a, _h, FALSE, _s, _i, _e,     \
+                             _args, _narg,                              \
+                             _exports, _nexport,                        \
+                             _imports, _nimport,                        \
+                             _cmds, _depends)
 
 #define MURPHY_REGISTER_CORE_PLUGIN(_n, _v, _d, _a, _h, _s, _i, _e,     \
                                     _args, _narg,                       \
@@ -412,9 +448,10 @@ struct mrp_plugin_s {
                              _args, _narg,                              \
                              _exports, _nexport,                        \
                              _imports, _nimport,                        \
-                             _cmds)
+                             _cmds, NULL)
 
 #define MRP_REGISTER_PLUGIN MURPHY_REGISTER_PLUGIN
+#define MRP_REGISTER_PLUGIN_DEPS MURPHY_REGISTER_PLUGIN_DEPS
 #define MRP_REGISTER_CORE_PLUGIN MURPHY_REGISTER_CORE_PLUGIN
 
 
@@ -428,6 +465,21 @@ int mrp_unload_plugin(mrp_plugin_t *plugin);
 int mrp_start_plugins(mrp_context_t *ctx);
 int mrp_start_plugin(mrp_plugin_t *plugin);
 int mrp_stop_plugin(mrp_plugin_t *plugin);
+
+/*
+ * asynchronous plugin initialization
+ *
+ * A plugin whose initialization involves waiting for something (D-Bus
+ * name acquisition, a server connection, etc.) can call
+ * mrp_plugin_init_pending() from its init function, return TRUE, and
+ * call mrp_plugin_init_done() once its initialization has completed
+ * or failed. Plugins depending on it are only started after that. On
+ * failure the plugin is expected to clean up after itself before
+ * calling mrp_plugin_init_done().
+ */
+
+void mrp_plugin_init_pending(mrp_plugin_t *plugin);
+void mrp_plugin_init_done(mrp_plugin_t *plugin, int success);
 int mrp_request_plugin(mrp_context_t *ctx, const char *name,
                        const char *instance);
 
@@ -0,0 +1,236 @@
+/*
+ * Copyright (c) 2012, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <murphy/common/macros.h>
+#include <murphy/common/log.h>
+#include <murphy/common/mainloop.h>
+#include <murphy/core/event.h>
+
+#define NEVENT 48                        /* events, more than 32 on purpose */
+
+#define fatal(fmt, args...) do {                \
+        mrp_log_error(fmt, ## args);            \
+        exit(1);                                \
+    } while (0)
+
+
+static int ids[NEVENT];
+static int counts[MRP_EVENT_MAX];
+static int last_value;
+
+
+static void count_cb(mrp_event_watch_t *w, int id, mrp_msg_t *data,
+                     void *user_data)
+{
+    MRP_UNUSED(w);
+    MRP_UNUSED(data);
+    MRP_UNUSED(user_data);
+
+    counts[id]++;
+}
+
+
+static void value_cb(mrp_event_watch_t *w, int id, mrp_msg_t *data,
+                     void *user_data)
+{
+    mrp_msg_field_t *f;
+
+    MRP_UNUSED(w);
+    MRP_UNUSED(user_data);
+
+    counts[id]++;
+
+    if (data != NULL && (f = mrp_msg_find(data, 1)) != NULL)
+        last_value = f->u32;
+}
+
+
+static void delete_cb(mrp_event_watch_t *w, int id, mrp_msg_t *data,
+                      void *user_data)
+{
+    mrp_event_watch_t **other = (mrp_event_watch_t **)user_data;
+
+    MRP_UNUSED(w);
+    MRP_UNUSED(data);
+
+    counts[id]++;
+
+    mrp_del_event_watch(*other);
+}
+
+
+static void register_events(void)
+{
+    char name[32];
+    int  i;
+
+    for (i = 0; i < NEVENT; i++) {
+        snprintf(name, sizeof(name), "test-event-%d", i);
+
+        if ((ids[i] = mrp_register_event(name)) == MRP_EVENT_UNKNOWN)
+            fatal("failed to register event %s", name);
+    }
+}
+
+
+static void check_masks(void)
+{
+    mrp_event_watch_t *w;
+    mrp_event_mask_t   mask;
+    int                i;
+
+    /* a single high event, and every event, the odd ones twice */
+    mrp_set_events(&mask, ids[NEVENT - 1], MRP_EVENT_UNKNOWN);
+    mrp_add_event_watch(&mask, count_cb, NULL);
+
+    mrp_reset_event_mask(&mask);
+    for (i = 0; i < NEVENT; i++)
+        mrp_add_event(&mask, ids[i]);
+    mrp_add_event_watch(&mask, count_cb, NULL);
+
+    mrp_reset_event_mask(&mask);
+    for (i = 1; i < NEVENT; i += 2)
+        mrp_add_event(&mask, ids[i]);
+    w = mrp_add_event_watch(&mask, count_cb, NULL);
+
+    for (i = 0; i < NEVENT; i++)
+        mrp_emit_event(ids[i], MRP_MSG_END);
+
+    for (i = 0; i < NEVENT; i++) {
+        if (counts[ids[i]] != 1 + (i & 1) + (i == NEVENT - 1))
+            fatal("event %d delivered %d times", ids[i], counts[ids[i]]);
+    }
+
+    mrp_del_event_watch(w);
+    memset(counts, 0, sizeof(counts));
+
+    for (i = 0; i < NEVENT; i++)
+        mrp_emit_event(ids[i], MRP_MSG_END);
+
+    for (i = 0; i < NEVENT; i++) {
+        if (counts[ids[i]] != 1 + (i == NEVENT - 1))
+            fatal("event %d delivered %d times after delete", ids[i],
+                  counts[ids[i]]);
+    }
+
+    printf("event masks: OK\n");
+}
+
+
+static void check_delete(void)
+{
+    mrp_event_watch_t *w1, *w2, *w3;
+    mrp_event_mask_t   mask;
+
+    /* a callback deleting a later watch must suppress its delivery */
+    mrp_set_events(&mask, ids[0], ids[1], MRP_EVENT_UNKNOWN);
+    w1 = mrp_add_event_watch(&mask, delete_cb, &w2);
+    w2 = mrp_add_event_watch(&mask, count_cb, NULL);
+    w3 = mrp_add_event_watch(&mask, count_cb, NULL);
+
+    memset(counts, 0, sizeof(counts));
+    mrp_emit_event(ids[1], MRP_MSG_END);
+
+    /* delete_cb, the all-events watch from check_masks and w3 */
+    if (counts[ids[1]] != 3)
+        fatal("event delivered %d times instead of 3", counts[ids[1]]);
+
+    mrp_del_event_watch(w1);
+    mrp_del_event_watch(w3);
+
+    printf("delete during emit: OK\n");
+}
+
+
+static void check_queue(mrp_mainloop_t *ml)
+{
+    mrp_event_watch_t *w;
+    mrp_event_mask_t   mask;
+    int                i;
+
+    mrp_set_event_mainloop(ml);
+    mrp_set_event_flags(ids[2], MRP_EVENT_FLAG_COALESCE);
+
+    mrp_set_events(&mask, ids[2], ids[3], MRP_EVENT_UNKNOWN);
+    w = mrp_add_event_watch(&mask, value_cb, NULL);
+
+    memset(counts, 0, sizeof(counts));
+
+    for (i = 1; i <= 10; i++) {
+        mrp_queue_event(ids[2], 1, MRP_MSG_FIELD_UINT32, i, MRP_MSG_END);
+        mrp_queue_event(ids[3], MRP_MSG_END);
+    }
+
+    if (counts[ids[2]] != 0 || counts[ids[3]] != 0)
+        fatal("queued events delivered synchronously");
+
+    mrp_mainloop_iterate(ml);
+
+    /* the watch for all events from check_masks gets them too */
+    if (counts[ids[2]] != 2 || last_value != 10)
+        fatal("coalescing event delivered %d times, last value %d",
+              counts[ids[2]], last_value);
+
+    if (counts[ids[3]] != 20)
+        fatal("queued event delivered %d times instead of 20",
+              counts[ids[3]]);
+
+    mrp_del_event_watch(w);
+    mrp_set_event_mainloop(NULL);
+
+    printf("queued events: OK\n");
+}
+
+
+int main(int argc, char *argv[])
+{
+    mrp_mainloop_t *ml;
+
+    MRP_UNUSED(argc);
+    MRP_UNUSED(argv);
+
+    mrp_log_set_mask(MRP_LOG_UPTO(MRP_LOG_WARNING));
+    mrp_log_set_target(MRP_LOG_TO_STDOUT);
+
+    if ((ml = mrp_mainloop_create()) == NULL)
+        fatal("failed to create mainloop");
+
+    register_events();
+    check_masks();
+    check_delete();
+    check_queue(ml);
+
+    mrp_mainloop_destroy(ml);
+
+    return 0;
+}
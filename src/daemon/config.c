@@ -69,12 +69,19 @@ static void print_usage(const char *argv0, int exit_code, const char *fmt, ...)
            "      The default plugin directory is '%s'.\n"
            "  -t, --log-target=TARGET        log target to use\n"
            "      TARGET is one of stderr,stdout,syslog, or a logfile path\n"
+           "      prefix TARGET with async: to log from a separate thread\n"
            "  -l, --log-level=LEVELS         logging level to use\n"
            "      LEVELS is a comma separated list of info, error and warning\n"
            "  -v, --verbose                  increase logging verbosity\n"
            "  -d, --debug                    enable given debug confguration\n"
            "  -D, --list-debug               list known debug sites\n"
+           "  -T, --trace[=PATH]             record debug messages to a binary\n"
+           "      trace buffer (by default /dev/shm/murphy-trace.<pid>)\n"
            "  -f, --foreground               don't daemonize\n"
+           "  -s, --slow-callbacks=USECS     profile mainloop callbacks and\n"
+           "      warn about the ones taking longer than USECS to run\n"
+           "  -S, --startup-profile          report the time spent in each\n"
+           "      startup phase and in loading and starting each plugin\n"
            "  -h, --help                     show help on usage\n"
            "  -q, --query-plugins            show detailed information about\n"
            "                                 all the available plugins\n",
@@ -183,7 +190,7 @@ static void config_set_defaults(mrp_context_t *ctx)
 
 void mrp_parse_cmdline(mrp_context_t *ctx, int argc, char **argv)
 {
-#   define OPTIONS "c:C:l:t:fP:a:vd:DhHq"
+#   define OPTIONS "c:C:l:t:fs:SP:a:vd:DT::hHq"
     struct option options[] = {
         { "config-file"  , required_argument, NULL, 'c' },
         { "config-dir"   , required_argument, NULL, 'C' },
@@ -193,20 +200,28 @@ void mrp_parse_cmdline(mrp_context_t *ctx, int argc, char **argv)
         { "verbose"      , optional_argument, NULL, 'v' },
         { "debug"        , required_argument, NULL, 'd' },
         { "list-debug"   , no_argument      , NULL, 'D' },
+        { "trace"        , optional_argument, NULL, 'T' },
         { "foreground"   , no_argument      , NULL, 'f' },
+        { "slow-callbacks", required_argument, NULL, 's' },
+        { "startup-profile", no_argument    , NULL, 'S' },
         { "help"         , no_argument      , NULL, 'h' },
         { "more-help"    , no_argument      , NULL, 'H' },
         { "query-plugins", no_argument      , NULL, 'q' },
         { NULL, 0, NULL, 0 }
     };
 
-    int opt, help;
+    int   opt, help, debug, trace;
+    long  usecs;
+    char *end, *trace_path;
 
     config_set_defaults(ctx);
     mrp_log_set_mask(ctx->log_mask);
     mrp_log_set_target(ctx->log_target);
 
-    help = FALSE;
+    help       = FALSE;
+    debug      = FALSE;
+    trace      = FALSE;
+    trace_path = NULL;
 
     while ((opt = getopt_long(argc, argv, OPTIONS, options, NULL)) != -1) {
         switch (opt) {
@@ -244,6 +259,12 @@ void mrp_parse_cmdline(mrp_context_t *ctx, int argc, char **argv)
             ctx->log_mask |= MRP_LOG_MASK_DEBUG;
             mrp_debug_set_config(optarg);
             mrp_debug_enable(TRUE);
+            debug = TRUE;
+            break;
+
+        case 'T':
+            trace      = TRUE;
+            trace_path = optarg;
             break;
 
         case 'D':
@@ -256,6 +277,21 @@ void mrp_parse_cmdline(mrp_context_t *ctx, int argc, char **argv)
             ctx->foreground = TRUE;
             break;
 
+        case 's':
+            usecs = strtol(optarg, &end, 10);
+            if (*end || end == optarg || usecs <= 0)
+                print_usage(argv[0], EINVAL, "invalid slow callback "
+                            "threshold '%s'", optarg);
+            else {
+                mrp_mainloop_profile(ctx->ml, TRUE);
+                mrp_mainloop_set_slow_threshold(ctx->ml, (unsigned int)usecs);
+            }
+            break;
+
+        case 'S':
+            ctx->startup_profile = TRUE;
+            break;
+
         case 'h':
             help++;
             break;
@@ -280,6 +316,14 @@ void mrp_parse_cmdline(mrp_context_t *ctx, int argc, char **argv)
         exit(0);
     }
 
+    if (trace) {
+        if (mrp_debug_trace_start(trace_path, 0) < 0)
+            print_usage(argv[0], EINVAL, "failed to set up debug tracing");
+
+        if (!debug)
+            mrp_debug_set_config("*");
+        mrp_debug_enable(TRUE);
+    }
 }
 
 
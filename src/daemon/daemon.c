@@ -27,12 +27,19 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
 #include <signal.h>
 
 #include <murphy/common/macros.h>
 #include <murphy/common/log.h>
+#include <murphy/common/mm.h>
 #include <murphy/common/mainloop.h>
+#include <murphy/common/list.h>
 #include <murphy/common/utils.h>
 #include <murphy/core/context.h>
 #include <murphy/core/plugin.h>
@@ -71,6 +78,7 @@ static void signal_handler(mrp_sighandler_t *h, int signum, void *user_data)
 {
     mrp_mainloop_t *ml  = mrp_get_sighandler_mainloop(h);
     mrp_context_t  *ctx = (mrp_context_t *)user_data;
+    char            path[PATH_MAX];
 
     MRP_UNUSED(ctx);
 
@@ -84,10 +92,95 @@ static void signal_handler(mrp_sighandler_t *h, int signum, void *user_data)
         mrp_log_info("Got SIGTERM, stopping...");
         mrp_mainloop_quit(ml, 0);
         break;
+
+    case SIGUSR2:
+        if (mrp_mm_profile_snapshot(NULL, path, sizeof(path)) < 0)
+            mrp_log_error("Failed to save heap profile (%d: %s).",
+                          errno, strerror(errno));
+        else
+            mrp_log_info("Heap profile saved to %s.", path);
+        break;
     }
 }
 
 
+/*
+ * startup profiling
+ */
+
+#define STARTUP_PHASES 16                /* max. number of phases */
+
+typedef void (*startup_phase_t)(mrp_context_t *ctx);
+
+static struct {
+    uint64_t    start;                   /* startup timestamp */
+    int         nphase;                  /* number of phases */
+    struct {
+        const char *name;                /* phase name */
+        uint64_t    usecs;               /* time spent in phase */
+    } phases[STARTUP_PHASES];
+} startup;
+
+
+static uint64_t time_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+
+static void run_phase(mrp_context_t *ctx, const char *name,
+                      startup_phase_t phase)
+{
+    uint64_t start = time_now();
+
+    phase(ctx);
+
+    if (startup.nphase < STARTUP_PHASES) {
+        startup.phases[startup.nphase].name  = name;
+        startup.phases[startup.nphase].usecs = time_now() - start;
+        startup.nphase++;
+    }
+}
+
+
+static void print_startup_profile(mrp_context_t *ctx)
+{
+    mrp_list_hook_t *p, *n;
+    mrp_plugin_t    *plugin;
+    uint64_t         total;
+    int              i;
+
+    if (!ctx->startup_profile)
+        return;
+
+    total = time_now() - startup.start;
+
+    fprintf(stderr, "Startup profile (msecs):\n");
+
+    for (i = 0; i < startup.nphase; i++)
+        fprintf(stderr, "  %-24s %9.3f\n", startup.phases[i].name,
+                startup.phases[i].usecs / 1000.0);
+
+    fprintf(stderr, "\n  %-24s %9s %9s %9s\n", "plugin", "load", "init",
+            "ready");
+
+    mrp_list_foreach(&ctx->plugins, p, n) {
+        plugin = mrp_list_entry(p, typeof(*plugin), hook);
+
+        fprintf(stderr, "  %-24s %9.3f %9.3f %9.3f%s\n", plugin->instance,
+                plugin->load_usecs / 1000.0, plugin->init_usecs / 1000.0,
+                plugin->ready_usecs / 1000.0,
+                plugin->ready_usecs > plugin->init_usecs ? " (async)" : "");
+    }
+
+    fprintf(stderr, "\n  %-24s %9.3f\n", "time to ready", total / 1000.0);
+}
+
+
 static mrp_context_t *create_context(void)
 {
     mrp_context_t *ctx;
@@ -107,6 +200,9 @@ static void setup_signals(mrp_context_t *ctx)
 {
     mrp_add_sighandler(ctx->ml, SIGINT , signal_handler, ctx);
     mrp_add_sighandler(ctx->ml, SIGTERM, signal_handler, ctx);
+
+    if (mrp_mm_type() == MRP_MM_SAMPLE)
+        mrp_add_sighandler(ctx->ml, SIGUSR2, signal_handler, ctx);
 }
 
 
@@ -244,15 +340,18 @@ int main(int argc, char *argv[])
 {
     mrp_context_t *ctx;
 
+    startup.start = time_now();
+
     ctx = create_context();
 
     setup_signals(ctx);
-    create_ruleset(ctx);
+    run_phase(ctx, "create ruleset", create_ruleset);
     parse_cmdline(ctx, argc, argv);
-    load_configuration(ctx);
-    start_plugins(ctx);
-    load_ruleset(ctx);
-    prepare_ruleset(ctx);
+    run_phase(ctx, "load configuration", load_configuration);
+    run_phase(ctx, "start plugins", start_plugins);
+    run_phase(ctx, "load ruleset", load_ruleset);
+    run_phase(ctx, "prepare ruleset", prepare_ruleset);
+    print_startup_profile(ctx);
     setup_logging(ctx);
     daemonize(ctx);
     run_mainloop(ctx);
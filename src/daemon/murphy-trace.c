@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2012, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+
+#include <murphy/common/macros.h>
+#include <murphy/common/debug.h>
+
+/*
+ * murphy-trace: offline decoder for binary debug trace buffers
+ */
+
+static void print_usage(const char *argv0, int exit_code)
+{
+    printf("usage: %s [options] trace-file...\n\n"
+           "Decode binary debug trace buffers recorded by murphyd -T.\n\n"
+           "The possible options are:\n"
+           "  -n, --records=COUNT            decode only the last COUNT records\n"
+           "  -h, --help                     show help on usage\n",
+           argv0);
+
+    exit(exit_code);
+}
+
+
+int main(int argc, char *argv[])
+{
+#   define OPTIONS "n:h"
+    struct option options[] = {
+        { "records", required_argument, NULL, 'n' },
+        { "help"   , no_argument      , NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    int   opt, cnt, status, i;
+    char *end;
+
+    cnt = 0;
+
+    while ((opt = getopt_long(argc, argv, OPTIONS, options, NULL)) != -1) {
+        switch (opt) {
+        case 'n':
+            cnt = (int)strtol(optarg, &end, 10);
+            if (*end || end == optarg || cnt < 0) {
+                fprintf(stderr, "Invalid number of records '%s'.\n", optarg);
+                print_usage(argv[0], EINVAL);
+            }
+            break;
+
+        case 'h':
+            print_usage(argv[0], 0);
+            break;
+
+        default:
+            print_usage(argv[0], EINVAL);
+        }
+    }
+
+    if (optind >= argc)
+        print_usage(argv[0], EINVAL);
+
+    status = 0;
+
+    for (i = optind; i < argc; i++) {
+        if (argc - optind > 1)
+            printf("%s%s:\n", i > optind ? "\n" : "", argv[i]);
+
+        if (mrp_debug_trace_dump(stdout, argv[i], cnt) < 0) {
+            fprintf(stderr, "Failed to decode trace file %s (%d: %s).\n",
+                    argv[i], errno, strerror(errno));
+            status = 1;
+        }
+    }
+
+    return status;
+}
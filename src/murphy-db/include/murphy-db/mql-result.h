@@ -86,6 +86,12 @@ const char      *mql_result_rows_get_string(mql_result_t*, int,int, char*,int);
 int32_t          mql_result_rows_get_integer(mql_result_t *, int,int);
 uint32_t         mql_result_rows_get_unsigned(mql_result_t *, int,int);
 double           mql_result_rows_get_floating(mql_result_t *, int,int);
+int              mql_result_rows_get_row_size(mql_result_t *);
+int              mql_result_rows_get_column_descs(mql_result_t *,
+                                                  mqi_column_desc_t *, int);
+mql_result_t    *mql_result_rows_append(mql_result_t *, void *);
+int              mql_result_rows_replace(mql_result_t *, int, void *);
+int              mql_result_rows_remove(mql_result_t *, int);
 
 const char      *mql_result_string_get(mql_result_t *);
 
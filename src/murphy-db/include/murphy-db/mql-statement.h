@@ -62,6 +62,14 @@ mql_result_t *mql_exec_statement(mql_result_type_t, mql_statement_t *);
 int mql_bind_value(mql_statement_t *, int, mqi_data_type_t, ...);
 void mql_statement_free(mql_statement_t *);
 
+/*
+ * a hook called after every mql_exec_statement() with the type of the
+ * statement and its execution time in microseconds
+ */
+typedef void (*mql_exec_hook_t)(mql_statement_type_t, uint64_t, void *);
+
+void mql_set_exec_hook(mql_exec_hook_t, void *);
+
 
 #endif /* __MQL_STATEMENT_H__ */
 
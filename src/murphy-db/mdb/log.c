@@ -47,6 +47,8 @@
 #define LOG_STATISTICS
 #endif
 
+#define CHANGE_CACHE_MAX 256    /* max. number of recycled change records */
+
 #define LOG_COMMON_FIELDS   \
     mdb_dlist_t     vlink;  \
     mdb_dlist_t     hlink;  \
@@ -86,8 +88,12 @@ static tx_log_t *get_tx_log(uint32_t);
 static tbl_log_t *get_tbl_log(mdb_dlist_t *, mdb_dlist_t *, uint32_t,
                               mdb_table_t *);
 static void delete_tx_log(uint32_t);
+static change_t *new_change(void);
+static void delete_change(change_t *);
 
 static MDB_DLIST_HEAD(tx_head);
+static change_t *change_cache;   /* recycled change records */
+static int       change_cache_len;
 
 int mdb_log_create(mdb_table_t *tbl)
 {
@@ -121,10 +127,8 @@ int mdb_log_change(mdb_table_t    *tbl,
         return -1;
     }
 
-    if (!(change = calloc(1, sizeof(change_t)))) {
-        errno = ENOMEM;
+    if (!(change = new_change()))
         return -1;
-    }
 
     change->type    = type;
     change->colmask = colmask;
@@ -227,7 +231,7 @@ mdb_log_entry_t *mdb_log_transaction_iterate(uint32_t   depth,
 
             if (delete) {
                 MDB_DLIST_UNLINK(change_t, link, change);
-                free(change);
+                delete_change(change);
             }
 
             return entry;
@@ -329,7 +333,7 @@ mdb_log_entry_t *mdb_log_table_iterate(mdb_table_t  *tbl,
 
             if (delete) {
                 MDB_DLIST_UNLINK(change_t, link, change);
-                free(change);
+                delete_change(change);
             }
 
             return entry;
@@ -426,10 +430,8 @@ static tbl_log_t *get_tbl_log(mdb_dlist_t *vhead,
             log->table = tbl;
             MDB_DLIST_INIT(log->changes);
 
-            if (!(change = calloc(1, sizeof(change_t)))) {
-                errno = ENOMEM;
+            if (!(change = new_change()))
                 return NULL;
-            }
 
             change->type  = mdb_log_stamp;
             change->stamp = tbl->stamp++;
@@ -464,6 +466,38 @@ static void delete_tx_log(uint32_t depth)
         delete_log(log);
 }
 
+static change_t *new_change(void)
+{
+    change_t *change;
+
+    /*
+     * Change records are allocated and freed for every logged row
+     * operation, so recycle a bounded number of them instead of
+     * going through the heap for each one of them.
+     */
+
+    if ((change = change_cache)) {
+        change_cache = (change_t *)change->link.next;
+        change_cache_len--;
+        memset(change, 0, sizeof(change_t));
+    }
+    else if (!(change = calloc(1, sizeof(change_t))))
+        errno = ENOMEM;
+
+    return change;
+}
+
+static void delete_change(change_t *change)
+{
+    if (change_cache_len < CHANGE_CACHE_MAX) {
+        change->link.next = (mdb_dlist_t *)change_cache;
+        change_cache = change;
+        change_cache_len++;
+    }
+    else
+        free(change);
+}
+
 
 
 /*
@@ -645,6 +645,92 @@ double mql_result_rows_get_floating(mql_result_t *r, int colidx, int rowidx)
 }
 
 
+int mql_result_rows_get_row_size(mql_result_t *r)
+{
+    result_rows_t *rslt = (result_rows_t *)r;
+
+    MDB_CHECKARG(rslt && rslt->type == mql_result_rows, -1);
+
+    return rslt->rowsize;
+}
+
+int mql_result_rows_get_column_descs(mql_result_t      *r,
+                                     mqi_column_desc_t *cds,
+                                     int                ncd)
+{
+    result_rows_t *rslt = (result_rows_t *)r;
+    int i;
+
+    MDB_CHECKARG(rslt && rslt->type == mql_result_rows &&
+                 cds && ncd > rslt->ncol, -1);
+
+    for (i = 0;  i < rslt->ncol;  i++) {
+        cds[i].cindex = rslt->cols[i].cindex;
+        cds[i].offset = rslt->cols[i].offset;
+    }
+
+    cds[i].cindex = -1;
+    cds[i].offset = -1;
+
+    return rslt->ncol;
+}
+
+mql_result_t *mql_result_rows_append(mql_result_t *r, void *row)
+{
+    result_rows_t *rslt = (result_rows_t *)r;
+    size_t         offs;
+    size_t         size;
+
+    MDB_CHECKARG(rslt && rslt->type == mql_result_rows && row, NULL);
+
+    offs = sizeof(column_desc_t) * rslt->ncol;
+    size = sizeof(result_rows_t) + offs + rslt->rowsize * (rslt->nrow + 1);
+
+    if (!(rslt = realloc(rslt, size))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    rslt->data = rslt->cols + rslt->ncol;
+
+    memcpy(rslt->data + rslt->rowsize * rslt->nrow, row, rslt->rowsize);
+    rslt->nrow++;
+
+    return (mql_result_t *)rslt;
+}
+
+int mql_result_rows_replace(mql_result_t *r, int rowidx, void *row)
+{
+    result_rows_t *rslt = (result_rows_t *)r;
+
+    MDB_CHECKARG(rslt && rslt->type == mql_result_rows &&
+                 rowidx >= 0 && rowidx < rslt->nrow && row, -1);
+
+    memcpy(rslt->data + rslt->rowsize * rowidx, row, rslt->rowsize);
+
+    return 0;
+}
+
+int mql_result_rows_remove(mql_result_t *r, int rowidx)
+{
+    result_rows_t *rslt = (result_rows_t *)r;
+    int            last;
+
+    MDB_CHECKARG(rslt && rslt->type == mql_result_rows &&
+                 rowidx >= 0 && rowidx < rslt->nrow, -1);
+
+    /* the last row takes the place of the removed one */
+    if (rowidx != (last = rslt->nrow - 1)) {
+        memcpy(rslt->data + rslt->rowsize * rowidx,
+               rslt->data + rslt->rowsize * last, rslt->rowsize);
+    }
+
+    rslt->nrow--;
+
+    return 0;
+}
+
+
 mql_result_t *mql_result_string_create_table_list(int n, char **names)
 {
     static const char *no_tables = "no tables\n";
@@ -33,6 +33,7 @@
 #include <stdarg.h>
 #include <alloca.h>
 #include <errno.h>
+#include <time.h>
 
 #include <murphy-db/assert.h>
 #include <murphy-db/mql.h>
@@ -132,6 +133,9 @@ static int bind_delete_value(delete_statement_t *,int,mqi_data_type_t,va_list);
 static int bind_select_value(select_statement_t *,int,mqi_data_type_t,va_list);
 static int bind_value(value_t *, mqi_data_type_t, va_list);
 
+static mql_exec_hook_t  exec_hook;
+static void            *exec_hook_data;
+
 mql_statement_t *mql_make_show_tables_statement(uint32_t flags)
 {
     shtable_statement_t *st;
@@ -505,12 +509,32 @@ mql_bind_value(mql_statement_t *s, int id, mqi_data_type_t type, ...)
     return sts;
 }
 
+void mql_set_exec_hook(mql_exec_hook_t hook, void *user_data)
+{
+    exec_hook      = hook;
+    exec_hook_data = user_data;
+}
+
+
+static uint64_t exec_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+
 mql_result_t *mql_exec_statement(mql_result_type_t type, mql_statement_t *s)
 {
     mql_result_t *result;
+    uint64_t      start;
 
     MDB_CHECKARG(s, NULL);
 
+    start = exec_hook ? exec_time() : 0;
+
     switch (s->type) {
 
     case mql_statement_show_tables:
@@ -555,6 +579,9 @@ mql_result_t *mql_exec_statement(mql_result_type_t type, mql_statement_t *s)
         break;
     }
 
+    if (exec_hook)
+        exec_hook(s->type, exec_time() - start, exec_hook_data);
+
     return result;
 }
 
@@ -475,6 +475,61 @@ START_TEST(exec_precompiled_full_select_from_persons)
 }
 END_TEST
 
+START_TEST(patch_full_select_result)
+{
+    mqi_column_desc_t cds[4];
+    mql_result_t *r;
+    uint8_t row[256];
+    int rowsize;
+    int n;
+
+    PREREQUISITE(precompile_full_person_select);
+
+    r = mql_exec_statement(mql_result_rows, persons.full_select);
+
+    fail_unless(mql_result_is_success(r), "exec error: %s",
+                mql_result_error_get_message(r));
+
+    fail_unless(mql_result_rows_get_column_descs(r, cds, 4) == 3,
+                "column description error");
+    fail_unless(cds[3].cindex == -1, "unterminated column description");
+
+    rowsize = mql_result_rows_get_row_size(r);
+    fail_unless(rowsize > 0 && rowsize <= (int)sizeof(row),
+                "invalid row size %d", rowsize);
+
+    n = mql_result_rows_get_row_count(r);
+
+    /* append a row, then let it take the place of the first one */
+    memset(row, 0, sizeof(row));
+
+    *(uint32_t *)(row + cds[0].offset) = 4242;
+    *(const char **)(row + cds[1].offset) = "Donald";
+    *(const char **)(row + cds[2].offset) = "Duck";
+
+    r = mql_result_rows_append(r, row);
+
+    fail_unless(r != NULL, "append failed (%s)", strerror(errno));
+    fail_unless(mql_result_rows_get_row_count(r) == n + 1,
+                "row count mismatch after append");
+    fail_unless(mql_result_rows_get_unsigned(r, 0, n) == 4242,
+                "appended row mismatch");
+
+    fail_unless(mql_result_rows_remove(r, 0) == 0, "remove failed");
+    fail_unless(mql_result_rows_get_row_count(r) == n,
+                "row count mismatch after remove");
+    fail_unless(!strcmp(mql_result_rows_get_string(r, 2, 0, NULL, 0), "Duck"),
+                "last row did not replace the removed one");
+
+    *(uint32_t *)(row + cds[0].offset) = 4343;
+    fail_unless(mql_result_rows_replace(r, 0, row) == 0, "replace failed");
+    fail_unless(mql_result_rows_get_unsigned(r, 0, 0) == 4343,
+                "replaced row mismatch");
+
+    mql_result_free(r);
+}
+END_TEST
+
 START_TEST(exec_precompiled_update_persons)
 {
     static uint32_t    id         = 2000;
@@ -895,6 +950,7 @@ static TCase *basic_tests(void)
     tcase_add_test(tc, precompile_delete_from_persons);
     tcase_add_test(tc, precompile_insert_into_persons);
     tcase_add_test(tc, exec_precompiled_filtered_select_from_persons);
+    tcase_add_test(tc, patch_full_select_result);
     tcase_add_test(tc, exec_precompiled_full_select_from_persons);
     tcase_add_test(tc, exec_precompiled_update_persons);
     tcase_add_test(tc, exec_precompiled_delete_from_persons);
@@ -151,6 +151,7 @@ struct pdp_s {
     const char      *address;            /* external transport address */
     mrp_transport_t *extt;               /* external transport */
     mrp_transport_t *wrtt;               /* WRT transport */
+    int              wrt_deflate;        /* WRT transport compression */
     mrp_transport_t *intt;               /* internal transport */
     mrp_list_hook_t  proxies;            /* list of enforcement points */
     mrp_list_hook_t  tables;             /* list of tables we track */
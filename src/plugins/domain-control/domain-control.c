@@ -44,7 +44,8 @@ static void destroy_transport(mrp_transport_t *t);
 
 pdp_t *create_domain_control(mrp_context_t *ctx,
                              const char *extaddr, const char *intaddr,
-                             const char *wrtaddr, const char *httpdir)
+                             const char *wrtaddr, const char *httpdir,
+                             int wrt_deflate)
 {
     pdp_t *pdp;
 
@@ -54,6 +55,8 @@ pdp_t *create_domain_control(mrp_context_t *ctx,
         pdp->ctx     = ctx;
         pdp->address = extaddr;
 
+        pdp->wrt_deflate = wrt_deflate;
+
         if (init_proxies(pdp) && init_tables(pdp)) {
 
             if (extaddr && *extaddr)
@@ -526,6 +529,7 @@ static void wrt_recv_cb(mrp_transport_t *t, void *data, void *user_data)
 static mrp_transport_t *create_transport(pdp_t *pdp, const char *address)
 {
     static mrp_transport_evt_t msg_evt, wrt_evt;
+    static mrp_wsck_deflate_t  deflate;
 
     mrp_transport_evt_t *e;
     mrp_transport_t     *t;
@@ -566,6 +570,9 @@ static mrp_transport_t *create_transport(pdp_t *pdp, const char *address)
     t = mrp_transport_create(pdp->ctx->ml, type, e, pdp, flags);
 
     if (t != NULL) {
+        if (e == &wrt_evt && pdp->wrt_deflate)
+            mrp_transport_setopt(t, MRP_WSCK_OPT_DEFLATE, &deflate);
+
         if (mrp_transport_bind(t, &addr, alen) && mrp_transport_listen(t, 4))
             return t;
         else {
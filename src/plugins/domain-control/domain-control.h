@@ -34,7 +34,7 @@
 
 pdp_t *create_domain_control(mrp_context_t *ctx, const char *ext_addr,
                              const char *int_addr, const char *wrt_addr,
-                             const char *httpdir);
+                             const char *httpdir, int wrt_deflate);
 void destroy_domain_control(pdp_t *pdp);
 
 void schedule_notification(pdp_t *pdp);
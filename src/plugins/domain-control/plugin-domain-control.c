@@ -49,7 +49,8 @@ enum {
     ARG_EXTADDR,                         /* external transport address */
     ARG_INTADDR,                         /* internal transport address */
     ARG_WRTADDR,                         /* WRT transport address */
-    ARG_HTTPDIR                          /* content directory for HTTP */
+    ARG_HTTPDIR,                         /* content directory for HTTP */
+    ARG_WRTDEFLATE                       /* WRT transport compression */
 };
 
 
@@ -59,12 +60,13 @@ static int plugin_init(mrp_plugin_t *plugin)
     const char *intaddr = plugin->args[ARG_INTADDR].str;
     const char *wrtaddr = plugin->args[ARG_WRTADDR].str;
     const char *httpdir = plugin->args[ARG_HTTPDIR].str;
+    int         deflate = plugin->args[ARG_WRTDEFLATE].bln;
 
     plugin->data = create_domain_control(plugin->ctx,
                                          extaddr && *extaddr ? extaddr : NULL,
                                          intaddr && *intaddr ? intaddr : NULL,
                                          wrtaddr && *wrtaddr ? wrtaddr : NULL,
-                                         httpdir);
+                                         httpdir, deflate);
 
     return (plugin->data != NULL);
 }
@@ -114,7 +116,8 @@ static mrp_plugin_arg_t domctl_args[] = {
     MRP_PLUGIN_ARGIDX(ARG_EXTADDR, STRING, "external_address", DEFAULT_EXTADDR),
     MRP_PLUGIN_ARGIDX(ARG_INTADDR, STRING, "internal_address", NO_ADDR        ),
     MRP_PLUGIN_ARGIDX(ARG_WRTADDR, STRING, "wrt_address"     , NO_ADDR        ),
-    MRP_PLUGIN_ARGIDX(ARG_HTTPDIR, STRING, "httpdir", DEFAULT_HTTPDIR)
+    MRP_PLUGIN_ARGIDX(ARG_HTTPDIR, STRING, "httpdir", DEFAULT_HTTPDIR),
+    MRP_PLUGIN_ARGIDX(ARG_WRTDEFLATE, BOOL, "wrt_deflate", FALSE)
 };
 
 MURPHY_REGISTER_PLUGIN("domain-control",
@@ -28,27 +28,204 @@
  */
 
 #include <errno.h>
+#include <string.h>
+#include <limits.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
 #include <murphy/common/macros.h>
+#include <murphy/common/mm.h>
+#include <murphy/common/file-utils.h>
 #include <murphy/core/plugin.h>
 #include <murphy/core/lua-bindings/murphy.h>
 
 #define LUAR_INTERPRETER_NAME "lua"
 
+#define CACHE_MAGIC   "MRPLUAC"          /* bytecode cache magic */
+#define CACHE_VERSION 2                  /* bytecode cache format version */
+#define CACHE_SUFFIX  ".cache"           /* bytecode cache suffix */
+
+/*
+ * bytecode cache header, followed by the lua_dump'ed chunk
+ */
+
+typedef struct {
+    char     magic[8];                   /* CACHE_MAGIC */
+    uint32_t version;                    /* CACHE_VERSION */
+    uint32_t lua;                        /* LUA_VERSION_NUM */
+    uint64_t size;                       /* size of the source */
+    uint64_t hash;                       /* content hash of the source */
+    uint64_t code;                       /* content hash of the bytecode */
+} cache_hdr_t;
+
+typedef struct {
+    char   *data;                        /* dump buffer */
+    size_t  size;                        /* allocated size */
+    size_t  used;                        /* amount of data */
+} dump_buf_t;
+
 
 enum {
     ARG_CONFIG,                          /* configuration file */
     ARG_RESOLVER,                        /* enable resolver lua support */
+    ARG_CACHE,                           /* enable config bytecode cache */
 };
 
 
-static int load_config(lua_State *L, const char *path)
+/*
+ * Compiled configuration caching. On a warm start we load the chunk
+ * from the bytecode dumped next to the configuration file, provided
+ * that the content hash and size of the source still match and that
+ * the cache file can be trusted as much as the configuration itself.
+ * Files the configuration loads itself are not cached.
+ */
+
+static int load_cached(lua_State *L, const char *path, const char *chunk,
+                       uint64_t hash, size_t size)
+{
+    cache_hdr_t *hdr;
+    char        *data;
+    size_t       len;
+    int          status;
+
+    if ((data = mrp_read_trusted_file(path, &len)) == NULL) {
+        if (errno == EPERM)
+            mrp_log_warning("plugin-lua: ignoring untrusted cache %s.", path);
+        return FALSE;
+    }
+
+    hdr    = (cache_hdr_t *)data;
+    status = FALSE;
+
+    /* lua does not verify bytecode, so check everything we can first */
+    if (len > sizeof(*hdr) &&
+        !memcmp(hdr->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) &&
+        hdr->version == CACHE_VERSION && hdr->lua == LUA_VERSION_NUM &&
+        hdr->size == size && hdr->hash == hash &&
+        hdr->code == mrp_hash_data(data + sizeof(*hdr), len - sizeof(*hdr))) {
+        if (!luaL_loadbuffer(L, data + sizeof(*hdr), len - sizeof(*hdr),
+                             chunk))
+            status = TRUE;
+        else {
+            mrp_debug("failed to load cached chunk (%s)", lua_tostring(L, -1));
+            lua_pop(L, 1);
+        }
+    }
+
+    mrp_free(data);
+
+    return status;
+}
+
+
+static int dump_chunk(lua_State *L, const void *p, size_t size, void *data)
+{
+    dump_buf_t *buf = (dump_buf_t *)data;
+    size_t      need;
+
+    MRP_UNUSED(L);
+
+    need = buf->used + size;
+
+    if (need > buf->size) {
+        if (buf->size == 0)
+            buf->size = 16 * 1024;
+        while (buf->size < need)
+            buf->size *= 2;
+
+        if (mrp_realloc(buf->data, buf->size) == NULL)
+            return -1;
+    }
+
+    memcpy(buf->data + buf->used, p, size);
+    buf->used += size;
+
+    return 0;
+}
+
+
+static void save_cached(lua_State *L, const char *path, uint64_t hash,
+                        size_t size)
+{
+    dump_buf_t  buf;
+    cache_hdr_t hdr;
+
+    mrp_clear(&hdr);
+    mrp_clear(&buf);
+
+    memcpy(hdr.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    hdr.version = CACHE_VERSION;
+    hdr.lua     = LUA_VERSION_NUM;
+    hdr.size    = size;
+    hdr.hash    = hash;
+
+    if (dump_chunk(L, &hdr, sizeof(hdr), &buf) < 0 ||
+        lua_dump(L, dump_chunk, &buf) != 0) {
+        mrp_debug("failed to dump bytecode for cache %s", path);
+        goto out;
+    }
+
+    ((cache_hdr_t *)buf.data)->code = mrp_hash_data(buf.data + sizeof(hdr),
+                                                    buf.used - sizeof(hdr));
+
+    if (mrp_write_file(path, buf.data, buf.used))
+        mrp_debug("saved bytecode cache %s (%zu bytes)", path, buf.used);
+    else
+        mrp_debug("failed to save bytecode cache %s", path);
+
+ out:
+
+    mrp_free(buf.data);
+}
+
+
+static int load_chunk(lua_State *L, const char *path, int cache)
+{
+    char      chunk[PATH_MAX + 1], cpath[PATH_MAX], *src, *p;
+    size_t    size;
+    uint64_t  hash;
+    int       status;
+
+    if (!cache)
+        return luaL_loadfile(L, path);
+
+    if ((src = mrp_read_file(path, &size)) == NULL)
+        return luaL_loadfile(L, path);
+
+    snprintf(chunk, sizeof(chunk), "@%s", path);
+    hash = mrp_hash_data(src, size);
+
+    if (snprintf(cpath, sizeof(cpath), "%s%s", path,
+                 CACHE_SUFFIX) >= (int)sizeof(cpath))
+        cache = FALSE;
+
+    if (cache && load_cached(L, cpath, chunk, hash, size)) {
+        mrp_log_info("plugin-lua: loaded %s from bytecode cache.", path);
+        mrp_free(src);
+        return 0;
+    }
+
+    /* blank out any leading #! line, like luaL_loadfile skips it */
+    if (*src == '#')
+        for (p = src; *p && *p != '\n'; p++)
+            *p = ' ';
+
+    status = luaL_loadbuffer(L, src, size, chunk);
+
+    if (status == 0 && cache)
+        save_cached(L, cpath, hash, size);
+
+    mrp_free(src);
+
+    return status;
+}
+
+
+static int load_config(lua_State *L, const char *path, int cache)
 {
-    if (!luaL_loadfile(L, path) && !lua_pcall(L, 0, 0, 0))
+    if (!load_chunk(L, path, cache) && !lua_pcall(L, 0, 0, 0))
         return TRUE;
     else {
         mrp_log_error("plugin-lua: failed to load config file %s.", path);
@@ -140,6 +317,7 @@ static int plugin_init(mrp_plugin_t *plugin)
     mrp_plugin_arg_t *args = plugin->args;
     const char       *cfg  = args[ARG_CONFIG].str;
     int               res  = args[ARG_RESOLVER].bln;
+    int               bc   = args[ARG_CACHE].bln;
     lua_State        *L;
 
     L = mrp_lua_set_murphy_context(plugin->ctx);
@@ -157,7 +335,7 @@ static int plugin_init(mrp_plugin_t *plugin)
         else
             mrp_log_info("plugin-lua: resolver Lua support disabled.");
 
-        if (load_config(L, cfg))
+        if (load_config(L, cfg, bc))
             return TRUE;
         else
             if (res)
@@ -187,6 +365,7 @@ static void plugin_exit(mrp_plugin_t *plugin)
 static mrp_plugin_arg_t plugin_args[] = {
     MRP_PLUGIN_ARGIDX(ARG_CONFIG  , STRING,  "config",  DEFAULT_CONFIG),
     MRP_PLUGIN_ARGIDX(ARG_RESOLVER, BOOL  , "resolver",TRUE),
+    MRP_PLUGIN_ARGIDX(ARG_CACHE   , BOOL  , "cache"   , TRUE),
 };
 
 MURPHY_REGISTER_PLUGIN("lua",
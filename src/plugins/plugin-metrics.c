@@ -0,0 +1,462 @@
+/*
+ * Copyright (c) 2012, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include <murphy/common/macros.h>
+#include <murphy/common/mm.h>
+#include <murphy/common/log.h>
+#include <murphy/common/debug.h>
+#include <murphy/common/metrics.h>
+#include <murphy/common/transport.h>
+#include <murphy/common/wsck-transport.h>
+#include <murphy/core/plugin.h>
+
+#include <murphy-db/mqi.h>
+
+/*
+ * Serve the runtime metrics registry (and a few murphy-db statistics)
+ * over HTTP in the Prometheus text exposition format.
+ *
+ * The response is generated into a single buffer that is reused for
+ * every request. The buffer grows as needed but is never shrunk, so
+ * once it has reached its steady-state size generating a response
+ * does not allocate memory.
+ */
+
+#define DEFAULT_ADDRESS "wsck:127.0.0.1:9464/murphy-metrics"
+#define DEFAULT_URI     "/metrics"
+#define METRIC_PREFIX   "murphy_"
+#define CONTENT_TYPE    "text/plain; version=0.0.4"
+#define BUFFER_MIN      16384            /* initial output buffer size */
+#define TABLE_MAX       512              /* max. number of tables shown */
+
+/*
+ * plugin argument indices
+ */
+
+enum {
+    ARG_ADDRESS,                         /* transport address to use */
+    ARG_URI,                             /* URI to serve metrics at */
+};
+
+
+/*
+ * plugin runtime data
+ */
+
+typedef struct {
+    mrp_context_t      *ctx;             /* murphy context */
+    const char         *addr;            /* address we listen on */
+    mrp_transport_t    *lt;              /* transport we listen on */
+    mrp_wsck_urigen_t   uris[2];         /* URI generator table */
+    char               *buf;             /* output buffer */
+    size_t              size;            /* output buffer size */
+    size_t              len;             /* amount of output */
+    int                 failed;          /* output buffer overflowed */
+    const char         *family;          /* name of last metric family */
+    mrp_metric_value_t  v;               /* metric being formatted */
+} metrics_t;
+
+
+static void output(metrics_t *m, const char *fmt, ...)
+{
+    va_list  ap;
+    size_t   size;
+    char    *buf;
+    int      n;
+
+    if (m->failed)
+        return;
+
+    for (;;) {
+        va_start(ap, fmt);
+        n = vsnprintf(m->buf + m->len, m->size - m->len, fmt, ap);
+        va_end(ap);
+
+        if (n < 0) {
+            m->failed = TRUE;
+            return;
+        }
+
+        if (m->len + n < m->size) {
+            m->len += n;
+            return;
+        }
+
+        size = 2 * m->size;
+
+        while (size <= m->len + n)
+            size *= 2;
+
+        if ((buf = mrp_realloc(m->buf, size)) == NULL) {
+            m->failed = TRUE;
+            return;
+        }
+
+        m->buf  = buf;
+        m->size = size;
+    }
+}
+
+
+static void output_labels(metrics_t *m, const char *label, const char *extra)
+{
+    const char *p, *eq, *end;
+    int         n;
+
+    if (label == NULL && extra == NULL)
+        return;
+
+    output(m, "{");
+    n = 0;
+
+    /* a label is a list of comma-separated key=value pairs */
+    for (p = label; p != NULL && *p; p = *end ? end + 1 : end) {
+        end = strchr(p, ',');
+
+        if (end == NULL)
+            end = p + strlen(p);
+
+        eq = memchr(p, '=', end - p);
+
+        if (eq == NULL)
+            continue;
+
+        output(m, "%s%.*s=\"", n++ ? "," : "", (int)(eq - p), p);
+
+        for (eq++; eq < end; eq++) {
+            switch (*eq) {
+            case '"':  output(m, "\\\""); break;
+            case '\\': output(m, "\\\\"); break;
+            case '\n': output(m, "\\n");  break;
+            default:   output(m, "%c", *eq);
+            }
+        }
+
+        output(m, "\"");
+    }
+
+    if (extra != NULL)
+        output(m, "%s%s", n ? "," : "", extra);
+
+    output(m, "}");
+}
+
+
+static void output_histogram(metrics_t *m)
+{
+    mrp_metric_value_t *v = &m->v;
+    uint64_t            total;
+    char                le[32];
+    int                 i;
+
+    /*
+     * Notes:
+     *     We only report the buckets ending at powers of two. Every
+     *     fourth bucket ends at one of these so the cumulative counts
+     *     stay exact. The tail of empty buckets is trimmed off.
+     */
+
+    total = 0;
+
+    for (i = 0; i < MRP_METRIC_BUCKETS - 1; i++) {
+        total += v->buckets[i];
+
+        if ((i & 3) != 3)
+            continue;
+
+        snprintf(le, sizeof(le), "le=\"%llu\"",
+                 (unsigned long long)mrp_metric_bucket_limit(i));
+
+        output(m, METRIC_PREFIX"%s_bucket", v->name);
+        output_labels(m, v->label, le);
+        output(m, " %llu\n", (unsigned long long)total);
+
+        if (total >= v->count)
+            break;
+    }
+
+    output(m, METRIC_PREFIX"%s_bucket", v->name);
+    output_labels(m, v->label, "le=\"+Inf\"");
+    output(m, " %llu\n", (unsigned long long)v->count);
+
+    output(m, METRIC_PREFIX"%s_sum", v->name);
+    output_labels(m, v->label, NULL);
+    output(m, " %llu\n", (unsigned long long)v->sum);
+
+    output(m, METRIC_PREFIX"%s_count", v->name);
+    output_labels(m, v->label, NULL);
+    output(m, " %llu\n", (unsigned long long)v->count);
+}
+
+
+static int output_metric(mrp_metric_t *metric, void *user_data)
+{
+    static const char *types[] = {
+        [MRP_METRIC_COUNTER]   = "counter",
+        [MRP_METRIC_GAUGE]     = "gauge",
+        [MRP_METRIC_HISTOGRAM] = "histogram",
+    };
+
+    metrics_t          *m = (metrics_t *)user_data;
+    mrp_metric_value_t *v = &m->v;
+
+    mrp_metric_read(metric, v);
+
+    /* metrics of the same name come in a row, describe them only once */
+    if (m->family == NULL || strcmp(m->family, v->name)) {
+        output(m, "# HELP "METRIC_PREFIX"%s %s\n", v->name, v->help);
+        output(m, "# TYPE "METRIC_PREFIX"%s %s\n", v->name, types[v->type]);
+        m->family = v->name;
+    }
+
+    switch (v->type) {
+    case MRP_METRIC_COUNTER:
+        output(m, METRIC_PREFIX"%s", v->name);
+        output_labels(m, v->label, NULL);
+        output(m, " %llu\n", (unsigned long long)v->count);
+        break;
+
+    case MRP_METRIC_GAUGE:
+        output(m, METRIC_PREFIX"%s", v->name);
+        output_labels(m, v->label, NULL);
+        output(m, " %lld\n", (long long)v->value);
+        break;
+
+    case MRP_METRIC_HISTOGRAM:
+        output_histogram(m);
+        break;
+    }
+
+    return !m->failed;
+}
+
+
+static void output_tables(metrics_t *m)
+{
+    char         *names[TABLE_MAX];
+    mqi_handle_t  h;
+    int           n, i;
+
+    n = mqi_show_tables(MQI_ANY, names, TABLE_MAX);
+
+    if (n <= 0)
+        return;
+
+    output(m, "# HELP "METRIC_PREFIX"db_table_rows "
+           "number of rows in a database table\n");
+    output(m, "# TYPE "METRIC_PREFIX"db_table_rows gauge\n");
+
+    for (i = 0; i < n; i++) {
+        if ((h = mqi_get_table_handle(names[i])) == MQI_HANDLE_INVALID)
+            continue;
+
+        output(m, METRIC_PREFIX"db_table_rows{table=\"%s\"} %d\n",
+               names[i], mqi_get_table_size(h));
+    }
+
+    output(m, "# HELP "METRIC_PREFIX"db_table_stamp "
+           "modification stamp of a database table\n");
+    output(m, "# TYPE "METRIC_PREFIX"db_table_stamp gauge\n");
+
+    for (i = 0; i < n; i++) {
+        if ((h = mqi_get_table_handle(names[i])) == MQI_HANDLE_INVALID)
+            continue;
+
+        output(m, METRIC_PREFIX"db_table_stamp{table=\"%s\"} %u\n",
+               names[i], mqi_get_table_stamp(h));
+    }
+}
+
+
+static int generate_metrics(const char *uri, const char **data, size_t *size,
+                            void *user_data)
+{
+    metrics_t *m = (metrics_t *)user_data;
+
+    mrp_debug("generating metrics for URI '%s'", uri);
+
+    m->len    = 0;
+    m->failed = FALSE;
+    m->family = NULL;
+
+    mrp_metrics_foreach(output_metric, m);
+    output_tables(m);
+
+    if (m->failed) {
+        mrp_log_error("Failed to generate metrics.");
+        return FALSE;
+    }
+
+    *data = m->buf;
+    *size = m->len;
+
+    return TRUE;
+}
+
+
+static void connection_evt(mrp_transport_t *lt, void *user_data)
+{
+    mrp_transport_t *t;
+
+    MRP_UNUSED(user_data);
+
+    /* we only talk HTTP, refuse any websocket connections */
+    if ((t = mrp_transport_accept(lt, NULL, 0)) != NULL)
+        mrp_transport_destroy(t);
+
+    mrp_debug("rejected websocket connection on metrics transport");
+}
+
+
+static void closed_evt(mrp_transport_t *t, int error, void *user_data)
+{
+    MRP_UNUSED(t);
+    MRP_UNUSED(error);
+    MRP_UNUSED(user_data);
+}
+
+
+static void recv_evt(mrp_transport_t *t, void *data, void *user_data)
+{
+    MRP_UNUSED(t);
+    MRP_UNUSED(data);
+    MRP_UNUSED(user_data);
+}
+
+
+static int transport_create(metrics_t *m)
+{
+    static mrp_transport_evt_t evt = {
+        { .recvcustom     = recv_evt },
+        { .recvcustomfrom = NULL     },
+        .connection       = connection_evt,
+        .closed           = closed_evt,
+    };
+
+    mrp_sockaddr_t  addr;
+    socklen_t       len;
+    const char     *type;
+    int             flags;
+
+    len = mrp_transport_resolve(NULL, m->addr, &addr, sizeof(addr), &type);
+
+    if (len <= 0) {
+        mrp_log_error("Failed to resolve transport address '%s'.", m->addr);
+        return FALSE;
+    }
+
+    if (strcmp(type, "wsck")) {
+        mrp_log_error("Metrics can only be served over a wsck transport.");
+        return FALSE;
+    }
+
+    flags = MRP_TRANSPORT_REUSEADDR | MRP_TRANSPORT_MODE_CUSTOM;
+    m->lt = mrp_transport_create(m->ctx->ml, type, &evt, m, flags);
+
+    if (m->lt == NULL)
+        return FALSE;
+
+    if (mrp_transport_setopt(m->lt, MRP_WSCK_OPT_URIGEN, m->uris) &&
+        mrp_transport_bind(m->lt, &addr, len) &&
+        mrp_transport_listen(m->lt, 0)) {
+        mrp_log_info("Serving metrics on transport '%s'...", m->addr);
+        return TRUE;
+    }
+
+    mrp_transport_destroy(m->lt);
+    m->lt = NULL;
+
+    return FALSE;
+}
+
+
+static int plugin_init(mrp_plugin_t *plugin)
+{
+    metrics_t *m;
+
+    if ((m = mrp_allocz(sizeof(*m))) == NULL)
+        return FALSE;
+
+    m->ctx  = plugin->ctx;
+    m->addr = plugin->args[ARG_ADDRESS].str;
+    m->buf  = mrp_alloc(BUFFER_MIN);
+    m->size = BUFFER_MIN;
+
+    m->uris[0].uri       = plugin->args[ARG_URI].str;
+    m->uris[0].type      = CONTENT_TYPE;
+    m->uris[0].generate  = generate_metrics;
+    m->uris[0].user_data = m;
+
+    if (m->buf == NULL || !transport_create(m)) {
+        mrp_free(m->buf);
+        mrp_free(m);
+        return FALSE;
+    }
+
+    plugin->data = m;
+
+    return TRUE;
+}
+
+
+static void plugin_exit(mrp_plugin_t *plugin)
+{
+    metrics_t *m = (metrics_t *)plugin->data;
+
+    if (m != NULL) {
+        mrp_transport_destroy(m->lt);
+        mrp_free(m->buf);
+        mrp_free(m);
+    }
+}
+
+
+#define PLUGIN_DESCRIPTION "Runtime metrics exporter plugin."
+#define PLUGIN_HELP        "Serve runtime metrics over HTTP in Prometheus " \
+                           "text format."
+#define PLUGIN_AUTHORS     "Krisztian Litkey <kli@iki.fi>"
+#define PLUGIN_VERSION     MRP_VERSION_INT(0, 0, 1)
+
+static mrp_plugin_arg_t plugin_args[] = {
+    MRP_PLUGIN_ARGIDX(ARG_ADDRESS, STRING, "address", DEFAULT_ADDRESS),
+    MRP_PLUGIN_ARGIDX(ARG_URI    , STRING, "uri"    , DEFAULT_URI    ),
+};
+
+MURPHY_REGISTER_PLUGIN("metrics",
+                       PLUGIN_VERSION, PLUGIN_DESCRIPTION, PLUGIN_AUTHORS,
+                       PLUGIN_HELP, MRP_SINGLETON, plugin_init, plugin_exit,
+                       plugin_args, MRP_ARRAY_SIZE(plugin_args),
+                       NULL, 0,
+                       NULL, 0,
+                       NULL);
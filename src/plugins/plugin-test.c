@@ -38,6 +38,7 @@
 
 typedef struct {
     mrp_event_watch_t *w;
+    mrp_timer_t       *init;                  /* async init timer */
 } test_data_t;
 
 
@@ -51,6 +52,7 @@ enum {
     ARG_DOUBLE1,
     ARG_FAILINIT,
     ARG_FAILEXIT,
+    ARG_ASYNCINIT,
     ARG_OBJECT,
     ARG_REST,
 };
@@ -395,6 +397,18 @@ static void unsubscribe_events(mrp_plugin_t *plugin)
 }
 
 
+static void async_init_cb(mrp_timer_t *t, void *user_data)
+{
+    mrp_plugin_t *plugin = (mrp_plugin_t *)user_data;
+    test_data_t  *data   = (test_data_t *)plugin->data;
+
+    mrp_del_timer(t);
+    data->init = NULL;
+
+    mrp_plugin_init_done(plugin, !plugin->args[ARG_FAILINIT].bln);
+}
+
+
 static int test_init(mrp_plugin_t *plugin)
 {
     mrp_plugin_arg_t *args, *arg;
@@ -415,6 +429,7 @@ static int test_init(mrp_plugin_t *plugin)
     printf("  double:  %f\n", args[ARG_DOUBLE1].dbl);
     printf("init fail: %s\n", args[ARG_FAILINIT].bln ? "TRUE" : "FALSE");
     printf("exit fail: %s\n", args[ARG_FAILEXIT].bln ? "TRUE" : "FALSE");
+    printf("async init: %u msecs\n", args[ARG_ASYNCINIT].u32);
     printf("   object: %s\n", mrp_json_object_to_string(json));
 
     mrp_plugin_foreach_undecl_arg(&args[ARG_REST], arg) {
@@ -459,17 +474,34 @@ static int test_init(mrp_plugin_t *plugin)
 
     subscribe_events(plugin);
 
+    if (args[ARG_ASYNCINIT].u32 > 0) {
+        data->init = mrp_add_timer(plugin->ctx->ml, args[ARG_ASYNCINIT].u32,
+                                   async_init_cb, plugin);
+
+        if (data->init == NULL)
+            return FALSE;
+
+        mrp_plugin_init_pending(plugin);
+        return TRUE;
+    }
+
     return !args[ARG_FAILINIT].bln;
 }
 
 
 static void test_exit(mrp_plugin_t *plugin)
 {
+    test_data_t *data;
+
     mrp_log_info("%s() called for test instance '%s'...", __FUNCTION__,
                  plugin->instance);
 
     unsubscribe_events(plugin);
 
+    data = (test_data_t *)plugin->data;
+    mrp_del_timer(data->init);
+    data->init = NULL;
+
 #if 0
     release_methods(plugin);
     remove_methods(plugin);
@@ -503,6 +535,7 @@ static mrp_plugin_arg_t args[] = {
     MRP_PLUGIN_ARGIDX(ARG_DOUBLE1 , DOUBLE, "double"  , -3.141           ),
     MRP_PLUGIN_ARGIDX(ARG_FAILINIT, BOOL  , "failinit", FALSE            ),
     MRP_PLUGIN_ARGIDX(ARG_FAILEXIT, BOOL  , "failexit", FALSE            ),
+    MRP_PLUGIN_ARGIDX(ARG_ASYNCINIT, UINT32, "asyncinit", 0              ),
     MRP_PLUGIN_ARGIDX(ARG_OBJECT  , OBJECT, "object"  , DEFAULT_OBJECT   ),
     MRP_PLUGIN_ARGIDX(ARG_REST    , UNDECL, NULL      , NULL             ),
 };
@@ -377,6 +377,23 @@ mrp_res_string_array_t *class_query_response(mrp_msg_t *msg, void **pcursor)
 }
 
 
+uint32_t server_features(mrp_msg_t *msg, void **pcursor)
+{
+    uint16_t tag;
+    uint16_t type;
+    mrp_msg_value_t value;
+    size_t size;
+
+    /* older servers don't announce any features */
+
+    if (!mrp_msg_iterate(msg, pcursor, &tag, &type, &value, &size) ||
+        tag != RESPROTO_SERVER_FEATURES || type != MRP_MSG_FIELD_UINT32)
+        return 0;
+
+    return value.u32;
+}
+
+
 bool create_resource_set_response(mrp_msg_t *msg,
         mrp_res_resource_set_t *rset, void **pcursor)
 {
@@ -505,10 +522,11 @@ error:
 
 
 int create_resource_set_request(mrp_res_context_t *cx,
-        mrp_res_resource_set_t *rset)
+        mrp_res_resource_set_t *rset, bool acquire)
 {
     mrp_msg_t *msg = NULL;
     uint32_t i;
+    uint16_t reqtype;
 
     if (!cx || !rset)
         return -1;
@@ -518,12 +536,17 @@ int create_resource_set_request(mrp_res_context_t *cx,
 
     rset->priv->seqno = cx->priv->next_seqno;
 
+    /* a compound request creates and acquires the set in one go */
+    if (acquire)
+        reqtype = RESPROTO_CREATE_ACQUIRE_RESOURCE_SET;
+    else
+        reqtype = RESPROTO_CREATE_RESOURCE_SET;
 
     msg = mrp_msg_create(
             RESPROTO_SEQUENCE_NO, MRP_MSG_FIELD_UINT32, cx->priv->next_seqno++,
-            RESPROTO_REQUEST_TYPE, MRP_MSG_FIELD_UINT16,
-                    RESPROTO_CREATE_RESOURCE_SET,
-            RESPROTO_RESOURCE_FLAGS, MRP_MSG_FIELD_UINT32, 0,
+            RESPROTO_REQUEST_TYPE, MRP_MSG_FIELD_UINT16, reqtype,
+            RESPROTO_RESOURCE_FLAGS, MRP_MSG_FIELD_UINT32,
+                    RESPROTO_RSETFLAG_COALESCE,
             RESPROTO_RESOURCE_PRIORITY, MRP_MSG_FIELD_UINT32, 0,
             RESPROTO_CLASS_NAME, MRP_MSG_FIELD_STRING, rset->application_class,
             RESPROTO_ZONE_NAME, MRP_MSG_FIELD_STRING, cx->zone,
@@ -67,6 +67,8 @@ mrp_res_resource_set_t *resource_query_response(mrp_msg_t *msg,
 
 mrp_res_string_array_t *class_query_response(mrp_msg_t *msg, void **pcursor);
 
+uint32_t server_features(mrp_msg_t *msg, void **pcursor);
+
 bool create_resource_set_response(mrp_msg_t *msg,
         mrp_res_resource_set_t *rset, void **pcursor);
 
@@ -82,7 +84,7 @@ int release_resource_set_request(mrp_res_context_t *cx,
         mrp_res_resource_set_t *rset);
 
 int create_resource_set_request(mrp_res_context_t *cx,
-        mrp_res_resource_set_t *rset);
+        mrp_res_resource_set_t *rset, bool acquire);
 
 int get_application_classes_request(mrp_res_context_t *cx);
 
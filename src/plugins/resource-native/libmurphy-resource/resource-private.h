@@ -106,6 +106,9 @@ struct mrp_res_context_private_s {
     mrp_res_string_array_t *master_classes;
     mrp_res_resource_set_t *master_resource_set;
 
+    /* optional protocol features announced by the server */
+    uint32_t server_features;
+
     /* sometimes we need to know which query was answered */
     uint32_t next_seqno;
 
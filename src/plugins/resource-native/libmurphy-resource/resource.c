@@ -83,7 +83,7 @@ uint32_t int_hash(const void *key)
 }
 
 
-static void resource_event(mrp_msg_t *msg,
+static int resource_event(mrp_msg_t *msg,
         mrp_res_context_t *cx,
         int32_t seqno,
         void **pcursor)
@@ -137,6 +137,10 @@ static void resource_event(mrp_msg_t *msg,
 
         mrp_res_resource_t *res = NULL;
 
+        /* in a multi-set event each set is a section of its own */
+        if (tag == RESPROTO_SECTION_END && type == MRP_MSG_FIELD_UINT8)
+            break;
+
         if ((tag != RESPROTO_RESOURCE_ID || type != MRP_MSG_FIELD_UINT32) ||
                 !fetch_resource_name(msg, pcursor, &resnam)) {
             mrp_log_error("failed to read resource from message");
@@ -221,10 +225,34 @@ static void resource_event(mrp_msg_t *msg,
         }
     }
 
-    return;
+    return 0;
 
  malformed:
     mrp_log_error("ignoring malformed resource event");
+    return -1;
+}
+
+
+static void resource_sets_event(mrp_msg_t *msg,
+        mrp_res_context_t *cx,
+        void **pcursor)
+{
+    uint16_t tag;
+    uint16_t type;
+    mrp_msg_value_t value;
+    size_t size;
+
+    /* every section starts with the sequence number of its request */
+
+    while (mrp_msg_iterate(msg, pcursor, &tag, &type, &value, &size)) {
+        if (tag != RESPROTO_SEQUENCE_NO || type != MRP_MSG_FIELD_UINT32) {
+            mrp_log_error("ignoring malformed resource sets event");
+            return;
+        }
+
+        if (resource_event(msg, cx, value.u32, pcursor) < 0)
+            return;
+    }
 }
 
 
@@ -264,14 +292,20 @@ static void recvfrom_msg(mrp_transport_t *transp, mrp_msg_t *msg,
             cx->priv->master_classes = class_query_response(msg, &cursor);
             if (!cx->priv->master_classes)
                 goto error;
+
+            cx->priv->server_features = server_features(msg, &cursor);
             break;
         case RESPROTO_CREATE_RESOURCE_SET:
+        case RESPROTO_CREATE_ACQUIRE_RESOURCE_SET:
         {
             mrp_res_resource_set_private_t *priv = NULL;
             mrp_res_resource_set_t *rset = NULL;
             mrp_list_hook_t *p, *n;
 
-            mrp_log_info("received CREATE_RESOURCE_SET response");
+            if (req == RESPROTO_CREATE_RESOURCE_SET)
+                mrp_log_info("received CREATE_RESOURCE_SET response");
+            else
+                mrp_log_info("received CREATE_ACQUIRE_RESOURCE_SET response");
 
             /* get the correct resource set from the pending_sets list */
 
@@ -297,8 +331,22 @@ static void recvfrom_msg(mrp_transport_t *transp, mrp_msg_t *msg,
             mrp_htbl_insert(cx->priv->rset_mapping,
                     u_to_p(rset->priv->id), rset);
 
-            if (acquire_resource_set_request(cx, rset) < 0) {
-                goto error;
+            if (req == RESPROTO_CREATE_RESOURCE_SET) {
+                if (acquire_resource_set_request(cx, rset) < 0) {
+                    goto error;
+                }
+                break;
+            }
+
+            /* the server acquires the set right after replying */
+            rset->priv->seqno = 0;
+
+            /* call the resource set callback */
+
+            if (rset->priv->cb) {
+                increase_ref(cx, rset);
+                rset->priv->cb(cx, rset, rset->priv->user_data);
+                decrease_ref(cx, rset);
             }
             break;
         }
@@ -354,6 +402,11 @@ static void recvfrom_msg(mrp_transport_t *transp, mrp_msg_t *msg,
 
             resource_event(msg, cx, seqno, &cursor);
             break;
+        case RESPROTO_RESOURCE_SETS_EVENT:
+            mrp_log_info("received RESOURCE_SETS_EVENT response");
+
+            resource_sets_event(msg, cx, &cursor);
+            break;
         case RESPROTO_DESTROY_RESOURCE_SET:
             mrp_log_info("received DESTROY_RESOURCE_SET response");
             /* TODO? */
@@ -707,6 +707,7 @@ int mrp_res_acquire_resource_set(mrp_res_context_t *cx,
 {
     mrp_msg_t *msg = NULL;
     mrp_res_resource_set_t *rset;
+    bool acquire;
 
     if (!cx->priv->connected) {
         mrp_log_error("not connected to server");
@@ -744,10 +745,19 @@ int mrp_res_acquire_resource_set(mrp_res_context_t *cx,
         }
     }
 
-    /* Create the resource set. The acquisition is continued
-     * when the set is created. */
+    /* If the set is still being created, it will be acquired once the
+     * pending request is done. Don't create a duplicate. */
 
-    if (create_resource_set_request(cx, rset) < 0) {
+    if (!mrp_list_empty(&rset->priv->hook))
+        return 0;
+
+    /* Create and acquire the resource set with a single compound request
+     * if the server supports it. Otherwise the acquisition is continued
+     * when the set is created. We don't wait for the reply either way. */
+
+    acquire = !!(cx->priv->server_features & RESPROTO_FEATURE_CREATE_ACQUIRE);
+
+    if (create_resource_set_request(cx, rset, acquire) < 0) {
         mrp_log_error("creating resource set failed");
         goto error;
     }
@@ -82,12 +82,20 @@ typedef struct {
     mrp_list_hook_t    clients;
 } resource_data_t;
 
+typedef struct {
+    uint32_t               id;        /* resource set id */
+    uint32_t               reqid;     /* latest request id, or 0 */
+} pending_event_t;
+
 typedef struct {
     mrp_list_hook_t        list;
     resource_data_t       *data;
     uint32_t               id;
     mrp_resource_client_t *rscli;
     mrp_transport_t       *transp;
+    pending_event_t       *events;    /* coalesced events to deliver */
+    int                    nevent;    /* number of pending events */
+    mrp_deferred_t        *flush;     /* deferred event delivery */
 } client_t;
 
 
@@ -98,6 +106,8 @@ static void print_owners_cb(mrp_console_t *, void *, int, char **argv);
 static void print_resources_cb(mrp_console_t *, void *, int, char **argv);
 
 static void resource_event_handler(uint32_t, mrp_resource_set_t *, void *);
+static void coalesced_event_handler(uint32_t, mrp_resource_set_t *, void *);
+static void flush_events(client_t *client);
 
 
 MRP_CONSOLE_GROUP(resource_group, "resource", NULL, NULL, {
@@ -315,7 +325,7 @@ static int set_default_configuration(void)
 #endif
 
 static void reply_with_array(client_t *client, mrp_msg_t *msg,
-                             uint16_t tag, const char **arr)
+                             uint16_t tag, const char **arr, bool features)
 {
     resource_data_t *data   = client->data;
     mrp_plugin_t    *plugin = data->plugin;
@@ -328,6 +338,10 @@ static void reply_with_array(client_t *client, mrp_msg_t *msg,
     s  = mrp_msg_append(msg, MRP_MSG_TAG_SINT16(RESPROTO_REQUEST_STATUS, 0));
     s &= mrp_msg_append(msg, MRP_MSG_TAG_STRING_ARRAY(tag, dim, arr));
 
+    if (features)
+        s &= mrp_msg_append(msg, MRP_MSG_TAG_UINT32(RESPROTO_SERVER_FEATURES,
+                                            RESPROTO_FEATURE_CREATE_ACQUIRE));
+
     if (!s) {
         mrp_log_error("%s: failed to build reply", plugin->instance);
         return;
@@ -448,7 +462,8 @@ static void query_classes_request(client_t *client, mrp_msg_t *req)
     if (!names)
         reply_with_status(client, req, ENOMEM);
     else {
-        reply_with_array(client, req, RESPROTO_CLASS_NAME, names);
+        /* the class query reply also announces our optional features */
+        reply_with_array(client, req, RESPROTO_CLASS_NAME, names, true);
         mrp_free(names);
     }
 }
@@ -460,7 +475,7 @@ static void query_zones_request(client_t *client, mrp_msg_t *req)
     if (!names)
         reply_with_status(client, req, ENOMEM);
     else {
-        reply_with_array(client, req, RESPROTO_ZONE_NAME, names);
+        reply_with_array(client, req, RESPROTO_ZONE_NAME, names, false);
         mrp_free(names);
     }
 }
@@ -586,10 +601,9 @@ static int read_resource(mrp_resource_set_t *rset, mrp_msg_t *req,void **pcurs)
 
 
 static void create_resource_set_request(client_t *client, mrp_msg_t *req,
-                                        uint32_t seqno, void **pcurs)
+                                        uint32_t seqno, bool acquire,
+                                        void **pcurs)
 {
-    static uint16_t reqtyp = RESPROTO_CREATE_RESOURCE_SET;
-
     resource_data_t        *data   = client->data;
     mrp_plugin_t           *plugin = data->plugin;
     mrp_resource_set_t     *rset   = 0;
@@ -608,10 +622,16 @@ static void create_resource_set_request(client_t *client, mrp_msg_t *req,
     bool                    auto_release;
     bool                    auto_acquire;
     mrp_resource_event_cb_t event_cb;
+    uint16_t                reqtyp;
 
     MRP_ASSERT(client, "invalid argument");
     MRP_ASSERT(client->rscli, "confused with data structures");
 
+    if (acquire)
+        reqtyp = RESPROTO_CREATE_ACQUIRE_RESOURCE_SET;
+    else
+        reqtyp = RESPROTO_CREATE_RESOURCE_SET;
+
     rsid = MRP_RESOURCE_ID_INVALID;
     status = EINVAL;
 
@@ -648,6 +668,8 @@ static void create_resource_set_request(client_t *client, mrp_msg_t *req,
 
     if (flags & RESPROTO_RSETFLAG_NOEVENTS)
         event_cb = NULL;
+    else if (flags & RESPROTO_RSETFLAG_COALESCE)
+        event_cb = coalesced_event_handler;
     else
         event_cb = resource_event_handler;
 
@@ -683,6 +705,10 @@ static void create_resource_set_request(client_t *client, mrp_msg_t *req,
 
     if (status != 0)
         mrp_resource_set_destroy(rset);
+    else if (acquire) {
+        /* acquire only after the reply, so events follow the set id */
+        mrp_resource_set_acquire(rset, seqno);
+    }
 }
 
 static void destroy_resource_set_request(client_t *client, mrp_msg_t *req,
@@ -803,6 +829,9 @@ static void closed_evt(mrp_transport_t *transp, int error, void *user_data)
 
     mrp_resource_client_destroy(client->rscli);
 
+    mrp_del_deferred(client->flush);
+    mrp_free(client->events);
+
     mrp_list_delete(&client->list);
     mrp_free(client);
 }
@@ -833,6 +862,9 @@ static void recvfrom_msg(mrp_transport_t *transp, mrp_msg_t *msg,
     mrp_log_info("%s: received a message", plugin->instance);
     mrp_msg_dump(msg, stdout);
 
+    /* events caused by earlier requests precede any reply to this one */
+    flush_events(client);
+
 
     if (mrp_msg_iterate(msg, &cursor, &tag, &type, &value, &size) &&
         tag == RESPROTO_SEQUENCE_NO && type == MRP_MSG_FIELD_UINT32)
@@ -867,7 +899,11 @@ static void recvfrom_msg(mrp_transport_t *transp, mrp_msg_t *msg,
         break;
 
     case RESPROTO_CREATE_RESOURCE_SET:
-        create_resource_set_request(client, msg, seqno, &cursor);
+        create_resource_set_request(client, msg, seqno, false, &cursor);
+        break;
+
+    case RESPROTO_CREATE_ACQUIRE_RESOURCE_SET:
+        create_resource_set_request(client, msg, seqno, true, &cursor);
         break;
 
     case RESPROTO_DESTROY_RESOURCE_SET:
@@ -895,13 +931,62 @@ static void recv_msg(mrp_transport_t *transp, mrp_msg_t *msg, void *user_data)
 }
 
 
+static bool write_set_resources(mrp_msg_t *msg, mrp_resource_set_t *rset)
+{
+#define PUSH(m, tag, typ, val)    \
+    mrp_msg_append(m, MRP_MSG_TAG_##typ(RESPROTO_##tag, val))
+
+    mrp_resource_mask_t mask;
+    mrp_resource_mask_t all;
+    mrp_resource_t     *res;
+    uint32_t            id;
+    const char         *name;
+    void               *curs;
+    mrp_attr_t          attrs[ATTRIBUTE_MAX + 1];
+
+    all  = mrp_get_resource_set_grant(rset) | mrp_get_resource_set_advice(rset);
+    curs = NULL;
+
+    while ((res = mrp_resource_set_iterate_resources(rset, &curs))) {
+        mask = mrp_resource_get_mask(res);
+
+        if (!(all & mask))
+            continue;
+
+        id = mrp_resource_get_id(res);
+        name = mrp_resource_get_name(res);
+
+        if (!PUSH(msg, RESOURCE_ID  , UINT32, id  ) ||
+            !PUSH(msg, RESOURCE_NAME, STRING, name)  )
+            return false;
+
+        if (!mrp_resource_read_all_attributes(res, ATTRIBUTE_MAX + 1, attrs))
+            return false;
+
+        if (!write_attributes(msg, attrs))
+            return false;
+    }
+
+    return true;
+
+#undef PUSH
+}
+
+
+static uint16_t get_set_state(mrp_resource_set_t *rset)
+{
+    if (mrp_get_resource_set_state(rset) == mrp_resource_acquire)
+        return RESPROTO_ACQUIRE;
+    else
+        return RESPROTO_RELEASE;
+}
+
+
 static void resource_event_handler(uint32_t reqid, mrp_resource_set_t *rset,
                                    void *userdata)
 {
 #define FIELD(tag, typ, val)      \
     RESPROTO_##tag, MRP_MSG_FIELD_##typ, val
-#define PUSH(m, tag, typ, val)    \
-    mrp_msg_append(m, MRP_MSG_TAG_##typ(RESPROTO_##tag, val))
 
     client_t           *client = (client_t *)userdata;
     resource_data_t    *data   = client->data;
@@ -910,27 +995,17 @@ static void resource_event_handler(uint32_t reqid, mrp_resource_set_t *rset,
     uint16_t            state;
     mrp_resource_mask_t grant;
     mrp_resource_mask_t advice;
-    mrp_resource_mask_t mask;
-    mrp_resource_mask_t all;
     mrp_msg_t          *msg;
-    mrp_resource_t     *res;
     uint32_t            id;
-    const char         *name;
-    void               *curs;
-    mrp_attr_t          attrs[ATTRIBUTE_MAX + 1];
 
     MRP_ASSERT(rset && client, "invalid argument");
 
     reqtyp = RESPROTO_RESOURCES_EVENT;
     id     = mrp_get_resource_set_id(rset);
+    state  = get_set_state(rset);
     grant  = mrp_get_resource_set_grant(rset);
     advice = mrp_get_resource_set_advice(rset);
 
-    if (mrp_get_resource_set_state(rset) == mrp_resource_acquire)
-        state = RESPROTO_ACQUIRE;
-    else
-        state = RESPROTO_RELEASE;
-
     msg = mrp_msg_create(FIELD( SEQUENCE_NO    , UINT32, reqid  ),
                          FIELD( REQUEST_TYPE   , UINT16, reqtyp ),
                          FIELD( RESOURCE_SET_ID, UINT32, id     ),
@@ -939,49 +1014,160 @@ static void resource_event_handler(uint32_t reqid, mrp_resource_set_t *rset,
                          FIELD( RESOURCE_ADVICE, UINT32, advice ),
                          RESPROTO_MESSAGE_END                   );
 
-    if (!msg)
+    if (!msg || !write_set_resources(msg, rset))
         goto failed;
 
-    all = grant | advice;
-    curs = NULL;
+    if (!mrp_transport_send(client->transp, msg))
+        goto failed;
 
-    while ((res = mrp_resource_set_iterate_resources(rset, &curs))) {
-        mask = mrp_resource_get_mask(res);
+    mrp_msg_unref(msg);
 
-        if (!(all & mask))
-            continue;
+    return;
 
-        id = mrp_resource_get_id(res);
-        name = mrp_resource_get_name(res);
+    failed:
+         mrp_log_error("%s: failed to build/send message for resource event",
+                       plugin->instance);
+         mrp_msg_unref(msg);
+
+#undef FIELD
+}
+
+
+static void flush_events(client_t *client)
+{
+#define FIELD(tag, typ, val)      \
+    RESPROTO_##tag, MRP_MSG_FIELD_##typ, val
+#define PUSH(m, tag, typ, val)    \
+    mrp_msg_append(m, MRP_MSG_TAG_##typ(RESPROTO_##tag, val))
+
+    resource_data_t    *data   = client->data;
+    mrp_plugin_t       *plugin = data->plugin;
+    uint16_t            reqtyp;
+    uint16_t            state;
+    mrp_resource_mask_t grant;
+    mrp_resource_mask_t advice;
+    mrp_resource_set_t *rset;
+    pending_event_t    *ev, *lastev;
+    mrp_msg_t          *msg;
+    int                 nset;
+
+    if (client->flush)
+        mrp_disable_deferred(client->flush);
+
+    if (!client->nevent)
+        return;
+
+    reqtyp = RESPROTO_RESOURCE_SETS_EVENT;
+    nset   = 0;
+
+    msg = mrp_msg_create(FIELD( SEQUENCE_NO , UINT32, 0      ),
+                         FIELD( REQUEST_TYPE, UINT16, reqtyp ),
+                         RESPROTO_MESSAGE_END                );
+
+    if (!msg)
+        goto failed;
 
-         if (!PUSH(msg, RESOURCE_ID  , UINT32, id  ) ||
-             !PUSH(msg, RESOURCE_NAME, STRING, name)  )
-             goto failed;
+    /*
+     * Only the current state of each set is sent. Sets that got
+     * destroyed since their event was queued are simply skipped.
+     */
+    for (lastev = (ev = client->events) + client->nevent; ev < lastev; ev++) {
+        if (!(rset = mrp_resource_client_find_set(client->rscli, ev->id)))
+            continue;
 
-         if (!mrp_resource_read_all_attributes(res, ATTRIBUTE_MAX + 1, attrs))
-             goto failed;
+        state  = get_set_state(rset);
+        grant  = mrp_get_resource_set_grant(rset);
+        advice = mrp_get_resource_set_advice(rset);
+
+        if (!PUSH(msg, SEQUENCE_NO    , UINT32, ev->reqid) ||
+            !PUSH(msg, RESOURCE_SET_ID, UINT32, ev->id   ) ||
+            !PUSH(msg, RESOURCE_STATE , UINT16, state    ) ||
+            !PUSH(msg, RESOURCE_GRANT , UINT32, grant    ) ||
+            !PUSH(msg, RESOURCE_ADVICE, UINT32, advice   ) ||
+            !write_set_resources(msg, rset)                ||
+            !PUSH(msg, SECTION_END    , UINT8 , 0        )  )
+            goto failed;
 
-         if (!write_attributes(msg, attrs))
-                 goto failed;
+        nset++;
     }
 
-    if (!mrp_transport_send(client->transp, msg))
+    mrp_free(client->events);
+    client->events = NULL;
+    client->nevent = 0;
+
+    if (nset > 0 && !mrp_transport_send(client->transp, msg))
         goto failed;
 
     mrp_msg_unref(msg);
 
     return;
 
-    failed:
-         mrp_log_error("%s: failed to build/send message for resource event",
-                       plugin->instance);
-         mrp_msg_unref(msg);
+ failed:
+    mrp_log_error("%s: failed to build/send message for resource events",
+                  plugin->instance);
+    mrp_free(client->events);
+    client->events = NULL;
+    client->nevent = 0;
+    mrp_msg_unref(msg);
 
 #undef PUSH
 #undef FIELD
 }
 
 
+static void flush_cb(mrp_deferred_t *d, void *user_data)
+{
+    client_t *client = (client_t *)user_data;
+
+    MRP_UNUSED(d);
+
+    flush_events(client);
+}
+
+
+static void coalesced_event_handler(uint32_t reqid, mrp_resource_set_t *rset,
+                                    void *userdata)
+{
+    client_t        *client = (client_t *)userdata;
+    mrp_plugin_t    *plugin = client->data->plugin;
+    uint32_t         id;
+    pending_event_t *ev;
+    int              i;
+
+    MRP_ASSERT(rset && client, "invalid argument");
+
+    id = mrp_get_resource_set_id(rset);
+
+    /* a newer event supersedes any pending one of the same set */
+    for (i = 0;  i < client->nevent;  i++) {
+        ev = client->events + i;
+
+        if (ev->id == id) {
+            if (reqid)
+                ev->reqid = reqid;
+            return;
+        }
+    }
+
+    if (!client->flush)
+        client->flush = mrp_add_deferred(plugin->ctx->ml, flush_cb, client);
+
+    if (!client->flush ||
+        !mrp_reallocz(client->events, client->nevent, client->nevent + 1)) {
+        /* can't queue it, deliver everything right away in order */
+        flush_events(client);
+        resource_event_handler(reqid, rset, userdata);
+        return;
+    }
+
+    ev = client->events + client->nevent++;
+    ev->id    = id;
+    ev->reqid = reqid;
+
+    mrp_enable_deferred(client->flush);
+}
+
+
 
 static int initiate_transport(mrp_plugin_t *plugin)
 {
@@ -67,7 +67,8 @@ enum {
     ARG_HTTPDIR,                         /* content directory for HTTP */
     ARG_SSLCERT,                         /* path to SSL certificate */
     ARG_SSLPKEY,                         /* path to SSL private key */
-    ARG_SSLCA                            /* path to SSL CA */
+    ARG_SSLCA,                           /* path to SSL CA */
+    ARG_DEFLATE                          /* negotiate compression */
 };
 
 
@@ -85,7 +86,7 @@ typedef struct {
     const char      *sslcert;            /* path to SSL certificate */
     const char      *sslpkey;            /* path to SSL private key */
     const char      *sslca;              /* path to SSL CA */
-
+    int              deflate;            /* negotiate compression */
 } wrt_data_t;
 
 
@@ -1103,6 +1104,7 @@ static void recv_evt(mrp_transport_t *t, void *data, void *user_data)
 
 static int transport_create(wrt_data_t *data)
 {
+    static mrp_wsck_deflate_t  deflate;
     static mrp_transport_evt_t evt = {
         { .recvcustom     = recv_evt },
         { .recvcustomfrom = NULL     },
@@ -1134,6 +1136,9 @@ static int transport_create(wrt_data_t *data)
                 mrp_transport_setopt(data->lt, MRP_WSCK_OPT_SSL_CA  , ca);
             }
 
+            if (data->deflate)
+                mrp_transport_setopt(data->lt, MRP_WSCK_OPT_DEFLATE, &deflate);
+
             if (mrp_transport_bind(data->lt, &addr, len) &&
                 mrp_transport_listen(data->lt, 0)) {
                 mrp_log_info("Listening on transport '%s'...", data->addr);
@@ -1179,6 +1184,7 @@ static int plugin_init(mrp_plugin_t *plugin)
         data->sslcert = plugin->args[ARG_SSLCERT].str;
         data->sslpkey = plugin->args[ARG_SSLPKEY].str;
         data->sslca   = plugin->args[ARG_SSLCA].str;
+        data->deflate = plugin->args[ARG_DEFLATE].bln;
 
         if (!transport_create(data))
             goto fail;
@@ -1218,7 +1224,8 @@ static mrp_plugin_arg_t plugin_args[] = {
     MRP_PLUGIN_ARGIDX(ARG_HTTPDIR, STRING, "httpdir", DEFAULT_HTTPDIR),
     MRP_PLUGIN_ARGIDX(ARG_SSLCERT, STRING, "sslcert", NULL),
     MRP_PLUGIN_ARGIDX(ARG_SSLPKEY, STRING, "sslpkey", NULL),
-    MRP_PLUGIN_ARGIDX(ARG_SSLCA  , STRING, "sslca"  , NULL)
+    MRP_PLUGIN_ARGIDX(ARG_SSLCA  , STRING, "sslca"  , NULL),
+    MRP_PLUGIN_ARGIDX(ARG_DEFLATE, BOOL  , "deflate", FALSE)
 
 };
 
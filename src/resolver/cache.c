@@ -0,0 +1,643 @@
+/*
+ * Copyright (c) 2012, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Intel Corporation nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <limits.h>
+
+#include <murphy/common/mm.h>
+#include <murphy/common/debug.h>
+#include <murphy/common/log.h>
+#include <murphy/common/file-utils.h>
+
+#include "resolver-types.h"
+#include "resolver.h"
+#include "target.h"
+#include "target-sorter.h"
+#include "cache.h"
+
+#define CACHE_MAGIC   "MRPRULES"         /* file magic, 8 bytes */
+#define CACHE_VERSION 1                  /* file format version */
+#define CACHE_SUFFIX  ".cache"           /* cache file suffix */
+#define NO_STRING     0xffffffffU        /* length of a NULL string */
+
+/*
+ * The cache file is in native byte order and not meant to be portable.
+ * Its layout is:
+ *
+ *   magic, version, sizeof(int)
+ *   hash of the predefined targets and their dependencies
+ *   number of inputs, and for each input: path, size and content hash
+ *   number of parsed targets, and for each: name, dependencies,
+ *     script type and script source
+ *   index of the auto-update target among the parsed ones, or -1
+ *   number and names of facts after sorting
+ *   number of targets after sorting, and for each: fact and target
+ *     update lists (with -1 for missing lists)
+ */
+
+typedef struct {
+    char   *data;                        /* buffer */
+    size_t  size;                        /* allocated buffer size */
+    size_t  used;                        /* amount of data in buffer */
+    int     error;                       /* whether allocation failed */
+} wbuf_t;
+
+typedef struct {
+    const char *p;                       /* read pointer */
+    const char *end;                     /* end of data */
+    int         error;                   /* whether data was malformed */
+} rbuf_t;
+
+typedef struct {
+    const char  *name;                   /* target name */
+    const char **depends;                /* target dependencies */
+    int          ndepend;                /* number of dependencies */
+    const char  *type;                   /* script type, or NULL */
+    const char  *source;                 /* script source, or NULL */
+} cached_target_t;
+
+typedef struct {
+    const char *items;                   /* unaligned update list items */
+    int         nitem;                   /* number of items, or -1 */
+} cached_list_t;
+
+
+static void put_data(wbuf_t *b, const void *data, size_t size)
+{
+    size_t need = b->used + size;
+
+    if (b->error)
+        return;
+
+    if (need > b->size) {
+        if (b->size == 0)
+            b->size = 4096;
+        while (b->size < need)
+            b->size *= 2;
+
+        if (mrp_realloc(b->data, b->size) == NULL) {
+            b->error = TRUE;
+            return;
+        }
+    }
+
+    memcpy(b->data + b->used, data, size);
+    b->used += size;
+}
+
+
+static void put_u32(wbuf_t *b, uint32_t v)
+{
+    put_data(b, &v, sizeof(v));
+}
+
+
+static void put_i32(wbuf_t *b, int32_t v)
+{
+    put_data(b, &v, sizeof(v));
+}
+
+
+static void put_u64(wbuf_t *b, uint64_t v)
+{
+    put_data(b, &v, sizeof(v));
+}
+
+
+static void put_str(wbuf_t *b, const char *s)
+{
+    uint32_t len;
+
+    if (s == NULL)
+        put_u32(b, NO_STRING);
+    else {
+        len = strlen(s);
+        put_u32(b, len);
+        put_data(b, s, len + 1);
+    }
+}
+
+
+static void put_list(wbuf_t *b, int *items)
+{
+    int n;
+
+    if (items == NULL)
+        put_i32(b, -1);
+    else {
+        for (n = 0; items[n] >= 0; n++)
+            ;
+        put_i32(b, n);
+        put_data(b, items, n * sizeof(items[0]));
+    }
+}
+
+
+static const void *get_data(rbuf_t *b, size_t size)
+{
+    const void *p = b->p;
+
+    if (b->error || (size_t)(b->end - b->p) < size) {
+        b->error = TRUE;
+        return NULL;
+    }
+
+    b->p += size;
+
+    return p;
+}
+
+
+static uint32_t get_u32(rbuf_t *b)
+{
+    const void *p = get_data(b, sizeof(uint32_t));
+    uint32_t    v = 0;
+
+    if (p != NULL)
+        memcpy(&v, p, sizeof(v));
+
+    return v;
+}
+
+
+static int32_t get_i32(rbuf_t *b)
+{
+    const void *p = get_data(b, sizeof(int32_t));
+    int32_t     v = -1;
+
+    if (p != NULL)
+        memcpy(&v, p, sizeof(v));
+
+    return v;
+}
+
+
+static uint64_t get_u64(rbuf_t *b)
+{
+    const void *p = get_data(b, sizeof(uint64_t));
+    uint64_t    v = 0;
+
+    if (p != NULL)
+        memcpy(&v, p, sizeof(v));
+
+    return v;
+}
+
+
+static const char *get_str(rbuf_t *b)
+{
+    const char *s;
+    uint32_t    len;
+
+    len = get_u32(b);
+
+    if (b->error || len == NO_STRING)
+        return NULL;
+
+    if ((size_t)(b->end - b->p) <= len) {
+        b->error = TRUE;
+        return NULL;
+    }
+
+    s = get_data(b, len + 1);
+
+    if (s[len] != '\0') {
+        b->error = TRUE;
+        return NULL;
+    }
+
+    return s;
+}
+
+
+static void get_list(rbuf_t *b, cached_list_t *l, int max)
+{
+    int32_t n = get_i32(b);
+
+    if (n < -1 || n > max) {
+        b->error = TRUE;
+        return;
+    }
+
+    l->nitem = n;
+    l->items = (n > 0 ? get_data(b, n * sizeof(int)) : NULL);
+}
+
+
+static int *install_list(cached_list_t *l, int max)
+{
+    int *items, i;
+
+    if (l->nitem < 0)
+        return NULL;
+
+    if ((items = mrp_alloc_array(int, l->nitem + 1)) == NULL)
+        return NULL;
+
+    memcpy(items, l->items, l->nitem * sizeof(int));
+    items[l->nitem] = -1;
+
+    for (i = 0; i < l->nitem; i++) {
+        if (items[i] < 0 || items[i] >= max) {
+            mrp_free(items);
+            errno = EINVAL;
+            return NULL;
+        }
+    }
+
+    return items;
+}
+
+
+static int cache_path(const char *path, char *buf, size_t size)
+{
+    int n = snprintf(buf, size, "%s%s", path, CACHE_SUFFIX);
+
+    return (n > 0 && n < (int)size);
+}
+
+
+static uint64_t predef_hash(mrp_resolver_t *r, int npredef)
+{
+    wbuf_t    b;
+    target_t *t;
+    uint64_t  h;
+    int       i, j;
+
+    mrp_clear(&b);
+
+    put_u32(&b, npredef);
+
+    for (i = 0, t = r->targets; i < npredef; i++, t++) {
+        put_str(&b, t->name);
+        put_u32(&b, t->ndepend);
+        for (j = 0; j < t->ndepend; j++)
+            put_str(&b, t->depends[j]);
+    }
+
+    h = b.error ? 0 : mrp_hash_data(b.data, b.used);
+
+    mrp_free(b.data);
+
+    return h;
+}
+
+
+int cache_save_ruleset(mrp_resolver_t *r, const char *path,
+                       yy_res_parser_t *parser, int npredef)
+{
+    char             file[PATH_MAX];
+    wbuf_t           b;
+    yy_res_input_t  *in;
+    yy_res_target_t *pt;
+    mrp_list_hook_t *p, *n;
+    target_t        *t;
+    uint64_t         hash;
+    size_t           size;
+    int              ninput, ntarget, i;
+
+    if (!cache_path(path, file, sizeof(file)))
+        return FALSE;
+
+    mrp_clear(&b);
+
+    put_data(&b, CACHE_MAGIC, sizeof(CACHE_MAGIC) - 1);
+    put_u32(&b, CACHE_VERSION);
+    put_u32(&b, sizeof(int));
+    put_u64(&b, predef_hash(r, npredef));
+
+    for (ninput = 0, in = parser->done; in != NULL; in = in->prev)
+        ninput++;
+
+    put_u32(&b, ninput);
+
+    for (in = parser->done; in != NULL; in = in->prev) {
+        if (!mrp_hash_file(in->name, &hash, &size))
+            goto fail;
+
+        put_str(&b, in->name);
+        put_u64(&b, size);
+        put_u64(&b, hash);
+    }
+
+    ntarget = 0;
+    mrp_list_foreach(&parser->targets, p, n) {
+        ntarget++;
+    }
+
+    put_u32(&b, ntarget);
+
+    mrp_list_foreach(&parser->targets, p, n) {
+        pt = mrp_list_entry(p, typeof(*pt), hook);
+
+        put_str(&b, pt->name);
+        put_u32(&b, pt->ndepend);
+        for (i = 0; i < pt->ndepend; i++)
+            put_str(&b, pt->depends[i]);
+        put_str(&b, pt->script_type);
+        put_str(&b, pt->script_source);
+    }
+
+    if (r->auto_update != NULL)
+        put_i32(&b, (r->auto_update - r->targets) - npredef);
+    else
+        put_i32(&b, -1);
+
+    put_u32(&b, r->nfact);
+    for (i = 0; i < r->nfact; i++)
+        put_str(&b, r->facts[i].name);
+
+    put_u32(&b, r->ntarget);
+    for (i = 0, t = r->targets; i < r->ntarget; i++, t++) {
+        put_list(&b, t->update_facts);
+        put_list(&b, t->update_targets);
+    }
+
+    if (b.error || !mrp_write_file(file, b.data, b.used))
+        goto fail;
+
+    mrp_debug("saved ruleset cache '%s' (%zu bytes)", file, b.used);
+
+    mrp_free(b.data);
+
+    return TRUE;
+
+ fail:
+    mrp_debug("failed to save ruleset cache '%s' (%d: %s)", file,
+              errno, strerror(errno));
+    mrp_free(b.data);
+
+    return FALSE;
+}
+
+
+static int cached_inputs_valid(rbuf_t *b)
+{
+    const char *name;
+    uint64_t    size, hash, chksum;
+    size_t      fsize;
+    uint32_t    ninput, i;
+
+    ninput = get_u32(b);
+
+    for (i = 0; i < ninput && !b->error; i++) {
+        name = get_str(b);
+        size = get_u64(b);
+        hash = get_u64(b);
+
+        if (b->error || name == NULL)
+            return FALSE;
+
+        if (!mrp_hash_file(name, &chksum, &fsize) ||
+            fsize != size || chksum != hash) {
+            mrp_debug("ruleset input '%s' has changed", name);
+            return FALSE;
+        }
+    }
+
+    return !b->error;
+}
+
+
+static int install_update_lists(mrp_resolver_t *r, cached_list_t *facts,
+                                cached_list_t *targets)
+{
+    target_t *t;
+    int       i;
+
+    for (i = 0, t = r->targets; i < r->ntarget; i++, t++) {
+        mrp_free(t->update_targets);
+        mrp_free(t->update_facts);
+        mrp_free(t->fact_stamps);
+        t->update_targets = NULL;
+        t->update_facts   = NULL;
+        t->fact_stamps    = NULL;
+    }
+
+    for (i = 0, t = r->targets; i < r->ntarget; i++, t++) {
+        if (facts[i].nitem > 0) {
+            t->update_facts = install_list(facts + i, r->nfact);
+            t->fact_stamps  = mrp_allocz_array(uint32_t, facts[i].nitem);
+
+            if (t->update_facts == NULL || t->fact_stamps == NULL)
+                return -1;
+        }
+
+        if (targets[i].nitem > 0) {
+            t->update_targets = install_list(targets + i, r->ntarget);
+
+            if (t->update_targets == NULL)
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+int cache_load_ruleset(mrp_resolver_t *r, const char *path)
+{
+    char             file[PATH_MAX];
+    char            *data;
+    size_t           size;
+    rbuf_t           b;
+    cached_target_t *targets;
+    cached_list_t   *facts, *updates;
+    const char     **fact_names;
+    const char      *magic;
+    uint64_t         hash;
+    uint32_t         ntarget, ndepend, nfact, nsorted, i, j;
+    int32_t          auto_update;
+    int              npredef, sorted, status;
+
+    if (!cache_path(path, file, sizeof(file)))
+        return 0;
+
+    /*
+     * The cache carries script sources that get executed, so only use
+     * it if it passes the same ownership and permission checks as the
+     * bytecode cache of the Lua plugin (the checks are done on the
+     * opened file, not the path, to avoid races).
+     */
+    if ((data = mrp_read_trusted_file(file, &size)) == NULL) {
+        if (errno == EPERM)
+            mrp_log_warning("Ignoring untrusted ruleset cache '%s'.", file);
+        else
+            mrp_debug("no ruleset cache '%s'", file);
+        return 0;
+    }
+
+    targets    = NULL;
+    facts      = updates = NULL;
+    fact_names = NULL;
+    status     = 0;
+    npredef    = r->ntarget;
+
+    b.p     = data;
+    b.end   = data + size;
+    b.error = FALSE;
+
+    magic = get_data(&b, sizeof(CACHE_MAGIC) - 1);
+
+    if (magic == NULL || memcmp(magic, CACHE_MAGIC, sizeof(CACHE_MAGIC) - 1) ||
+        get_u32(&b) != CACHE_VERSION || get_u32(&b) != sizeof(int)) {
+        mrp_debug("ignoring ruleset cache '%s' of unknown format", file);
+        goto out;
+    }
+
+    hash = get_u64(&b);
+
+    if (!cached_inputs_valid(&b)) {
+        mrp_debug("ruleset cache '%s' is stale", file);
+        goto out;
+    }
+
+    /* decode and check everything before touching the resolver */
+    ntarget = get_u32(&b);
+
+    if (b.error || ntarget > (size_t)(b.end - b.p))
+        goto corrupt;
+
+    if ((targets = mrp_allocz_array(cached_target_t, ntarget)) == NULL)
+        goto out;
+
+    for (i = 0; i < ntarget && !b.error; i++) {
+        targets[i].name = get_str(&b);
+        ndepend         = get_u32(&b);
+
+        if (b.error || targets[i].name == NULL ||
+            ndepend > (size_t)(b.end - b.p))
+            goto corrupt;
+
+        if (ndepend > 0) {
+            targets[i].depends = mrp_allocz_array(const char *, ndepend);
+
+            if (targets[i].depends == NULL)
+                goto out;
+
+            targets[i].ndepend = ndepend;
+
+            for (j = 0; j < ndepend; j++)
+                if ((targets[i].depends[j] = get_str(&b)) == NULL)
+                    goto corrupt;
+        }
+
+        targets[i].type   = get_str(&b);
+        targets[i].source = get_str(&b);
+    }
+
+    auto_update = get_i32(&b);
+
+    if (auto_update < -1 || auto_update >= (int32_t)ntarget)
+        goto corrupt;
+
+    nfact = get_u32(&b);
+
+    if (b.error || nfact > (size_t)(b.end - b.p))
+        goto corrupt;
+
+    if ((fact_names = mrp_allocz_array(const char *, nfact + 1)) == NULL)
+        goto out;
+
+    for (i = 0; i < nfact; i++)
+        if ((fact_names[i] = get_str(&b)) == NULL)
+            goto corrupt;
+
+    nsorted = get_u32(&b);
+
+    if (b.error || nsorted > (size_t)(b.end - b.p))
+        goto corrupt;
+
+    facts   = mrp_allocz_array(cached_list_t, nsorted + 1);
+    updates = mrp_allocz_array(cached_list_t, nsorted + 1);
+
+    if (facts == NULL || updates == NULL)
+        goto out;
+
+    for (i = 0; i < nsorted; i++) {
+        get_list(&b, facts + i, nfact);
+        get_list(&b, updates + i, nsorted);
+    }
+
+    if (b.error || b.p != b.end)
+        goto corrupt;
+
+    /* create the cached targets, as create_targets would do */
+    status = -1;
+
+    for (i = 0; i < ntarget; i++) {
+        if (create_target(r, targets[i].name,
+                          targets[i].depends, targets[i].ndepend,
+                          targets[i].type, targets[i].source) == NULL)
+            goto out;
+    }
+
+    if (auto_update >= 0)
+        r->auto_update = r->targets + npredef + auto_update;
+
+    /* reuse the cached update lists if nothing has changed under them */
+    sorted = (hash == predef_hash(r, npredef) &&
+              nfact == (uint32_t)r->nfact && nsorted == (uint32_t)r->ntarget);
+
+    for (i = 0; sorted && i < nfact; i++)
+        if (strcmp(fact_names[i], r->facts[i].name))
+            sorted = FALSE;
+
+    if (sorted)
+        status = install_update_lists(r, facts, updates);
+    else {
+        mrp_debug("predefined targets have changed, resorting");
+        status = sort_targets(r);
+    }
+
+    if (status == 0) {
+        mrp_log_info("Loaded resolver ruleset from cache '%s'.", file);
+        status = 1;
+    }
+
+    goto out;
+
+ corrupt:
+    mrp_log_warning("Ignoring corrupt resolver ruleset cache '%s'.", file);
+    status = 0;
+
+ out:
+    if (targets != NULL) {
+        for (i = 0; i < ntarget; i++)
+            mrp_free(targets[i].depends);
+        mrp_free(targets);
+    }
+    mrp_free(fact_names);
+    mrp_free(facts);
+    mrp_free(updates);
+    mrp_free(data);
+
+    return status;
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2012, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Intel Corporation nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __MURPHY_RESOLVER_CACHE_H__
+#define __MURPHY_RESOLVER_CACHE_H__
+
+#include "resolver-types.h"
+#include "resolver.h"
+#include "parser-api.h"
+
+/*
+ * A compiled ruleset cache is stored next to the ruleset input as
+ * <input>.cache. It holds the parsed targets and the sorted update
+ * lists of all targets, and it is validated against the content hash
+ * of every input file (including the ones pulled in by include) and
+ * against the targets that were present in the resolver before the
+ * ruleset was loaded.
+ */
+
+/** Load cached ruleset for path, return 1 on hit, 0 on miss, -1 on error. */
+int cache_load_ruleset(mrp_resolver_t *r, const char *path);
+
+/** Save the ruleset parsed from path after npredef predefined targets. */
+int cache_save_ruleset(mrp_resolver_t *r, const char *path,
+                       yy_res_parser_t *parser, int npredef);
+
+#endif /* __MURPHY_RESOLVER_CACHE_H__ */
@@ -34,6 +34,7 @@
 
 #include <murphy/common/mainloop.h>
 #include <murphy/common/hashtbl.h>
+#include <murphy/common/metrics.h>
 #include <murphy/core/context.h>
 #include <murphy/core/scripting.h>
 
@@ -54,6 +55,7 @@ struct target_s {
     int             *update_targets;     /* targets to check when updating */
     uint32_t        *fact_stamps;        /* stamps of facts at last update */
     mrp_scriptlet_t *script;             /* update script if any, or NULL */
+    mrp_metric_t    *metric;             /* update latency histogram */
     int              prepared : 1;       /* ready for resolution */
     int              precompiled : 1;
 };
@@ -33,19 +33,60 @@
 #include <murphy/common/mm.h>
 #include <murphy/common/debug.h>
 #include <murphy/common/log.h>
+#include <murphy/common/metrics.h>
+
+#include <murphy-db/mql.h>
 
 #include "scanner.h"
 #include "resolver-types.h"
 #include "target.h"
 #include "target-sorter.h"
 #include "fact.h"
+#include "cache.h"
 #include "resolver.h"
 
 
+static void mql_exec_metric(mql_statement_type_t type, uint64_t usecs,
+                            void *user_data)
+{
+    static const char *labels[] = {
+        [mql_statement_unknown]      = "statement=unknown",
+        [mql_statement_show_tables]  = "statement=show_tables",
+        [mql_statement_describe]     = "statement=describe",
+        [mql_statement_create_table] = "statement=create_table",
+        [mql_statement_create_index] = "statement=create_index",
+        [mql_statement_drop_table]   = "statement=drop_table",
+        [mql_statement_drop_index]   = "statement=drop_index",
+        [mql_statement_begin]        = "statement=begin",
+        [mql_statement_commit]       = "statement=commit",
+        [mql_statement_rollback]     = "statement=rollback",
+        [mql_statement_insert]       = "statement=insert",
+        [mql_statement_update]       = "statement=update",
+        [mql_statement_delete]       = "statement=delete",
+        [mql_statement_select]       = "statement=select",
+    };
+    static mrp_metric_t *metrics[mql_statement_last];
+
+    MRP_UNUSED(user_data);
+
+    if (type < 0 || type >= mql_statement_last)
+        type = mql_statement_unknown;
+
+    if (metrics[type] == NULL)
+        metrics[type] = mrp_metric_histogram("mql_exec_usecs", labels[type],
+                                             "MQL statement execution time "
+                                             "in microseconds");
+
+    mrp_metric_observe(metrics[type], usecs);
+}
+
+
 mrp_resolver_t *mrp_resolver_create(mrp_context_t *ctx)
 {
     mrp_resolver_t *r;
 
+    mql_set_exec_hook(mql_exec_metric, NULL);
+
     r = mrp_allocz(sizeof(mrp_resolver_t));
 
     if (r != NULL) {
@@ -66,8 +107,10 @@ mrp_resolver_t *mrp_resolver_parse(mrp_resolver_t *r, mrp_context_t *ctx,
                                    const char *path)
 {
     yy_res_parser_t parser;
+    int             npredef;
 
     mrp_clear(&parser);
+    mrp_list_init(&parser.targets);
 
     if (r == NULL) {
         r = mrp_resolver_create(ctx);
@@ -76,10 +119,24 @@ mrp_resolver_t *mrp_resolver_parse(mrp_resolver_t *r, mrp_context_t *ctx,
             return NULL;
     }
 
+    npredef = r->ntarget;
+
+    switch (cache_load_ruleset(r, path)) {
+    case 1:
+        if (compile_target_scripts(r) == 0)
+            return r;
+        goto fail;
+    case 0:
+        break;
+    default:
+        goto fail;
+    }
+
     if (parser_parse_file(&parser, path)) {
         if (create_targets(r, &parser) == 0 &&
             sort_targets(r)            == 0 &&
             compile_target_scripts(r)  == 0) {
+            cache_save_ruleset(r, path, &parser, npredef);
             parser_cleanup(&parser);
             return r;
         }
@@ -87,6 +144,7 @@ mrp_resolver_t *mrp_resolver_parse(mrp_resolver_t *r, mrp_context_t *ctx,
     else
         mrp_log_error("Failed to parse resolver input.");
 
+ fail:
     mrp_resolver_destroy(r);
     parser_cleanup(&parser);
 
@@ -27,6 +27,7 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <stdio.h>
 #include <stdarg.h>
 #include <errno.h>
 #include <alloca.h>
@@ -34,6 +35,7 @@
 #include <murphy/common/log.h>
 #include <murphy/common/mm.h>
 #include <murphy/common/list.h>
+#include <murphy/common/metrics.h>
 
 #include <murphy/core/scripting.h>
 
@@ -386,12 +388,32 @@ static void update_target_stamps(mrp_resolver_t *r, target_t *t)
 }
 
 
+static mrp_metric_t *target_metric(target_t *t)
+{
+    char label[256];
+
+    if (t->metric == NULL) {
+        snprintf(label, sizeof(label), "target=%s", t->name);
+        t->metric = mrp_metric_histogram("resolver_update_usecs", label,
+                                         "resolver target update time "
+                                         "in microseconds");
+    }
+
+    return t->metric;
+}
+
+
 static int update_target(mrp_resolver_t *r, target_t *t)
 {
+    static mrp_metric_t *failures;
+
     mqi_handle_t  tx;
     target_t     *dep;
     uint32_t      stamps[r->ntarget * r->nfact];
     int           i, id, status, needs_update, level;
+    uint64_t      start;
+
+    start = mrp_metrics_on ? mrp_metric_now() : 0;
 
     tx = start_transaction(r);
 
@@ -457,6 +479,18 @@ static int update_target(mrp_resolver_t *r, target_t *t)
 
     r->level--;
 
+    if (mrp_metrics_on) {
+        mrp_metric_since(target_metric(t), start);
+
+        if (status <= 0) {
+            if (failures == NULL)
+                failures = mrp_metric_counter("resolver_update_failures_total",
+                                              NULL, "failed resolver target "
+                                              "updates");
+            mrp_metric_inc(failures);
+        }
+    }
+
     return status;
 }
 
@@ -85,6 +85,7 @@ enum field_e {
     METHOD,
     OWNERS,
     VETO,
+    VETO_ZONE,
     ID
 };
 
@@ -1224,6 +1225,7 @@ static int resmethod_getfield(lua_State *L)
         else {
             switch (fld) {
             case VETO:
+            case VETO_ZONE:
                 lua_pushstring(L, name);
                 lua_rawget(L, 1);
                 break;
@@ -1253,6 +1255,14 @@ static int resmethod_setfield(lua_State *L)
             method->veto = mrp_funcarray_check(L, -1);
             lua_rawset(L, 1);
             break;
+        case VETO_ZONE:
+            lua_pushstring(L, name);
+            lua_pushvalue(L, 3);
+            method->veto_zone = mrp_funcbridge_create_luafunc(L, -1);
+            if (method->veto_zone->type != MRP_LUA_FUNCTION)
+                luaL_error(L, "'%s' must be a lua function", name);
+            lua_rawset(L, 1);
+            break;
         default:
             luaL_error(L, "invalid method '%s'", name);
             break;
@@ -1269,6 +1279,7 @@ static void resmethod_destroy(void *data)
     MRP_LUA_ENTER;
 
     method->veto = NULL;
+    method->veto_zone = NULL;
 
     MRP_LUA_LEAVE_NOARG;
 }
@@ -1624,6 +1635,8 @@ static field_t field_name_to_type(const char *name, size_t len)
             return MANDATORY;
         if (!strcmp(name, "shareable"))
             return SHAREABLE;
+        if (!strcmp(name, "veto_zone"))
+            return VETO_ZONE;
         break;
 
     case 10:
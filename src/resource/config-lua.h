@@ -37,7 +37,8 @@
 typedef struct mrp_lua_resmethod_s   mrp_lua_resmethod_t;
 
 struct mrp_lua_resmethod_s {
-    mrp_funcarray_t *veto;
+    mrp_funcarray_t  *veto;
+    mrp_funcbridge_t *veto_zone;
 };
 
 
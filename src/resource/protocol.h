@@ -43,10 +43,13 @@
 #define RESPROTO_RSETFLAG_AUTORELEASE RESPROTO_BIT(0)
 #define RESPROTO_RSETFLAG_AUTOACQUIRE RESPROTO_BIT(1)
 #define RESPROTO_RSETFLAG_NOEVENTS    RESPROTO_BIT(2)
+#define RESPROTO_RSETFLAG_COALESCE    RESPROTO_BIT(3)
 
 #define RESPROTO_RESFLAG_MANDATORY    RESPROTO_BIT(0)
 #define RESPROTO_RESFLAG_SHARED       RESPROTO_BIT(1)
 
+#define RESPROTO_FEATURE_CREATE_ACQUIRE RESPROTO_BIT(0)
+
 #define RESPROTO_TAG(x)               ((uint16_t)(x))
 
 #define RESPROTO_MESSAGE_END          MRP_MSG_FIELD_END
@@ -68,6 +71,36 @@
 #define RESPROTO_ATTRIBUTE_INDEX      RESPROTO_TAG(16)
 #define RESPROTO_ATTRIBUTE_NAME       RESPROTO_TAG(17)
 #define RESPROTO_ATTRIBUTE_VALUE      RESPROTO_TAG(18)
+#define RESPROTO_SERVER_FEATURES      RESPROTO_TAG(19)
+
+/*
+ * Requests are processed strictly in the order they are received and
+ * every reply carries the sequence number of the request it answers.
+ * Clients can therefore pipeline requests, ie. send several of them
+ * without waiting for the replies to earlier ones.
+ *
+ * RESPROTO_CREATE_ACQUIRE_RESOURCE_SET is a compound request with the
+ * same body as RESPROTO_CREATE_RESOURCE_SET. It creates the resource
+ * set, sets the attributes of its resources and acquires it. The reply
+ * has the same layout as the reply to a plain create request and it is
+ * always sent before any resource events for the newly created set.
+ *
+ * Servers supporting it announce RESPROTO_FEATURE_CREATE_ACQUIRE in the
+ * RESPROTO_SERVER_FEATURES bitmask that follows the class names in the
+ * reply to RESPROTO_QUERY_CLASSES. Older servers send no such field and
+ * silently drop requests they don't know, so clients must not use the
+ * compound request unless the feature has been announced.
+ *
+ * Events of resource sets created with RESPROTO_RSETFLAG_COALESCE are
+ * not sent one by one. They are collected per client and delivered in
+ * a single RESPROTO_RESOURCE_SETS_EVENT message once the triggering
+ * update is over, but always before the reply to the next request of
+ * the client. Only the latest state of each set is sent. The message
+ * has a zero sequence number and carries one section per resource set:
+ * the sequence number of the request that caused the event (or zero),
+ * followed by the fields of a RESPROTO_RESOURCES_EVENT message starting
+ * with the resource set id, terminated by RESPROTO_SECTION_END.
+ */
 
 typedef enum {
     RESPROTO_QUERY_RESOURCES,
@@ -78,6 +111,8 @@ typedef enum {
     RESPROTO_ACQUIRE_RESOURCE_SET,
     RESPROTO_RELEASE_RESOURCE_SET,
     RESPROTO_RESOURCES_EVENT,
+    RESPROTO_CREATE_ACQUIRE_RESOURCE_SET,
+    RESPROTO_RESOURCE_SETS_EVENT,
 } mrp_resproto_request_t;
 
 typedef enum {
@@ -192,13 +192,126 @@ bool mrp_resource_lua_veto(mrp_zone_t *zone,
             args[++i].integer = grant;
             args[++i].pointer = oref;
 
-            return mrp_funcarray_call_from_c(L, veto, "sodo", args);
+            return mrp_funcarray_call_sig(L, veto,
+                                          MRP_FUNCBRIDGE_SIGNATURE("sodo"),
+                                          args);
         }
     }
 
     return true;
 }
 
+bool mrp_resource_lua_has_zone_veto(void)
+{
+    mrp_lua_resmethod_t *methods = mrp_lua_get_resource_methods();
+
+    return methods && methods->veto_zone;
+}
+
+int mrp_resource_lua_veto_zone(mrp_zone_t *zone,
+                               mrp_resource_owner_t *owners,
+                               mrp_resource_lua_grant_t *grants,
+                               int ngrant)
+{
+    lua_State *L = mrp_lua_get_lua_state();
+    mrp_lua_resmethod_t *methods = mrp_lua_get_resource_methods();
+    mrp_funcbridge_t *veto;
+    mrp_resource_setref_t *sref;
+    mrp_resource_ownersref_t *oref;
+    mrp_resource_lua_grant_t *g;
+    int top, i, nveto;
+
+    if (!L || !zone || !owners || !grants || ngrant <= 0 || !methods ||
+        !(veto = methods->veto_zone) || !(oref = owners_get(L, zone->id)))
+        return 0;
+
+    oref->owners = owners;
+    top = lua_gettop(L);
+    nveto = 0;
+
+    /*
+     * Call veto_zone(zone_name, candidates, owners) once for the whole
+     * zone. candidates is an array of { set = <setref>, grant = <mask> }
+     * records. The function returns nil or true to accept everything,
+     * false to veto everything, or an array where a false entry vetoes
+     * the corresponding candidate.
+     */
+
+    mrp_funcbridge_push(L, veto);
+    lua_rawgeti(L, -1, 1);
+
+    if (!lua_isfunction(L, -1)) {
+        lua_settop(L, top);
+        return 0;
+    }
+
+    lua_pushstring(L, zone->name);
+    lua_createtable(L, ngrant, 0);
+
+    for (i = 0;  i < ngrant;  i++) {
+        g = grants + i;
+
+        lua_createtable(L, 0, 2);
+
+        if ((sref = find_in_id_hash(g->rset->id)))
+            mrp_lua_push_object(L, sref);
+        else
+            lua_pushnil(L);
+        lua_setfield(L, -2, "set");
+
+        lua_pushinteger(L, g->grant);
+        lua_setfield(L, -2, "grant");
+
+        lua_rawseti(L, -2, i + 1);
+    }
+
+    mrp_lua_push_object(L, oref);
+
+    if (lua_pcall(L, 3, 1, 0) != 0) {
+        mrp_log_error("resource zone veto failed: %s", lua_tostring(L, -1));
+        goto veto_all;
+    }
+
+    switch (lua_type(L, -1)) {
+    case LUA_TNIL:
+        break;
+
+    case LUA_TBOOLEAN:
+        if (!lua_toboolean(L, -1))
+            goto veto_all;
+        break;
+
+    case LUA_TTABLE:
+        for (i = 0;  i < ngrant;  i++) {
+            lua_rawgeti(L, -1, i + 1);
+
+            if (lua_isboolean(L, -1) && !lua_toboolean(L, -1)) {
+                grants[i].vetoed = true;
+                nveto++;
+            }
+
+            lua_pop(L, 1);
+        }
+        break;
+
+    default:
+        mrp_log_error("resource zone veto returned invalid value");
+        goto veto_all;
+    }
+
+    lua_settop(L, top);
+
+    return nveto;
+
+ veto_all:
+    for (i = 0;  i < ngrant;  i++)
+        grants[i].vetoed = true;
+
+    lua_settop(L, top);
+
+    return ngrant;
+}
+
 void mrp_resource_lua_set_owners(mrp_zone_t *zone,mrp_resource_owner_t *owners)
 {
     lua_State *L = mrp_lua_get_lua_state();
@@ -45,11 +45,20 @@ struct mrp_resource_setref_s {
     mrp_resource_set_t   *rset;
 };
 
+typedef struct {
+    mrp_resource_set_t   *rset;    /* candidate resource set */
+    mrp_resource_mask_t   grant;   /* tentative grant of the set */
+    bool                  vetoed;  /* set by the zone veto */
+} mrp_resource_lua_grant_t;
+
 
 void mrp_resource_lua_init(lua_State *);
 
 bool mrp_resource_lua_veto(mrp_zone_t *, mrp_resource_set_t *,
                            mrp_resource_owner_t *, mrp_resource_mask_t);
+bool mrp_resource_lua_has_zone_veto(void);
+int  mrp_resource_lua_veto_zone(mrp_zone_t *, mrp_resource_owner_t *,
+                                mrp_resource_lua_grant_t *, int);
 void mrp_resource_lua_set_owners(mrp_zone_t *, mrp_resource_owner_t *);
 
 void mrp_resource_lua_register_resource_set(mrp_resource_set_t *);
@@ -36,6 +36,7 @@
 #include <murphy/common/hashtbl.h>
 #include <murphy/common/utils.h>
 #include <murphy/common/log.h>
+#include <murphy/common/metrics.h>
 
 #include <murphy-db/mqi.h>
 
@@ -63,11 +64,21 @@ typedef struct {
     mrp_attr_value_t  attrs[MQI_COLUMN_MAX];
 } owner_row_t;
 
+typedef struct {
+    mrp_resource_set_t  *rset;
+    mrp_resource_mask_t  grant;
+    mrp_resource_mask_t  advice;
+    bool                 force_release;
+    bool                 vetoed;
+} decision_t;
+
 static mrp_resource_owner_t  resource_owners[MRP_ZONE_MAX * MRP_RESOURCE_MAX];
 static mqi_handle_t          owner_tables[MRP_RESOURCE_MAX];
 
 static mrp_resource_owner_t *get_owner(uint32_t, uint32_t);
 static void reset_owners(uint32_t, mrp_resource_owner_t *);
+static decision_t *decide_zone(mrp_zone_t *, decision_t *, uint32_t);
+static void revoke_zone(mrp_zone_t *, decision_t *, decision_t *);
 static bool grant_ownership(mrp_resource_owner_t *, mrp_zone_t *,
                             mrp_application_class_t *, mrp_resource_set_t *,
                             mrp_resource_t *);
@@ -155,6 +166,41 @@ int mrp_resource_owner_create_database_table(mrp_resource_def_t *rdef)
 }
 
 
+typedef struct {
+    mrp_metric_t *usecs;                 /* zone update duration */
+    mrp_metric_t *sets;                  /* resource sets decided */
+    mrp_metric_t *events;                /* resource sets changed */
+} zone_metrics_t;
+
+
+static void update_zone_metrics(mrp_zone_t *zone, uint64_t start,
+                                uint32_t nset, uint32_t nevent)
+{
+    static zone_metrics_t metrics[MRP_ZONE_MAX];
+
+    zone_metrics_t *m = metrics + zone->id;
+    char            label[128];
+
+    if (m->usecs == NULL) {
+        snprintf(label, sizeof(label), "zone=%s", zone->name);
+
+        m->usecs  = mrp_metric_histogram("resource_zone_update_usecs", label,
+                                         "resource zone update time "
+                                         "in microseconds");
+        m->sets   = mrp_metric_counter("resource_zone_update_sets_total",
+                                       label, "resource sets decided "
+                                       "in zone updates");
+        m->events = mrp_metric_counter("resource_zone_update_events_total",
+                                       label, "resource sets changed "
+                                       "by zone updates");
+    }
+
+    mrp_metric_since(m->usecs, start);
+    mrp_metric_add(m->sets, nset);
+    mrp_metric_add(m->events, nevent);
+}
+
+
 void mrp_resource_owner_update_zone(uint32_t zoneid,
                                     mrp_resource_set_t *reqset,
                                     uint32_t reqid)
@@ -166,164 +212,141 @@ void mrp_resource_owner_update_zone(uint32_t zoneid,
     } event_t;
 
     mrp_resource_owner_t oldowners[MRP_RESOURCE_MAX];
-    mrp_resource_owner_t backup[MRP_RESOURCE_MAX];
     mrp_zone_t *zone;
-    mrp_application_class_t *class;
     mrp_resource_set_t *rset;
-    mrp_resource_t *res;
-    mrp_resource_def_t *rdef;
-    mrp_resource_mgr_ftbl_t *ftbl;
     mrp_resource_owner_t *owner, *old, *owners;
-    mrp_resource_mask_t mask;
-    mrp_resource_mask_t mandatory;
     mrp_resource_mask_t grant;
     mrp_resource_mask_t advice;
-    void *clc, *rsc, *rc;
     uint32_t rid;
     uint32_t rcnt;
-    bool force_release;
     bool changed;
     bool shuffle;
     uint32_t replyid;
     uint32_t nevent, maxev;
     event_t *events, *ev, *lastev;
+    decision_t *decisions, *d, *lastd;
+    mrp_resource_lua_grant_t *grants;
+    decision_t **granted;
+    int ngrant, i;
+    bool zone_veto;
+    uint32_t nset;
+    uint64_t start;
 
     MRP_ASSERT(zoneid < MRP_ZONE_MAX, "invalid argument");
 
+    start = mrp_metrics_on ? mrp_metric_now() : 0;
+
     zone = mrp_zone_find_by_id(zoneid);
 
     MRP_ASSERT(zone, "zone is not defined");
 
-    maxev  = mrp_get_resource_set_count();
-    nevent = 0;
-    events = mrp_alloc(sizeof(event_t) * maxev);
+    maxev     = mrp_get_resource_set_count();
+    nevent    = 0;
+    events    = mrp_alloc(sizeof(event_t) * maxev);
+    decisions = mrp_allocz(sizeof(decision_t) * maxev);
 
-    MRP_ASSERT(events, "Memory alloc failure. Can't update zone");
+    MRP_ASSERT(events && decisions,
+               "Memory alloc failure. Can't update zone");
 
-    reset_owners(zoneid, oldowners);
-    manager_start_transaction(zone);
+    if ((zone_veto = mrp_resource_lua_has_zone_veto())) {
+        grants  = mrp_alloc(sizeof(mrp_resource_lua_grant_t) * maxev);
+        granted = mrp_alloc(sizeof(decision_t *) * maxev);
 
-    rcnt = mrp_resource_definition_count();
-    clc  = NULL;
-
-    while ((class = mrp_application_class_iterate_classes(&clc))) {
-        rsc = NULL;
-
-        while ((rset=mrp_application_class_iterate_rsets(class,zoneid,&rsc))) {
-            force_release = false;
-            mandatory = rset->resource.mask.mandatory;
-            grant = 0;
-            advice = 0;
-            rc = NULL;
-
-            switch (rset->state) {
-
-            case mrp_resource_acquire:
-                while ((res = mrp_resource_set_iterate_resources(rset, &rc))) {
-                    rdef  = res->def;
-                    rid   = rdef->id;
-                    owner = get_owner(zoneid, rid);
-
-                    backup[rid] = *owner;
+        MRP_ASSERT(grants && granted,
+                   "Memory alloc failure. Can't update zone");
+    }
+    else {
+        grants  = NULL;
+        granted = NULL;
+    }
 
-                    if (grant_ownership(owner, zone, class, rset, res))
-                        grant |= ((mrp_resource_mask_t)1 << rid);
-                    else {
-                        if (owner->rset != rset)
-                            force_release |= owner->modal;
-                    }
-                }
-                owners = get_owner(zoneid, 0);
-                if ((grant & mandatory) == mandatory &&
-                    mrp_resource_lua_veto(zone, rset, owners, grant))
-                {
-                    advice = grant;
-                }
-                else {
-                    /* rollback, ie. restore the backed up state */
-                    rc = NULL;
-                    while ((res=mrp_resource_set_iterate_resources(rset,&rc))){
-                         rdef  = res->def;
-                         rid   = rdef->id;
-                         mask  = (mrp_resource_mask_t)1 << rid;
-                         owner = get_owner(zoneid, rid);
-                        *owner = backup[rid];
+    reset_owners(zoneid, oldowners);
+    manager_start_transaction(zone);
 
-                        if ((grant & mask)) {
-                            if ((ftbl = rdef->manager.ftbl) && ftbl->free)
-                                ftbl->free(zone, res, rdef->manager.userdata);
-                        }
+    rcnt   = mrp_resource_definition_count();
+    owners = get_owner(zoneid, 0);
 
-                        if (advice_ownership(owner, zone, class, rset, res))
-                            advice |= mask;
-                    }
+    /*
+     * Decide the grants of the zone. If a zone veto is configured, all
+     * the tentative grants are passed to it in a single call. If it vetoes
+     * any of them, the allocations are revoked and the zone is decided
+     * again with the vetoed sets excluded. Every round vetoes at least one
+     * more set so this terminates.
+     */
+    for (;;) {
+        lastd = decide_zone(zone, decisions, maxev);
 
-                    grant = 0;
+        if (!zone_veto)
+            break;
 
-                    if ((advice & mandatory) != mandatory)
-                        advice = 0;
+        for (d = decisions, ngrant = 0;   d < lastd;   d++) {
+            if (d->rset->state == mrp_resource_acquire && d->grant) {
+                grants[ngrant].rset   = d->rset;
+                grants[ngrant].grant  = d->grant;
+                grants[ngrant].vetoed = false;
+                granted[ngrant++] = d;
+            }
+        }
 
-                    mrp_resource_lua_set_owners(zone, owners);
-                }
-                break;
+        if (mrp_resource_lua_veto_zone(zone, owners, grants, ngrant) <= 0)
+            break;
 
-            case mrp_resource_release:
-                while ((res = mrp_resource_set_iterate_resources(rset, &rc))) {
-                    rdef  = res->def;
-                    rid   = rdef->id;
-                    owner = get_owner(zoneid, rid);
+        for (i = 0;   i < ngrant;   i++) {
+            if (grants[i].vetoed)
+                granted[i]->vetoed = true;
+        }
 
-                    if (advice_ownership(owner, zone, class, rset, res))
-                        advice |= ((mrp_resource_mask_t)1 << rid);
-                }
-                if ((advice & mandatory) != mandatory)
-                    advice = 0;
-                break;
+        revoke_zone(zone, decisions, lastd);
+        reset_owners(zoneid, NULL);
+        mrp_resource_lua_set_owners(zone, owners);
+    }
 
-            default:
-                break;
-            }
+    for (d = decisions;   d < lastd;   d++) {
+        rset   = d->rset;
+        grant  = d->grant;
+        advice = d->advice;
 
-            changed = false;
-            shuffle = false;
-            replyid = (reqset == rset && reqid == rset->request.id) ? reqid:0;
+        changed = false;
+        shuffle = false;
+        replyid = (reqset == rset && reqid == rset->request.id) ? reqid:0;
 
 
-            if (force_release) {
-                shuffle = (rset->state != mrp_resource_release);
-                changed = shuffle || rset->resource.mask.grant;
-                rset->state = mrp_resource_release;
-                rset->resource.mask.grant = 0;
-            }
-            else {
-                if (grant != rset->resource.mask.grant) {
-                    rset->resource.mask.grant = grant;
-                    changed = true;
+        if (d->force_release) {
+            shuffle = (rset->state != mrp_resource_release);
+            changed = shuffle || rset->resource.mask.grant;
+            rset->state = mrp_resource_release;
+            rset->resource.mask.grant = 0;
+        }
+        else {
+            if (grant != rset->resource.mask.grant) {
+                rset->resource.mask.grant = grant;
+                changed = true;
 
-                    if (!grant && rset->auto_release) {
-                        rset->state = mrp_resource_release;
-                        shuffle = true;
-                    }
+                if (!grant && rset->auto_release) {
+                    rset->state = mrp_resource_release;
+                    shuffle = true;
                 }
             }
+        }
 
-            if (advice != rset->resource.mask.advice) {
-                rset->resource.mask.advice = advice;
-                changed = true;
-            }
+        if (advice != rset->resource.mask.advice) {
+            rset->resource.mask.advice = advice;
+            changed = true;
+        }
 
-            if (replyid || changed) {
-                ev = events + nevent++;
+        if (replyid || changed) {
+            ev = events + nevent++;
 
-                ev->replyid = replyid;
-                ev->rset    = rset;
-                ev->shuffle = shuffle;
-            }
-        } /* while rset */
-    } /* while class */
+            ev->replyid = replyid;
+            ev->rset    = rset;
+            ev->shuffle = shuffle;
+        }
+    }
 
     manager_end_transaction(zone);
 
+    nset = lastd - decisions;
+
     for (lastev = (ev = events) + nevent;     ev < lastev;     ev++) {
         rset = ev->rset;
 
@@ -337,6 +360,9 @@ void mrp_resource_owner_update_zone(uint32_t zoneid,
     }
 
     mrp_free(events);
+    mrp_free(decisions);
+    mrp_free(grants);
+    mrp_free(granted);
 
     for (rid = 0;  rid < rcnt;  rid++) {
         owner = get_owner(zoneid, rid);
@@ -354,6 +380,9 @@ void mrp_resource_owner_update_zone(uint32_t zoneid,
                 update_resource_owner(zone, owner->class, owner->res);
         }
     }
+
+    if (mrp_metrics_on)
+        update_zone_metrics(zone, start, nset, nevent);
 }
 
 int mrp_resource_owner_print(char *buf, int len)
@@ -446,6 +475,152 @@ static void reset_owners(uint32_t zone, mrp_resource_owner_t *oldowners)
         owners[i].share = true;
 }
 
+static decision_t *decide_zone(mrp_zone_t *zone, decision_t *decisions,
+                               uint32_t max)
+{
+    mrp_resource_owner_t backup[MRP_RESOURCE_MAX];
+    mrp_application_class_t *class;
+    mrp_resource_set_t *rset;
+    mrp_resource_t *res;
+    mrp_resource_def_t *rdef;
+    mrp_resource_mgr_ftbl_t *ftbl;
+    mrp_resource_owner_t *owner, *owners;
+    mrp_resource_mask_t mask;
+    mrp_resource_mask_t mandatory;
+    mrp_resource_mask_t grant;
+    mrp_resource_mask_t advice;
+    void *clc, *rsc, *rc;
+    uint32_t zoneid;
+    uint32_t rid;
+    bool force_release;
+    decision_t *d;
+
+    zoneid = zone->id;
+    owners = get_owner(zoneid, 0);
+    d      = decisions;
+    clc    = NULL;
+
+    while ((class = mrp_application_class_iterate_classes(&clc))) {
+        rsc = NULL;
+
+        while ((rset=mrp_application_class_iterate_rsets(class,zoneid,&rsc))) {
+            MRP_ASSERT(d < decisions + max, "confused with data structures");
+
+            force_release = false;
+            mandatory = rset->resource.mask.mandatory;
+            grant = 0;
+            advice = 0;
+            rc = NULL;
+
+            switch (rset->state) {
+
+            case mrp_resource_acquire:
+                while ((res = mrp_resource_set_iterate_resources(rset, &rc))) {
+                    rdef  = res->def;
+                    rid   = rdef->id;
+                    owner = get_owner(zoneid, rid);
+
+                    backup[rid] = *owner;
+
+                    if (grant_ownership(owner, zone, class, rset, res))
+                        grant |= ((mrp_resource_mask_t)1 << rid);
+                    else {
+                        if (owner->rset != rset)
+                            force_release |= owner->modal;
+                    }
+                }
+                if ((grant & mandatory) == mandatory && !d->vetoed &&
+                    mrp_resource_lua_veto(zone, rset, owners, grant))
+                {
+                    advice = grant;
+                }
+                else {
+                    /* rollback, ie. restore the backed up state */
+                    rc = NULL;
+                    while ((res=mrp_resource_set_iterate_resources(rset,&rc))){
+                         rdef  = res->def;
+                         rid   = rdef->id;
+                         mask  = (mrp_resource_mask_t)1 << rid;
+                         owner = get_owner(zoneid, rid);
+                        *owner = backup[rid];
+
+                        if ((grant & mask)) {
+                            if ((ftbl = rdef->manager.ftbl) && ftbl->free)
+                                ftbl->free(zone, res, rdef->manager.userdata);
+                        }
+
+                        if (advice_ownership(owner, zone, class, rset, res))
+                            advice |= mask;
+                    }
+
+                    grant = 0;
+
+                    if ((advice & mandatory) != mandatory)
+                        advice = 0;
+
+                    mrp_resource_lua_set_owners(zone, owners);
+                }
+                break;
+
+            case mrp_resource_release:
+                while ((res = mrp_resource_set_iterate_resources(rset, &rc))) {
+                    rdef  = res->def;
+                    rid   = rdef->id;
+                    owner = get_owner(zoneid, rid);
+
+                    if (advice_ownership(owner, zone, class, rset, res))
+                        advice |= ((mrp_resource_mask_t)1 << rid);
+                }
+                if ((advice & mandatory) != mandatory)
+                    advice = 0;
+                break;
+
+            default:
+                break;
+            }
+
+            d->rset          = rset;
+            d->grant         = grant;
+            d->advice        = advice;
+            d->force_release = force_release;
+            d++;
+        } /* while rset */
+    } /* while class */
+
+    return d;
+}
+
+static void revoke_zone(mrp_zone_t *zone, decision_t *decisions,
+                        decision_t *lastd)
+{
+    mrp_resource_set_t *rset;
+    mrp_resource_t *res;
+    mrp_resource_def_t *rdef;
+    mrp_resource_mgr_ftbl_t *ftbl;
+    decision_t *d;
+    void *rc;
+
+    for (d = decisions;   d < lastd;   d++) {
+        rset = d->rset;
+
+        if (!d->grant)
+            continue;
+
+        rc = NULL;
+        while ((res = mrp_resource_set_iterate_resources(rset, &rc))) {
+            rdef = res->def;
+
+            if ((d->grant & ((mrp_resource_mask_t)1 << rdef->id))) {
+                if ((ftbl = rdef->manager.ftbl) && ftbl->free)
+                    ftbl->free(zone, res, rdef->manager.userdata);
+            }
+        }
+
+        d->grant  = 0;
+        d->advice = 0;
+    }
+}
+
 static bool grant_ownership(mrp_resource_owner_t    *owner,
                             mrp_zone_t              *zone,
                             mrp_application_class_t *class,
@@ -34,6 +34,7 @@
 #include <murphy/common/hashtbl.h>
 #include <murphy/common/utils.h>
 #include <murphy/common/log.h>
+#include <murphy/common/metrics.h>
 
 #include <murphy-db/mqi.h>
 
@@ -55,6 +56,7 @@
 static MRP_LIST_HOOK(resource_set_list);
 static uint32_t resource_set_count;
 static mrp_htbl_t *id_hash;
+static mrp_objpool_t *rset_pool;
 
 static int add_to_id_hash(mrp_resource_set_t *);
 static void remove_from_id_hash(mrp_resource_set_t *);
@@ -88,7 +90,21 @@ mrp_resource_set_t *mrp_resource_set_create(mrp_resource_client_t *client,
     if (priority >= PRIORITY_MAX)
         priority = PRIORITY_MAX - 1;
 
-    if (!(rset = mrp_allocz(sizeof(mrp_resource_set_t))))
+    if (!rset_pool) {
+        mrp_objpool_config_t cfg;
+
+        mrp_clear(&cfg);
+        cfg.name     = "resource-set";
+        cfg.objsize  = sizeof(mrp_resource_set_t);
+        cfg.prealloc = 32;
+        cfg.flags    = MRP_OBJPOOL_FLAG_ZERO;
+
+        rset_pool = mrp_objpool_create(&cfg);
+    }
+
+    rset = rset_pool ? mrp_objpool_alloc(rset_pool) : NULL;
+
+    if (!rset)
         mrp_log_error("Memory alloc failure. Can't create resource set");
     else {
         rset->id = ++our_id;
@@ -144,7 +160,7 @@ void mrp_resource_set_destroy(mrp_resource_set_t *rset)
         mrp_list_delete(&rset->client.list);
         mrp_list_delete(&rset->class.list);
 
-        mrp_free(rset);
+        mrp_objpool_free(rset);
 
         if (resource_set_count > 0)
             resource_set_count--;
@@ -312,13 +328,27 @@ int mrp_resource_set_write_attributes(mrp_resource_set_t *rset,
 
 void mrp_resource_set_acquire(mrp_resource_set_t *rset, uint32_t reqid)
 {
+    static mrp_metric_t *latency;
+
     mqi_handle_t trh;
+    uint64_t     start;
 
     MRP_ASSERT(rset, "invalid argument");
 
     rset->state = mrp_resource_acquire;
 
     if (rset->class.ptr) {
+        if (mrp_metrics_on) {
+            if (!latency)
+                latency = mrp_metric_histogram("resource_grant_usecs", NULL,
+                                               "resource acquisition to "
+                                               "decision time in "
+                                               "microseconds");
+            start = mrp_metric_now();
+        }
+        else
+            start = 0;
+
         rset->request.id = reqid;
         rset->request.stamp = get_request_stamp();
 
@@ -327,6 +357,9 @@ void mrp_resource_set_acquire(mrp_resource_set_t *rset, uint32_t reqid)
         trh = mqi_begin_transaction();
         mrp_resource_owner_update_zone(rset->zone, rset, reqid);
         mqi_commit_transaction(trh);
+
+        if (start)
+            mrp_metric_since(latency, start);
     }
 }
 